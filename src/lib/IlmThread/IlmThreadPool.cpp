@@ -14,11 +14,18 @@
 #include "IlmThread.h"
 #include "IlmThreadSemaphore.h"
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <limits>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #if (defined(_WIN32) || defined(_WIN64))
@@ -27,6 +34,12 @@
 #    include <unistd.h>
 #endif
 
+#if defined(__linux__)
+#    include <pthread.h>
+#    include <sched.h>
+#    include <sys/syscall.h>
+#endif
+
 #if ILMTHREAD_THREADING_ENABLED
 #    define ENABLE_THREADING
 #    if ILMTHREAD_USE_TBB
@@ -66,6 +79,203 @@ handleProcessTask (Task* task)
 }
 
 #ifdef ENABLE_THREADING
+
+//
+// Parses a linux style processor / node list, i.e. "0-3,8-11"
+//
+static std::vector<int>
+parseCpuList (const char* path)
+{
+    std::vector<int> ret;
+
+    FILE* f = fopen (path, "r");
+    if (!f) return ret;
+
+    char   buf[4096];
+    size_t n = fread (buf, 1, sizeof (buf) - 1, f);
+    fclose (f);
+    buf[n] = '\0';
+
+    const char* p = buf;
+    while (*p)
+    {
+        char* end;
+        long  a = strtol (p, &end, 10);
+        if (end == p) break;
+        long b = a;
+        if (*end == '-')
+        {
+            p = end + 1;
+            b = strtol (p, &end, 10);
+            if (end == p) break;
+        }
+        if (a < 0 || b < a || b > 65535) break;
+        for (long c = a; c <= b; ++c)
+            ret.push_back (static_cast<int> (c));
+        p = end;
+        if (*p == ',') ++p;
+    }
+    return ret;
+}
+
+//
+// The NUMA nodes, and the processors on them this process may run
+// on. Only linux reports the topology, elsewhere all processors are
+// put on a single node 0.
+//
+struct NumaTopology
+{
+    std::vector<int>              nodeIds;  // os numbering of each node
+    std::vector<std::vector<int>> nodeCpus; // processors of each node
+    std::vector<int>              ordered;  // all processors, node by node
+
+    int nodeOfCpu (int cpu) const
+    {
+        for (size_t n = 0; n != nodeIds.size (); ++n)
+        {
+            for (int c: nodeCpus[n])
+                if (c == cpu) return nodeIds[n];
+        }
+        return -1;
+    }
+
+    static const NumaTopology& get ()
+    {
+        static const NumaTopology topo;
+        return topo;
+    }
+
+private:
+    NumaTopology ()
+    {
+#    if defined(__linux__)
+        cpu_set_t mask;
+        CPU_ZERO (&mask);
+        bool haveMask = (0 == sched_getaffinity (0, sizeof (mask), &mask));
+
+        for (int node: parseCpuList ("/sys/devices/system/node/online"))
+        {
+            char path[64];
+            snprintf (
+                path,
+                sizeof (path),
+                "/sys/devices/system/node/node%d/cpulist",
+                node);
+
+            std::vector<int> cpus;
+            for (int c: parseCpuList (path))
+            {
+                if (!haveMask || (c < CPU_SETSIZE && CPU_ISSET (c, &mask)))
+                    cpus.push_back (c);
+            }
+            if (!cpus.empty ())
+            {
+                nodeIds.push_back (node);
+                nodeCpus.push_back (std::move (cpus));
+            }
+        }
+
+        if (nodeIds.empty () && haveMask)
+        {
+            std::vector<int> cpus;
+            for (int c = 0; c < CPU_SETSIZE; ++c)
+                if (CPU_ISSET (c, &mask)) cpus.push_back (c);
+            if (!cpus.empty ())
+            {
+                nodeIds.push_back (0);
+                nodeCpus.push_back (std::move (cpus));
+            }
+        }
+#    endif
+        if (nodeIds.empty ())
+        {
+            unsigned         hw = std::max (std::thread::hardware_concurrency (), 1u);
+            std::vector<int> cpus;
+            for (unsigned c = 0; c < hw; ++c)
+                cpus.push_back (static_cast<int> (c));
+            nodeIds.push_back (0);
+            nodeCpus.push_back (std::move (cpus));
+        }
+
+        for (auto& cpus: nodeCpus)
+            ordered.insert (ordered.end (), cpus.begin (), cpus.end ());
+    }
+};
+
+//
+// Returns the processor each of count worker threads should be
+// pinned to under the policy, -1 meaning not pinned
+//
+static std::vector<int>
+planAffinity (ThreadAffinity policy, const std::vector<int>& cpus, size_t count)
+{
+    const NumaTopology& topo = NumaTopology::get ();
+    size_t              nn   = topo.nodeCpus.size ();
+
+    std::vector<int> ret (count, -1);
+    for (size_t i = 0; i != count; ++i)
+    {
+        switch (policy)
+        {
+            case THREAD_AFFINITY_COMPACT:
+                ret[i] = topo.ordered[i % topo.ordered.size ()];
+                break;
+            case THREAD_AFFINITY_SCATTER: {
+                const std::vector<int>& nc = topo.nodeCpus[i % nn];
+                ret[i]                     = nc[(i / nn) % nc.size ()];
+                break;
+            }
+            case THREAD_AFFINITY_EXPLICIT:
+                if (!cpus.empty ()) ret[i] = cpus[i % cpus.size ()];
+                break;
+            case THREAD_AFFINITY_NONE: break;
+        }
+    }
+    return ret;
+}
+
+//
+// Pins the thread to the processor, or lets it run on any processor
+// available to the process if cpu is negative. This is best effort,
+// a processor we may not run on is silently ignored by the os.
+//
+static void
+pinThread (std::thread& t, int cpu)
+{
+#    if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    if (cpu >= 0)
+    {
+        if (cpu >= CPU_SETSIZE) return;
+        CPU_SET (cpu, &set);
+    }
+    else
+    {
+        for (int c: NumaTopology::get ().ordered)
+            if (c < CPU_SETSIZE) CPU_SET (c, &set);
+    }
+    pthread_setaffinity_np (t.native_handle (), sizeof (set), &set);
+#    elif defined(_WIN32) || defined(_WIN64)
+    DWORD_PTR mask = 0;
+    if (cpu >= 0)
+    {
+        if (cpu >= static_cast<int> (sizeof (DWORD_PTR) * 8)) return;
+        mask = DWORD_PTR (1) << cpu;
+    }
+    else
+    {
+        DWORD_PTR sysMask;
+        if (!GetProcessAffinityMask (GetCurrentProcess (), &mask, &sysMask))
+            return;
+    }
+    SetThreadAffinityMask (t.native_handle (), mask);
+#    else
+    (void) t;
+    (void) cpu;
+#    endif
+}
+
 struct DefaultThreadPoolData
 {
     Semaphore          _taskSemaphore; // threads wait on this for ready tasks
@@ -78,6 +288,10 @@ struct DefaultThreadPoolData
     std::atomic<int>  _threadCount;
     std::atomic<bool> _stopping;
 
+    // guarded by _threadMutex
+    ThreadAffinity   _affinity;
+    std::vector<int> _affinityCpus;
+
     inline bool stopped () const
     {
         return _stopping.load (std::memory_order_relaxed);
@@ -126,16 +340,18 @@ struct ThreadPool::Data
     Data (const Data&)            = delete;
     Data& operator= (const Data&) = delete;
 
-#    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
     Data (Data&& other) noexcept
+        : _affinity (other._affinity)
+        , _affinityCpus (std::move (other._affinityCpus))
     {
+#    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
         ProviderPtr p =
             other._provider.exchange (ProviderPtr{}, std::memory_order_acq_rel);
         _provider.store (p, std::memory_order_release);
-    }
 #    else
-    Data (Data&&) = default;
+        _provider = std::move (other._provider);
 #    endif
+    }
 
     Data& operator= (Data&&) = delete;
 
@@ -164,6 +380,12 @@ struct ThreadPool::Data
 #    else
     ProviderPtr _provider;
 #    endif
+
+    // kept such that providers created on a change of thread count
+    // use the same policy, guarded by _affinityMutex
+    std::mutex       _affinityMutex;
+    ThreadAffinity   _affinity;
+    std::vector<int> _affinityCpus;
 };
 
 namespace
@@ -226,13 +448,28 @@ private:
 };
 #endif
 
+//
+// Interface of the providers built in here which can pin their
+// threads; kept out of ThreadPoolProvider to leave its vtable
+// unchanged for providers implemented elsewhere
+//
+class AffinityThreadPoolProvider : public ThreadPoolProvider
+{
+public:
+    virtual void
+    setThreadAffinity (ThreadAffinity policy, const std::vector<int>& cpus) = 0;
+};
+
 //
 // class DefaultThreadPoolProvider
 //
-class DefaultThreadPoolProvider : public ThreadPoolProvider
+class DefaultThreadPoolProvider : public AffinityThreadPoolProvider
 {
 public:
-    DefaultThreadPoolProvider (int count);
+    DefaultThreadPoolProvider (
+        int                     count,
+        ThreadAffinity          policy = THREAD_AFFINITY_NONE,
+        const std::vector<int>& cpus   = std::vector<int> ());
     DefaultThreadPoolProvider (const DefaultThreadPoolProvider&) = delete;
     DefaultThreadPoolProvider&
     operator= (const DefaultThreadPoolProvider&)                       = delete;
@@ -246,17 +483,27 @@ public:
 
     void finish () override;
 
+    void setThreadAffinity (
+        ThreadAffinity policy, const std::vector<int>& cpus) override;
+
 private:
     void lockedFinish ();
+    void lockedApplyAffinity ();
     void threadLoop (std::shared_ptr<DefaultThreadPoolData> d);
 
     std::shared_ptr<DefaultThreadPoolData> _data;
 };
 
-DefaultThreadPoolProvider::DefaultThreadPoolProvider (int count)
+DefaultThreadPoolProvider::DefaultThreadPoolProvider (
+    int count, ThreadAffinity policy, const std::vector<int>& cpus)
     : _data (std::make_shared<DefaultThreadPoolData> ())
 {
     _data->resetAtomics ();
+    {
+        std::lock_guard<std::mutex> lock (_data->_threadMutex);
+        _data->_affinity     = policy;
+        _data->_affinityCpus = cpus;
+    }
     setNumThreads (count);
 }
 
@@ -296,6 +543,8 @@ DefaultThreadPoolProvider::setNumThreads (int count)
             std::thread (&DefaultThreadPoolProvider::threadLoop, this, _data);
     }
     _data->_threadCount = static_cast<int> (_data->_threads.size ());
+
+    if (_data->_affinity != THREAD_AFFINITY_NONE) lockedApplyAffinity ();
 }
 
 void
@@ -328,6 +577,28 @@ DefaultThreadPoolProvider::finish ()
     lockedFinish ();
 }
 
+void
+DefaultThreadPoolProvider::setThreadAffinity (
+    ThreadAffinity policy, const std::vector<int>& cpus)
+{
+    std::lock_guard<std::mutex> lock (_data->_threadMutex);
+
+    _data->_affinity     = policy;
+    _data->_affinityCpus = cpus;
+    lockedApplyAffinity ();
+}
+
+void
+DefaultThreadPoolProvider::lockedApplyAffinity ()
+{
+    // all threads share the one queue, so only the pinning applies
+    // and task node preferences are not used
+    std::vector<int> plan = planAffinity (
+        _data->_affinity, _data->_affinityCpus, _data->_threads.size ());
+    for (size_t i = 0; i != plan.size (); ++i)
+        pinThread (_data->_threads[i], plan[i]);
+}
+
 void
 DefaultThreadPoolProvider::lockedFinish ()
 {
@@ -421,6 +692,629 @@ DefaultThreadPoolProvider::threadLoop (
     }
 }
 
+//
+// class WorkStealingDeque
+//
+// Chase-Lev work-stealing deque (as formulated for the C11 memory
+// model by Le et al., "Correct and Efficient Work-Stealing for Weak
+// Memory Models"). Only the owning worker pushes and pops at the
+// bottom, any thread may steal from the top. Retired arrays are kept
+// until destruction, as a thief may still be reading from them.
+//
+class WorkStealingDeque
+{
+public:
+    WorkStealingDeque () : _top (0), _bottom (0), _array (new Array (256))
+    {}
+    ~WorkStealingDeque ()
+    {
+        delete _array.load (std::memory_order_relaxed);
+        for (Array* a: _retired)
+            delete a;
+    }
+    WorkStealingDeque (const WorkStealingDeque&)            = delete;
+    WorkStealingDeque& operator= (const WorkStealingDeque&) = delete;
+    WorkStealingDeque (WorkStealingDeque&&)                 = delete;
+    WorkStealingDeque& operator= (WorkStealingDeque&&)      = delete;
+
+    // owner only
+    void push (Task* task)
+    {
+        int64_t b = _bottom.load (std::memory_order_relaxed);
+        int64_t t = _top.load (std::memory_order_acquire);
+        Array*  a = _array.load (std::memory_order_relaxed);
+
+        if (b - t > a->capacity () - 1)
+        {
+            Array* na = a->grow (b, t);
+            _retired.push_back (a);
+            _array.store (na, std::memory_order_release);
+            a = na;
+        }
+        a->put (b, task);
+        _bottom.store (b + 1, std::memory_order_release);
+    }
+
+    // owner only
+    Task* pop ()
+    {
+        int64_t b = _bottom.load (std::memory_order_relaxed) - 1;
+        Array*  a = _array.load (std::memory_order_relaxed);
+        _bottom.store (b, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        int64_t t = _top.load (std::memory_order_relaxed);
+
+        Task* task = nullptr;
+        if (t <= b)
+        {
+            task = a->get (b);
+            if (t == b)
+            {
+                // last entry, race any thieves for it
+                if (!_top.compare_exchange_strong (
+                        t,
+                        t + 1,
+                        std::memory_order_seq_cst,
+                        std::memory_order_relaxed))
+                    task = nullptr;
+                _bottom.store (b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+            _bottom.store (b + 1, std::memory_order_relaxed);
+        return task;
+    }
+
+    // any thread
+    Task* steal ()
+    {
+        int64_t t = _top.load (std::memory_order_acquire);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        int64_t b = _bottom.load (std::memory_order_acquire);
+
+        if (t < b)
+        {
+            Array* a    = _array.load (std::memory_order_acquire);
+            Task*  task = a->get (t);
+            if (_top.compare_exchange_strong (
+                    t,
+                    t + 1,
+                    std::memory_order_seq_cst,
+                    std::memory_order_relaxed))
+                return task;
+        }
+        return nullptr;
+    }
+
+    bool empty () const
+    {
+        int64_t t = _top.load (std::memory_order_acquire);
+        int64_t b = _bottom.load (std::memory_order_acquire);
+        return b <= t;
+    }
+
+private:
+    struct Array
+    {
+        explicit Array (int64_t cap)
+            : _mask (cap - 1), _buf (new std::atomic<Task*>[cap])
+        {}
+        ~Array () { delete[] _buf; }
+        Array (const Array&)            = delete;
+        Array& operator= (const Array&) = delete;
+
+        int64_t capacity () const { return _mask + 1; }
+        Task*   get (int64_t i) const
+        {
+            return _buf[i & _mask].load (std::memory_order_relaxed);
+        }
+        void put (int64_t i, Task* task)
+        {
+            _buf[i & _mask].store (task, std::memory_order_relaxed);
+        }
+        Array* grow (int64_t b, int64_t t) const
+        {
+            Array* na = new Array (capacity () * 2);
+            for (int64_t i = t; i != b; ++i)
+                na->put (i, get (i));
+            return na;
+        }
+
+        int64_t             _mask;
+        std::atomic<Task*>* _buf;
+    };
+
+    alignas (64) std::atomic<int64_t> _top;
+    alignas (64) std::atomic<int64_t> _bottom;
+    std::atomic<Array*> _array;
+    std::vector<Array*> _retired;
+};
+
+struct WorkStealingData;
+
+//
+// per worker thread state, the deque is fed by the worker itself
+// (tasks added by tasks running on that worker), and the inbox by
+// any other thread
+//
+struct WorkStealingWorker
+{
+    explicit WorkStealingWorker (WorkStealingData* d, uint64_t seed, int node)
+        : _data (d), _node (node), _inboxSize (0), _rng (seed | 1)
+    {}
+
+    uint32_t nextRandom ()
+    {
+        // xorshift64
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 7;
+        _rng ^= _rng << 17;
+        return static_cast<uint32_t> (_rng >> 32);
+    }
+
+    WorkStealingData* _data;
+    WorkStealingDeque _deque;
+    int               _node; // NUMA node pinned to, -1 if not pinned
+
+    alignas (64) std::mutex _inboxMutex;
+    std::deque<Task*> _inbox;
+    std::atomic<int>  _inboxSize;
+
+    uint64_t _rng;
+};
+
+struct WorkStealingData
+{
+    // plan holds the processor each worker is pinned to, see
+    // planAffinity
+    explicit WorkStealingData (const std::vector<int>& plan)
+        : _nextInbox (0), _sleepers (0), _wakeups (0), _stopping (false)
+    {
+        const NumaTopology& topo = NumaTopology::get ();
+
+        _workers.reserve (plan.size ());
+        for (size_t i = 0; i != plan.size (); ++i)
+        {
+            int node = plan[i] >= 0 ? topo.nodeOfCpu (plan[i]) : -1;
+            _workers.emplace_back (new WorkStealingWorker (
+                this,
+                0x9E3779B97F4A7C15ULL * static_cast<uint64_t> (i + 1),
+                node));
+
+            if (node < 0) continue;
+            auto nw = std::find_if (
+                _nodeWorkers.begin (),
+                _nodeWorkers.end (),
+                [node] (const NodeWorkers& x) { return x.first == node; });
+            if (nw == _nodeWorkers.end ())
+                _nodeWorkers.emplace_back (node, std::vector<size_t> (1, i));
+            else
+                nw->second.push_back (i);
+        }
+    }
+
+    // the workers pinned to a NUMA node, nullptr if there are none
+    const std::vector<size_t>* workersOnNode (int node) const
+    {
+        if (node < 0) return nullptr;
+        for (auto& nw: _nodeWorkers)
+            if (nw.first == node) return &(nw.second);
+        return nullptr;
+    }
+
+    bool stopped () const { return _stopping.load (std::memory_order_acquire); }
+
+    bool hasWork () const
+    {
+        for (auto& w: _workers)
+        {
+            if (!w->_deque.empty () ||
+                w->_inboxSize.load (std::memory_order_acquire) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    void inject (Task* task)
+    {
+        // spread the external submissions over the workers such that
+        // the submitting threads rarely contend on the same lock,
+        // restricted to the workers on the node the task prefers
+        size_t next = _nextInbox.fetch_add (1, std::memory_order_relaxed);
+        const std::vector<size_t>* local =
+            workersOnNode (task->preferredNode ());
+        size_t idx = local ? (*local)[next % local->size ()]
+                           : next % _workers.size ();
+        WorkStealingWorker& w = *_workers[idx];
+        {
+            std::lock_guard<std::mutex> lk (w._inboxMutex);
+            w._inbox.push_back (task);
+            w._inboxSize.fetch_add (1, std::memory_order_release);
+        }
+        wake ();
+    }
+
+    void wake ()
+    {
+        // pairs with the increment of _sleepers in park: either the
+        // parking thread sees the new task, or we see it parking
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        if (_sleepers.load (std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lk (_parkMutex);
+                ++_wakeups;
+            }
+            _parkCond.notify_one ();
+        }
+    }
+
+    void wakeAll ()
+    {
+        {
+            std::lock_guard<std::mutex> lk (_parkMutex);
+            ++_wakeups;
+        }
+        _parkCond.notify_all ();
+    }
+
+    void park ()
+    {
+        std::unique_lock<std::mutex> lk (_parkMutex);
+        _sleepers.fetch_add (1, std::memory_order_seq_cst);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        if (!hasWork () && !stopped ())
+        {
+            uint64_t epoch = _wakeups;
+            _parkCond.wait (
+                lk, [&] () { return _wakeups != epoch || stopped (); });
+        }
+        _sleepers.fetch_sub (1, std::memory_order_relaxed);
+    }
+
+    Task* takeInbox (WorkStealingWorker& w, bool all)
+    {
+        if (w._inboxSize.load (std::memory_order_acquire) == 0) return nullptr;
+
+        std::deque<Task*> batch;
+        {
+            std::unique_lock<std::mutex> lk (w._inboxMutex, std::defer_lock);
+            if (all)
+                lk.lock ();
+            else if (!lk.try_lock ())
+                return nullptr;
+
+            if (w._inbox.empty ()) return nullptr;
+            if (!all)
+            {
+                Task* task = w._inbox.front ();
+                w._inbox.pop_front ();
+                w._inboxSize.fetch_sub (1, std::memory_order_relaxed);
+                return task;
+            }
+            batch.swap (w._inbox);
+            w._inboxSize.store (0, std::memory_order_relaxed);
+        }
+
+        // move the rest to our deque, in reverse such that pop
+        // returns them in submission order
+        Task* task = batch.front ();
+        for (size_t i = batch.size () - 1; i > 0; --i)
+            w._deque.push (batch[i]);
+        return task;
+    }
+
+    Task* findWork (WorkStealingWorker& self)
+    {
+        Task* task = self._deque.pop ();
+        if (task) return task;
+
+        task = takeInbox (self, true);
+        if (task) return task;
+
+        // visit the other workers starting at a random victim, those
+        // on our own NUMA node first
+        size_t n = _workers.size ();
+        if (n < 2) return nullptr;
+        size_t start = self.nextRandom () % n;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (size_t i = 0; i != n; ++i)
+            {
+                WorkStealingWorker& victim = *_workers[(start + i) % n];
+                if (&victim == &self) continue;
+                if ((victim._node == self._node) != (pass == 0)) continue;
+
+                task = victim._deque.steal ();
+                if (task) return task;
+                task = takeInbox (victim, false);
+                if (task) return task;
+            }
+        }
+        return nullptr;
+    }
+
+    // only valid once the worker threads have exited
+    void drainTo (std::vector<Task*>& tasks)
+    {
+        for (auto& w: _workers)
+        {
+            while (Task* task = w->_deque.pop ())
+                tasks.push_back (task);
+            std::lock_guard<std::mutex> lk (w->_inboxMutex);
+            tasks.insert (tasks.end (), w->_inbox.begin (), w->_inbox.end ());
+            w->_inbox.clear ();
+            w->_inboxSize.store (0, std::memory_order_relaxed);
+        }
+    }
+
+    using NodeWorkers = std::pair<int, std::vector<size_t>>;
+
+    std::vector<std::unique_ptr<WorkStealingWorker>> _workers;
+    std::vector<std::thread>                         _threads;
+    std::vector<NodeWorkers>                         _nodeWorkers;
+
+    alignas (64) std::atomic<size_t> _nextInbox;
+    alignas (64) std::atomic<int> _sleepers;
+
+    std::mutex              _parkMutex;
+    std::condition_variable _parkCond;
+    uint64_t                _wakeups;
+
+    std::atomic<bool> _stopping;
+};
+
+// the worker the current thread is running as, if any
+static thread_local WorkStealingWorker* tlsWorker = nullptr;
+
+//
+// class WorkStealingThreadPoolProvider
+//
+// Alternative to the default provider for many threads processing
+// many small tasks: instead of a single locked queue, each worker
+// has a lock-free deque, and idle workers steal from random victims
+// before spinning briefly and parking.
+//
+class WorkStealingThreadPoolProvider : public AffinityThreadPoolProvider
+{
+public:
+    using DataPtr = std::shared_ptr<WorkStealingData>;
+
+    WorkStealingThreadPoolProvider (
+        int                     count,
+        ThreadAffinity          policy = THREAD_AFFINITY_NONE,
+        const std::vector<int>& cpus   = std::vector<int> ());
+    WorkStealingThreadPoolProvider (const WorkStealingThreadPoolProvider&) =
+        delete;
+    WorkStealingThreadPoolProvider&
+    operator= (const WorkStealingThreadPoolProvider&) = delete;
+    WorkStealingThreadPoolProvider (WorkStealingThreadPoolProvider&&) =
+        delete;
+    WorkStealingThreadPoolProvider&
+    operator= (WorkStealingThreadPoolProvider&&) = delete;
+    ~WorkStealingThreadPoolProvider () override;
+
+    int  numThreads () const override;
+    void setNumThreads (int count) override;
+    void addTask (Task* task) override;
+
+    void finish () override;
+
+    void setThreadAffinity (
+        ThreadAffinity policy, const std::vector<int>& cpus) override;
+
+private:
+    DataPtr getData () const
+    {
+#    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
+        return _data.load (std::memory_order_acquire);
+#    else
+        return std::atomic_load (&_data);
+#    endif
+    }
+
+    DataPtr exchangeData (DataPtr d)
+    {
+#    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
+        return _data.exchange (d, std::memory_order_acq_rel);
+#    else
+        return std::atomic_exchange (&_data, d);
+#    endif
+    }
+
+    void lockedSetNumThreads (int count);
+    void retire (DataPtr old, const DataPtr& cur);
+
+    static void threadLoop (DataPtr d, size_t idx);
+
+    std::mutex _threadMutex; // serializes changes to the thread count
+
+    // guarded by _threadMutex
+    ThreadAffinity   _affinity;
+    std::vector<int> _affinityCpus;
+
+#    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
+    std::atomic<DataPtr> _data;
+#    else
+    DataPtr _data;
+#    endif
+};
+
+WorkStealingThreadPoolProvider::WorkStealingThreadPoolProvider (
+    int count, ThreadAffinity policy, const std::vector<int>& cpus)
+    : _affinity (policy), _affinityCpus (cpus)
+{
+    setNumThreads (count);
+}
+
+WorkStealingThreadPoolProvider::~WorkStealingThreadPoolProvider ()
+{
+    finish ();
+}
+
+int
+WorkStealingThreadPoolProvider::numThreads () const
+{
+    DataPtr d = getData ();
+    return d ? static_cast<int> (d->_workers.size ()) : 0;
+}
+
+void
+WorkStealingThreadPoolProvider::setNumThreads (int count)
+{
+    std::lock_guard<std::mutex> lock (_threadMutex);
+
+    lockedSetNumThreads (count);
+}
+
+void
+WorkStealingThreadPoolProvider::setThreadAffinity (
+    ThreadAffinity policy, const std::vector<int>& cpus)
+{
+    std::lock_guard<std::mutex> lock (_threadMutex);
+
+    _affinity     = policy;
+    _affinityCpus = cpus;
+
+    // the workers' nodes are fixed once running, so restart them
+    // (not holding on to the current set, which retire waits on)
+    int count = numThreads ();
+    if (count > 0) lockedSetNumThreads (count);
+}
+
+void
+WorkStealingThreadPoolProvider::lockedSetNumThreads (int count)
+{
+    DataPtr nd;
+    if (count > 0)
+    {
+        std::vector<int> plan = planAffinity (
+            _affinity, _affinityCpus, static_cast<size_t> (count));
+
+        nd = std::make_shared<WorkStealingData> (plan);
+        nd->_threads.reserve (static_cast<size_t> (count));
+        for (size_t i = 0; i < static_cast<size_t> (count); ++i)
+        {
+            nd->_threads.emplace_back (
+                &WorkStealingThreadPoolProvider::threadLoop, nd, i);
+            if (plan[i] >= 0) pinThread (nd->_threads.back (), plan[i]);
+        }
+    }
+
+    // the worker array is fixed once running, so switch to a new
+    // set of workers and retire the old
+    retire (exchangeData (nd), nd);
+}
+
+void
+WorkStealingThreadPoolProvider::addTask (Task* task)
+{
+    WorkStealingWorker* w    = tlsWorker;
+    int                 node = task->preferredNode ();
+    if (w && getData ().get () == w->_data &&
+        (node < 0 || node == w->_node || !w->_data->workersOnNode (node)))
+    {
+        // added from one of our tasks, keep it local unless it
+        // would rather run on another node
+        w->_deque.push (task);
+        w->_data->wake ();
+        return;
+    }
+
+    DataPtr d = getData ();
+    if (d)
+        d->inject (task);
+    else
+        handleProcessTask (task);
+}
+
+void
+WorkStealingThreadPoolProvider::finish ()
+{
+    std::lock_guard<std::mutex> lock (_threadMutex);
+
+    retire (exchangeData (DataPtr ()), DataPtr ());
+}
+
+void
+WorkStealingThreadPoolProvider::retire (DataPtr old, const DataPtr& cur)
+{
+    if (!old) return;
+
+    old->_stopping.store (true, std::memory_order_release);
+    old->wakeAll ();
+    for (auto& t: old->_threads)
+        t.join ();
+    old->_threads.clear ();
+
+    // a thread adding a task may have picked up the old set of
+    // workers just before the switch, wait for it to be done
+    while (old.use_count () > 1)
+        std::this_thread::yield ();
+
+    std::vector<Task*> leftover;
+    old->drainTo (leftover);
+    for (Task* task: leftover)
+    {
+        if (cur)
+            cur->inject (task);
+        else
+            handleProcessTask (task);
+    }
+}
+
+void
+WorkStealingThreadPoolProvider::threadLoop (DataPtr d, size_t idx)
+{
+    WorkStealingWorker& self = *(d->_workers[idx]);
+    tlsWorker                = &self;
+
+    while (true)
+    {
+        Task* task = d->findWork (self);
+
+        // spin for a little while before parking, new work is
+        // usually not far off when processing many small tasks
+        for (int spin = 0; !task && spin < 64; ++spin)
+        {
+            std::this_thread::yield ();
+            task = d->findWork (self);
+        }
+
+        if (task)
+        {
+            handleProcessTask (task);
+            continue;
+        }
+
+        if (d->stopped ())
+        {
+            // make sure nothing was added while we were looking
+            if (!d->hasWork ()) break;
+            continue;
+        }
+
+        d->park ();
+    }
+
+    tlsWorker = nullptr;
+}
+
+//
+// The provider created when setting a thread count may be switched
+// to the work-stealing provider by setting the environment variable
+// ILMTHREAD_PROVIDER to "workstealing".
+//
+static bool
+useWorkStealingProvider ()
+{
+    static const bool useWS = [] () {
+        const char* env = getenv ("ILMTHREAD_PROVIDER");
+        return env && !strcmp (env, "workstealing");
+    }();
+    return useWS;
+}
+
 } //namespace
 
 //
@@ -494,12 +1388,13 @@ TaskGroup::Data::removeTask ()
 // struct ThreadPool::Data
 //
 
-ThreadPool::Data::Data ()
+ThreadPool::Data::Data () : _affinity (THREAD_AFFINITY_NONE)
 {
     // empty
 }
 
 ThreadPool::Data::Data (ThreadPoolProvider *p)
+    : _affinity (THREAD_AFFINITY_NONE)
 {
 #    ifdef ILMTHREAD_HAVE_ATOMIC_SHARED_PTR
     _provider.store (ProviderPtr (p), std::memory_order_release);
@@ -519,6 +1414,74 @@ ThreadPool::Data::~Data ()
 // class Task
 //
 
+#ifdef ENABLE_THREADING
+namespace
+{
+
+//
+// The NUMA node hints of the tasks which have one, kept out of Task
+// to leave its size unchanged for the classes deriving from it. The
+// table is split in shards to spread the locking when many threads
+// add tasks, and is never destroyed such that tasks outliving the
+// static destructors can still remove themselves.
+//
+class TaskNodeHints
+{
+public:
+    static TaskNodeHints& get ()
+    {
+        static TaskNodeHints* hints = new TaskNodeHints;
+        return *hints;
+    }
+
+    void set (const Task* task, int node)
+    {
+        if (node < 0 && !_used.load (std::memory_order_acquire)) return;
+        _used.store (true, std::memory_order_release);
+
+        Shard&                      sh = shard (task);
+        std::lock_guard<std::mutex> lk (sh.mutex);
+        if (node < 0)
+            sh.nodes.erase (task);
+        else
+            sh.nodes[task] = node;
+    }
+
+    int find (const Task* task)
+    {
+        // no task has ever had a hint, the common case
+        if (!_used.load (std::memory_order_acquire)) return -1;
+
+        Shard&                      sh = shard (task);
+        std::lock_guard<std::mutex> lk (sh.mutex);
+        auto                        i = sh.nodes.find (task);
+        return i == sh.nodes.end () ? -1 : i->second;
+    }
+
+    void remove (const Task* task) { set (task, -1); }
+
+private:
+    struct Shard
+    {
+        std::mutex                           mutex;
+        std::unordered_map<const Task*, int> nodes;
+    };
+
+    Shard& shard (const Task* task)
+    {
+        uintptr_t p = reinterpret_cast<uintptr_t> (task);
+        return _shards[(p >> 6) % kNumShards];
+    }
+
+    static const size_t kNumShards = 16;
+
+    std::atomic<bool> _used{false};
+    Shard             _shards[kNumShards];
+};
+
+} // namespace
+#endif
+
 Task::Task (TaskGroup* g) : _group (g)
 {
 #ifdef ENABLE_THREADING
@@ -528,7 +1491,9 @@ Task::Task (TaskGroup* g) : _group (g)
 
 Task::~Task ()
 {
-    // empty
+#ifdef ENABLE_THREADING
+    TaskNodeHints::get ().remove (this);
+#endif
 }
 
 TaskGroup*
@@ -537,6 +1502,26 @@ Task::group ()
     return _group;
 }
 
+void
+Task::setPreferredNode (int node)
+{
+#ifdef ENABLE_THREADING
+    TaskNodeHints::get ().set (this, node);
+#else
+    (void) node;
+#endif
+}
+
+int
+Task::preferredNode () const
+{
+#ifdef ENABLE_THREADING
+    return TaskNodeHints::get ().find (this);
+#else
+    return -1;
+#endif
+}
+
 TaskGroup::TaskGroup ()
     :
 #ifdef ENABLE_THREADING
@@ -649,10 +1634,18 @@ ThreadPool::setNumThreads (int count)
     // either a null provider or a case where we should switch from
     // a default provider to a null one or vice-versa
     if (count == 0)
+    {
         _data->setProvider (nullptr);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock (_data->_affinityMutex);
+    if (useWorkStealingProvider ())
+        _data->setProvider (std::make_shared<WorkStealingThreadPoolProvider> (
+            count, _data->_affinity, _data->_affinityCpus));
     else
-        _data->setProvider (
-            std::make_shared<DefaultThreadPoolProvider> (count));
+        _data->setProvider (std::make_shared<DefaultThreadPoolProvider> (
+            count, _data->_affinity, _data->_affinityCpus));
 
 #else
     // just blindly ignore
@@ -665,6 +1658,11 @@ ThreadPool::setThreadProvider (ThreadPoolProvider* provider)
 {
 #ifdef ENABLE_THREADING
     // contract is we take ownership and will free the provider
+    std::lock_guard<std::mutex> lock (_data->_affinityMutex);
+    AffinityThreadPoolProvider* ap =
+        dynamic_cast<AffinityThreadPoolProvider*> (provider);
+    if (ap && _data->_affinity != THREAD_AFFINITY_NONE)
+        ap->setThreadAffinity (_data->_affinity, _data->_affinityCpus);
     _data->setProvider (Data::ProviderPtr (provider));
 #else
     throw IEX_INTERNAL_NAMESPACE::ArgExc (
@@ -673,6 +1671,103 @@ ThreadPool::setThreadProvider (ThreadPoolProvider* provider)
 #endif
 }
 
+ThreadPoolProvider*
+ThreadPool::createWorkStealingProvider (int count)
+{
+#ifdef ENABLE_THREADING
+    if (count < 0)
+        throw IEX_INTERNAL_NAMESPACE::ArgExc (
+            "Attempt to set the number of threads "
+            "in a thread pool to a negative value.");
+
+    return new WorkStealingThreadPoolProvider (count);
+#else
+    throw IEX_INTERNAL_NAMESPACE::ArgExc (
+        "Attempt to create a thread provider on a system with threads"
+        " disabled / not available");
+#endif
+}
+
+void
+ThreadPool::setThreadAffinity (
+    ThreadAffinity policy, const std::vector<int>& cpus)
+{
+#ifdef ENABLE_THREADING
+    if (policy == THREAD_AFFINITY_EXPLICIT)
+    {
+        if (cpus.empty ())
+            throw IEX_INTERNAL_NAMESPACE::ArgExc (
+                "Attempt to set an explicit thread affinity "
+                "with no processors.");
+        for (int c: cpus)
+        {
+            if (c < 0)
+                throw IEX_INTERNAL_NAMESPACE::ArgExc (
+                    "Attempt to set a thread affinity "
+                    "to a negative processor.");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock (_data->_affinityMutex);
+    _data->_affinity = policy;
+    _data->_affinityCpus =
+        (policy == THREAD_AFFINITY_EXPLICIT) ? cpus : std::vector<int> ();
+
+    Data::ProviderPtr           sp = _data->getProvider ();
+    AffinityThreadPoolProvider* ap =
+        dynamic_cast<AffinityThreadPoolProvider*> (sp.get ());
+    if (ap) ap->setThreadAffinity (_data->_affinity, _data->_affinityCpus);
+#else
+    // just blindly ignore
+    (void) policy;
+    (void) cpus;
+#endif
+}
+
+ThreadAffinity
+ThreadPool::threadAffinity () const
+{
+#ifdef ENABLE_THREADING
+    std::lock_guard<std::mutex> lock (_data->_affinityMutex);
+    return _data->_affinity;
+#else
+    return THREAD_AFFINITY_NONE;
+#endif
+}
+
+int
+ThreadPool::numNumaNodes ()
+{
+#ifdef ENABLE_THREADING
+    return static_cast<int> (NumaTopology::get ().nodeIds.size ());
+#else
+    return 1;
+#endif
+}
+
+int
+ThreadPool::numaNodeOfAddress (const void* addr)
+{
+#if defined(ENABLE_THREADING) && defined(__linux__) && defined(SYS_move_pages)
+    if (!addr) return -1;
+
+    static const uintptr_t pageSize =
+        static_cast<uintptr_t> (sysconf (_SC_PAGESIZE));
+    void* page = reinterpret_cast<void*> (
+        reinterpret_cast<uintptr_t> (addr) & ~(pageSize - 1));
+
+    // with no target nodes given, move_pages only reports where the
+    // pages are, without faulting them in
+    int status = -1;
+    if (0 == syscall (SYS_move_pages, 0, 1UL, &page, nullptr, &status, 0) &&
+        status >= 0)
+        return status;
+#else
+    (void) addr;
+#endif
+    return -1;
+}
+
 void
 ThreadPool::addTask (Task* task)
 {
@@ -35,11 +35,33 @@
 #include "IlmThreadExport.h"
 #include "IlmThreadNamespace.h"
 
+#include <vector>
+
 ILMTHREAD_INTERNAL_NAMESPACE_HEADER_ENTER
 
 class TaskGroup;
 class Task;
 
+//-------------------------------------------------------
+// ThreadAffinity -- how the worker threads of a pool are
+// pinned to processors.
+//
+// THREAD_AFFINITY_NONE leaves the scheduling to the
+// operating system (the default). THREAD_AFFINITY_COMPACT
+// fills the processors of one NUMA node before moving on
+// to the next, THREAD_AFFINITY_SCATTER deals the threads
+// out across the NUMA nodes in turn, and
+// THREAD_AFFINITY_EXPLICIT pins the threads round-robin to
+// a given list of processors.
+//-------------------------------------------------------
+enum ThreadAffinity
+{
+    THREAD_AFFINITY_NONE,
+    THREAD_AFFINITY_COMPACT,
+    THREAD_AFFINITY_SCATTER,
+    THREAD_AFFINITY_EXPLICIT
+};
+
 //-------------------------------------------------------
 // ThreadPoolProvider -- this is a pure virtual interface
 // enabling custom overloading of the threads used and how
@@ -130,6 +152,52 @@ public:
     //--------------------------------------------------------
     ILMTHREAD_EXPORT void setThreadProvider (ThreadPoolProvider* provider);
 
+    //--------------------------------------------------------
+    // Create a work-stealing ThreadPoolProvider with count
+    // worker threads, for use with setThreadProvider.
+    //
+    // Rather than all threads sharing a single locked task
+    // queue as the default provider does, each worker keeps
+    // its own lock-free deque and idle workers steal tasks from
+    // random other workers, which scales better when many
+    // threads are processing many small tasks.
+    //
+    // Setting the environment variable ILMTHREAD_PROVIDER to
+    // "workstealing" makes setNumThreads create this provider
+    // instead of the default one.
+    //--------------------------------------------------------
+    ILMTHREAD_EXPORT
+    static ThreadPoolProvider* createWorkStealingProvider (int count);
+
+    //--------------------------------------------------------
+    // Pin the worker threads of the pool to processors, see
+    // ThreadAffinity above. cpus is the list of processors for
+    // THREAD_AFFINITY_EXPLICIT, and is ignored otherwise.
+    //
+    // The policy is kept when the number of threads changes.
+    // Only the providers built into IlmThread (the default and
+    // the work-stealing provider) pin their threads, other
+    // providers set through setThreadProvider are left alone.
+    //
+    // Warning: never call setThreadAffinity from within a
+    // worker thread as this will almost certainly cause a
+    // deadlock or crash.
+    //--------------------------------------------------------
+    ILMTHREAD_EXPORT void setThreadAffinity (
+        ThreadAffinity          policy,
+        const std::vector<int>& cpus = std::vector<int> ());
+    ILMTHREAD_EXPORT ThreadAffinity threadAffinity () const;
+
+    //--------------------------------------------------------
+    // Query the NUMA topology: the number of NUMA nodes with
+    // processors available to this process, and the node the
+    // memory page containing addr resides on, or -1 if that
+    // is not known (including when the page has not yet been
+    // touched).
+    //--------------------------------------------------------
+    ILMTHREAD_EXPORT static int numNumaNodes ();
+    ILMTHREAD_EXPORT static int numaNodeOfAddress (const void* addr);
+
     //------------------------------------------------------------
     // Add a task for processing.  The ThreadPool can handle any
     // number of tasks regardless of the number of worker threads.
@@ -169,6 +237,17 @@ public:
     ILMTHREAD_EXPORT
     TaskGroup* group ();
 
+    //--------------------------------------------------------
+    // Hint which NUMA node the task would best run on, such
+    // as the node owning the memory the task writes to, or -1
+    // (the default) for no preference. Providers are free to
+    // ignore this, the work-stealing provider hands such
+    // tasks to a worker on that node when the pool has a
+    // thread affinity set.
+    //--------------------------------------------------------
+    ILMTHREAD_EXPORT void setPreferredNode (int node);
+    ILMTHREAD_EXPORT int  preferredNode () const;
+
 protected:
     TaskGroup* _group;
 };
@@ -43,6 +43,8 @@ public:
         : _sem (numThreads)
         , _avail_head (nullptr)
         , _first_failure (nullptr)
+        , _first_missing (nullptr)
+        , _first_invalid (nullptr)
     {
         _fixed_pool.resize (numThreads);
         for ( unsigned int i = 0; i < numThreads; ++i )
@@ -61,8 +63,9 @@ public:
     ProcessGroup& operator= (ProcessGroup&&) = delete;
     ~ProcessGroup()
     {
-        std::string *cur = _first_failure.load ();
-        delete cur;
+        delete _first_failure.load ();
+        delete _first_missing.load ();
+        delete _first_invalid.load ();
     }
 
     void push (Process *p)
@@ -115,20 +118,51 @@ public:
         // should we construct a list of failures if there are
         // more than one? seems less confusing to just report
         // the first we happened to record
+        record (_first_failure, e);
+    }
 
-        std::string *cur = _first_failure.load ();
-        if (!cur)
-        {
-            std::string *msg = new std::string (e);
-            if (! _first_failure.compare_exchange_strong (cur, msg))
-                delete msg;
-        }
+    // records a failure due to data missing from the file (i.e. a
+    // chunk which can not be found in the chunk table). This is
+    // reported as an InputExc in preference to any other failure,
+    // so callers can distinguish missing data from broken data the
+    // same as when the chunk is looked up prior to dispatch
+    void record_missing (const char *e)
+    {
+        record (_first_missing, e);
+    }
+
+    // records a failure due to an argument the caller gave which
+    // does not fit the file, reported as an ArgExc as it would be
+    // without threads, unless data is missing as well
+    void record_invalid (const char *e)
+    {
+        record (_first_invalid, e);
     }
 
     void throw_on_failure ()
     {
-        std::string *cur = _first_failure.load ();
-        _first_failure.store (nullptr);
+        std::string *missing = _first_missing.exchange (nullptr);
+        std::string *invalid = _first_invalid.exchange (nullptr);
+        std::string *cur = _first_failure.exchange (nullptr);
+
+        if (missing)
+        {
+            std::string msg (*missing);
+            delete missing;
+            delete invalid;
+            delete cur;
+
+            throw IEX_NAMESPACE::InputExc (msg);
+        }
+
+        if (invalid)
+        {
+            std::string msg (*invalid);
+            delete invalid;
+            delete cur;
+
+            throw IEX_NAMESPACE::ArgExc (msg);
+        }
 
         if (cur)
         {
@@ -139,6 +173,17 @@ public:
         }
     }
 private:
+    static void record (std::atomic<std::string *> &first, const char *e)
+    {
+        std::string *cur = first.load ();
+        if (!cur)
+        {
+            std::string *msg = new std::string (e);
+            if (! first.compare_exchange_strong (cur, msg))
+                delete msg;
+        }
+    }
+
     Semaphore _sem;
 
     std::vector<Process>   _fixed_pool;
@@ -146,6 +191,8 @@ private:
     std::atomic<Process *> _avail_head;
 
     std::atomic<std::string *> _first_failure;
+    std::atomic<std::string *> _first_missing;
+    std::atomic<std::string *> _first_invalid;
 };
 
 
@@ -0,0 +1,357 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+//-----------------------------------------------------------------------------
+//
+//	Shared cache of decompressed chunks
+//
+//-----------------------------------------------------------------------------
+
+#include "ImfChunkCache.h"
+#include "ImfChunkCacheDecode.h"
+
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if __cplusplus >= 202002L
+#    include <ranges>
+#    include <span>
+#endif
+
+using namespace std;
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
+
+namespace
+{
+
+using ChunkData = shared_ptr<const vector<uint8_t>>;
+
+struct ChunkKey
+{
+    string file;
+    int    part;
+    int    chunk;
+
+    bool operator== (const ChunkKey& o) const
+    {
+        return part == o.part && chunk == o.chunk && file == o.file;
+    }
+};
+
+struct ChunkKeyHash
+{
+    size_t operator() (const ChunkKey& k) const
+    {
+        size_t h = hash<string> () (k.file);
+        h ^= hash<uint64_t> () (
+                 (uint64_t (uint32_t (k.part)) << 32) | uint32_t (k.chunk)) +
+             0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+//
+// Least recently used list of chunks, most recent at the front. The
+// payloads are reference counted so a hit can be copied out after the
+// lock is released, even if the entry is evicted in the meantime.
+//
+
+class ChunkCache
+{
+public:
+    ChunkData find (const ChunkKey& key)
+    {
+        lock_guard<mutex> lk (_mx);
+        auto              i = _map.find (key);
+        if (i == _map.end ())
+        {
+            ++_stats.misses;
+            return ChunkData ();
+        }
+        _lru.splice (_lru.begin (), _lru, i->second);
+        ++_stats.hits;
+        return i->second->second;
+    }
+
+    void insert (const ChunkKey& key, ChunkData data)
+    {
+        lock_guard<mutex> lk (_mx);
+        size_t            sz = data->size ();
+        if (sz > _stats.capacity) return;
+
+        auto i = _map.find (key);
+        if (i != _map.end ())
+        {
+            // another reader decoded the same chunk concurrently
+            _lru.splice (_lru.begin (), _lru, i->second);
+            return;
+        }
+
+        _lru.emplace_front (key, std::move (data));
+        _map.emplace (key, _lru.begin ());
+        _stats.bytes += sz;
+        ++_stats.entries;
+        ++_stats.insertions;
+        trim ();
+    }
+
+    size_t capacity ()
+    {
+        lock_guard<mutex> lk (_mx);
+        return _stats.capacity;
+    }
+
+    void setCapacity (size_t bytes)
+    {
+        lock_guard<mutex> lk (_mx);
+        _stats.capacity = bytes;
+        trim ();
+    }
+
+    ChunkCacheStats stats ()
+    {
+        lock_guard<mutex> lk (_mx);
+        return _stats;
+    }
+
+    void clear ()
+    {
+        lock_guard<mutex> lk (_mx);
+        _map.clear ();
+        _lru.clear ();
+        _stats.entries = 0;
+        _stats.bytes   = 0;
+    }
+
+    void resetStats ()
+    {
+        lock_guard<mutex> lk (_mx);
+        _stats.hits       = 0;
+        _stats.misses     = 0;
+        _stats.insertions = 0;
+        _stats.evictions  = 0;
+    }
+
+private:
+    using Entry = pair<ChunkKey, ChunkData>;
+
+    void trim ()
+    {
+        while (_stats.bytes > _stats.capacity && !_lru.empty ())
+        {
+            Entry& e = _lru.back ();
+            _stats.bytes -= e.second->size ();
+            --_stats.entries;
+            ++_stats.evictions;
+            _map.erase (e.first);
+            _lru.pop_back ();
+        }
+    }
+
+    mutex                                                         _mx;
+    list<Entry>                                                   _lru;
+    unordered_map<ChunkKey, list<Entry>::iterator, ChunkKeyHash> _map;
+    ChunkCacheStats _stats = {0, 0, 0, 0, 0, 0, 0};
+};
+
+ChunkCache&
+theCache ()
+{
+    static ChunkCache cache;
+    return cache;
+}
+
+//
+// Identify the file behind a context by path, size and modification
+// time, so a file rewritten in place does not hit stale entries. An
+// empty string means the context is not backed by a file we can stat.
+//
+
+string
+fileIdentity (exr_const_context_t ctxt)
+{
+    const char* name = nullptr;
+
+    if (EXR_ERR_SUCCESS != exr_get_file_name (ctxt, &name) || !name ||
+        name[0] == '\0')
+        return string ();
+
+#if __cplusplus >= 202002L
+    auto u8view = ranges::views::transform (
+        span{name, strlen (name)}, [] (char c) -> char8_t { return c; });
+    filesystem::path p (u8view.begin (), u8view.end ());
+#else
+    filesystem::path p = filesystem::u8path (name);
+#endif
+
+    error_code ec;
+    uintmax_t  sz = filesystem::file_size (p, ec);
+    if (ec) return string ();
+    auto mtime = filesystem::last_write_time (p, ec);
+    if (ec) return string ();
+
+    string id (name);
+    id += '\0';
+    id += to_string (sz);
+    id += ':';
+    id += to_string (mtime.time_since_epoch ().count ());
+    return id;
+}
+
+struct CacheHook
+{
+    exr_result_t (*decompress_fn) (exr_decode_pipeline_t*);
+    void*     userData;
+    ChunkData hit;
+    ChunkData filled;
+};
+
+exr_result_t
+cachedRead (exr_decode_pipeline_t*)
+{
+    // the payload comes out of the cache in cachedDecompress, so
+    // there is nothing to read
+    return EXR_ERR_SUCCESS;
+}
+
+exr_result_t
+cachedDecompress (exr_decode_pipeline_t* decode)
+{
+    CacheHook* hook = static_cast<CacheHook*> (decode->decoding_user_data);
+
+    if (hook->hit)
+    {
+        if (hook->hit->size () != decode->chunk.unpacked_size)
+            return EXR_ERR_CORRUPT_CHUNK;
+        memcpy (
+            decode->unpacked_buffer, hook->hit->data (), hook->hit->size ());
+        return EXR_ERR_SUCCESS;
+    }
+
+    decode->decoding_user_data = hook->userData;
+    exr_result_t rv            = hook->decompress_fn (decode);
+    decode->decoding_user_data = hook;
+
+    if (rv == EXR_ERR_SUCCESS)
+    {
+        const uint8_t* src =
+            static_cast<const uint8_t*> (decode->unpacked_buffer);
+        // called from the core library, so don't let bad_alloc out
+        try
+        {
+            hook->filled = make_shared<const vector<uint8_t>> (
+                src, src + decode->chunk.unpacked_size);
+        }
+        catch (...)
+        {
+            hook->filled.reset ();
+        }
+    }
+    return rv;
+}
+
+bool
+isCacheable (const exr_decode_pipeline_t* decoder)
+{
+    exr_storage_t stortype = static_cast<exr_storage_t> (decoder->chunk.type);
+
+    // uncompressed chunks (or chunks stored raw because they did
+    // not compress) only cost a read, which the OS cache already
+    // shares, and deep chunks carry per-reader sample tables
+    return decoder->decompress_fn != nullptr &&
+           decoder->chunk.unpacked_size > 0 &&
+           decoder->chunk.packed_size != decoder->chunk.unpacked_size &&
+           stortype != EXR_STORAGE_DEEP_SCANLINE &&
+           stortype != EXR_STORAGE_DEEP_TILED;
+}
+
+} // namespace
+
+size_t
+chunkCacheCapacity ()
+{
+    return theCache ().capacity ();
+}
+
+void
+setChunkCacheCapacity (size_t bytes)
+{
+    theCache ().setCapacity (bytes);
+}
+
+ChunkCacheStats
+chunkCacheStats ()
+{
+    return theCache ().stats ();
+}
+
+void
+clearChunkCache ()
+{
+    theCache ().clear ();
+}
+
+void
+resetChunkCacheStats ()
+{
+    theCache ().resetStats ();
+}
+
+const string&
+ChunkCacheFile::identity (exr_const_context_t ctxt)
+{
+    call_once (_once, [this, ctxt] { _identity = fileIdentity (ctxt); });
+    return _identity;
+}
+
+exr_result_t
+runCachedDecode (
+    exr_const_context_t    ctxt,
+    int                    partIdx,
+    exr_decode_pipeline_t* decoder,
+    ChunkCacheFile&        file)
+{
+    ChunkCache& cache = theCache ();
+
+    if (cache.capacity () == 0 || !isCacheable (decoder))
+        return exr_decoding_run (ctxt, partIdx, decoder);
+
+    ChunkKey key;
+    key.file = file.identity (ctxt);
+    if (key.file.empty ()) return exr_decoding_run (ctxt, partIdx, decoder);
+    key.part  = partIdx;
+    key.chunk = decoder->chunk.idx;
+
+    CacheHook hook;
+    hook.decompress_fn = decoder->decompress_fn;
+    hook.userData      = decoder->decoding_user_data;
+    hook.hit           = cache.find (key);
+
+    auto savedRead = decoder->read_fn;
+
+    if (hook.hit) decoder->read_fn = &cachedRead;
+    decoder->decompress_fn      = &cachedDecompress;
+    decoder->decoding_user_data = &hook;
+
+    exr_result_t rv = exr_decoding_run (ctxt, partIdx, decoder);
+
+    decoder->read_fn            = savedRead;
+    decoder->decompress_fn      = hook.decompress_fn;
+    decoder->decoding_user_data = hook.userData;
+
+    if (rv == EXR_ERR_SUCCESS && hook.filled)
+        cache.insert (key, std::move (hook.filled));
+
+    return rv;
+}
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
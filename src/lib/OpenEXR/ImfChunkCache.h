@@ -0,0 +1,95 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifndef INCLUDED_IMF_CHUNK_CACHE_H
+#define INCLUDED_IMF_CHUNK_CACHE_H
+
+#include "ImfExport.h"
+#include "ImfNamespace.h"
+
+#include <cstddef>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+//
+//	Shared cache of decompressed chunks
+//
+//	Applications that open the same file many times (e.g. several
+//	nodes of a compositing graph each holding their own InputFile)
+//	otherwise read and decompress identical chunks once per reader.
+//	When enabled, the scan line and tiled readers keep the
+//	decompressed payload of each chunk in a process-wide cache,
+//	so later readers of the same chunk only pay for unpacking the
+//	data into their own frame buffer.
+//
+//	Entries are keyed by the identity of the file on disk (path,
+//	modification time and size), the part number and the chunk
+//	index.  Files that do not live on disk (memory streams, custom
+//	IStream implementations whose fileName() is not a path), deep
+//	parts and uncompressed chunks are never cached.
+//
+//	A reader takes the identity of its file once, when it first
+//	looks up a chunk.  The identity cannot tell apart two versions
+//	of a file with the same path and size whose modification times
+//	fall within the file system's timestamp resolution (up to two
+//	seconds on some file systems), so readers of a file rewritten
+//	that quickly in place may be served the chunks of the earlier
+//	version.  Applications that rewrite files like that should call
+//	clearChunkCache() after each rewrite.
+//
+//	The cache is bounded by a byte budget, evicting the least
+//	recently used chunks first.  It is disabled (a budget of zero)
+//	by default.
+//
+//-----------------------------------------------------------------------------
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
+
+struct IMF_EXPORT_TYPE ChunkCacheStats
+{
+    uint64_t hits;       // chunks served from the cache
+    uint64_t misses;     // cacheable chunks that had to be decompressed
+    uint64_t insertions; // chunks added to the cache
+    uint64_t evictions;  // chunks dropped to stay within the budget
+    size_t   entries;    // chunks currently held
+    size_t   bytes;      // decompressed bytes currently held
+    size_t   capacity;   // current byte budget
+};
+
+//-----------------------------------------------------------------------------
+// Return the byte budget of the shared chunk cache (zero when disabled)
+//-----------------------------------------------------------------------------
+
+IMF_EXPORT size_t chunkCacheCapacity ();
+
+//-----------------------------------------------------------------------------
+// Change the byte budget of the shared chunk cache.  Shrinking the
+// budget evicts entries immediately, zero disables the cache and
+// releases everything it holds.
+//-----------------------------------------------------------------------------
+
+IMF_EXPORT void setChunkCacheCapacity (size_t bytes);
+
+//-----------------------------------------------------------------------------
+// Return the current counters of the shared chunk cache
+//-----------------------------------------------------------------------------
+
+IMF_EXPORT ChunkCacheStats chunkCacheStats ();
+
+//-----------------------------------------------------------------------------
+// Drop all cached chunks, leaving the budget and counters unchanged
+//-----------------------------------------------------------------------------
+
+IMF_EXPORT void clearChunkCache ();
+
+//-----------------------------------------------------------------------------
+// Reset the hit / miss / insertion / eviction counters to zero
+//-----------------------------------------------------------------------------
+
+IMF_EXPORT void resetChunkCacheStats ();
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
+
+#endif
@@ -0,0 +1,52 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifndef INCLUDED_IMF_CHUNK_CACHE_DECODE_H
+#define INCLUDED_IMF_CHUNK_CACHE_DECODE_H
+
+#include "ImfNamespace.h"
+
+#include "openexr.h"
+
+#include <mutex>
+#include <string>
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
+
+//
+// The identity of the file a reader reads, as the shared chunk cache
+// keys it. Each reader holds one, so the file is looked up on disk
+// once, on its first cacheable chunk, rather than for every chunk.
+//
+
+class ChunkCacheFile
+{
+public:
+    const std::string& identity (exr_const_context_t ctxt);
+
+private:
+    std::once_flag _once;
+    std::string    _identity;
+};
+
+//
+// Drop-in replacement for exr_decoding_run used by the scan line and
+// tiled readers. When the shared chunk cache is enabled and the chunk
+// is cacheable, the read and decompress stages of the pipeline are
+// replaced by a copy out of the cache on a hit, and the decompressed
+// payload is added to the cache on a miss. Otherwise this is just
+// exr_decoding_run.
+//
+
+exr_result_t
+runCachedDecode (
+    exr_const_context_t    ctxt,
+    int                    partIdx,
+    exr_decode_pipeline_t* decoder,
+    ChunkCacheFile&        file);
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
+
+#endif
@@ -12,9 +12,13 @@
 #include "ImfDeepScanLineInputPart.h"
 #include "ImfFrameBuffer.h"
 #include "ImfPixelType.h"
+#include "ImfSimd.h"
+#include "ImfStandardAttributes.h"
 
 #include "Iex.h"
+#include <algorithm>
 #include <stddef.h>
+#include <typeinfo>
 #include <vector>
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
 
@@ -286,43 +290,301 @@ CompositeDeepScanLine::setFrameBuffer (const FrameBuffer& fr)
 namespace
 {
 
+//
+// the shared state of the compositing tasks of one readPixels call
+//
+
+struct CompositeRows
+{
+    CompositeDeepScanLine::Data*   data;
+    int                            start;
+    vector<const char*>            names;
+    vector<vector<vector<float*>>> pointers;
+    vector<vector<unsigned int>>   counts;      // per source sample counts
+    vector<unsigned int>           total_sizes; // per pixel sample counts
+    vector<unsigned int>           num_sources; // non-empty sources per pixel
+    bool sorted_sources; // every source is flagged as (at least) sorted
+};
+
 class LineCompositeTask : public Task
 {
 public:
     LineCompositeTask (
-        TaskGroup*                      group,
-        CompositeDeepScanLine::Data*    data,
-        int                             y,
-        int                             start,
-        vector<const char*>*            names,
-        vector<vector<vector<float*>>>* pointers,
-        vector<unsigned int>*           total_sizes,
-        vector<unsigned int>*           num_sources)
-        : Task (group)
-        , _Data (data)
-        , _y (y)
-        , _start (start)
-        , _names (names)
-        , _pointers (pointers)
-        , _total_sizes (total_sizes)
-        , _num_sources (num_sources)
+        TaskGroup* group, CompositeRows* rows, int y, int x0, int x1)
+        : Task (group), _rows (rows), _y (y), _x0 (x0), _x1 (x1)
     {}
 
     virtual ~LineCompositeTask () {}
 
-    virtual void                    execute ();
-    CompositeDeepScanLine::Data*    _Data;
-    int                             _y;
-    int                             _start;
-    vector<const char*>*            _names;
-    vector<vector<vector<float*>>>* _pointers;
-    vector<unsigned int>*           _total_sizes;
-    vector<unsigned int>*           _num_sources;
+    virtual void   execute ();
+    CompositeRows* _rows;
+    int            _y;
+    int            _x0; // first pixel of the span of the line
+    int            _x1; // last pixel of the span of the line
+};
+
+//
+// the sort key of a sample: samples are put front to back in the
+// order DeepCompositing::sort gives them, by Z, then ZBack, then
+// where they are in the pixel
+//
+
+struct SampleKey
+{
+    float z;
+    float zback;
+    int   index;
+
+    bool operator< (const SampleKey& other) const
+    {
+        if (z < other.z) return true;
+        if (z > other.z) return false;
+        if (zback < other.zback) return true;
+        if (zback > other.zback) return false;
+        return index < other.index;
+    }
 };
 
+//
+// true if the samples of a pixel are front to back already, so
+// sorting them would leave them where they are
+//
+
+inline bool
+samplesSorted (const float* z, const float* zback, int num_samples)
+{
+    for (int i = 1; i < num_samples; i++)
+    {
+        if (z[i] < z[i - 1]) return false;
+        if (z[i] == z[i - 1] && zback[i] < zback[i - 1]) return false;
+    }
+    return true;
+}
+
+//
+// sort the keys of a pixel; pixels rarely have more than a handful
+// of samples, for which an insertion sort beats std::sort
+//
+
+inline void
+sortKeys (SampleKey* keys, int num_samples)
+{
+    if (num_samples > 16)
+    {
+        std::sort (keys, keys + num_samples);
+        return;
+    }
+
+    for (int i = 1; i < num_samples; i++)
+    {
+        SampleKey k = keys[i];
+        int       j = i;
+        for (; j > 0 && k < keys[j - 1]; j--)
+            keys[j] = keys[j - 1];
+        keys[j] = k;
+    }
+}
+
+//
+// composite the pixels x0 to x1 of line y with the default
+// DeepCompositing behavior, a whole span at a time. The samples are
+// ordered and accumulated exactly as composite_pixel does, but the
+// per pixel virtual calls and allocations are gone, pixels with a
+// single source or samples that are in order already skip the sort,
+// pixels whose sources are all sorted merge them rather than sort,
+// and the results are gathered per channel (structure of arrays) so
+// each output slice is written in one pass over the span.
+//
+
+void
+composite_span_default (int y, int x0, int x1, const CompositeRows& rows)
+{
+    CompositeDeepScanLine::Data* _Data = rows.data;
+
+    const int num_channels = static_cast<int> (rows.names.size ());
+    const int width        = x1 - x0 + 1;
+    const int row_width =
+        _Data->_dataWindow.max.x + 1 - _Data->_dataWindow.min.x;
+    const int first =
+        (y - rows.start) * row_width + x0 - _Data->_dataWindow.min.x;
+
+    // outputs[c * width + i] is channel c of pixel i of the span
+    vector<float>         outputs (size_t (num_channels) * size_t (width));
+    vector<const float*>  inputs (num_channels);
+    vector<float* const*> channels (num_channels);
+    vector<float>         weights;
+    vector<int>           order;
+    vector<SampleKey>     keys;
+    vector<SampleKey>     merged;
+
+    // the first sample of each pixel of each channel; without a zback
+    // channel, 1 is a second copy of Z
+    for (int c = 0; c < num_channels; c++)
+    {
+        int from    = (c == 1 && !_Data->_zback) ? 0 : c;
+        channels[c] = &rows.pointers[0][from][first];
+    }
+
+    for (int i = 0; i < width; i++)
+    {
+        const int pixel       = first + i;
+        const int num_samples = static_cast<int> (rows.total_sizes[pixel]);
+        if (num_samples == 0) continue;
+
+        for (int c = 0; c < num_channels; c++)
+            inputs[c] = channels[c][i];
+
+        if (weights.size () < size_t (num_samples))
+        {
+            weights.resize (num_samples);
+            order.resize (num_samples);
+            keys.resize (num_samples);
+            merged.resize (num_samples);
+        }
+
+        //
+        // find the order, as composite_pixel would: only pixels with
+        // samples from more than one source are sorted
+        //
+
+        const int* ord = nullptr;
+        if (rows.num_sources[pixel] > 1 &&
+            !samplesSorted (inputs[0], inputs[1], num_samples))
+        {
+            for (int s = 0; s < num_samples; s++)
+            {
+                keys[s].z     = inputs[0][s];
+                keys[s].zback = inputs[1][s];
+                keys[s].index = s;
+            }
+
+            if (rows.sorted_sources)
+            {
+                //
+                // the samples of each source are in order already:
+                // merge the runs of samples from each source in turn
+                //
+
+                int done = 0;
+                for (size_t part = 0; part < rows.counts.size (); part++)
+                {
+                    int run = static_cast<int> (rows.counts[part][pixel]);
+                    if (run == 0) continue;
+                    if (done > 0)
+                    {
+                        std::merge (
+                            keys.begin (),
+                            keys.begin () + done,
+                            keys.begin () + done,
+                            keys.begin () + done + run,
+                            merged.begin ());
+                        std::copy (
+                            merged.begin (),
+                            merged.begin () + done + run,
+                            keys.begin ());
+                    }
+                    done += run;
+                }
+            }
+            else
+                sortKeys (&keys[0], num_samples);
+
+            for (int s = 0; s < num_samples; s++)
+                order[s] = keys[s].index;
+            ord = &order[0];
+        }
+
+        //
+        // front to back: each sample is weighted by what the samples
+        // in front of it let through, until the pixel is opaque
+        //
+
+        int   used  = 0;
+        float alpha = 0.0f;
+        for (; used < num_samples && alpha < 1.0f; used++)
+        {
+            int s          = ord ? ord[used] : used;
+            weights[used]  = 1.0f - alpha;
+            alpha         += weights[used] * inputs[2][s];
+        }
+
+        //
+        // accumulate each channel; the sums for each channel are
+        // formed in the same sequence as composite_pixel, several
+        // channels at a time
+        //
+
+        float* out = &outputs[i];
+        int    c   = 0;
+#ifdef IMF_HAVE_SSE2
+        for (; c + 4 <= num_channels; c += 4)
+        {
+            const float* c0  = inputs[c];
+            const float* c1  = inputs[c + 1];
+            const float* c2  = inputs[c + 2];
+            const float* c3  = inputs[c + 3];
+            __m128       acc = _mm_setzero_ps ();
+            for (int k = 0; k < used; k++)
+            {
+                int    s = ord ? ord[k] : k;
+                __m128 v = _mm_set_ps (c3[s], c2[s], c1[s], c0[s]);
+                v = _mm_mul_ps (_mm_set1_ps (weights[k]), v);
+                acc = _mm_add_ps (acc, v);
+            }
+
+            float sums[4];
+            _mm_storeu_ps (sums, acc);
+            for (int j = 0; j < 4; j++)
+                out[size_t (c + j) * size_t (width)] = sums[j];
+        }
+#endif
+        for (; c < num_channels; c++)
+        {
+            const float* in  = inputs[c];
+            float        acc = 0.0f;
+            for (int k = 0; k < used; k++)
+                acc += weights[k] * in[ord ? ord[k] : k];
+            out[size_t (c) * size_t (width)] = acc;
+        }
+    }
+
+    //
+    // write out composited values into the output frame buffer,
+    // one slice at a time
+    //
+
+    size_t channel_number = 0;
+    for (FrameBuffer::Iterator it = _Data->_outputFrameBuffer.begin ();
+         it != _Data->_outputFrameBuffer.end ();
+         it++)
+    {
+        size_t       c      = size_t (_Data->_bufferMap[channel_number]);
+        const float* values = &outputs[c * size_t (width)];
+        const Slice& slice  = it.slice ();
+        intptr_t     base   = reinterpret_cast<intptr_t> (slice.base) +
+                        y * slice.yStride + x0 * slice.xStride;
+
+        // cast to half float if necessary
+        if (slice.type == OPENEXR_IMF_INTERNAL_NAMESPACE::FLOAT)
+        {
+            for (int i = 0; i < width; i++, base += slice.xStride)
+                *reinterpret_cast<float*> (base) = values[i];
+        }
+        else if (slice.type == HALF)
+        {
+            for (int i = 0; i < width; i++, base += slice.xStride)
+                *reinterpret_cast<half*> (base) = half (values[i]);
+        }
+
+        channel_number++;
+    }
+}
+
 void
 composite_line (
     int                                   y,
+    int                                   x0,
+    int                                   x1,
     int                                   start,
     CompositeDeepScanLine::Data*          _Data,
     vector<const char*>&                  names,
@@ -332,13 +594,13 @@ composite_line (
 {
     vector<float> output_pixel (names.size ()); //the pixel we'll output to
     vector<const float*> inputs (names.size ());
-    DeepCompositing      d; // fallback compositing engine
-    DeepCompositing*     comp = _Data->_comp ? _Data->_comp : &d;
+    DeepCompositing*     comp = _Data->_comp;
 
-    int pixel =
-        (y - start) * (_Data->_dataWindow.max.x + 1 - _Data->_dataWindow.min.x);
+    int pixel = (y - start) *
+                    (_Data->_dataWindow.max.x + 1 - _Data->_dataWindow.min.x) +
+                x0 - _Data->_dataWindow.min.x;
 
-    for (int x = _Data->_dataWindow.min.x; x <= _Data->_dataWindow.max.x; x++)
+    for (int x = x0; x <= x1; x++)
     {
         // set inputs[] to point to the first sample of the first part of each channel
         // if there's a zback, set all channel independently...
@@ -410,8 +672,30 @@ composite_line (
 void
 LineCompositeTask::execute ()
 {
-    composite_line (
-        _y, _start, _Data, *_names, *_pointers, *_total_sizes, *_num_sources);
+    CompositeDeepScanLine::Data* _Data = _rows->data;
+
+    //
+    // classes derived from DeepCompositing get a call per pixel; the
+    // default behavior is run a span at a time
+    //
+
+    if (!_Data->_comp || typeid (*_Data->_comp) == typeid (DeepCompositing))
+    {
+        composite_span_default (_y, _x0, _x1, *_rows);
+    }
+    else
+    {
+        composite_line (
+            _y,
+            _x0,
+            _x1,
+            _rows->start,
+            _Data,
+            _rows->names,
+            _rows->pointers,
+            _rows->total_sizes,
+            _rows->num_sources);
+    }
 }
 
 } // namespace
@@ -584,9 +868,18 @@ CompositeDeepScanLine::readPixels (int start, int end)
     // composite pixels and write back to framebuffer
     //
 
+    CompositeRows rows;
+    rows.data  = _Data;
+    rows.start = start;
+    rows.pointers.swap (pointers);
+    rows.counts.swap (counts);
+    rows.total_sizes.swap (total_sizes);
+    rows.num_sources.swap (num_sources);
+
     // turn vector of strings into array of char *
     // and make sure 'ZBack' channel is correct
-    vector<const char*> names (_Data->_channels.size ());
+    vector<const char*>& names = rows.names;
+    names.resize (_Data->_channels.size ());
     for (size_t i = 0; i < names.size (); i++)
     {
         names[i] = _Data->_channels[i].c_str ();
@@ -595,18 +888,50 @@ CompositeDeepScanLine::readPixels (int start, int end)
     if (!_Data->_zback)
         names[1] = names[0]; // no zback channel, so make it point to z
 
+    //
+    // when every source promises sorted pixels, a pixel's samples
+    // from several sources only need merging
+    //
+
+    rows.sorted_sources = true;
+    for (size_t i = 0; i < parts; i++)
+    {
+        if (!hasDeepImageState (*headers[i]) ||
+            (deepImageState (*headers[i]) != DIS_SORTED &&
+             deepImageState (*headers[i]) != DIS_TIDY))
+        {
+            rows.sorted_sources = false;
+        }
+    }
+
+    //
+    // one task per line, or per span of a line when there are too
+    // few lines to keep the threads busy
+    //
+
+    int lines   = end - start + 1;
+    int width   = static_cast<int> (total_width);
+    int spans   = 1;
+    int threads = ThreadPool::globalThreadPool ().numThreads ();
+    if (threads > 1 && lines < 2 * threads)
+    {
+        spans = std::min (
+            (2 * threads + lines - 1) / lines, std::max (1, width / 64));
+    }
+
     TaskGroup g;
     for (int y = start; y <= end; y++)
     {
-        ThreadPool::addGlobalTask (new LineCompositeTask (
-            &g,
-            _Data,
-            y,
-            start,
-            &names,
-            &pointers,
-            &total_sizes,
-            &num_sources));
+        for (int span = 0; span < spans; span++)
+        {
+            int x0 = _Data->_dataWindow.min.x +
+                     static_cast<int> (int64_t (width) * span / spans);
+            int x1 = _Data->_dataWindow.min.x +
+                     static_cast<int> (int64_t (width) * (span + 1) / spans) -
+                     1;
+            ThreadPool::addGlobalTask (
+                new LineCompositeTask (&g, &rows, y, x0, x1));
+        }
     } //next row
 }
 
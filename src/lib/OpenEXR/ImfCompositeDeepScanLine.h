@@ -100,6 +100,10 @@ public:
     // override default sorting/compositing operation
     // (otherwise an instance of the base class will be used)
     //
+    // the default operation gives the results DeepCompositing does,
+    // but composites spans of scanlines at a time; a class derived
+    // from DeepCompositing is called for each pixel
+    //
 
     IMF_EXPORT
     void setCompositing (DeepCompositing*);
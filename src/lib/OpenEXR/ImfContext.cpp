@@ -852,4 +852,40 @@ Context::chunkTableValid (int partidx) const
     return exr_validate_chunk_table (*_ctxt, partidx) == EXR_ERR_SUCCESS;
 }
 
+uint64_t
+Context::chunkTableFingerprint (int partidx) const
+{
+    uint64_t* table;
+    int32_t   count;
+
+    if (EXR_ERR_SUCCESS !=
+        exr_get_chunk_table (*_ctxt, partidx, &table, &count))
+    {
+        THROW (
+            IEX_NAMESPACE::InputExc,
+            "Unable to read the chunk table of part " << partidx
+                                                      << " of file \""
+                                                      << fileName () << "\"");
+    }
+
+    //
+    // 64-bit FNV-1a over the count and the offsets
+    //
+
+    uint64_t hash = 14695981039346656037ULL;
+    auto     mix  = [&hash] (uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+        {
+            hash ^= (v >> (8 * i)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    mix (uint64_t (count));
+    for (int32_t c = 0; c < count; ++c)
+        mix (table[c]);
+
+    return hash;
+}
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
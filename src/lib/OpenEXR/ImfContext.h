@@ -91,6 +91,10 @@ public:
 
     IMF_EXPORT bool chunkTableValid (int partidx) const;
 
+    // a hash of the chunk offset table of a part; rewriting the
+    // part with different data almost always changes it
+    IMF_EXPORT uint64_t chunkTableFingerprint (int partidx) const;
+
 private:
     std::shared_ptr<exr_context_t> _ctxt;
 }; // class Context
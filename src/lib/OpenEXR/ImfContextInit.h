@@ -62,6 +62,15 @@ public:
         return *this;
     }
 
+    /// Optional batched read routine to accompany a custom read
+    /// function, see \c exr_read_batch_func_ptr_t
+    ContextInitializer&
+    setCustomReadBatch (exr_read_batch_func_ptr_t batchfn) noexcept
+    {
+        _initializer.read_batch_fn = batchfn;
+        return *this;
+    }
+
     ContextInitializer& setCustomOutputIO (
         void*                         user,
         exr_write_func_ptr_t          writefn,
@@ -129,6 +138,12 @@ public:
         return *this;
     }
 
+    ContextInitializer& memoryMapRead (bool onoff) noexcept
+    {
+        setFlag (EXR_CONTEXT_FLAG_MEMORY_MAP_READ, onoff);
+        return *this;
+    }
+
 private:
     void setFlag (const int flag, bool onoff)
     {
@@ -0,0 +1,155 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+//-----------------------------------------------------------------------------
+//
+//      Per-chunk depth statistics for deep files
+//
+//-----------------------------------------------------------------------------
+
+#include "ImfDeepChunkStats.h"
+#include "ImfBytesAttribute.h"
+#include "ImfCompression.h"
+#include "ImfHeader.h"
+#include "ImfIO.h"
+#include "ImfMisc.h"
+#include "ImfTiledMisc.h"
+#include "ImfXdr.h"
+
+#include <limits>
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
+
+using std::numeric_limits;
+using std::vector;
+
+namespace
+{
+
+const size_t STATS_ENTRY_SIZE =
+    Xdr::size<uint64_t> () + 2 * Xdr::size<float> ();
+
+int
+numChunks (const Header& header)
+{
+    //
+    // The headers that applications pass to the deep writers need
+    // not have a type attribute yet; the writers add it.
+    //
+
+    if (header.hasType ()) return getChunkOffsetTableSize (header);
+
+    if (header.hasTileDescription ())
+        return getTiledChunkOffsetTableSize (header);
+
+    const IMATH_NAMESPACE::Box2i& dw = header.dataWindow ();
+    int64_t lines = getCompressionNumScanlines (header.compression ());
+
+    return static_cast<int> (
+        (static_cast<int64_t> (dw.max.y) - dw.min.y + lines) / lines);
+}
+
+} // namespace
+
+constexpr uint64_t    DeepChunkStats::UNKNOWN_SAMPLE_COUNT;
+constexpr const char* DeepChunkStats::ATTRIBUTE_NAME;
+
+DeepChunkStats::DeepChunkStats ()
+    : sampleCount (UNKNOWN_SAMPLE_COUNT)
+    , minZ (-numeric_limits<float>::infinity ())
+    , maxZ (numeric_limits<float>::infinity ())
+{
+    // empty
+}
+
+DeepChunkStats::DeepChunkStats (uint64_t sampleCount, float minZ, float maxZ)
+    : sampleCount (sampleCount), minZ (minZ), maxZ (maxZ)
+{
+    // empty
+}
+
+bool
+DeepChunkStats::isKnown () const
+{
+    return sampleCount != UNKNOWN_SAMPLE_COUNT;
+}
+
+bool
+DeepChunkStats::hasSamples () const
+{
+    return sampleCount != 0;
+}
+
+bool
+DeepChunkStats::intersects (float zMin, float zMax) const
+{
+    if (!isKnown ()) return true;
+
+    return sampleCount != 0 && minZ <= zMax && maxZ >= zMin;
+}
+
+void
+addDeepChunkStats (Header& header)
+{
+    setDeepChunkStats (
+        header, vector<DeepChunkStats> (numChunks (header), DeepChunkStats ()));
+}
+
+bool
+hasDeepChunkStats (const Header& header)
+{
+    return header.findTypedAttribute<BytesAttribute> (
+               DeepChunkStats::ATTRIBUTE_NAME) != 0;
+}
+
+vector<DeepChunkStats>
+deepChunkStats (const Header& header)
+{
+    vector<DeepChunkStats> stats;
+
+    const BytesAttribute* attr = header.findTypedAttribute<BytesAttribute> (
+        DeepChunkStats::ATTRIBUTE_NAME);
+
+    if (!attr || attr->typeHint != DeepChunkStats::ATTRIBUTE_NAME)
+        return stats;
+
+    size_t n = static_cast<size_t> (numChunks (header));
+
+    if (n == 0 || attr->size () != n * STATS_ENTRY_SIZE) return stats;
+
+    stats.resize (n);
+
+    const char* ptr = reinterpret_cast<const char*> (&attr->data ()[0]);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        Xdr::read<CharPtrIO> (ptr, stats[i].sampleCount);
+        Xdr::read<CharPtrIO> (ptr, stats[i].minZ);
+        Xdr::read<CharPtrIO> (ptr, stats[i].maxZ);
+    }
+
+    return stats;
+}
+
+void
+setDeepChunkStats (Header& header, const vector<DeepChunkStats>& stats)
+{
+    vector<char> data (stats.size () * STATS_ENTRY_SIZE);
+    char*        ptr = data.data ();
+
+    for (size_t i = 0; i < stats.size (); ++i)
+    {
+        Xdr::write<CharPtrIO> (ptr, stats[i].sampleCount);
+        Xdr::write<CharPtrIO> (ptr, stats[i].minZ);
+        Xdr::write<CharPtrIO> (ptr, stats[i].maxZ);
+    }
+
+    header.insert (
+        DeepChunkStats::ATTRIBUTE_NAME,
+        BytesAttribute (
+            data.size (), data.data (), DeepChunkStats::ATTRIBUTE_NAME));
+}
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
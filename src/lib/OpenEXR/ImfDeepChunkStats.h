@@ -0,0 +1,134 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifndef INCLUDED_IMF_DEEP_CHUNK_STATS_H
+#define INCLUDED_IMF_DEEP_CHUNK_STATS_H
+
+//-----------------------------------------------------------------------------
+//
+//      Per-chunk depth statistics for deep files
+//
+//      A deep file can carry, in its header, the number of samples
+//      and the depth range of the samples in each of its chunks.
+//      Readers that only need the samples within a depth range, for
+//      example to extract a holdout, or only the parts of the image
+//      that hold samples, can use the statistics to skip the other
+//      chunks without decompressing them.
+//
+//      The statistics are stored in a "bytes" attribute with name
+//      and type hint "deepChunkStats".  The value has one entry per
+//      chunk, in the order of the chunk offset table; each entry is
+//      the number of samples in the chunk (unsigned 64-bit integer),
+//      followed by the smallest Z and the largest ZBack, or Z if the
+//      file has no ZBack channel (32-bit floats).
+//
+//      To record the statistics, call addDeepChunkStats() on the
+//      header that is passed to DeepScanLineOutputFile,
+//      DeepTiledOutputFile or MultiPartOutputFile.  The writer
+//      reserves space for the attribute when it writes the header,
+//      and fills it in when the file is closed.  Chunks that were
+//      not written by writePixels() or writeTiles(), for example
+//      because they were copied with copyPixels(), are recorded as
+//      unknown.
+//
+//-----------------------------------------------------------------------------
+
+#include "ImfForward.h"
+
+#include <cstdint>
+#include <vector>
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
+
+struct IMF_EXPORT_TYPE DeepChunkStats
+{
+    //------------------------------------------------------------
+    // sampleCount is the number of samples in the chunk, or
+    // UNKNOWN_SAMPLE_COUNT if the chunk's statistics were not
+    // recorded.  If the chunk holds samples, then minZ and maxZ
+    // bound their depth; samples with a NaN depth widen the range
+    // to [-inf, +inf].
+    //------------------------------------------------------------
+
+    static constexpr uint64_t UNKNOWN_SAMPLE_COUNT = ~uint64_t (0);
+
+    //------------------------------------------------------------
+    // The name and type hint of the header attribute
+    //------------------------------------------------------------
+
+    static constexpr const char* ATTRIBUTE_NAME = "deepChunkStats";
+
+    uint64_t sampleCount;
+    float    minZ;
+    float    maxZ;
+
+    //------------------------------------------------------------
+    // The default constructor makes unknown statistics, whose
+    // depth range is [-inf, +inf].
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    DeepChunkStats ();
+
+    IMF_EXPORT
+    DeepChunkStats (uint64_t sampleCount, float minZ, float maxZ);
+
+    //------------------------------------------------------------
+    // Queries
+    //
+    // isKnown()             returns true if the statistics were
+    //                       recorded
+    //
+    // hasSamples()          returns false only if the chunk is
+    //                       known to hold no samples
+    //
+    // intersects(z1, z2)    returns false only if the chunk is
+    //                       known to hold no samples with a
+    //                       depth range that overlaps [z1, z2]
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    bool isKnown () const;
+
+    IMF_EXPORT
+    bool hasSamples () const;
+
+    IMF_EXPORT
+    bool intersects (float zMin, float zMax) const;
+};
+
+//
+// addDeepChunkStats(h) adds a deepChunkStats attribute to header h,
+// with unknown statistics for every chunk, so that deep writers record
+// the statistics.  If h already has the attribute, its statistics are
+// reset to unknown.
+//
+// hasDeepChunkStats(h) returns true if h has a deepChunkStats attribute.
+//
+// deepChunkStats(h) returns the statistics in the deepChunkStats
+// attribute of h, one entry per chunk, in the order of the chunk
+// offset table.  If h has no deepChunkStats attribute, or the number
+// of entries does not match the number of chunks that h describes,
+// deepChunkStats() returns an empty vector.
+//
+// setDeepChunkStats(h, s) stores s in the deepChunkStats attribute of h.
+//
+
+IMF_EXPORT
+void addDeepChunkStats (Header& header);
+
+IMF_EXPORT
+bool hasDeepChunkStats (const Header& header);
+
+IMF_EXPORT
+std::vector<DeepChunkStats> deepChunkStats (const Header& header);
+
+IMF_EXPORT
+void
+setDeepChunkStats (Header& header, const std::vector<DeepChunkStats>& stats);
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
+
+#endif
@@ -33,24 +33,25 @@ DeepCompositing::composite_pixel (
     // no samples? do nothing
     if (num_samples == 0) { return; }
 
+    // most pixels have few samples: avoid the heap for those
+    int         local_order[64];
     vector<int> sort_order;
+    int*        order = local_order;
     if (sources > 1)
     {
-        sort_order.resize (num_samples);
+        if (num_samples > 64)
+        {
+            sort_order.resize (num_samples);
+            order = &sort_order[0];
+        }
         for (int i = 0; i < num_samples; i++)
-            sort_order[i] = i;
-        sort (
-            &sort_order[0],
-            inputs,
-            channel_names,
-            num_channels,
-            num_samples,
-            sources);
+            order[i] = i;
+        sort (order, inputs, channel_names, num_channels, num_samples, sources);
     }
 
     for (int i = 0; i < num_samples; i++)
     {
-        int   s     = (sources > 1) ? sort_order[i] : i;
+        int   s     = (sources > 1) ? order[i] : i;
         float alpha = outputs[2];
         if (alpha >= 1.0f) return;
 
@@ -84,7 +85,28 @@ DeepCompositing::sort (
     int          num_samples,
     int          sources)
 {
-    std::sort (order + 0, order + num_samples, sort_helper (inputs));
+    sort_helper less (inputs);
+
+    //
+    // insertion sort is quicker than std::sort for the handful of
+    // samples in a typical pixel; the order is a strict total order,
+    // so both give the same result
+    //
+
+    if (num_samples <= 16)
+    {
+        for (int i = 1; i < num_samples; i++)
+        {
+            int v = order[i];
+            int j = i;
+            for (; j > 0 && less (v, order[j - 1]); j--)
+                order[j] = order[j - 1];
+            order[j] = v;
+        }
+        return;
+    }
+
+    std::sort (order + 0, order + num_samples, less);
 }
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
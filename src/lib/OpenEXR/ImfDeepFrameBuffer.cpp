@@ -181,4 +181,67 @@ DeepFrameBuffer::getSampleCountSlice () const
     return _sampleCounts;
 }
 
+void
+DeepFrameBuffer::insertSampleOffsetSlice (const Slice& slice)
+{
+    if (slice.base &&
+        (slice.xSampling != 1 || slice.ySampling != 1))
+    {
+        throw IEX_NAMESPACE::ArgExc (
+            "The sample offset slice cannot be subsampled.");
+    }
+
+    _sampleOffsets = slice;
+}
+
+const Slice&
+DeepFrameBuffer::getSampleOffsetSlice () const
+{
+    return _sampleOffsets;
+}
+
+bool
+DeepFrameBuffer::hasSampleOffsets () const
+{
+    return _sampleOffsets.base != 0;
+}
+
+uint64_t
+DeepFrameBuffer::computeSampleOffsets (const IMATH_NAMESPACE::Box2i& window) const
+{
+    if (!_sampleCounts.base)
+    {
+        throw IEX_NAMESPACE::ArgExc (
+            "Invalid base pointer, please set a proper sample count slice.");
+    }
+    if (!_sampleOffsets.base)
+    {
+        throw IEX_NAMESPACE::ArgExc (
+            "Invalid base pointer, please set a proper sample offset slice.");
+    }
+
+    uint64_t total = 0;
+    for (int y = window.min.y; y <= window.max.y; ++y)
+    {
+        const char* counts = _sampleCounts.base +
+                             int64_t (y) * int64_t (_sampleCounts.yStride) +
+                             int64_t (window.min.x) *
+                                 int64_t (_sampleCounts.xStride);
+        char* offsets = _sampleOffsets.base +
+                        int64_t (y) * int64_t (_sampleOffsets.yStride) +
+                        int64_t (window.min.x) *
+                            int64_t (_sampleOffsets.xStride);
+
+        for (int x = window.min.x; x <= window.max.x; ++x)
+        {
+            *reinterpret_cast<uint64_t*> (offsets) = total;
+            total += *reinterpret_cast<const unsigned int*> (counts);
+
+            counts += _sampleCounts.xStride;
+            offsets += _sampleOffsets.xStride;
+        }
+    }
+    return total;
+}
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
@@ -146,9 +146,55 @@ public:
     IMF_EXPORT
     const Slice& getSampleCountSlice () const;
 
+    //----------------------------------------------------------------
+    // Contiguous sample layout.
+    //
+    // By default the slice base of a deep channel addresses one
+    // pointer per pixel, each pointing at that pixel's samples.
+    // Once a sample offset slice has been inserted, the base of every
+    // deep slice instead points at a single block holding all of the
+    // samples of that channel, and the address of sample i in pixel
+    // (x, y) is
+    //
+    //  base + (offset (x, y) + i) * sampleStride
+    //
+    // where offset (x, y) is the uint64_t at
+    //
+    //  offsets.base + xp * offsets.xStride + yp * offsets.yStride
+    //
+    // (xp and yp as for DeepSlice; the type of the offset slice is
+    // ignored). The offsets must put the pixels of a row of the
+    // data window back to back, as an exclusive prefix sum of the
+    // sample counts in scan line order does, which lets the readers
+    // decode a whole row of samples at a time rather than chasing a
+    // pointer per pixel.
+    //
+    // computeSampleOffsets() fills the offset slice that way from the
+    // sample count slice, once the counts have been read, for the
+    // pixels in window, and returns the total number of samples, i.e.
+    // how many samples each channel's block needs room for. Offsets
+    // start at 0 at window.min. It does not honor xTileCoords or
+    // yTileCoords.
+    //
+    // Inserting a slice with a null base switches back to per pixel
+    // pointers. Only the input files support this layout.
+    //----------------------------------------------------------------
+
+    IMF_EXPORT
+    void insertSampleOffsetSlice (const Slice& slice);
+    IMF_EXPORT
+    const Slice& getSampleOffsetSlice () const;
+    IMF_EXPORT
+    bool hasSampleOffsets () const;
+
+    IMF_EXPORT
+    uint64_t
+    computeSampleOffsets (const IMATH_NAMESPACE::Box2i& window) const;
+
 private:
     SliceMap _map;
     Slice    _sampleCounts;
+    Slice    _sampleOffsets;
 };
 
 //----------
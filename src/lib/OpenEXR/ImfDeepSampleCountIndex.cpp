@@ -0,0 +1,497 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+//-----------------------------------------------------------------------------
+//
+//      class DeepSampleCountIndex
+//
+//-----------------------------------------------------------------------------
+
+#include "ImfDeepSampleCountIndex.h"
+#include "ImfCompression.h"
+#include "ImfDeepFrameBuffer.h"
+#include "ImfDeepScanLineInputFile.h"
+#include "ImfHeader.h"
+#include "ImfIO.h"
+#include "ImfStdIO.h"
+#include "ImfXdr.h"
+#include "Iex.h"
+#include "openexr_compression.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
+
+using IMATH_NAMESPACE::Box2i;
+using IMATH_NAMESPACE::V2i;
+using std::max;
+using std::min;
+using std::vector;
+
+namespace
+{
+
+const char INDEX_MAGIC[4] = {'d', 's', 'c', 'i'};
+const int  INDEX_VERSION  = 1;
+
+//
+// Deep scan line chunks are usually a single scan line, too small
+// to compress the sample counts well, so the counts are compressed
+// in blocks of at least this many scan lines
+//
+
+const int BLOCK_LINES = 16;
+
+//
+// Sample counts are read from the file at most about this
+// many pixels at a time while the index is built
+//
+
+const int64_t BUILD_BATCH_PIXELS = 1 << 22;
+
+void
+packCounts (const unsigned int* counts, size_t n, vector<char>& packed)
+{
+    vector<char> raw (n * Xdr::size<unsigned int> ());
+    char*        p = raw.data ();
+
+    for (size_t i = 0; i < n; ++i)
+        Xdr::write<CharPtrIO> (p, counts[i]);
+
+    size_t bound = exr_compress_max_buffer_size (raw.size ());
+    size_t actual;
+
+    packed.resize (bound);
+    if (EXR_ERR_SUCCESS != exr_compress_buffer (
+                               nullptr,
+                               -1,
+                               raw.data (),
+                               raw.size (),
+                               packed.data (),
+                               bound,
+                               &actual))
+    {
+        throw IEX_NAMESPACE::IoExc (
+            "Deep sample count index compression failed.");
+    }
+
+    packed.resize (actual);
+    packed.shrink_to_fit ();
+}
+
+} // namespace
+
+DeepSampleCountIndex::DeepSampleCountIndex ()
+    : _linesPerChunk (1), _chunksPerBlock (1), _fileFingerprint (0)
+{
+    setLayout (Box2i (V2i (0, 0), V2i (-1, -1)), 1);
+}
+
+DeepSampleCountIndex::DeepSampleCountIndex (
+    const char fileName[], int numThreads)
+    : _linesPerChunk (1), _chunksPerBlock (1), _fileFingerprint (0)
+{
+    DeepScanLineInputFile in (fileName, numThreads);
+    build (in);
+}
+
+DeepSampleCountIndex::DeepSampleCountIndex (IStream& is, int numThreads)
+    : _linesPerChunk (1), _chunksPerBlock (1), _fileFingerprint (0)
+{
+    DeepScanLineInputFile in (is, numThreads);
+    build (in);
+}
+
+void
+DeepSampleCountIndex::setLayout (const Box2i& dataWindow, int lines)
+{
+    _dataWindow     = dataWindow;
+    _linesPerChunk  = lines;
+    _chunksPerBlock = (BLOCK_LINES + lines - 1) / lines;
+
+    int64_t height = int64_t (dataWindow.max.y) - dataWindow.min.y + 1;
+    int64_t chunks = height > 0 ? (height + lines - 1) / lines : 0;
+    int64_t blocks = (chunks + _chunksPerBlock - 1) / _chunksPerBlock;
+
+    _chunkSampleCounts.assign (chunks, 0);
+    _packedCounts.assign (blocks, vector<char> ());
+}
+
+int
+DeepSampleCountIndex::linesPerBlock () const
+{
+    return _linesPerChunk * _chunksPerBlock;
+}
+
+bool
+DeepSampleCountIndex::blockIsEmpty (int block) const
+{
+    int c0 = block * _chunksPerBlock;
+    int c1 = min (numChunks (), c0 + _chunksPerBlock);
+
+    for (int c = c0; c < c1; ++c)
+        if (_chunkSampleCounts[c] != 0) return false;
+
+    return true;
+}
+
+void
+DeepSampleCountIndex::build (DeepScanLineInputFile& in)
+{
+    const Header& hdr = in.header ();
+    setLayout (
+        hdr.dataWindow (), getCompressionNumScanlines (hdr.compression ()));
+    _fileFingerprint = in.chunkTableFingerprint ();
+
+    int64_t width  = int64_t (_dataWindow.max.x) - _dataWindow.min.x + 1;
+    int64_t height = int64_t (_dataWindow.max.y) - _dataWindow.min.y + 1;
+    int64_t blocksPerBatch =
+        max (int64_t (1), BUILD_BATCH_PIXELS / (width * linesPerBlock ()));
+    int64_t batchLines = min (blocksPerBatch * linesPerBlock (), height);
+
+    vector<unsigned int> counts (width * batchLines);
+
+    for (int64_t y0 = _dataWindow.min.y; y0 <= _dataWindow.max.y;
+         y0 += batchLines)
+    {
+        int64_t y1 = min (y0 + batchLines - 1, int64_t (_dataWindow.max.y));
+
+        DeepFrameBuffer fb;
+        fb.insertSampleCountSlice (Slice::Make (
+            UINT,
+            counts.data (),
+            Box2i (
+                V2i (_dataWindow.min.x, int (y0)),
+                V2i (_dataWindow.max.x, int (y1)))));
+
+        in.setFrameBuffer (fb);
+        in.readPixelSampleCounts (int (y0), int (y1));
+
+        //
+        // Per-chunk totals, then the packed counts of each block
+        //
+
+        for (int64_t y = y0; y <= y1; ++y)
+        {
+            const unsigned int* line = counts.data () + (y - y0) * width;
+            uint64_t            total = 0;
+
+            for (int64_t x = 0; x < width; ++x)
+                total += line[x];
+
+            _chunkSampleCounts[(y - _dataWindow.min.y) / _linesPerChunk] +=
+                total;
+        }
+
+        for (int64_t y = y0; y <= y1; y += linesPerBlock ())
+        {
+            int     block = int ((y - _dataWindow.min.y) / linesPerBlock ());
+            int64_t lines = min (int64_t (linesPerBlock ()), y1 - y + 1);
+
+            if (!blockIsEmpty (block))
+            {
+                packCounts (
+                    counts.data () + (y - y0) * width,
+                    size_t (width * lines),
+                    _packedCounts[block]);
+            }
+        }
+    }
+}
+
+void
+DeepSampleCountIndex::save (const char fileName[]) const
+{
+    StdOFStream os (fileName);
+    write (os);
+}
+
+void
+DeepSampleCountIndex::load (const char fileName[])
+{
+    StdIFStream is (fileName);
+    read (is);
+}
+
+void
+DeepSampleCountIndex::write (OStream& os) const
+{
+    Xdr::write<StreamIO> (os, INDEX_MAGIC, 4);
+    Xdr::write<StreamIO> (os, INDEX_VERSION);
+
+    Xdr::write<StreamIO> (os, _dataWindow.min.x);
+    Xdr::write<StreamIO> (os, _dataWindow.min.y);
+    Xdr::write<StreamIO> (os, _dataWindow.max.x);
+    Xdr::write<StreamIO> (os, _dataWindow.max.y);
+    Xdr::write<StreamIO> (os, _linesPerChunk);
+    Xdr::write<StreamIO> (os, _chunksPerBlock);
+    Xdr::write<StreamIO> (os, numChunks ());
+    Xdr::write<StreamIO> (os, _fileFingerprint);
+
+    for (int c = 0; c < numChunks (); ++c)
+        Xdr::write<StreamIO> (os, _chunkSampleCounts[c]);
+
+    for (size_t b = 0; b < _packedCounts.size (); ++b)
+        Xdr::write<StreamIO> (os, uint64_t (_packedCounts[b].size ()));
+
+    for (size_t b = 0; b < _packedCounts.size (); ++b)
+    {
+        if (!_packedCounts[b].empty ())
+        {
+            os.write (
+                _packedCounts[b].data (), int (_packedCounts[b].size ()));
+        }
+    }
+}
+
+void
+DeepSampleCountIndex::read (IStream& is)
+{
+    char magic[4];
+    int  version;
+
+    Xdr::read<StreamIO> (is, magic, 4);
+    Xdr::read<StreamIO> (is, version);
+
+    if (memcmp (magic, INDEX_MAGIC, 4) != 0)
+        throw IEX_NAMESPACE::InputExc ("Not a deep sample count index.");
+
+    if (version != INDEX_VERSION)
+    {
+        THROW (
+            IEX_NAMESPACE::InputExc,
+            "Cannot read version " << version
+                                   << " of deep sample count index.");
+    }
+
+    Box2i    dw;
+    int      lines;
+    int      chunksPerBlock;
+    int      chunks;
+    uint64_t fingerprint;
+
+    Xdr::read<StreamIO> (is, dw.min.x);
+    Xdr::read<StreamIO> (is, dw.min.y);
+    Xdr::read<StreamIO> (is, dw.max.x);
+    Xdr::read<StreamIO> (is, dw.max.y);
+    Xdr::read<StreamIO> (is, lines);
+    Xdr::read<StreamIO> (is, chunksPerBlock);
+    Xdr::read<StreamIO> (is, chunks);
+    Xdr::read<StreamIO> (is, fingerprint);
+
+    int64_t width  = int64_t (dw.max.x) - dw.min.x + 1;
+    int64_t height = int64_t (dw.max.y) - dw.min.y + 1;
+
+    if (width <= 0 || height <= 0 || lines <= 0 ||
+        chunks != (height + lines - 1) / lines ||
+        chunksPerBlock != (BLOCK_LINES + lines - 1) / lines)
+    {
+        throw IEX_NAMESPACE::InputExc (
+            "Invalid layout in deep sample count index.");
+    }
+
+    DeepSampleCountIndex index;
+    index.setLayout (dw, lines);
+    index._fileFingerprint = fingerprint;
+
+    for (int c = 0; c < chunks; ++c)
+        Xdr::read<StreamIO> (is, index._chunkSampleCounts[c]);
+
+    //
+    // A block's compressed counts can be no larger than the
+    // compression bound of its uncompressed counts, and only
+    // blocks with samples have any
+    //
+
+    uint64_t maxPacked = exr_compress_max_buffer_size (
+        size_t (width * index.linesPerBlock ()) * Xdr::size<unsigned int> ());
+
+    vector<uint64_t> packedSizes (index._packedCounts.size ());
+    for (size_t b = 0; b < packedSizes.size (); ++b)
+    {
+        Xdr::read<StreamIO> (is, packedSizes[b]);
+
+        if (index.blockIsEmpty (int (b)) != (packedSizes[b] == 0) ||
+            packedSizes[b] > maxPacked || packedSizes[b] > uint64_t (INT_MAX))
+        {
+            THROW (
+                IEX_NAMESPACE::InputExc,
+                "Invalid size of block " << b
+                                         << " in deep sample count index.");
+        }
+    }
+
+    for (size_t b = 0; b < packedSizes.size (); ++b)
+    {
+        if (packedSizes[b] == 0) continue;
+
+        index._packedCounts[b].resize (packedSizes[b]);
+        is.read (index._packedCounts[b].data (), int (packedSizes[b]));
+    }
+
+    *this = std::move (index);
+}
+
+bool
+DeepSampleCountIndex::matches (const DeepScanLineInputFile& file) const
+{
+    const Header& header = file.header ();
+
+    return header.dataWindow () == _dataWindow &&
+           getCompressionNumScanlines (header.compression ()) ==
+               _linesPerChunk &&
+           file.chunkTableFingerprint () == _fileFingerprint;
+}
+
+const Box2i&
+DeepSampleCountIndex::dataWindow () const
+{
+    return _dataWindow;
+}
+
+int
+DeepSampleCountIndex::linesPerChunk () const
+{
+    return _linesPerChunk;
+}
+
+int
+DeepSampleCountIndex::numChunks () const
+{
+    return int (_chunkSampleCounts.size ());
+}
+
+uint64_t
+DeepSampleCountIndex::chunkSampleCount (int chunk) const
+{
+    if (chunk < 0 || chunk >= numChunks ())
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Chunk " << chunk << " is not in the deep sample count index.");
+    }
+
+    return _chunkSampleCounts[chunk];
+}
+
+uint64_t
+DeepSampleCountIndex::totalSampleCount () const
+{
+    uint64_t total = 0;
+    for (uint64_t n: _chunkSampleCounts)
+        total += n;
+    return total;
+}
+
+uint64_t
+DeepSampleCountIndex::sampleCount (int scanLine1, int scanLine2) const
+{
+    if (scanLine2 < scanLine1) std::swap (scanLine1, scanLine2);
+
+    if (scanLine1 < _dataWindow.min.y || scanLine2 > _dataWindow.max.y)
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Scan lines " << scanLine1 << " - " << scanLine2
+                          << " are outside the data window of the deep "
+                             "sample count index: "
+                          << _dataWindow.min.y << " - " << _dataWindow.max.y);
+    }
+
+    int c0 = (scanLine1 - _dataWindow.min.y) / _linesPerChunk;
+    int c1 = (scanLine2 - _dataWindow.min.y) / _linesPerChunk;
+
+    uint64_t total = 0;
+    for (int c = c0; c <= c1; ++c)
+        total += _chunkSampleCounts[c];
+    return total;
+}
+
+void
+DeepSampleCountIndex::readPixelSampleCounts (
+    const DeepFrameBuffer& frameBuffer, int scanLine1, int scanLine2) const
+{
+    const Slice& scslice = frameBuffer.getSampleCountSlice ();
+
+    if (!scslice.base)
+    {
+        throw IEX_NAMESPACE::ArgExc (
+            "Invalid base pointer, please set a proper sample count slice.");
+    }
+    if (scslice.type != OPENEXR_IMF_INTERNAL_NAMESPACE::UINT)
+    {
+        throw IEX_NAMESPACE::ArgExc (
+            "The type of sample count slice should be UINT.");
+    }
+
+    if (scanLine2 < scanLine1) std::swap (scanLine1, scanLine2);
+
+    if (scanLine1 < _dataWindow.min.y || scanLine2 > _dataWindow.max.y)
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Tried to read scan line outside "
+            "the deep sample count index's data window: "
+                << scanLine1 << " - " << scanLine2 << " vs datawindow "
+                << _dataWindow.min.y << " - " << _dataWindow.max.y);
+    }
+
+    int64_t width = int64_t (_dataWindow.max.x) - _dataWindow.min.x + 1;
+    int64_t xS    = int64_t (scslice.xStride);
+    int64_t yS    = int64_t (scslice.yStride);
+
+    vector<char> raw (width * linesPerBlock () * Xdr::size<unsigned int> ());
+
+    int b0 = (scanLine1 - _dataWindow.min.y) / linesPerBlock ();
+    int b1 = (scanLine2 - _dataWindow.min.y) / linesPerBlock ();
+
+    for (int b = b0; b <= b1; ++b)
+    {
+        int  by0   = _dataWindow.min.y + b * linesPerBlock ();
+        int  by1   = min (by0 + linesPerBlock () - 1, _dataWindow.max.y);
+        bool empty = _packedCounts[b].empty ();
+
+        if (!empty)
+        {
+            size_t expected =
+                size_t (width * (by1 - by0 + 1)) * Xdr::size<unsigned int> ();
+            size_t actual;
+
+            if (EXR_ERR_SUCCESS != exr_uncompress_buffer (
+                                       nullptr,
+                                       _packedCounts[b].data (),
+                                       _packedCounts[b].size (),
+                                       raw.data (),
+                                       raw.size (),
+                                       &actual) ||
+                actual != expected)
+            {
+                THROW (
+                    IEX_NAMESPACE::InputExc,
+                    "Corrupt sample counts for block "
+                        << b << " in deep sample count index.");
+            }
+        }
+
+        for (int y = max (by0, scanLine1); y <= min (by1, scanLine2); ++y)
+        {
+            const char* src = raw.data () + (y - by0) * width *
+                                                Xdr::size<unsigned int> ();
+            char* ptr = scslice.base + int64_t (_dataWindow.min.x) * xS +
+                        int64_t (y) * yS;
+
+            for (int64_t x = 0; x < width; ++x, ptr += xS)
+            {
+                unsigned int n = 0;
+                if (!empty) Xdr::read<CharPtrIO> (src, n);
+                *reinterpret_cast<unsigned int*> (ptr) = n;
+            }
+        }
+    }
+}
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
@@ -0,0 +1,169 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifndef INCLUDED_IMF_DEEP_SAMPLE_COUNT_INDEX_H
+#define INCLUDED_IMF_DEEP_SAMPLE_COUNT_INDEX_H
+
+//-----------------------------------------------------------------------------
+//
+//      class DeepSampleCountIndex
+//
+//      A summary of the sample counts of a deep scan line file, kept
+//      apart from the file.  The index stores the total number of
+//      samples in each chunk of the file, and the per-pixel sample
+//      counts.  The per-pixel counts are compressed in blocks of at
+//      least 16 scan lines, independently of each other, and blocks
+//      without samples take no space.
+//
+//      Planning the memory for a large deep image normally takes a
+//      pass over every chunk of the file to read its sample count
+//      table.  With an index, the counts come from one small,
+//      contiguous read instead, and chunks without samples can be
+//      skipped without touching the file at all.
+//
+//      The index is built once, for example right after a renderer
+//      has written the file, and saved as a "sidecar" file next to
+//      it.  Readers load the sidecar and either query it directly,
+//      or hand it to DeepScanLineInputFile::setSampleCountIndex(),
+//      so that readPixelSampleCounts() is served from the index.
+//
+//      File name parameters are UTF-8 paths; see ImfIO.h.
+//
+//-----------------------------------------------------------------------------
+
+#include "ImfForward.h"
+
+#include "ImfThreading.h"
+
+#include <Imath/ImathBox.h>
+
+#include <cstdint>
+#include <vector>
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
+
+class IMF_EXPORT_TYPE DeepSampleCountIndex
+{
+public:
+    //------------------------------------------------------------
+    // Constructors
+    //
+    // The default constructor makes an empty index, ready for
+    // read() or load().
+    //
+    // DeepSampleCountIndex(n) and DeepSampleCountIndex(is) build
+    // the index for the deep scan line file with name n, or in
+    // stream is, by reading the sample count table of every chunk.
+    // No pixel data are read.
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    DeepSampleCountIndex ();
+
+    IMF_EXPORT
+    explicit DeepSampleCountIndex (
+        const char fileName[], int numThreads = globalThreadCount ());
+
+    IMF_EXPORT
+    explicit DeepSampleCountIndex (
+        IStream& is, int numThreads = globalThreadCount ());
+
+    //------------------------------------------------------------
+    // Sidecar files
+    //
+    // save(n) and write(os) store the index in the file with name
+    // n or in stream os; load(n) and read(is) replace the contents
+    // of the index with one that was stored by save() or write().
+    // load() and read() throw an Iex::InputExc if the data are not
+    // a valid index.
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    void save (const char fileName[]) const;
+    IMF_EXPORT
+    void load (const char fileName[]);
+
+    IMF_EXPORT
+    void write (OStream& os) const;
+    IMF_EXPORT
+    void read (IStream& is);
+
+    //------------------------------------------------------------
+    // matches(f) returns true if the index was built from file f:
+    // the data window and the number of scan lines per chunk must
+    // be the same, and so must a fingerprint of the file's chunk
+    // offset table.  An index left over from an earlier version
+    // of a file with the same layout but different samples is
+    // almost certainly rejected, because the chunks have moved.
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    bool matches (const DeepScanLineInputFile& file) const;
+
+    //------------------------------------------------------------
+    // Access to the index
+    //
+    // dataWindow()          the data window of the indexed file
+    //
+    // linesPerChunk()       the number of scan lines per chunk;
+    //                       the last chunk may have fewer
+    //
+    // numChunks()           the number of chunks
+    //
+    // chunkSampleCount(c)   the number of samples in chunk c
+    //
+    // totalSampleCount()    the number of samples in the file
+    //
+    // sampleCount(s1, s2)   the number of samples in the chunks
+    //                       that hold scan lines s1 to s2
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    const IMATH_NAMESPACE::Box2i& dataWindow () const;
+    IMF_EXPORT
+    int linesPerChunk () const;
+    IMF_EXPORT
+    int numChunks () const;
+
+    IMF_EXPORT
+    uint64_t chunkSampleCount (int chunk) const;
+    IMF_EXPORT
+    uint64_t totalSampleCount () const;
+    IMF_EXPORT
+    uint64_t sampleCount (int scanLine1, int scanLine2) const;
+
+    //------------------------------------------------------------
+    // readPixelSampleCounts(fb, s1, s2) stores the sample counts
+    // of scan lines min(s1,s2) to max(s1,s2) in the sample count
+    // slice of frame buffer fb, like
+    // DeepScanLineInputFile::readPixelSampleCounts() does.  Only
+    // the blocks that hold these scan lines and have samples are
+    // decompressed.
+    //------------------------------------------------------------
+
+    IMF_EXPORT
+    void readPixelSampleCounts (
+        const DeepFrameBuffer& frameBuffer,
+        int                    scanLine1,
+        int                    scanLine2) const;
+
+private:
+    void build (DeepScanLineInputFile& in);
+    void setLayout (const IMATH_NAMESPACE::Box2i& dataWindow, int lines);
+
+    int linesPerBlock () const;
+    bool blockIsEmpty (int block) const;
+
+    IMATH_NAMESPACE::Box2i         _dataWindow;
+    int                            _linesPerChunk;
+    int                            _chunksPerBlock;
+    uint64_t                       _fileFingerprint;
+    std::vector<uint64_t>          _chunkSampleCounts;
+    std::vector<std::vector<char>> _packedCounts; // per block, compressed
+};
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
+
+#endif
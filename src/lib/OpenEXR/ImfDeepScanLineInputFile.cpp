@@ -12,7 +12,9 @@
 #include "ImfDeepScanLineInputFile.h"
 
 #include "ImfDeepFrameBuffer.h"
+#include "ImfDeepSampleCountIndex.h"
 #include "ImfInputPartData.h"
+#include "ImfMisc.h"
 
 #include "IlmThreadPool.h"
 #if ILMTHREAD_THREADING_ENABLED
@@ -23,6 +25,8 @@
 #include "Iex.h"
 
 #include <algorithm>
+#include <cstring>
+#include <exception>
 #include <limits>
 #include <string>
 #include <vector>
@@ -71,6 +75,8 @@ struct ScanLineProcess
         int fbY,
         int fbLastY);
 
+    void update_layout (const DeepFrameBuffer *outfb);
+
     void run_fill (
         const DeepFrameBuffer *outfb,
         int fbY,
@@ -80,12 +86,27 @@ struct ScanLineProcess
         const DeepFrameBuffer *outfb,
         int fbY);
 
+    void prep_index_check ();
+    exr_result_t check_index_counts ();
+    void throw_decode_error ();
+
     exr_result_t          last_decode_err = EXR_ERR_UNKNOWN;
     bool                  first = true;
     bool                  counts_only = false;
     exr_chunk_info_t      cinfo;
     exr_decode_pipeline_t decoder;
 
+    // per channel line pointers when the frame buffer has a sample
+    // offset slice
+    std::vector<uint8_t*> line_ptrs;
+
+    // when set, the sample count table of every decoded chunk must
+    // match the counts in the index, which the caller used to
+    // allocate the sample buffers
+    const DeepSampleCountIndex* index = nullptr;
+    std::vector<unsigned int>   index_counts;
+    std::exception_ptr          index_error;
+
     ScanLineProcess*      next;
 };
 
@@ -112,6 +133,12 @@ struct DeepScanLineInputFile::Data
     }
 
     std::pair<int, int> getChunkRange (int y) const;
+    int                 linesPerChunk () const;
+
+    const std::vector<DeepChunkStats>& getChunkStats (const Header& hdr);
+
+    std::vector<int> findChunks (
+        const Header& hdr, bool depthRange, float zMin, float zMax);
 
     void readData (const DeepFrameBuffer &fb, int scanLine1, int scanLine2, bool countsOnly);
     void readMemData (
@@ -123,6 +150,8 @@ struct DeepScanLineInputFile::Data
 
     void prepFillList (const DeepFrameBuffer &fb, std::vector<DeepSlice> &fill);
 
+    std::shared_ptr<const DeepSampleCountIndex> getSampleCountIndex ();
+
     Context* _ctxt;
     int partNumber;
     int numThreads;
@@ -134,6 +163,11 @@ struct DeepScanLineInputFile::Data
     DeepFrameBuffer frameBuffer;
     std::vector<DeepSlice> fill_list;
 
+    std::shared_ptr<const DeepSampleCountIndex> sampleCountIndex;
+
+    std::vector<DeepChunkStats> chunkStats;
+    bool                        chunkStats_filled = false;
+
 #if ILMTHREAD_THREADING_ENABLED
     std::mutex _mx;
 
@@ -145,10 +179,10 @@ struct DeepScanLineInputFile::Data
             Data*                   ifd,
             ScanLineProcessGroup*   lineg,
             const DeepFrameBuffer*  outfb,
-            const exr_chunk_info_t& cinfo,
             int                     fby,
             int                     endScan,
-            bool                    countsOnly)
+            bool                    countsOnly,
+            const DeepSampleCountIndex* index)
             : Task (group)
             , _outfb (outfb)
             , _ifd (ifd)
@@ -157,8 +191,8 @@ struct DeepScanLineInputFile::Data
             , _line (lineg->pop ())
             , _line_group (lineg)
         {
-            _line->cinfo = cinfo;
             _line->counts_only = countsOnly;
+            _line->index       = index;
         }
 
         ~LineBufferTask () override
@@ -410,6 +444,15 @@ DeepScanLineInputFile::readPixelSampleCounts (int scanline1, int scanline2)
             "readPixelSampleCounts called with no valid frame buffer");
     }
 
+    std::shared_ptr<const DeepSampleCountIndex> index =
+        _data->getSampleCountIndex ();
+
+    if (index)
+    {
+        index->readPixelSampleCounts (_data->frameBuffer, scanline1, scanline2);
+        return;
+    }
+
     _data->readData (_data->frameBuffer, scanline1, scanline2, true);
 }
 
@@ -419,6 +462,74 @@ DeepScanLineInputFile::readPixelSampleCounts (int scanline)
     readPixelSampleCounts (scanline, scanline);
 }
 
+void
+DeepScanLineInputFile::setSampleCountIndex (
+    std::shared_ptr<const DeepSampleCountIndex> index)
+{
+    if (index && !index->matches (*this))
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Deep sample count index was not built from file \""
+                << fileName () << "\".");
+    }
+
+#if ILMTHREAD_THREADING_ENABLED
+    std::lock_guard<std::mutex> lock (_data->_mx);
+#endif
+    _data->sampleCountIndex = index;
+}
+
+std::shared_ptr<const DeepSampleCountIndex>
+DeepScanLineInputFile::Data::getSampleCountIndex ()
+{
+#if ILMTHREAD_THREADING_ENABLED
+    std::lock_guard<std::mutex> lock (_mx);
+#endif
+    return sampleCountIndex;
+}
+
+uint64_t
+DeepScanLineInputFile::chunkTableFingerprint () const
+{
+    return _ctxt.chunkTableFingerprint (_data->partNumber);
+}
+
+bool
+DeepScanLineInputFile::hasChunkStats () const
+{
+    return !_data->getChunkStats (header ()).empty ();
+}
+
+DeepChunkStats
+DeepScanLineInputFile::chunkStats (int y) const
+{
+    const std::vector<DeepChunkStats>& stats =
+        _data->getChunkStats (header ());
+
+    int first = firstScanLineInChunk (y);
+
+    if (stats.empty ()) return DeepChunkStats ();
+
+    int64_t chunk =
+        (static_cast<int64_t> (first) - header ().dataWindow ().min.y) /
+        _data->linesPerChunk ();
+
+    return stats[chunk];
+}
+
+std::vector<int>
+DeepScanLineInputFile::chunksWithSamples () const
+{
+    return _data->findChunks (header (), false, 0, 0);
+}
+
+std::vector<int>
+DeepScanLineInputFile::chunksInDepthRange (float zMin, float zMax) const
+{
+    return _data->findChunks (header (), true, zMin, zMax);
+}
+
 int
 DeepScanLineInputFile::firstScanLineInChunk (int y) const
 {
@@ -431,6 +542,64 @@ DeepScanLineInputFile::lastScanLineInChunk (int y) const
     return _data->getChunkRange (y).second;
 }
 
+int
+DeepScanLineInputFile::Data::linesPerChunk () const
+{
+    int32_t scansperchunk = 1;
+
+    if (EXR_ERR_SUCCESS != exr_get_scanlines_per_chunk (*_ctxt, partNumber, &scansperchunk))
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Error querying scanline counts from image "
+            "file \"" << _ctxt->fileName () << "\".");
+    }
+
+    return scansperchunk;
+}
+
+const std::vector<DeepChunkStats>&
+DeepScanLineInputFile::Data::getChunkStats (const Header& hdr)
+{
+#if ILMTHREAD_THREADING_ENABLED
+    std::lock_guard<std::mutex> lock (_mx);
+#endif
+    if (!chunkStats_filled)
+    {
+        chunkStats        = deepChunkStats (hdr);
+        chunkStats_filled = true;
+    }
+    return chunkStats;
+}
+
+std::vector<int>
+DeepScanLineInputFile::Data::findChunks (
+    const Header& hdr, bool depthRange, float zMin, float zMax)
+{
+    const std::vector<DeepChunkStats>& stats = getChunkStats (hdr);
+
+    const IMATH_NAMESPACE::Box2i& dw    = hdr.dataWindow ();
+    int64_t                       lines = linesPerChunk ();
+    size_t                        chunk = 0;
+
+    std::vector<int> chunks;
+
+    for (int64_t y = dw.min.y; y <= dw.max.y; y += lines, ++chunk)
+    {
+        if (chunk < stats.size ())
+        {
+            const DeepChunkStats& s = stats[chunk];
+
+            if (depthRange ? !s.intersects (zMin, zMax) : !s.hasSamples ())
+                continue;
+        }
+
+        chunks.push_back (static_cast<int> (y));
+    }
+
+    return chunks;
+}
+
 std::pair<int, int> DeepScanLineInputFile::Data::getChunkRange (int y) const
 {
     exr_attr_box2i_t dw = _ctxt->dataWindow (partNumber);
@@ -504,6 +673,10 @@ DeepScanLineInputFile::Data::readData (
             << dw.min.y << " - " << dw.max.y);
     }
 
+    // held for the whole read, in case the index is replaced meanwhile
+    std::shared_ptr<const DeepSampleCountIndex> index;
+    if (!countsOnly) index = getSampleCountIndex ();
+
 #if ILMTHREAD_THREADING_ENABLED
     int64_t nchunks;
     nchunks = ((int64_t) scanLine2 - (int64_t) scanLine1);
@@ -521,15 +694,25 @@ DeepScanLineInputFile::Data::readData (
         {
             ILMTHREAD_NAMESPACE::TaskGroup tg;
 
-            for (int y = scanLine1; y <= scanLine2; )
+            // the tasks look up their own chunk information (which
+            // for deep data includes reading the chunk leader) so
+            // those reads overlap decoding rather than delaying
+            // dispatch, and chunk boundaries are computed from the
+            // data window here
+            for (int64_t y = scanLine1; y <= scanLine2; )
             {
-                if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (*_ctxt, partNumber, y, &cinfo))
-                    throw IEX_NAMESPACE::InputExc ("Unable to query scanline information");
-
                 ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (
-                    new LineBufferTask (&tg, this, &sg, &fb, cinfo, y, scanLine2, countsOnly) );
-
-                y += scansperchunk - (y - cinfo.start_y);
+                    new LineBufferTask (
+                        &tg,
+                        this,
+                        &sg,
+                        &fb,
+                        static_cast<int> (y),
+                        scanLine2,
+                        countsOnly,
+                        index.get ()) );
+
+                y += scansperchunk - ((y - dw.min.y) % scansperchunk);
             }
         }
 
@@ -542,6 +725,7 @@ DeepScanLineInputFile::Data::readData (
         bool redo = true;
 
         sp.counts_only = countsOnly;
+        sp.index       = index.get ();
         for (int y = scanLine1; y <= scanLine2; )
         {
             if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (*_ctxt, partNumber, y, &cinfo))
@@ -632,14 +816,19 @@ DeepScanLineInputFile::Data::readMemData (
         }
     }
 
+    std::shared_ptr<const DeepSampleCountIndex> index;
     if (!countsOnly)
+    {
         prepFillList(fb, fills);
+        index = getSampleCountIndex ();
+    }
 
     if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (
             *_ctxt, partNumber, scanLine1, &proc.cinfo))
         throw IEX_NAMESPACE::InputExc ("Unable to query scanline information");
 
     proc.counts_only = countsOnly;
+    proc.index       = index.get ();
     proc.run_mem_decode (
         *_ctxt,
         partNumber,
@@ -700,6 +889,13 @@ void DeepScanLineInputFile::Data::LineBufferTask::execute ()
 {
     try
     {
+        if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (
+                *(_ifd->_ctxt), _ifd->partNumber, _fby, &(_line->cinfo)))
+        {
+            _line_group->record_missing ("Unable to query scanline information");
+            return;
+        }
+
         _line->run_decode (
             *(_ifd->_ctxt),
             _ifd->partNumber,
@@ -708,6 +904,10 @@ void DeepScanLineInputFile::Data::LineBufferTask::execute ()
             _last_fby,
             _ifd->fill_list);
     }
+    catch (IEX_NAMESPACE::ArgExc &e)
+    {
+        _line_group->record_invalid (e.what ());
+    }
     catch (std::exception &e)
     {
         _line_group->record_failure (e.what ());
@@ -727,6 +927,88 @@ mem_skip_read_chunk (exr_decode_pipeline_t* decode)
     return EXR_ERR_SUCCESS;
 }
 
+// runs between unpacking the sample count table and unpacking the
+// samples, so a mismatch stops the decode before it writes past the
+// sample buffers the caller sized from the index
+static exr_result_t
+index_check_counts (exr_decode_pipeline_t* decode)
+{
+    return static_cast<ScanLineProcess*> (decode->decoding_user_data)
+        ->check_index_counts ();
+}
+
+void ScanLineProcess::prep_index_check ()
+{
+    index_error = nullptr;
+    if (index && !counts_only)
+    {
+        decoder.decoding_user_data       = this;
+        decoder.realloc_nonimage_data_fn = &index_check_counts;
+    }
+    else
+    {
+        decoder.decoding_user_data       = nullptr;
+        decoder.realloc_nonimage_data_fn = nullptr;
+    }
+}
+
+exr_result_t ScanLineProcess::check_index_counts ()
+{
+    try
+    {
+        size_t n = size_t (cinfo.width) * size_t (cinfo.height);
+
+        index_counts.resize (n);
+
+        DeepFrameBuffer fb;
+        fb.insertSampleCountSlice (Slice::Make (
+            OPENEXR_IMF_INTERNAL_NAMESPACE::UINT,
+            index_counts.data (),
+            IMATH_NAMESPACE::V2i (cinfo.start_x, cinfo.start_y),
+            cinfo.width,
+            cinfo.height));
+
+        index->readPixelSampleCounts (
+            fb, cinfo.start_y, cinfo.start_y + cinfo.height - 1);
+
+        static_assert (
+            sizeof (unsigned int) == sizeof (int32_t),
+            "sample counts must be 32 bits");
+
+        if (memcmp (
+                index_counts.data (),
+                decoder.sample_count_table,
+                n * sizeof (int32_t)))
+        {
+            THROW (
+                IEX_NAMESPACE::ArgExc,
+                "Sample counts of scan lines "
+                    << cinfo.start_y << " - "
+                    << cinfo.start_y + cinfo.height - 1
+                    << " do not match the deep sample count index.");
+        }
+    }
+    catch (...)
+    {
+        index_error = std::current_exception ();
+        return EXR_ERR_INVALID_ARGUMENT;
+    }
+
+    return EXR_ERR_SUCCESS;
+}
+
+void ScanLineProcess::throw_decode_error ()
+{
+    if (index_error)
+    {
+        std::exception_ptr e;
+        std::swap (e, index_error);
+        std::rethrow_exception (e);
+    }
+
+    throw IEX_NAMESPACE::IoExc ("Unable to run decoder");
+}
+
 void ScanLineProcess::run_mem_decode (
         exr_const_context_t ctxt,
         int pn,
@@ -751,6 +1033,7 @@ void ScanLineProcess::run_mem_decode (
     if (counts_only)
         decoder.decode_flags |= EXR_DECODE_SAMPLE_DATA_ONLY;
 
+    update_layout (outfb);
     update_pointers (outfb, fbY, fbLastY);
 
     if (EXR_ERR_SUCCESS !=
@@ -765,9 +1048,11 @@ void ScanLineProcess::run_mem_decode (
     rawdata += cinfo.sample_count_table_size;
     decoder.packed_buffer = const_cast<char*> (rawdata);
 
+    prep_index_check ();
+
     last_decode_err = exr_decoding_run (ctxt, pn, &decoder);
     if (EXR_ERR_SUCCESS != last_decode_err)
-        throw IEX_NAMESPACE::IoExc ("Unable to run decoder");
+        throw_decode_error ();
 
     copy_sample_count (outfb, fbY);
 
@@ -817,6 +1102,7 @@ void ScanLineProcess::run_decode (
     else
         decoder.decode_flags = decoder.decode_flags & ~EXR_DECODE_SAMPLE_DATA_ONLY;
 
+    update_layout (outfb);
     update_pointers (outfb, fbY, fbLastY);
 
     if (flags != decoder.decode_flags)
@@ -828,9 +1114,11 @@ void ScanLineProcess::run_decode (
         }
     }
 
+    prep_index_check ();
+
     last_decode_err = exr_decoding_run (ctxt, pn, &decoder);
     if (EXR_ERR_SUCCESS != last_decode_err)
-        throw IEX_NAMESPACE::IoExc ("Unable to run decoder");
+        throw_decode_error ();
 
     copy_sample_count (outfb, fbY);
 
@@ -850,8 +1138,21 @@ void ScanLineProcess::run_unpack (
     int fbLastY,
     const std::vector<DeepSlice> &filllist)
 {
+    uint16_t flags = decoder.decode_flags;
+
+    update_layout (outfb);
     update_pointers (outfb, fbY, fbLastY);
 
+    // the frame buffer may have switched layout since the decode
+    if (flags != decoder.decode_flags)
+    {
+        if (EXR_ERR_SUCCESS !=
+            exr_decoding_choose_default_routines (ctxt, pn, &decoder))
+        {
+            throw IEX_NAMESPACE::IoExc ("Unable to choose decoder routines");
+        }
+    }
+
     copy_sample_count (outfb, fbY);
 
     if (counts_only)
@@ -885,6 +1186,14 @@ void ScanLineProcess::update_pointers (
     if (counts_only)
         return;
 
+    const Slice& offsets = outfb->getSampleOffsetSlice ();
+    int64_t      lines   = int64_t (cinfo.height) -
+                    int64_t (decoder.user_line_begin_skip) -
+                    int64_t (decoder.user_line_end_ignore);
+
+    if (offsets.base)
+        line_ptrs.resize (size_t (decoder.channel_count) * size_t (lines));
+
     for (int c = 0; c < decoder.channel_count; ++c)
     {
         exr_coding_channel_info_t& curchan = decoder.channels[c];
@@ -901,6 +1210,30 @@ void ScanLineProcess::update_pointers (
             continue;
         }
 
+        if (offsets.base)
+        {
+            // a row of the chunk is contiguous in the channel's sample
+            // block, starting at the offset of its first pixel
+            uint8_t** lp = line_ptrs.data () + size_t (c) * size_t (lines);
+            for (int64_t l = 0; l < lines; ++l)
+            {
+                const char* op = offsets.base;
+                op += int64_t (cinfo.start_x) * int64_t (offsets.xStride);
+                op += (int64_t (fbY) + l) * int64_t (offsets.yStride);
+
+                lp[l] = reinterpret_cast<uint8_t*> (fbslice->base) +
+                        *reinterpret_cast<const uint64_t*> (op) *
+                            uint64_t (fbslice->sampleStride);
+            }
+
+            curchan.user_bytes_per_element = fbslice->sampleStride;
+            curchan.user_data_type    = (exr_pixel_type_t)fbslice->type;
+            curchan.user_pixel_stride = 0;
+            curchan.user_line_stride  = sizeof (uint8_t*);
+            curchan.decode_to_ptr     = reinterpret_cast<uint8_t*> (lp);
+            continue;
+        }
+
         curchan.user_bytes_per_element = fbslice->sampleStride;
         curchan.user_data_type         = (exr_pixel_type_t)fbslice->type;
         curchan.user_pixel_stride      = fbslice->xStride;
@@ -916,11 +1249,29 @@ void ScanLineProcess::update_pointers (
 
 ////////////////////////////////////////
 
+void ScanLineProcess::update_layout (const DeepFrameBuffer *outfb)
+{
+    if (outfb->hasSampleOffsets ())
+    {
+        decoder.decode_flags &= ~EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS;
+        decoder.decode_flags |= EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS;
+    }
+    else
+    {
+        decoder.decode_flags &= ~EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS;
+        decoder.decode_flags |= EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS;
+    }
+}
+
+////////////////////////////////////////
+
 void ScanLineProcess::run_fill (
     const DeepFrameBuffer *outfb,
     int fbY,
     const std::vector<DeepSlice> &filllist)
 {
+    const Slice& offsets = outfb->getSampleOffsetSlice ();
+
     for (auto& fills: filllist)
     {
         uint8_t*       ptr;
@@ -928,6 +1279,31 @@ void ScanLineProcess::run_fill (
         if (fills.xSampling != 1 || fills.ySampling != 1)
             throw IEX_NAMESPACE::InputExc ("Expect sampling of 1");
 
+        if (offsets.base)
+        {
+            int stop = cinfo.start_y + cinfo.height - decoder.user_line_end_ignore;
+            for ( int y = fbY; y < stop; ++y )
+            {
+                const int32_t* counts = decoder.sample_count_table;
+                counts += ((int64_t) y - (int64_t) cinfo.start_y) * (int64_t) cinfo.width;
+
+                int64_t samps = 0;
+                for ( int sx = 0; sx < cinfo.width; ++sx )
+                    samps += counts[sx];
+
+                const char* op = offsets.base;
+                op += int64_t (cinfo.start_x) * int64_t (offsets.xStride);
+                op += int64_t (y) * int64_t (offsets.yStride);
+
+                fillDeepSampleBlock (
+                    fills.base + *reinterpret_cast<const uint64_t*> (op) *
+                                     uint64_t (fills.sampleStride),
+                    fills,
+                    samps);
+            }
+            continue;
+        }
+
         ptr  = reinterpret_cast<uint8_t*> (fills.base);
         ptr += int64_t (cinfo.start_x) * int64_t (fills.xStride);
         ptr += int64_t (fbY) * int64_t (fills.yStride);
@@ -18,6 +18,7 @@
 
 #include "ImfContext.h"
 
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepScanLineOutputFile.h"
 
 #include "ImfThreading.h"
@@ -235,6 +236,62 @@ public:
         int                    scanLine1,
         int                    scanLine2) const;
 
+    //----------------------------------------------------------
+    // Serve sample counts from an index
+    //
+    // setSampleCountIndex(i) makes readPixelSampleCounts(s1, s2)
+    // and readPixelSampleCounts(s) copy the sample counts from
+    // index i rather than read them from the file; see
+    // ImfDeepSampleCountIndex.h.  The index must have been built
+    // from this file; setSampleCountIndex() throws an
+    // Iex::ArgExc unless the index matches() the file, that is,
+    // unless its data window, its scan lines per chunk and its
+    // fingerprint of the chunk offset table match the file's.
+    // setSampleCountIndex(nullptr) goes back to reading the
+    // counts from the file.
+    //
+    // readPixels() still decodes the sample count tables stored in
+    // the file, and throws an Iex::ArgExc if those of a chunk
+    // differ from the counts in the index, before any samples of
+    // that chunk are stored in the frame buffer.
+    //----------------------------------------------------------
+
+    IMF_EXPORT
+    void setSampleCountIndex (
+        std::shared_ptr<const DeepSampleCountIndex> index);
+
+    //----------------------------------------------------------
+    // Per-chunk statistics; see ImfDeepChunkStats.h
+    //
+    // hasChunkStats() returns true if the file records the
+    // number of samples and the depth range of each chunk.
+    //
+    // chunkStats(y) returns the statistics of the chunk that
+    // holds scan line y.  If the file does not record them,
+    // the statistics are unknown.
+    //
+    // chunksWithSamples() and chunksInDepthRange(z1, z2) return,
+    // in increasing order, the first scan line of each chunk
+    // that may hold samples, or samples whose depth range
+    // overlaps [z1, z2].  Reading the scan lines from
+    // firstScanLineInChunk(y) to lastScanLineInChunk(y) of only
+    // those chunks yields all such samples, without
+    // decompressing the other chunks.  If the file does not
+    // record the statistics, every chunk is returned.
+    //----------------------------------------------------------
+
+    IMF_EXPORT
+    bool hasChunkStats () const;
+
+    IMF_EXPORT
+    DeepChunkStats chunkStats (int y) const;
+
+    IMF_EXPORT
+    std::vector<int> chunksWithSamples () const;
+
+    IMF_EXPORT
+    std::vector<int> chunksInDepthRange (float zMin, float zMax) const;
+
 private:
     Context _ctxt;
     struct IMF_HIDDEN Data;
@@ -242,8 +299,11 @@ private:
 
     IMF_HIDDEN DeepScanLineInputFile (InputPartData* part);
 
+    IMF_HIDDEN uint64_t chunkTableFingerprint () const;
+
     friend class MultiPartInputFile;
     friend class InputFile;
+    friend class DeepSampleCountIndex;
 
     friend void DeepScanLineOutputFile::copyPixels (DeepScanLineInputFile&);
 };
@@ -116,4 +116,35 @@ DeepScanLineInputPart::readPixelSampleCounts (
         rawdata, frameBuffer, scanLine1, scanLine2);
 }
 
+void
+DeepScanLineInputPart::setSampleCountIndex (
+    std::shared_ptr<const DeepSampleCountIndex> index)
+{
+    file->setSampleCountIndex (index);
+}
+
+bool
+DeepScanLineInputPart::hasChunkStats () const
+{
+    return file->hasChunkStats ();
+}
+
+DeepChunkStats
+DeepScanLineInputPart::chunkStats (int y) const
+{
+    return file->chunkStats (y);
+}
+
+std::vector<int>
+DeepScanLineInputPart::chunksWithSamples () const
+{
+    return file->chunksWithSamples ();
+}
+
+std::vector<int>
+DeepScanLineInputPart::chunksInDepthRange (float zMin, float zMax) const
+{
+    return file->chunksInDepthRange (zMin, zMax);
+}
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
@@ -8,7 +8,11 @@
 
 #include "ImfForward.h"
 
+#include "ImfDeepChunkStats.h"
+
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
 
@@ -141,11 +145,24 @@ public:
         int                    scanLine1,
         int                    scanLine2) const;
 
+    IMF_EXPORT
+    void setSampleCountIndex (
+        std::shared_ptr<const DeepSampleCountIndex> index);
+
     IMF_EXPORT
     int firstScanLineInChunk (int y) const;
     IMF_EXPORT
     int lastScanLineInChunk (int y) const;
 
+    IMF_EXPORT
+    bool hasChunkStats () const;
+    IMF_EXPORT
+    DeepChunkStats chunkStats (int y) const;
+    IMF_EXPORT
+    std::vector<int> chunksWithSamples () const;
+    IMF_EXPORT
+    std::vector<int> chunksInDepthRange (float zMin, float zMax) const;
+
 private:
     DeepScanLineInputFile* file;
 
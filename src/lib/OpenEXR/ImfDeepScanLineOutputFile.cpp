@@ -15,6 +15,7 @@
 #include "ImfArray.h"
 #include "ImfChannelList.h"
 #include "ImfCompressor.h"
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepScanLineInputFile.h"
 #include "ImfDeepScanLineInputPart.h"
 #include "ImfDeepScanLineOutputFile.h"
@@ -22,6 +23,7 @@
 #include "ImfPartType.h"
 #include "ImfPreviewImageAttribute.h"
 #include "ImfStdIO.h"
+#include "ImfVersion.h"
 #include "ImfXdr.h"
 
 #include "Iex.h"
@@ -175,6 +177,11 @@ struct DeepScanLineOutputFile::Data
     uint64_t              lineOffsetsPosition; // file position for line
                                                // offset table
 
+    vector<DeepChunkStats> chunkStats;         // statistics of each chunk,
+                                               // if they are recorded
+    uint64_t               chunkStatsPosition; // file position for chunk
+                                               // statistics
+
     vector<LineBuffer*> lineBuffers;   // each holds one line buffer
     int                 linesInBuffer; // number of scanlines each
                                        // buffer holds
@@ -212,6 +219,7 @@ struct DeepScanLineOutputFile::Data
 
 DeepScanLineOutputFile::Data::Data (int numThreads)
     : lineOffsetsPosition (0)
+    , chunkStatsPosition (0)
     , partNumber (-1)
     , _streamData (NULL)
     , _deleteStream (false)
@@ -692,8 +700,9 @@ LineBufferTask::execute ()
         // Compress the pixel sample count table.
         //
 
-        char*    ptr           = _lineBuffer->sampleCountTableBuffer;
-        uint64_t tableDataSize = 0;
+        char*            ptr           = _lineBuffer->sampleCountTableBuffer;
+        uint64_t         tableDataSize = 0;
+        vector<uint64_t> lineSampleCounts;
         for (int i = _lineBuffer->minY; i <= _lineBuffer->maxY; i++)
         {
             int count = 0;
@@ -703,6 +712,7 @@ LineBufferTask::execute ()
                 Xdr::write<CharPtrIO> (ptr, count);
                 tableDataSize += sizeof (int);
             }
+            lineSampleCounts.push_back (count);
         }
 
         if (_lineBuffer->sampleCountTableCompressor)
@@ -727,6 +737,23 @@ LineBufferTask::execute ()
                 _lineBuffer->sampleCountTableBuffer;
         }
 
+        //
+        // Record the chunk's statistics before the sample data
+        // are compressed.
+        //
+
+        if (!_ofd->chunkStats.empty ())
+        {
+            _ofd->chunkStats
+                [(_lineBuffer->minY - _ofd->minY) / _ofd->linesInBuffer] =
+                computeDeepChunkStats (
+                    _lineBuffer->dataPtr,
+                    _lineBuffer->dataSize,
+                    _ofd->header.channels (),
+                    lineSampleCounts,
+                    _ofd->format);
+        }
+
         //
         // Compress the sample data
         //
@@ -809,8 +836,11 @@ DeepScanLineOutputFile::DeepScanLineOutputFile (
         // Write header and empty offset table to the file.
         writeMagicNumberAndVersionField (
             *_data->_streamData->os, _data->header);
-        _data->previewPosition =
-            _data->header.writeTo (*_data->_streamData->os);
+        _data->previewPosition = _data->header.writeTo (
+            *_data->_streamData->os,
+            false,
+            DeepChunkStats::ATTRIBUTE_NAME,
+            _data->chunkStatsPosition);
         _data->lineOffsetsPosition =
             writeLineOffsets (*_data->_streamData->os, _data->lineOffsets);
         _data->multipart = false; // not multipart; only one header
@@ -856,8 +886,11 @@ DeepScanLineOutputFile::DeepScanLineOutputFile (
         // Write header and empty offset table to the file.
         writeMagicNumberAndVersionField (
             *_data->_streamData->os, _data->header);
-        _data->previewPosition =
-            _data->header.writeTo (*_data->_streamData->os);
+        _data->previewPosition = _data->header.writeTo (
+            *_data->_streamData->os,
+            false,
+            DeepChunkStats::ATTRIBUTE_NAME,
+            _data->chunkStatsPosition);
         _data->lineOffsetsPosition =
             writeLineOffsets (*_data->_streamData->os, _data->lineOffsets);
         _data->multipart = false;
@@ -897,6 +930,7 @@ DeepScanLineOutputFile::DeepScanLineOutputFile (const OutputPartData* part)
         _data->partNumber          = part->partNumber;
         _data->lineOffsetsPosition = part->chunkOffsetTablePosition;
         _data->previewPosition     = part->previewPosition;
+        _data->chunkStatsPosition  = part->chunkStatsPosition;
         _data->multipart           = part->multipart;
     }
     catch (IEX_NAMESPACE::BaseExc& e)
@@ -950,6 +984,12 @@ DeepScanLineOutputFile::initialize (const Header& header)
 
     _data->header.setChunkCount (lineOffsetSize);
 
+    if (hasDeepChunkStats (_data->header))
+    {
+        addDeepChunkStats (_data->header);
+        _data->chunkStats.resize (lineOffsetSize);
+    }
+
     _data->lineOffsets.resize (lineOffsetSize);
 
     _data->bytesPerLine.resize (_data->maxY - _data->minY + 1);
@@ -986,6 +1026,14 @@ DeepScanLineOutputFile::~DeepScanLineOutputFile ()
                 _data->_streamData->os->seekp (_data->lineOffsetsPosition);
                 writeLineOffsets (*_data->_streamData->os, _data->lineOffsets);
 
+                if (_data->chunkStatsPosition > 0)
+                {
+                    setDeepChunkStats (_data->header, _data->chunkStats);
+                    _data->_streamData->os->seekp (_data->chunkStatsPosition);
+                    _data->header[DeepChunkStats::ATTRIBUTE_NAME].writeValueTo (
+                        *_data->_streamData->os, EXR_VERSION);
+                }
+
                 //
                 // Restore the original position.
                 //
@@ -1039,6 +1087,16 @@ DeepScanLineOutputFile::setFrameBuffer (const DeepFrameBuffer& frameBuffer)
     // is compatible with the image file header.
     //
 
+    if (frameBuffer.hasSampleOffsets ())
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Cannot write output file \""
+                << fileName ()
+                << "\" from a deep frame buffer using sample offsets; "
+                   "only per pixel sample pointers are supported.");
+    }
+
     const ChannelList& channels = _data->header.channels ();
 
     for (ChannelList::ConstIterator i = channels.begin (); i != channels.end ();
@@ -21,12 +21,14 @@
 
 #include "ImfDeepFrameBuffer.h"
 #include "ImfInputPartData.h"
+#include "ImfMisc.h"
 
 // TODO: remove once TiledOutput is converted
 #include "ImfTileOffsets.h"
 #include "ImfTiledMisc.h"
 
 #include <algorithm>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -71,6 +73,10 @@ struct TileProcess
     exr_chunk_info_t      cinfo;
     exr_decode_pipeline_t decoder;
 
+    // per channel line pointers when the frame buffer has a sample
+    // offset slice
+    std::vector<uint8_t*> line_ptrs;
+
     TileProcess*          next;
 };
 
@@ -136,6 +142,22 @@ struct DeepTiledInputFile::Data
     DeepFrameBuffer frameBuffer;
     std::vector<DeepSlice> fill_list;
 
+    std::vector<DeepChunkStats> chunkStats;
+    bool chunkStats_filled = false;
+
+    const std::vector<DeepChunkStats>& getChunkStats (const Header& hdr)
+    {
+#if ILMTHREAD_THREADING_ENABLED
+        std::lock_guard<std::mutex> lock (_mx);
+#endif
+        if (!chunkStats_filled)
+        {
+            chunkStats = deepChunkStats (hdr);
+            chunkStats_filled = true;
+        }
+        return chunkStats;
+    }
+
 #if ILMTHREAD_THREADING_ENABLED
     std::mutex _mx;
 
@@ -147,15 +169,21 @@ struct DeepTiledInputFile::Data
             Data*                   ifd,
             TileProcessGroup*       tileg,
             const DeepFrameBuffer*  outfb,
-            const exr_chunk_info_t& cinfo,
+            int                     tx,
+            int                     ty,
+            int                     lx,
+            int                     ly,
             bool                    countsOnly)
             : Task (group)
             , _outfb (outfb)
             , _ifd (ifd)
+            , _tx (tx)
+            , _ty (ty)
+            , _lx (lx)
+            , _ly (ly)
             , _tile (tileg->pop ())
             , _tile_group (tileg)
         {
-            _tile->cinfo = cinfo;
             _tile->counts_only = countsOnly;
         }
 
@@ -171,6 +199,10 @@ struct DeepTiledInputFile::Data
 
         const DeepFrameBuffer* _outfb;
         Data*                  _ifd;
+        int                    _tx;
+        int                    _ty;
+        int                    _lx;
+        int                    _ly;
 
         TileProcess*       _tile;
         TileProcessGroup*  _tile_group;
@@ -719,6 +751,122 @@ DeepTiledInputFile::readPixelSampleCounts (
     readPixelSampleCounts (dx1, dx2, dy1, dy2, l, l);
 }
 
+bool
+DeepTiledInputFile::hasChunkStats () const
+{
+    return !_data->getChunkStats (header ()).empty ();
+}
+
+DeepChunkStats
+DeepTiledInputFile::tileStats (int dx, int dy, int l) const
+{
+    return tileStats (dx, dy, l, l);
+}
+
+DeepChunkStats
+DeepTiledInputFile::tileStats (int dx, int dy, int lx, int ly) const
+{
+    if (!isValidTile (dx, dy, lx, ly))
+        throw IEX_NAMESPACE::ArgExc ("Arguments not in valid range.");
+
+    const std::vector<DeepChunkStats>& stats =
+        _data->getChunkStats (header ());
+
+    if (stats.empty ()) return DeepChunkStats ();
+
+    return stats[firstChunkInLevel (lx, ly) + dy * numXTiles (lx) + dx];
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputFile::tilesWithSamples (int l) const
+{
+    return tilesWithSamples (l, l);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputFile::tilesWithSamples (int lx, int ly) const
+{
+    return findTiles (lx, ly, false, 0, 0);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputFile::tilesInDepthRange (float zMin, float zMax, int l) const
+{
+    return tilesInDepthRange (zMin, zMax, l, l);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputFile::tilesInDepthRange (
+    float zMin, float zMax, int lx, int ly) const
+{
+    return findTiles (lx, ly, true, zMin, zMax);
+}
+
+int
+DeepTiledInputFile::firstChunkInLevel (int lx, int ly) const
+{
+    std::vector<int> xTiles (numXLevels ());
+    std::vector<int> yTiles (numYLevels ());
+
+    for (size_t i = 0; i < xTiles.size (); ++i)
+        xTiles[i] = numXTiles (static_cast<int> (i));
+
+    for (size_t i = 0; i < yTiles.size (); ++i)
+        yTiles[i] = numYTiles (static_cast<int> (i));
+
+    return tileChunkNumber (
+        levelMode (),
+        numXLevels (),
+        xTiles.data (),
+        yTiles.data (),
+        0,
+        0,
+        lx,
+        ly);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputFile::findTiles (
+    int lx, int ly, bool depthRange, float zMin, float zMax) const
+{
+    if (!isValidLevel (lx, ly))
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Level coordinate "
+            "(" << lx
+                << ", " << ly
+                << ") "
+                   "is invalid.");
+
+    const std::vector<DeepChunkStats>& stats =
+        _data->getChunkStats (header ());
+
+    int    xTiles = numXTiles (lx);
+    int    yTiles = numYTiles (ly);
+    size_t chunk  = stats.empty () ? 0 : firstChunkInLevel (lx, ly);
+
+    std::vector<IMATH_NAMESPACE::V2i> tiles;
+
+    for (int dy = 0; dy < yTiles; ++dy)
+    {
+        for (int dx = 0; dx < xTiles; ++dx, ++chunk)
+        {
+            if (!stats.empty ())
+            {
+                const DeepChunkStats& s = stats[chunk];
+
+                if (depthRange ? !s.intersects (zMin, zMax)
+                               : !s.hasSamples ())
+                    continue;
+            }
+
+            tiles.push_back (IMATH_NAMESPACE::V2i (dx, dy));
+        }
+    }
+
+    return tiles;
+}
+
 size_t
 DeepTiledInputFile::totalTiles () const
 {
@@ -918,24 +1066,16 @@ void DeepTiledInputFile::Data::readTiles (
         {
             ILMTHREAD_NAMESPACE::TaskGroup tg;
 
+            // the tasks look up their own chunk information so any
+            // chunk table / leader reads overlap decoding rather
+            // than delaying dispatch
             for (int ty = dy1; ty <= dy2; ++ty)
             {
                 for (int tx = dx1; tx <= dx2; ++tx)
                 {
-                    exr_result_t rv = exr_read_tile_chunk_info (
-                        *_ctxt, partNumber, tx, ty, lx, ly, &cinfo);
-                    if (EXR_ERR_INCOMPLETE_CHUNK_TABLE == rv)
-                    {
-                        THROW (
-                            IEX_NAMESPACE::InputExc,
-                            "Tile (" << tx << ", " << ty << ", " << lx << ", " << ly
-                            << ") is missing.");
-                    }
-                    else if (EXR_ERR_SUCCESS != rv)
-                        throw IEX_NAMESPACE::InputExc ("Unable to query tile information");
-
                     ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (
-                        new TileBufferTask (&tg, this, &tpg, &frameBuffer, cinfo, countsOnly) );
+                        new TileBufferTask (
+                            &tg, this, &tpg, &frameBuffer, tx, ty, lx, ly, countsOnly) );
                 }
             }
         }
@@ -982,6 +1122,28 @@ void DeepTiledInputFile::Data::TileBufferTask::execute ()
 {
     try
     {
+        exr_result_t rv = exr_read_tile_chunk_info (
+            *(_ifd->_ctxt),
+            _ifd->partNumber,
+            _tx,
+            _ty,
+            _lx,
+            _ly,
+            &(_tile->cinfo));
+        if (EXR_ERR_INCOMPLETE_CHUNK_TABLE == rv)
+        {
+            std::stringstream msg;
+            msg << "Tile (" << _tx << ", " << _ty << ", " << _lx << ", "
+                << _ly << ") is missing.";
+            _tile_group->record_missing (msg.str ().c_str ());
+            return;
+        }
+        else if (EXR_ERR_SUCCESS != rv)
+        {
+            _tile_group->record_missing ("Unable to query tile information");
+            return;
+        }
+
         _tile->run_decode (
             *(_ifd->_ctxt),
             _ifd->partNumber,
@@ -1049,6 +1211,17 @@ void TileProcess::run_decode (
     else
         decoder.decode_flags = decoder.decode_flags & ~EXR_DECODE_SAMPLE_DATA_ONLY;
 
+    if (outfb->hasSampleOffsets ())
+    {
+        decoder.decode_flags &= ~EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS;
+        decoder.decode_flags |= EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS;
+    }
+    else
+    {
+        decoder.decode_flags &= ~EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS;
+        decoder.decode_flags |= EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS;
+    }
+
     update_pointers (outfb, dw.min.x, dw.min.y, absX, absY);
 
     if (flags != decoder.decode_flags)
@@ -1084,6 +1257,14 @@ void TileProcess::update_pointers (const DeepFrameBuffer *outfb, int fb_absX, in
     decoder.user_line_begin_skip = 0;
     decoder.user_line_end_ignore = 0;
 
+    if (counts_only)
+        return;
+
+    const Slice& offsets = outfb->getSampleOffsetSlice ();
+
+    if (offsets.base)
+        line_ptrs.resize (size_t (decoder.channel_count) * size_t (cinfo.height));
+
     for (int c = 0; c < decoder.channel_count; ++c)
     {
         exr_coding_channel_info_t& curchan = decoder.channels[c];
@@ -1103,6 +1284,33 @@ void TileProcess::update_pointers (const DeepFrameBuffer *outfb, int fb_absX, in
         if (fbslice->xSampling != 1 || fbslice->ySampling != 1)
             throw IEX_NAMESPACE::ArgExc ("Tiled data should not have subsampling.");
 
+        if (offsets.base)
+        {
+            // a row of the tile is contiguous in the channel's sample
+            // block, starting at the offset of its first pixel
+            int xOffset = offsets.xTileCoords ? 0 : t_absX;
+            int yOffset = offsets.yTileCoords ? 0 : t_absY;
+
+            uint8_t** lp = line_ptrs.data () + size_t (c) * size_t (cinfo.height);
+            for (int l = 0; l < cinfo.height; ++l)
+            {
+                const char* op = offsets.base;
+                op += int64_t (xOffset) * int64_t (offsets.xStride);
+                op += (int64_t (yOffset) + l) * int64_t (offsets.yStride);
+
+                lp[l] = reinterpret_cast<uint8_t*> (fbslice->base) +
+                        *reinterpret_cast<const uint64_t*> (op) *
+                            uint64_t (fbslice->sampleStride);
+            }
+
+            curchan.user_bytes_per_element = fbslice->sampleStride;
+            curchan.user_data_type    = (exr_pixel_type_t)fbslice->type;
+            curchan.user_pixel_stride = 0;
+            curchan.user_line_stride  = sizeof (uint8_t*);
+            curchan.decode_to_ptr     = reinterpret_cast<uint8_t*> (lp);
+            continue;
+        }
+
         int xOffset = fbslice->xTileCoords ? 0 : t_absX;
         int yOffset = fbslice->yTileCoords ? 0 : t_absY;
 
@@ -1125,6 +1333,8 @@ void TileProcess::run_fill (
     const DeepFrameBuffer *outfb, int fb_absX, int fb_absY, int t_absX, int t_absY,
     const std::vector<DeepSlice> &filllist)
 {
+    const Slice& offsets = outfb->getSampleOffsetSlice ();
+
     for (auto& fills: filllist)
     {
         uint8_t* ptr;
@@ -1132,6 +1342,33 @@ void TileProcess::run_fill (
         if (fills.xSampling != 1 || fills.ySampling != 1)
             throw IEX_NAMESPACE::ArgExc ("Tiled data should not have subsampling.");
 
+        if (offsets.base)
+        {
+            int xOffset = offsets.xTileCoords ? 0 : t_absX;
+            int yOffset = offsets.yTileCoords ? 0 : t_absY;
+
+            for ( int start = 0; start < cinfo.height; ++start )
+            {
+                const int32_t* counts = decoder.sample_count_table;
+                counts += (int64_t) start * (int64_t) cinfo.width;
+
+                int64_t samps = 0;
+                for ( int sx = 0; sx < cinfo.width; ++sx )
+                    samps += counts[sx];
+
+                const char* op = offsets.base;
+                op += int64_t (xOffset) * int64_t (offsets.xStride);
+                op += (int64_t (yOffset) + start) * int64_t (offsets.yStride);
+
+                fillDeepSampleBlock (
+                    fills.base + *reinterpret_cast<const uint64_t*> (op) *
+                                     uint64_t (fills.sampleStride),
+                    fills,
+                    samps);
+            }
+            continue;
+        }
+
         int xOffset = fills.xTileCoords ? 0 : t_absX;
         int yOffset = fills.yTileCoords ? 0 : t_absY;
 
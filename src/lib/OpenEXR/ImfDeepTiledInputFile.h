@@ -18,12 +18,16 @@
 
 #include "ImfContext.h"
 
+#include "ImfDeepChunkStats.h"
+
 #include "ImfThreading.h"
 
 #include "ImfTileDescription.h"
 
 #include <Imath/ImathBox.h>
 
+#include <vector>
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
 
 class IMF_EXPORT_TYPE DeepTiledInputFile
@@ -379,6 +383,47 @@ public:
     IMF_EXPORT
     void readPixelSampleCounts (int dx1, int dx2, int dy1, int dy2, int l = 0);
 
+    //------------------------------------------------------------------
+    // Per-tile statistics; see ImfDeepChunkStats.h
+    //
+    // hasChunkStats() returns true if the file records the number of
+    // samples and the depth range of each tile.
+    //
+    // tileStats(dx, dy, lx, ly) returns the statistics of tile
+    // (dx, dy) on level (lx, ly).  If the file does not record them,
+    // the statistics are unknown.
+    //
+    // tilesWithSamples(lx, ly) and tilesInDepthRange(z1, z2, lx, ly)
+    // return the tile coordinates (dx, dy) of the tiles on level
+    // (lx, ly) that may hold samples, or samples whose depth range
+    // overlaps [z1, z2], in scan line order.  Reading only those tiles
+    // with readTile() yields all such samples, without decompressing
+    // the other tiles.  If the file does not record the statistics,
+    // every tile on the level is returned.
+    //
+    // The versions with a single level number l use lx = ly = l.
+    //------------------------------------------------------------------
+
+    IMF_EXPORT
+    bool hasChunkStats () const;
+
+    IMF_EXPORT
+    DeepChunkStats tileStats (int dx, int dy, int l = 0) const;
+    IMF_EXPORT
+    DeepChunkStats tileStats (int dx, int dy, int lx, int ly) const;
+
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i> tilesWithSamples (int l = 0) const;
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i> tilesWithSamples (int lx, int ly) const;
+
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i>
+    tilesInDepthRange (float zMin, float zMax, int l = 0) const;
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i>
+    tilesInDepthRange (float zMin, float zMax, int lx, int ly) const;
+
 private:
     Context _ctxt;
     struct IMF_HIDDEN Data;
@@ -393,6 +438,11 @@ private:
 
     void getTileOrder (int dx[], int dy[], int lx[], int ly[]) const;
 
+    int firstChunkInLevel (int lx, int ly) const;
+
+    std::vector<IMATH_NAMESPACE::V2i>
+    findTiles (int lx, int ly, bool depthRange, float zMin, float zMax) const;
+
     friend class InputFile;
     friend class MultiPartInputFile;
 
@@ -207,4 +207,47 @@ DeepTiledInputPart::readPixelSampleCounts (
     file->readPixelSampleCounts (dx1, dx2, dy1, dy2, l);
 }
 
+bool
+DeepTiledInputPart::hasChunkStats () const
+{
+    return file->hasChunkStats ();
+}
+
+DeepChunkStats
+DeepTiledInputPart::tileStats (int dx, int dy, int l) const
+{
+    return file->tileStats (dx, dy, l);
+}
+
+DeepChunkStats
+DeepTiledInputPart::tileStats (int dx, int dy, int lx, int ly) const
+{
+    return file->tileStats (dx, dy, lx, ly);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputPart::tilesWithSamples (int l) const
+{
+    return file->tilesWithSamples (l);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputPart::tilesWithSamples (int lx, int ly) const
+{
+    return file->tilesWithSamples (lx, ly);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputPart::tilesInDepthRange (float zMin, float zMax, int l) const
+{
+    return file->tilesInDepthRange (zMin, zMax, l);
+}
+
+std::vector<IMATH_NAMESPACE::V2i>
+DeepTiledInputPart::tilesInDepthRange (
+    float zMin, float zMax, int lx, int ly) const
+{
+    return file->tilesInDepthRange (zMin, zMax, lx, ly);
+}
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
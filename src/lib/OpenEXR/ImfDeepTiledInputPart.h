@@ -8,10 +8,12 @@
 
 #include "ImfForward.h"
 
+#include "ImfDeepChunkStats.h"
 #include "ImfTileDescription.h"
 
 #include <cstdint>
 #include <Imath/ImathBox.h>
+#include <vector>
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
 
@@ -334,6 +336,30 @@ public:
     IMF_EXPORT
     void readPixelSampleCounts (int dx1, int dx2, int dy1, int dy2, int l = 0);
 
+    //------------------------------------------------------------------
+    // Per-tile statistics; see DeepTiledInputFile
+    //------------------------------------------------------------------
+
+    IMF_EXPORT
+    bool hasChunkStats () const;
+
+    IMF_EXPORT
+    DeepChunkStats tileStats (int dx, int dy, int l = 0) const;
+    IMF_EXPORT
+    DeepChunkStats tileStats (int dx, int dy, int lx, int ly) const;
+
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i> tilesWithSamples (int l = 0) const;
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i> tilesWithSamples (int lx, int ly) const;
+
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i>
+    tilesInDepthRange (float zMin, float zMax, int l = 0) const;
+    IMF_EXPORT
+    std::vector<IMATH_NAMESPACE::V2i>
+    tilesInDepthRange (float zMin, float zMax, int lx, int ly) const;
+
 private:
     DeepTiledInputFile* file;
 
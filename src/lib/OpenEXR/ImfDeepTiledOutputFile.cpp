@@ -14,6 +14,7 @@
 #include "ImfArray.h"
 #include "ImfChannelList.h"
 #include "ImfCompressor.h"
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepFrameBuffer.h"
 #include "ImfDeepTiledInputFile.h"
 #include "ImfDeepTiledInputPart.h"
@@ -250,6 +251,10 @@ struct DeepTiledOutputFile::Data
 
     uint64_t tileOffsetsPosition; // position of the tile index
 
+    vector<DeepChunkStats> chunkStats;         // statistics of each tile,
+                                               // if they are recorded
+    uint64_t               chunkStatsPosition; // position of the statistics
+
     TileMap   tileMap; // the map of buffered tiles
     TileCoord nextTileToWrite;
 
@@ -291,6 +296,7 @@ DeepTiledOutputFile::Data::Data (int numThreads)
     : numXTiles (0)
     , numYTiles (0)
     , tileOffsetsPosition (0)
+    , chunkStatsPosition (0)
     , partNumber (-1)
     , _streamData (NULL)
     , _deleteStream (true)
@@ -941,8 +947,9 @@ TileBufferTask::execute ()
         // Compress the pixel sample count table.
         //
 
-        char*    ptr           = _tileBuffer->sampleCountTableBuffer;
-        uint64_t tableDataSize = 0;
+        char*            ptr           = _tileBuffer->sampleCountTableBuffer;
+        uint64_t         tableDataSize = 0;
+        vector<uint64_t> lineSampleCounts;
         for (int i = tileRange.min.y; i <= tileRange.max.y; i++)
         {
             int count = 0;
@@ -953,6 +960,7 @@ TileBufferTask::execute ()
                 Xdr::write<CharPtrIO> (ptr, count);
                 tableDataSize += sizeof (int);
             }
+            lineSampleCounts.push_back (count);
         }
 
         if (_tileBuffer->sampleCountTableCompressor)
@@ -986,6 +994,27 @@ TileBufferTask::execute ()
         _tileBuffer->uncompressedSize = _tileBuffer->dataSize;
         _tileBuffer->dataPtr          = _tileBuffer->buffer;
 
+        if (!_ofd->chunkStats.empty ())
+        {
+            const TileCoord& t = _tileBuffer->tileCoord;
+
+            _ofd->chunkStats[tileChunkNumber (
+                _ofd->tileDesc.mode,
+                _ofd->numXLevels,
+                _ofd->numXTiles,
+                _ofd->numYTiles,
+                t.dx,
+                t.dy,
+                t.lx,
+                t.ly)] =
+                computeDeepChunkStats (
+                    _tileBuffer->dataPtr,
+                    _tileBuffer->dataSize,
+                    _ofd->header.channels (),
+                    lineSampleCounts,
+                    _ofd->format);
+        }
+
         // (TODO) don't do this all the time.
         if (_tileBuffer->compressor != 0) delete _tileBuffer->compressor;
         _tileBuffer->compressor = newTileCompressor (
@@ -1062,8 +1091,11 @@ DeepTiledOutputFile::DeepTiledOutputFile (
         // Write header and empty offset table to the file.
         writeMagicNumberAndVersionField (
             *_data->_streamData->os, _data->header);
-        _data->previewPosition =
-            _data->header.writeTo (*_data->_streamData->os, true);
+        _data->previewPosition = _data->header.writeTo (
+            *_data->_streamData->os,
+            true,
+            DeepChunkStats::ATTRIBUTE_NAME,
+            _data->chunkStatsPosition);
         _data->tileOffsetsPosition =
             _data->tileOffsets.writeTo (*_data->_streamData->os);
         _data->multipart = false;
@@ -1112,8 +1144,11 @@ DeepTiledOutputFile::DeepTiledOutputFile (
         // Write header and empty offset table to the file.
         writeMagicNumberAndVersionField (
             *_data->_streamData->os, _data->header);
-        _data->previewPosition =
-            _data->header.writeTo (*_data->_streamData->os, true);
+        _data->previewPosition = _data->header.writeTo (
+            *_data->_streamData->os,
+            true,
+            DeepChunkStats::ATTRIBUTE_NAME,
+            _data->chunkStatsPosition);
         _data->tileOffsetsPosition =
             _data->tileOffsets.writeTo (*_data->_streamData->os);
         _data->multipart = false;
@@ -1156,6 +1191,7 @@ DeepTiledOutputFile::DeepTiledOutputFile (const OutputPartData* part)
         _data->partNumber          = part->partNumber;
         _data->tileOffsetsPosition = part->chunkOffsetTablePosition;
         _data->previewPosition     = part->previewPosition;
+        _data->chunkStatsPosition  = part->chunkStatsPosition;
         _data->multipart           = part->multipart;
     }
     catch (IEX_NAMESPACE::BaseExc& e)
@@ -1257,6 +1293,12 @@ DeepTiledOutputFile::initialize (const Header& header)
     //ignore the existing value of chunkCount - correct it if it's wrong
     _data->header.setChunkCount (getChunkOffsetTableSize (_data->header));
 
+    if (hasDeepChunkStats (_data->header))
+    {
+        addDeepChunkStats (_data->header);
+        _data->chunkStats.resize (_data->header.chunkCount ());
+    }
+
     for (size_t i = 0; i < _data->tileBuffers.size (); i++)
     {
         _data->tileBuffers[i] = new TileBuffer ();
@@ -1291,6 +1333,16 @@ DeepTiledOutputFile::~DeepTiledOutputFile ()
                     _data->_streamData->os->seekp (_data->tileOffsetsPosition);
                     _data->tileOffsets.writeTo (*_data->_streamData->os);
 
+                    if (_data->chunkStatsPosition > 0)
+                    {
+                        setDeepChunkStats (_data->header, _data->chunkStats);
+                        _data->_streamData->os->seekp (
+                            _data->chunkStatsPosition);
+                        _data->header[DeepChunkStats::ATTRIBUTE_NAME]
+                            .writeValueTo (
+                                *_data->_streamData->os, EXR_VERSION);
+                    }
+
                     //
                     // Restore the original position.
                     //
@@ -1347,6 +1399,16 @@ DeepTiledOutputFile::setFrameBuffer (const DeepFrameBuffer& frameBuffer)
     // is compatible with the image file header.
     //
 
+    if (frameBuffer.hasSampleOffsets ())
+    {
+        THROW (
+            IEX_NAMESPACE::ArgExc,
+            "Cannot write output file \""
+                << fileName ()
+                << "\" from a deep frame buffer using sample offsets; "
+                   "only per pixel sample pointers are supported.");
+    }
+
     const ChannelList& channels = _data->header.channels ();
 
     for (ChannelList::ConstIterator i = channels.begin (); i != channels.end ();
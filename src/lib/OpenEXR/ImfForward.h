@@ -39,6 +39,7 @@ class IMF_EXPORT_TYPE DeepScanLineInputFile;
 class IMF_EXPORT_TYPE DeepScanLineOutputFile;
 class IMF_EXPORT_TYPE DeepTiledInputFile;
 class IMF_EXPORT_TYPE DeepTiledOutputFile;
+class IMF_EXPORT_TYPE DeepSampleCountIndex;
 class OPENEXR_DEPRECATED ("AcesInputFile is deprecated")
     IMF_EXPORT_TYPE AcesInputFile;
 class OPENEXR_DEPRECATED ("AcesOutputFile is deprecated")
@@ -75,6 +76,7 @@ struct InputStreamMutex;
 class IMF_EXPORT_TYPE  FrameBuffer;
 class IMF_EXPORT_TYPE  DeepFrameBuffer;
 struct IMF_EXPORT_TYPE DeepSlice;
+struct IMF_EXPORT_TYPE DeepChunkStats;
 
 // compositing
 class IMF_EXPORT_TYPE DeepCompositing;
@@ -1300,6 +1300,17 @@ Header::readsNothing ()
 uint64_t
 Header::writeTo (
     OPENEXR_IMF_INTERNAL_NAMESPACE::OStream& os, bool isTiled) const
+{
+    uint64_t attributePosition;
+    return writeTo (os, isTiled, 0, attributePosition);
+}
+
+uint64_t
+Header::writeTo (
+    OPENEXR_IMF_INTERNAL_NAMESPACE::OStream& os,
+    bool                                     isTiled,
+    const char                               attributeName[],
+    uint64_t&                                attributePosition) const
 {
     //
     // Write a "magic number" to identify the file as an image file.
@@ -1318,6 +1329,16 @@ Header::writeTo (
     const Attribute* preview =
         findTypedAttribute<PreviewImageAttribute> ("preview");
 
+    const Attribute* attribute = 0;
+
+    if (attributeName)
+    {
+        ConstIterator a = find (attributeName);
+        if (a != end ()) attribute = &a.attribute ();
+    }
+
+    attributePosition = 0;
+
     for (ConstIterator i = begin (); i != end (); ++i)
     {
         //
@@ -1343,6 +1364,7 @@ Header::writeTo (
             OPENEXR_IMF_INTERNAL_NAMESPACE::StreamIO> (os, (int) s.length ());
 
         if (&i.attribute () == preview) previewPosition = os.tellp ();
+        if (&i.attribute () == attribute) attributePosition = os.tellp ();
 
         os.write (s.data (), int (s.length ()));
     }
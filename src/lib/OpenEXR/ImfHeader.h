@@ -466,6 +466,11 @@ public:
     // information is used by OutputFile::updatePreviewImage().
     // If the header contains no preview image attribute, then writeTo()
     // returns 0.
+    //
+    // writeTo(os, isTiled, name, position) also stores in position the
+    // position of the value of attribute name in the output stream, or
+    // 0 if the header contains no such attribute.  Deep output files use
+    // this to fill in the deepChunkStats attribute when they are closed.
     //------------------------------------------------------------------
 
     IMF_EXPORT
@@ -473,6 +478,13 @@ public:
         OPENEXR_IMF_INTERNAL_NAMESPACE::OStream& os,
         bool                                     isTiled = false) const;
 
+    IMF_EXPORT
+    uint64_t writeTo (
+        OPENEXR_IMF_INTERNAL_NAMESPACE::OStream& os,
+        bool                                     isTiled,
+        const char                               attributeName[],
+        uint64_t&                                attributePosition) const;
+
     IMF_EXPORT
     void readFrom (OPENEXR_IMF_INTERNAL_NAMESPACE::IStream& is, int& version);
 
@@ -11,10 +11,14 @@
 
 #include "ImfNamespace.h"
 #include "Iex.h"
+#include "IlmThreadPool.h"
 #include "ImfAttribute.h"
 #include "ImfChannelList.h"
 #include "ImfCompressor.h"
 #include "ImfConvert.h"
+#include "ImfDeepChunkStats.h"
+#include "ImfDeepFrameBuffer.h"
+#include "ImfFrameBuffer.h"
 #include "ImfHeader.h"
 #include "ImfMisc.h"
 #include "ImfPartType.h"
@@ -23,7 +27,10 @@
 #include "ImfXdr.h"
 #include <Imath/ImathFun.h>
 
+#include <cmath>
 #include <codecvt>
+#include <cstring>
+#include <limits>
 #include <locale>
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
@@ -1912,6 +1919,164 @@ fillChannelWithZeroes (
     }
 }
 
+void
+fillDeepSampleBlock (char* dest, const DeepSlice& fills, int64_t count)
+{
+    switch (fills.type)
+    {
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::UINT:
+        {
+            unsigned int fillVal = (unsigned int) (fills.fillValue);
+            for (int64_t s = 0; s < count; ++s, dest += fills.sampleStride)
+                *reinterpret_cast<unsigned int*> (dest) = fillVal;
+            break;
+        }
+
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::HALF:
+        {
+            half fillVal = half (fills.fillValue);
+            for (int64_t s = 0; s < count; ++s, dest += fills.sampleStride)
+                *reinterpret_cast<half*> (dest) = fillVal;
+            break;
+        }
+
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::FLOAT:
+        {
+            float fillVal = float (fills.fillValue);
+            for (int64_t s = 0; s < count; ++s, dest += fills.sampleStride)
+                *reinterpret_cast<float*> (dest) = fillVal;
+            break;
+        }
+        default:
+            throw IEX_NAMESPACE::ArgExc ("Unknown pixel data type.");
+    }
+}
+
+namespace
+{
+
+template <class T>
+float
+depthValue (const char* ptr, Compressor::Format format)
+{
+    T value;
+
+    if (format == Compressor::XDR)
+        Xdr::read<CharPtrIO> (ptr, value);
+    else
+        memcpy (&value, ptr, sizeof (value));
+
+    return static_cast<float> (value);
+}
+
+float
+depthValue (const char* ptr, Compressor::Format format, PixelType type)
+{
+    switch (type)
+    {
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::UINT:
+            return depthValue<unsigned int> (ptr, format);
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::HALF:
+            return depthValue<half> (ptr, format);
+        case OPENEXR_IMF_INTERNAL_NAMESPACE::FLOAT:
+            return depthValue<float> (ptr, format);
+        default: throw IEX_NAMESPACE::ArgExc ("Unknown pixel data type.");
+    }
+}
+
+} // namespace
+
+DeepChunkStats
+computeDeepChunkStats (
+    const char*             data,
+    uint64_t                dataSize,
+    const ChannelList&      channels,
+    const vector<uint64_t>& lineSampleCounts,
+    Compressor::Format      format)
+{
+    const float inf = std::numeric_limits<float>::infinity ();
+
+    DeepChunkStats stats (0, inf, -inf);
+
+    const Channel* z     = channels.findChannel ("Z");
+    const Channel* zBack = channels.findChannel ("ZBack");
+
+    const char* ptr = data;
+    const char* end = data + dataSize;
+
+    for (size_t i = 0; i < lineSampleCounts.size (); ++i)
+    {
+        uint64_t n = lineSampleCounts[i];
+
+        stats.sampleCount += n;
+
+        if (n > 0 && !z)
+        {
+            stats.minZ = -inf;
+            stats.maxZ = inf;
+        }
+
+        for (ChannelList::ConstIterator c = channels.begin ();
+             c != channels.end ();
+             ++c)
+        {
+            PixelType type = c.channel ().type;
+            uint64_t  size = n * pixelTypeSize (type);
+
+            if (size > static_cast<uint64_t> (end - ptr))
+            {
+                //
+                // The buffer does not have the expected layout;
+                // don't guess.
+                //
+
+                return DeepChunkStats ();
+            }
+
+            bool front = &c.channel () == z;
+            bool back  = &c.channel () == (zBack ? zBack : z);
+
+            for (uint64_t j = 0; (front || back) && j < n; ++j)
+            {
+                float d = depthValue (
+                    ptr + j * pixelTypeSize (type), format, type);
+
+                if (std::isnan (d))
+                {
+                    stats.minZ = -inf;
+                    stats.maxZ = inf;
+                    break;
+                }
+
+                if (front && d < stats.minZ) stats.minZ = d;
+                if (back && d > stats.maxZ) stats.maxZ = d;
+            }
+
+            ptr += size;
+        }
+    }
+
+    return stats;
+}
+
+int
+frameBufferNumaNode (const FrameBuffer& frameBuffer, int x, int y)
+{
+    if (ILMTHREAD_NAMESPACE::ThreadPool::numNumaNodes () < 2) return -1;
+
+    FrameBuffer::ConstIterator i = frameBuffer.begin ();
+    if (i == frameBuffer.end () || !i.slice ().base) return -1;
+
+    const Slice& s  = i.slice ();
+    intptr_t     xp = s.xTileCoords ? 0 : x;
+    intptr_t     yp = s.yTileCoords ? 0 : y;
+
+    const char* ptr = s.base + (xp / s.xSampling) * intptr_t (s.xStride) +
+                      (yp / s.ySampling) * intptr_t (s.yStride);
+
+    return ILMTHREAD_NAMESPACE::ThreadPool::numaNodeOfAddress (ptr);
+}
+
 bool
 usesLongNames (const Header& header)
 {
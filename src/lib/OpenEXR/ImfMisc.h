@@ -420,9 +420,57 @@ IMF_EXPORT
 void fillChannelWithZeroes (
     char*& writePtr, Compressor::Format format, PixelType type, size_t xSize);
 
+//
+// Fill count samples of a deep slice with the slice's fill value.
+// The samples start at dest and are fills.sampleStride bytes apart.
+//
+
+IMF_EXPORT
+void fillDeepSampleBlock (char* dest, const DeepSlice& fills, int64_t count);
+
+//
+// Compute the statistics of a chunk of a deep output file from the
+// contents of its line buffer or tile buffer; see ImfDeepChunkStats.h.
+// If the buffer is shorter than the sample counts imply, the
+// statistics are unknown.
+//
+//    data, dataSize    the data in the line or tile buffer, in the
+//                      layout produced by copyFromDeepFrameBuffer()
+//                      and fillChannelWithZeroes(): for each scan
+//                      line, the samples of each channel in turn.
+//
+//    channels          the channels in the output file.
+//
+//    lineSampleCounts  the number of samples in each scan line of
+//                      the chunk.
+//
+//    format            indicates if the line or tile buffer is
+//                      in NATIVE or XDR format.
+//
+
+IMF_EXPORT
+DeepChunkStats computeDeepChunkStats (
+    const char*                  data,
+    uint64_t                     dataSize,
+    const ChannelList&           channels,
+    const std::vector<uint64_t>& lineSampleCounts,
+    Compressor::Format           format);
+
 IMF_EXPORT
 bool usesLongNames (const Header& header);
 
+//
+// Return the NUMA node holding the memory the first slice of a
+// frame buffer would receive pixel (x, y) in, or -1 if that is not
+// known or the machine has a single node. Used to hint the decode
+// tasks to run near their destination. (x, y) is the first pixel
+// of a chunk, in the coordinates of the chunk's level; slices with
+// tile coordinates put that pixel at their origin.
+//
+
+IMF_EXPORT
+int frameBufferNumaNode (const FrameBuffer& frameBuffer, int x, int y);
+
 //
 // compute size of chunk offset table - for existing types, computes
 // the chunk size from the image size, compression type, and tile
@@ -6,6 +6,7 @@
 #include "ImfMultiPartOutputFile.h"
 #include "ImfBoxAttribute.h"
 #include "ImfChromaticitiesAttribute.h"
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepScanLineOutputFile.h"
 #include "ImfDeepTiledOutputFile.h"
 #include "ImfFloatAttribute.h"
@@ -154,6 +155,20 @@ MultiPartOutputFile::Data::do_header_sanity_checks (
             _headers[0].setChunkCount (getChunkOffsetTableSize (_headers[0]));
         }
     }
+
+    //
+    // Make room for the statistics of every chunk in the deep parts
+    // that record them; the parts fill them in when they are closed.
+    //
+
+    for (size_t i = 0; i < parts; i++)
+    {
+        if (_headers[i].hasType () && isDeepData (_headers[i].type ()) &&
+            hasDeepChunkStats (_headers[i]))
+        {
+            addDeepChunkStats (_headers[i]);
+        }
+    }
 }
 
 MultiPartOutputFile::MultiPartOutputFile (
@@ -471,10 +486,11 @@ MultiPartOutputFile::Data::writeHeadersToFile (const vector<Header>& headers)
     {
 
         // (TODO) consider deep files' preview images here.
-        if (headers[i].type () == TILEDIMAGE)
-            parts[i]->previewPosition = headers[i].writeTo (*os, true);
-        else
-            parts[i]->previewPosition = headers[i].writeTo (*os, false);
+        parts[i]->previewPosition = headers[i].writeTo (
+            *os,
+            headers[i].type () == TILEDIMAGE,
+            DeepChunkStats::ATTRIBUTE_NAME,
+            parts[i]->chunkStatsPosition);
     }
 
     //
@@ -19,8 +19,10 @@
 #    include <mutex>
 #endif
 
+#include "ImfChunkCacheDecode.h"
 #include "ImfFrameBuffer.h"
 #include "ImfInputPartData.h"
+#include "ImfMisc.h"
 
 #include <vector>
 
@@ -42,7 +44,8 @@ struct ScanLineProcess
         const FrameBuffer *outfb,
         int fbY,
         int fbLastY,
-        const std::vector<Slice> &filllist);
+        const std::vector<Slice> &filllist,
+        ChunkCacheFile &cacheFile);
 
     void run_unpack (
         exr_const_context_t ctxt,
@@ -125,6 +128,7 @@ struct ScanLineInputFile::Data
 
     FrameBuffer frameBuffer;
     std::vector<Slice> fill_list;
+    ChunkCacheFile cacheFile;
 
 #if ILMTHREAD_THREADING_ENABLED
     std::mutex _mx;
@@ -137,7 +141,6 @@ struct ScanLineInputFile::Data
             Data*                   ifd,
             ScanLineProcessGroup*   lineg,
             const FrameBuffer*      outfb,
-            const exr_chunk_info_t& cinfo,
             int                     fby,
             int                     endScan)
             : Task (group)
@@ -148,7 +151,6 @@ struct ScanLineInputFile::Data
             , _line (lineg->pop ())
             , _line_group (lineg)
         {
-            _line->cinfo = cinfo;
         }
 
         ~LineBufferTask () override
@@ -457,15 +459,20 @@ void ScanLineInputFile::Data::readPixels (
         {
             ILMTHREAD_NAMESPACE::TaskGroup tg;
 
-            for (int y = scanLine1; y <= scanLine2; )
+            // the chunk information is looked up by the tasks
+            // themselves, so the (potentially I/O bound) chunk table
+            // and leader reads overlap decoding of other chunks
+            // instead of delaying dispatch, and chunk boundaries are
+            // computed from the data window here
+            for (int64_t y = scanLine1; y <= scanLine2; )
             {
-                if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (*_ctxt, partNumber, y, &cinfo))
-                    throw IEX_NAMESPACE::InputExc ("Unable to query scanline information");
-
-                ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (
-                    new LineBufferTask (&tg, this, &sg, &fb, cinfo, y, scanLine2) );
+                LineBufferTask* task = new LineBufferTask (
+                    &tg, this, &sg, &fb, static_cast<int> (y), scanLine2);
+                task->setPreferredNode (
+                    frameBufferNumaNode (fb, dw.min.x, static_cast<int> (y)));
+                ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (task);
 
-                y += scansperchunk - (y - cinfo.start_y);
+                y += scansperchunk - ((y - dw.min.y) % scansperchunk);
             }
         }
 
@@ -504,7 +511,8 @@ void ScanLineInputFile::Data::readPixels (
                     &fb,
                     y,
                     scanLine2,
-                    fill_list);
+                    fill_list,
+                    cacheFile);
             }
 
             y += scansperchunk - (y - cinfo.start_y);
@@ -521,13 +529,21 @@ void ScanLineInputFile::Data::LineBufferTask::execute ()
 {
     try
     {
+        if (EXR_ERR_SUCCESS != exr_read_scanline_chunk_info (
+                *(_ifd->_ctxt), _ifd->partNumber, _fby, &(_line->cinfo)))
+        {
+            _line_group->record_missing ("Unable to query scanline information");
+            return;
+        }
+
         _line->run_decode (
             *(_ifd->_ctxt),
             _ifd->partNumber,
             _outfb,
             _fby,
             _last_fby,
-            _ifd->fill_list);
+            _ifd->fill_list,
+            _ifd->cacheFile);
     }
     catch (std::exception &e)
     {
@@ -548,7 +564,8 @@ void ScanLineProcess::run_decode (
     const FrameBuffer *outfb,
     int fbY,
     int fbLastY,
-    const std::vector<Slice> &filllist)
+    const std::vector<Slice> &filllist,
+    ChunkCacheFile &cacheFile)
 {
     last_decode_err = EXR_ERR_UNKNOWN;
     // stash the flag off to make sure to clean up in the event
@@ -584,7 +601,7 @@ void ScanLineProcess::run_decode (
         }
     }
 
-    last_decode_err = exr_decoding_run (ctxt, pn, &decoder);
+    last_decode_err = runCachedDecode (ctxt, pn, &decoder, cacheFile);
     if (EXR_ERR_SUCCESS != last_decode_err)
         throw IEX_NAMESPACE::IoExc ("Unable to run decoder");
 
@@ -19,14 +19,17 @@
 #    include <mutex>
 #endif
 
+#include "ImfChunkCacheDecode.h"
 #include "ImfFrameBuffer.h"
 #include "ImfInputPartData.h"
+#include "ImfMisc.h"
 
 // TODO: remove once TiledOutput is converted
 #include "ImfTileOffsets.h"
 #include "ImfTiledMisc.h"
 
 #include <algorithm>
+#include <sstream>
 #include <vector>
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
@@ -45,7 +48,8 @@ struct TileProcess
         exr_const_context_t ctxt,
         int pn,
         const FrameBuffer *outfb,
-        const std::vector<Slice> &filllist);
+        const std::vector<Slice> &filllist,
+        ChunkCacheFile &cacheFile);
 
     void update_pointers (
         const FrameBuffer *outfb,
@@ -127,6 +131,7 @@ struct TiledInputFile::Data
 
     FrameBuffer frameBuffer;
     std::vector<Slice> fill_list;
+    ChunkCacheFile cacheFile;
 
     std::vector<std::string> _failures;
 
@@ -141,14 +146,20 @@ struct TiledInputFile::Data
             Data*                   ifd,
             TileProcessGroup*       tileg,
             const FrameBuffer*      outfb,
-            const exr_chunk_info_t& cinfo)
+            int                     tx,
+            int                     ty,
+            int                     lx,
+            int                     ly)
             : Task (group)
             , _outfb (outfb)
             , _ifd (ifd)
+            , _tx (tx)
+            , _ty (ty)
+            , _lx (lx)
+            , _ly (ly)
             , _tile (tileg->pop ())
             , _tile_group (tileg)
         {
-            _tile->cinfo = cinfo;
         }
 
         ~TileBufferTask () override
@@ -163,6 +174,10 @@ struct TiledInputFile::Data
 
         const FrameBuffer* _outfb;
         Data*              _ifd;
+        int                _tx;
+        int                _ty;
+        int                _lx;
+        int                _ly;
 
         TileProcess*       _tile;
         TileProcessGroup*  _tile_group;
@@ -775,25 +790,36 @@ void TiledInputFile::Data::readTiles (int dx1, int dx2, int dy1, int dy2, int lx
 
         {
             ILMTHREAD_NAMESPACE::TaskGroup tg;
-
+            exr_attr_box2i_t dw = _ctxt->dataWindow (partNumber);
+            TileDescription  td (
+                tile_x_size,
+                tile_y_size,
+                static_cast<LevelMode> (tile_level_mode),
+                static_cast<LevelRoundingMode> (tile_round_mode));
+
+            // the tasks look up their own chunk information so any
+            // chunk table / leader reads overlap decoding rather
+            // than delaying dispatch
             for (int ty = dy1; ty <= dy2; ++ty)
             {
                 for (int tx = dx1; tx <= dx2; ++tx)
                 {
-                    exr_result_t rv = exr_read_tile_chunk_info (
-                        *_ctxt, partNumber, tx, ty, lx, ly, &cinfo);
-                    if (EXR_ERR_INCOMPLETE_CHUNK_TABLE == rv)
-                    {
-                        THROW (
-                            IEX_NAMESPACE::InputExc,
-                            "Tile (" << tx << ", " << ty << ", " << lx << ", " << ly
-                            << ") is missing.");
-                    }
-                    else if (EXR_ERR_SUCCESS != rv)
-                        throw IEX_NAMESPACE::InputExc ("Unable to query tile information");
-
-                    ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (
-                        new TileBufferTask (&tg, this, &tpg, &frameBuffer, cinfo) );
+                    TileBufferTask* task = new TileBufferTask (
+                        &tg, this, &tpg, &frameBuffer, tx, ty, lx, ly);
+                    IMATH_NAMESPACE::Box2i tw =
+                        OPENEXR_IMF_INTERNAL_NAMESPACE::dataWindowForTile (
+                            td,
+                            dw.min.x,
+                            dw.max.x,
+                            dw.min.y,
+                            dw.max.y,
+                            tx,
+                            ty,
+                            lx,
+                            ly);
+                    task->setPreferredNode (frameBufferNumaNode (
+                        frameBuffer, tw.min.x, tw.min.y));
+                    ILMTHREAD_NAMESPACE::ThreadPool::addGlobalTask (task);
                 }
             }
         }
@@ -826,7 +852,8 @@ void TiledInputFile::Data::readTiles (int dx1, int dx2, int dy1, int dy2, int lx
                     *_ctxt,
                     partNumber,
                     &frameBuffer,
-                    fill_list);
+                    fill_list,
+                    cacheFile);
             }
         }
     }
@@ -839,11 +866,34 @@ void TiledInputFile::Data::TileBufferTask::execute ()
 {
     try
     {
+        exr_result_t rv = exr_read_tile_chunk_info (
+            *(_ifd->_ctxt),
+            _ifd->partNumber,
+            _tx,
+            _ty,
+            _lx,
+            _ly,
+            &(_tile->cinfo));
+        if (EXR_ERR_INCOMPLETE_CHUNK_TABLE == rv)
+        {
+            std::stringstream msg;
+            msg << "Tile (" << _tx << ", " << _ty << ", " << _lx << ", "
+                << _ly << ") is missing.";
+            _tile_group->record_missing (msg.str ().c_str ());
+            return;
+        }
+        else if (EXR_ERR_SUCCESS != rv)
+        {
+            _tile_group->record_missing ("Unable to query tile information");
+            return;
+        }
+
         _tile->run_decode (
             *(_ifd->_ctxt),
             _ifd->partNumber,
             _outfb,
-            _ifd->fill_list);
+            _ifd->fill_list,
+            _ifd->cacheFile);
     }
     catch (std::exception &e)
     {
@@ -862,7 +912,8 @@ void TileProcess::run_decode (
     exr_const_context_t ctxt,
     int pn,
     const FrameBuffer *outfb,
-    const std::vector<Slice> &filllist)
+    const std::vector<Slice> &filllist,
+    ChunkCacheFile &cacheFile)
 {
     int absX, absY, tileX, tileY;
     exr_attr_box2i_t dw;
@@ -910,7 +961,7 @@ void TileProcess::run_decode (
         }
     }
 
-    if (EXR_ERR_SUCCESS != exr_decoding_run (ctxt, pn, &decoder))
+    if (EXR_ERR_SUCCESS != runCachedDecode (ctxt, pn, &decoder, cacheFile))
         throw IEX_NAMESPACE::IoExc ("Unable to run decoder");
 
     run_fill (outfb, dw.min.x, dw.min.y, absX, absY, filllist);
@@ -393,4 +393,50 @@ getTiledChunkOffsetTableSize (const Header& header)
     }
 }
 
+int
+tileChunkNumber (
+    LevelMode  mode,
+    int        numXLevels,
+    const int* numXTiles,
+    const int* numYTiles,
+    int        dx,
+    int        dy,
+    int        lx,
+    int        ly)
+{
+    //
+    // The chunk offset table lists the levels in order, with x
+    // levels varying fastest in a RIPMAP_LEVELS file, and the tiles
+    // of each level in scan line order.
+    //
+
+    int64_t chunk = 0;
+
+    switch (mode)
+    {
+        case ONE_LEVEL:
+        case MIPMAP_LEVELS:
+            for (int l = 0; l < lx; ++l)
+                chunk += static_cast<int64_t> (numXTiles[l]) * numYTiles[l];
+            break;
+
+        case RIPMAP_LEVELS:
+            for (int y = 0; y < ly; ++y)
+                for (int x = 0; x < numXLevels; ++x)
+                    chunk += static_cast<int64_t> (numXTiles[x]) * numYTiles[y];
+
+            for (int x = 0; x < lx; ++x)
+                chunk += static_cast<int64_t> (numXTiles[x]) * numYTiles[ly];
+            break;
+
+        case NUM_LEVELMODES:
+            throw IEX_NAMESPACE::LogicExc (
+                "Bad level mode computing tile chunk number");
+    }
+
+    chunk += static_cast<int64_t> (dy) * numXTiles[lx] + dx;
+
+    return static_cast<int> (chunk);
+}
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
@@ -88,6 +88,23 @@ void precalculateTileInfo (
 IMF_EXPORT
 int getTiledChunkOffsetTableSize (const Header& header);
 
+//
+// Return the position of tile (dx, dy, lx, ly) in the chunk offset table
+// of a tiled file; numXLevels, numXTiles and numYTiles are computed by
+// precalculateTileInfo().
+//
+
+IMF_EXPORT
+int tileChunkNumber (
+    LevelMode  mode,
+    int        numXLevels,
+    const int* numXTiles,
+    const int* numYTiles,
+    int        dx,
+    int        dy,
+    int        lx,
+    int        ly);
+
 OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
 
 #endif
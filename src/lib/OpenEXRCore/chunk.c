@@ -12,6 +12,7 @@
 #include "internal_file.h"
 
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 /**************************************/
@@ -1513,23 +1514,12 @@ exr_read_tile_chunk_info (
     return EXR_ERR_SUCCESS;
 }
 
-exr_result_t
-exr_read_chunk (
+static exr_result_t
+validate_read_chunk (
     exr_const_context_t     ctxt,
-    int                     part_index,
-    const exr_chunk_info_t* cinfo,
-    void*                   packed_data)
+    exr_const_priv_part_t   part,
+    const exr_chunk_info_t* cinfo)
 {
-    exr_result_t                 rv;
-    uint64_t                     dataoffset, toread;
-    int64_t                      nread;
-    enum _INTERNAL_EXR_READ_MODE rmode = EXR_MUST_READ_ALL;
-    EXR_READONLY_AND_DEFINE_PART (part_index);
-
-    if (!cinfo) return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
-    if (cinfo->packed_size > 0 && !packed_data)
-        return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
-
     if (cinfo->idx < 0 || cinfo->idx >= part->chunk_count)
         return ctxt->print_error (
             ctxt,
@@ -1548,16 +1538,43 @@ exr_read_chunk (
             EXR_ERR_INVALID_ARGUMENT,
             "mismatched compression type for chunk block info");
 
-    dataoffset = cinfo->data_offset;
-    if (ctxt->file_size > 0 && dataoffset > (uint64_t) ctxt->file_size)
+    if (ctxt->file_size > 0 &&
+        cinfo->data_offset > (uint64_t) ctxt->file_size)
         return ctxt->print_error (
             ctxt,
             EXR_ERR_INVALID_ARGUMENT,
             "chunk block info data offset (%" PRIu64
             ") past end of file (%" PRId64 ")",
-            dataoffset,
+            cinfo->data_offset,
             ctxt->file_size);
 
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+exr_result_t
+exr_read_chunk (
+    exr_const_context_t     ctxt,
+    int                     part_index,
+    const exr_chunk_info_t* cinfo,
+    void*                   packed_data)
+{
+    exr_result_t                 rv;
+    uint64_t                     dataoffset, toread;
+    int64_t                      nread;
+    enum _INTERNAL_EXR_READ_MODE rmode = EXR_MUST_READ_ALL;
+    EXR_READONLY_AND_DEFINE_PART (part_index);
+
+    if (!cinfo) return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+    if (cinfo->packed_size > 0 && !packed_data)
+        return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+    rv = validate_read_chunk (ctxt, part, cinfo);
+    if (rv != EXR_ERR_SUCCESS) return rv;
+
+    dataoffset = cinfo->data_offset;
+
     /* allow a short read if uncompressed */
     if (part->comp_type == EXR_COMPRESSION_NONE) rmode = EXR_ALLOW_SHORT_READ;
 
@@ -1586,6 +1603,176 @@ exr_read_chunk (
 
 /**************************************/
 
+static int
+compare_read_request (const void* a, const void* b)
+{
+    const exr_read_request_t* ra = (const exr_read_request_t*) a;
+    const exr_read_request_t* rb = (const exr_read_request_t*) b;
+
+    if (ra->offset < rb->offset) return -1;
+    if (ra->offset > rb->offset) return 1;
+    return 0;
+}
+
+/* chunk headers (the coordinates and sizes preceding the packed
+ * data) are at most this large, gaps up to this size between the
+ * requested chunks are read into a scratch buffer such that the
+ * chunks of a part can be read as one contiguous transfer */
+#define EXR_READ_BATCH_MAX_GAP 64
+
+static exr_result_t
+batch_read_chunks (
+    exr_const_context_t     ctxt,
+    int                     count,
+    const exr_chunk_info_t* cinfos,
+    void* const*            packed_data,
+    int*                    complete)
+{
+    uint8_t             gapbuf[EXR_READ_BATCH_MAX_GAP];
+    exr_read_request_t* reqs;
+    exr_read_request_t* sorted;
+    exr_read_request_t  cur;
+    uint64_t            total  = 0;
+    uint64_t            prvend = 0;
+    int64_t             nread  = 0;
+    int                 nsort  = 0;
+    int                 nreq   = 0;
+    int                 insort = 1;
+
+    *complete = 0;
+
+    /* room for each request plus a gap filler between each, the
+     * sorted requests are staged in the upper half */
+    reqs = (exr_read_request_t*) ctxt->alloc_fn (
+        sizeof (exr_read_request_t) * (size_t) count * 2);
+    if (!reqs) return ctxt->standard_error (ctxt, EXR_ERR_OUT_OF_MEMORY);
+    sorted = reqs + count;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (cinfos[i].packed_size == 0) continue;
+
+        sorted[nsort].buffer = packed_data[i];
+        sorted[nsort].size   = cinfos[i].packed_size;
+        sorted[nsort].offset = cinfos[i].data_offset;
+        if (nsort > 0 && sorted[nsort].offset < sorted[nsort - 1].offset)
+            insort = 0;
+        ++nsort;
+    }
+
+    /* the common case of reading a part in order is already sorted */
+    if (!insort)
+        qsort (
+            sorted,
+            (size_t) nsort,
+            sizeof (exr_read_request_t),
+            &compare_read_request);
+
+    for (int i = 0; i < nsort; ++i)
+    {
+        /* the output never overtakes the input, but may write the
+         * slot just read */
+        cur = sorted[i];
+        if (i > 0 && cur.offset > prvend &&
+            (cur.offset - prvend) <= EXR_READ_BATCH_MAX_GAP)
+        {
+            reqs[nreq].buffer = gapbuf;
+            reqs[nreq].size   = cur.offset - prvend;
+            reqs[nreq].offset = prvend;
+            total += reqs[nreq].size;
+            ++nreq;
+        }
+        reqs[nreq++] = cur;
+        total += cur.size;
+        prvend = cur.offset + cur.size;
+    }
+
+    if (nreq > 0)
+        nread = ctxt->read_batch_fn (
+            ctxt, ctxt->user_data, reqs, nreq, ctxt->print_error);
+
+    ctxt->free_fn (reqs);
+
+    /* the stream has already reported any error */
+    if (nread < 0) return EXR_ERR_READ_IO;
+
+    *complete = (nread == (int64_t) total);
+    return EXR_ERR_SUCCESS;
+}
+
+exr_result_t
+exr_read_chunks (
+    exr_const_context_t     ctxt,
+    int                     part_index,
+    int                     count,
+    const exr_chunk_info_t* cinfos,
+    void* const*            packed_data)
+{
+    exr_result_t rv;
+    int          complete = 0;
+    EXR_READONLY_AND_DEFINE_PART (part_index);
+
+    if (count < 0 || (count > 0 && (!cinfos || !packed_data)))
+        return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (cinfos[i].packed_size > 0 && !packed_data[i])
+            return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+        rv = validate_read_chunk (ctxt, part, cinfos + i);
+        if (rv != EXR_ERR_SUCCESS) return rv;
+    }
+
+    if (ctxt->read_batch_fn && count > 1)
+    {
+        rv = batch_read_chunks (ctxt, count, cinfos, packed_data, &complete);
+        if (rv != EXR_ERR_SUCCESS) return rv;
+    }
+
+    /* no batch read support, or something came up short (i.e. a
+     * truncated file), so read each chunk individually such that the
+     * normal short read / error handling rules apply */
+    for (int i = 0; !complete && i < count; ++i)
+    {
+        rv = exr_read_chunk (ctxt, part_index, cinfos + i, packed_data[i]);
+        if (rv != EXR_ERR_SUCCESS) return rv;
+    }
+
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+exr_result_t
+internal_exr_borrow_chunk (
+    exr_const_context_t     ctxt,
+    int                     part_index,
+    const exr_chunk_info_t* cinfo,
+    const void**            packed_data)
+{
+    exr_result_t rv;
+    EXR_READONLY_AND_DEFINE_PART (part_index);
+
+    if (!cinfo || !packed_data)
+        return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+    *packed_data = NULL;
+
+    rv = validate_read_chunk (ctxt, part, cinfo);
+    if (rv != EXR_ERR_SUCCESS) return rv;
+
+    /* a truncated chunk falls back to a normal (short) read */
+    if (ctxt->mapped_data && cinfo->packed_size > 0 &&
+        cinfo->data_offset <= ctxt->mapped_size &&
+        cinfo->packed_size <= (ctxt->mapped_size - cinfo->data_offset))
+        *packed_data = ctxt->mapped_data + cinfo->data_offset;
+
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
 exr_result_t
 exr_read_deep_chunk (
     exr_const_context_t     ctxt,
@@ -196,6 +196,207 @@ internal_encode_alloc_buffer (
     return EXR_ERR_SUCCESS;
 }
 
+/**************************************/
+
+/* The decode buffer pool holds intrusive singly linked free lists of
+ * buffers per buffer id and size class, with the pointer to the next
+ * free buffer stored in the first bytes of each free buffer. The size
+ * classes are a quarter of a power of two apart, such that rounding a
+ * request up to its class wastes at most 25%. */
+
+#define EXR_BUFFER_POOL_MIN_BITS 8
+#define EXR_BUFFER_POOL_MAX_BITS 40
+#define EXR_BUFFER_POOL_CLASSES                                                \
+    (((EXR_BUFFER_POOL_MAX_BITS - EXR_BUFFER_POOL_MIN_BITS) * 4) + 1)
+#define EXR_BUFFER_POOL_IDS ((int) EXR_TRANSCODE_BUFFER_SAMPLES + 1)
+
+struct _internal_exr_buffer_pool
+{
+    void*    free_lists[EXR_BUFFER_POOL_IDS][EXR_BUFFER_POOL_CLASSES];
+    uint64_t requests;
+    uint64_t hits;
+    uint64_t returns;
+    uint64_t discards;
+    uint64_t cached_bytes;
+};
+
+static inline int
+floor_log2_size (size_t v)
+{
+    int r = 0;
+    while (v >>= 1)
+        ++r;
+    return r;
+}
+
+/* smallest class able to hold sz bytes */
+static inline int
+pool_class_for_request (size_t sz, size_t* classsz)
+{
+    size_t v;
+    int    lg, sub;
+
+    if (sz <= ((size_t) 1 << EXR_BUFFER_POOL_MIN_BITS))
+    {
+        *classsz = ((size_t) 1 << EXR_BUFFER_POOL_MIN_BITS);
+        return 0;
+    }
+    if ((uint64_t) sz > ((uint64_t) 1 << EXR_BUFFER_POOL_MAX_BITS)) return -1;
+
+    v        = sz - 1;
+    lg       = floor_log2_size (v);
+    sub      = (int) ((v >> (lg - 2)) & 3);
+    *classsz = ((size_t) (5 + sub)) << (lg - 2);
+    return (lg - EXR_BUFFER_POOL_MIN_BITS) * 4 + sub + 1;
+}
+
+/* largest class a buffer of sz bytes can serve */
+static inline int
+pool_class_for_buffer (size_t sz, size_t* classsz)
+{
+    int lg, sub;
+
+    if (sz < ((size_t) 1 << EXR_BUFFER_POOL_MIN_BITS)) return -1;
+
+    lg = floor_log2_size (sz);
+    if (lg >= EXR_BUFFER_POOL_MAX_BITS)
+    {
+        *classsz = (size_t) ((uint64_t) 1 << EXR_BUFFER_POOL_MAX_BITS);
+        return EXR_BUFFER_POOL_CLASSES - 1;
+    }
+
+    sub      = (int) ((sz >> (lg - 2)) & 3);
+    *classsz = ((size_t) (4 + sub)) << (lg - 2);
+    return (lg - EXR_BUFFER_POOL_MIN_BITS) * 4 + sub;
+}
+
+/* size of the buffers in class c, the inverse of the above */
+static inline size_t
+pool_class_size (int c)
+{
+    int lg, sub;
+
+    if (c == 0) return ((size_t) 1 << EXR_BUFFER_POOL_MIN_BITS);
+
+    lg  = EXR_BUFFER_POOL_MIN_BITS + (c - 1) / 4;
+    sub = (c - 1) % 4;
+    return ((size_t) (5 + sub)) << (lg - 2);
+}
+
+static void*
+pool_checkout (
+    exr_const_context_t                  ctxt,
+    exr_transcoding_pipeline_buffer_id_t bufid,
+    size_t*                              sz)
+{
+    exr_context_t nonc = EXR_CONST_CAST (exr_context_t, ctxt);
+    struct _internal_exr_buffer_pool* pool;
+    size_t                            classsz;
+    void*                             buf = NULL;
+    int                               cls;
+
+    cls = pool_class_for_request (*sz, &classsz);
+    if (cls < 0 || (int) bufid < 0 || (int) bufid >= EXR_BUFFER_POOL_IDS)
+        return ctxt->alloc_fn (*sz);
+
+    internal_exr_lock (ctxt);
+    if (ctxt->buffer_pool_limit == 0)
+    {
+        internal_exr_unlock (ctxt);
+        return ctxt->alloc_fn (*sz);
+    }
+
+    pool = ctxt->buffer_pool;
+    if (!pool)
+    {
+        pool = ctxt->alloc_fn (sizeof (struct _internal_exr_buffer_pool));
+        if (pool) memset (pool, 0, sizeof (struct _internal_exr_buffer_pool));
+        nonc->buffer_pool = pool;
+    }
+
+    if (pool)
+    {
+        ++(pool->requests);
+        buf = pool->free_lists[bufid][cls];
+        if (buf)
+        {
+            pool->free_lists[bufid][cls] = *((void**) buf);
+            pool->cached_bytes -= classsz;
+            ++(pool->hits);
+        }
+    }
+    internal_exr_unlock (ctxt);
+
+    if (!buf) buf = ctxt->alloc_fn (classsz);
+    if (buf) *sz = classsz;
+    return buf;
+}
+
+static void
+pool_checkin (
+    exr_const_context_t                  ctxt,
+    exr_transcoding_pipeline_buffer_id_t bufid,
+    void*                                buf,
+    size_t                               sz)
+{
+    struct _internal_exr_buffer_pool* pool;
+    size_t                            classsz;
+    int                               cls;
+
+    cls = pool_class_for_buffer (sz, &classsz);
+
+    internal_exr_lock (ctxt);
+    pool = ctxt->buffer_pool;
+    if (pool && cls >= 0 && (int) bufid >= 0 &&
+        (int) bufid < EXR_BUFFER_POOL_IDS)
+    {
+        ++(pool->returns);
+        if (pool->cached_bytes + classsz <= ctxt->buffer_pool_limit)
+        {
+            *((void**) buf)              = pool->free_lists[bufid][cls];
+            pool->free_lists[bufid][cls] = buf;
+            pool->cached_bytes += classsz;
+            buf = NULL;
+        }
+        else
+            ++(pool->discards);
+    }
+    internal_exr_unlock (ctxt);
+
+    if (buf) ctxt->free_fn (buf);
+}
+
+/* releases pooled buffers until at most maxbytes are held, called
+ * with the context locked */
+static void
+pool_trim (exr_const_context_t ctxt, uint64_t maxbytes)
+{
+    struct _internal_exr_buffer_pool* pool = ctxt->buffer_pool;
+    void*                             buf;
+    size_t                            classsz;
+
+    if (!pool) return;
+
+    /* free the largest buffers first */
+    for (int c = EXR_BUFFER_POOL_CLASSES - 1; c >= 0; --c)
+    {
+        if (pool->cached_bytes <= maxbytes) break;
+
+        classsz = pool_class_size (c);
+
+        for (int b = 0; b < EXR_BUFFER_POOL_IDS; ++b)
+        {
+            while (pool->cached_bytes > maxbytes &&
+                   (buf = pool->free_lists[b][c]) != NULL)
+            {
+                pool->free_lists[b][c] = *((void**) buf);
+                pool->cached_bytes -= classsz;
+                ctxt->free_fn (buf);
+            }
+        }
+    }
+}
+
 exr_result_t
 internal_decode_free_buffer (
     exr_decode_pipeline_t*               decode,
@@ -216,7 +417,7 @@ internal_decode_free_buffer (
                 exr_const_context_t ctxt = decode->context;
                 EXR_CHECK_CONTEXT_AND_PART (decode->part_index);
 
-                ctxt->free_fn (curbuf);
+                pool_checkin (ctxt, bufid, curbuf, cursz);
             }
         }
         *buf = NULL;
@@ -253,7 +454,7 @@ internal_decode_alloc_buffer (
             exr_const_context_t ctxt = decode->context;
             EXR_CHECK_CONTEXT_AND_PART (decode->part_index);
 
-            curbuf = ctxt->alloc_fn (newsz);
+            curbuf = pool_checkout (ctxt, bufid, &newsz);
         }
 
         if (curbuf == NULL)
@@ -273,3 +474,57 @@ internal_decode_alloc_buffer (
     }
     return EXR_ERR_SUCCESS;
 }
+
+/**************************************/
+
+void
+internal_exr_destroy_buffer_pool (exr_context_t ctxt)
+{
+    if (ctxt->buffer_pool)
+    {
+        pool_trim (ctxt, 0);
+        ctxt->free_fn (ctxt->buffer_pool);
+        ctxt->buffer_pool = NULL;
+    }
+}
+
+/**************************************/
+
+exr_result_t
+exr_get_decode_buffer_pool_stats (
+    exr_const_context_t ctxt, exr_decode_buffer_pool_stats_t* stats)
+{
+    if (!ctxt) return EXR_ERR_MISSING_CONTEXT_ARG;
+    if (!stats) return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+    memset (stats, 0, sizeof (exr_decode_buffer_pool_stats_t));
+
+    internal_exr_lock (ctxt);
+    if (ctxt->buffer_pool)
+    {
+        stats->requests     = ctxt->buffer_pool->requests;
+        stats->hits         = ctxt->buffer_pool->hits;
+        stats->returns      = ctxt->buffer_pool->returns;
+        stats->discards     = ctxt->buffer_pool->discards;
+        stats->cached_bytes = ctxt->buffer_pool->cached_bytes;
+    }
+    stats->limit = ctxt->buffer_pool_limit;
+    internal_exr_unlock (ctxt);
+
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+exr_result_t
+exr_set_decode_buffer_pool_limit (exr_context_t ctxt, uint64_t maxbytes)
+{
+    if (!ctxt) return EXR_ERR_MISSING_CONTEXT_ARG;
+
+    internal_exr_lock (ctxt);
+    ctxt->buffer_pool_limit = maxbytes;
+    pool_trim (ctxt, maxbytes);
+    internal_exr_unlock (ctxt);
+
+    return EXR_ERR_SUCCESS;
+}
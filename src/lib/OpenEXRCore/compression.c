@@ -31,8 +31,12 @@
 #else
 #    include <libdeflate.h>
 #endif
+#include <stddef.h>
 #include <string.h>
 
+#include "internal_thread.h"
+#include "internal_xdr.h"
+
 #if (                                                                          \
     LIBDEFLATE_VERSION_MAJOR > 1 ||                                            \
     (LIBDEFLATE_VERSION_MAJOR == 1 && LIBDEFLATE_VERSION_MINOR > 18))
@@ -85,42 +89,51 @@ exr_compress_max_buffer_size (size_t in_bytes)
 
 /**************************************/
 
-exr_result_t
-exr_compress_buffer (
-    exr_const_context_t ctxt,
-    int                 level,
-    const void*         in,
-    size_t              in_bytes,
-    void*               out,
-    size_t              out_bytes_avail,
-    size_t*             actual_out)
+static int
+resolve_zip_level (int level)
 {
-    struct libdeflate_compressor* comp;
+    if (level < 0)
+    {
+        exr_get_default_zip_compression_level (&level);
+        /* truly unset anywhere */
+        if (level < 0) level = EXR_DEFAULT_ZLIB_COMPRESS_LEVEL;
+    }
+    return level;
+}
 
+static struct libdeflate_compressor*
+alloc_compressor (exr_const_context_t ctxt, int level)
+{
 #ifdef EXR_USE_CONFIG_DEFLATE_STRUCT
     struct libdeflate_options opt = {
         .sizeof_options = sizeof (struct libdeflate_options),
         .malloc_func    = ctxt ? ctxt->alloc_fn : internal_exr_alloc,
         .free_func      = ctxt ? ctxt->free_fn : internal_exr_free};
 
+    return libdeflate_alloc_compressor_ex (level, &opt);
 #else
     libdeflate_set_memory_allocator (
         ctxt ? ctxt->alloc_fn : internal_exr_alloc,
         ctxt ? ctxt->free_fn : internal_exr_free);
+    return libdeflate_alloc_compressor (level);
 #endif
+}
 
-    if (level < 0)
-    {
-        exr_get_default_zip_compression_level (&level);
-        /* truly unset anywhere */
-        if (level < 0) level = EXR_DEFAULT_ZLIB_COMPRESS_LEVEL;
-    }
+/**************************************/
 
-#ifdef EXR_USE_CONFIG_DEFLATE_STRUCT
-    comp = libdeflate_alloc_compressor_ex (level, &opt);
-#else
-    comp = libdeflate_alloc_compressor (level);
-#endif
+exr_result_t
+exr_compress_buffer (
+    exr_const_context_t ctxt,
+    int                 level,
+    const void*         in,
+    size_t              in_bytes,
+    void*               out,
+    size_t              out_bytes_avail,
+    size_t*             actual_out)
+{
+    struct libdeflate_compressor* comp;
+
+    comp = alloc_compressor (ctxt, resolve_zip_level (level));
     if (comp)
     {
         size_t outsz;
@@ -141,6 +154,570 @@ exr_compress_buffer (
 
 /**************************************/
 
+/*
+ * Intra-chunk threading for deflate, in the style of pigz: the input
+ * is cut into segments which are raw deflated independently, and the
+ * results are concatenated into a single zlib stream. Readers see an
+ * ordinary stream that happens to contain more blocks.
+ *
+ * libdeflate always marks the last block it writes as final and has
+ * no flush operation, so each segment but the last is walked to find
+ * the header of its final block (to clear BFINAL) and the bit where
+ * its end-of-block code stops. An empty stored block is then appended
+ * to get back to a byte boundary, which is what a zlib sync flush
+ * does. Each segment starts with an empty window, so the output is a
+ * little larger than the single threaded one.
+ */
+
+#define EXR_SPLIT_DEFLATE_MIN_SEGMENT (128 * 1024)
+#define EXR_SPLIT_DEFLATE_MAX_SEGMENTS 64
+
+#define WALK_TABLE_BITS 10
+#define WALK_TABLE_SIZE (1 << WALK_TABLE_BITS)
+
+/* table entries: bits to consume (code + extra bits), kind and symbol */
+#define WALK_KIND_LITERAL (1 << 8)
+#define WALK_KIND_LENGTH (2 << 8)
+#define WALK_KIND_END (3 << 8)
+#define WALK_KIND_MASK (3 << 8)
+
+enum walk_tree_mode
+{
+    WALK_TREE_LITLEN,
+    WALK_TREE_DIST,
+    WALK_TREE_CODELEN
+};
+
+static const uint8_t walk_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+static const uint8_t walk_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static const uint8_t walk_codelen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+typedef struct
+{
+    uint32_t table[WALK_TABLE_SIZE];
+    uint16_t count[16];
+    uint16_t symbol[288];
+    int      mode;
+} walk_tree_t;
+
+typedef struct
+{
+    const uint8_t* start;
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint64_t       bits;
+    int            nbits;
+    size_t         pad; /* zero bytes fed past the end */
+} walk_reader_t;
+
+static uint32_t
+walk_entry (int mode, int sym, int len)
+{
+    switch (mode)
+    {
+        case WALK_TREE_LITLEN:
+            if (sym < 256) return WALK_KIND_LITERAL | (uint32_t) len;
+            if (sym == 256) return WALK_KIND_END | (uint32_t) len;
+            if (sym < 286)
+                return WALK_KIND_LENGTH |
+                       (uint32_t) (len + walk_length_extra[sym - 257]);
+            return 0;
+        case WALK_TREE_DIST:
+            if (sym < 30)
+                return WALK_KIND_LITERAL |
+                       (uint32_t) (len + walk_dist_extra[sym]);
+            return 0;
+        default:
+            return WALK_KIND_LITERAL | ((uint32_t) sym << 16) |
+                   (uint32_t) len;
+    }
+}
+
+static int
+walk_build_tree (walk_tree_t* t, const uint8_t* lens, int n, int mode)
+{
+    uint16_t offs[16];
+    int      left, len, s, idx;
+    uint32_t code;
+
+    memset (t->count, 0, sizeof (t->count));
+    for (s = 0; s < n; ++s)
+        t->count[lens[s]]++;
+    t->count[0] = 0;
+
+    left = 1;
+    for (len = 1; len < 16; ++len)
+    {
+        left <<= 1;
+        left -= t->count[len];
+        if (left < 0) return -1;
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < 15; ++len)
+        offs[len + 1] = offs[len] + t->count[len];
+    for (s = 0; s < n; ++s)
+        if (lens[s] != 0) t->symbol[offs[lens[s]]++] = (uint16_t) s;
+
+    t->mode = mode;
+    memset (t->table, 0, sizeof (t->table));
+    code = 0;
+    idx  = 0;
+    for (len = 1; len <= WALK_TABLE_BITS; ++len)
+    {
+        for (s = 0; s < t->count[len]; ++s, ++code)
+        {
+            uint32_t rev = 0, e, i;
+            int      b;
+
+            for (b = 0; b < len; ++b)
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            e = walk_entry (mode, t->symbol[idx++], len);
+            for (i = rev; i < WALK_TABLE_SIZE; i += (1u << len))
+                t->table[i] = e;
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+/* canonical decode one bit at a time, for codes longer than the table */
+static uint32_t
+walk_decode_slow (const walk_tree_t* t, uint64_t bits)
+{
+    int code = 0, first = 0, index = 0, len, count;
+
+    for (len = 1; len < 16; ++len)
+    {
+        code |= (int) (bits & 1);
+        bits >>= 1;
+        count = t->count[len];
+        if (code - count < first)
+            return walk_entry (t->mode, t->symbol[index + (code - first)], len);
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return 0;
+}
+
+static inline void
+walk_refill (walk_reader_t* r)
+{
+    if (r->end - r->cur >= 8)
+    {
+        uint64_t v;
+        memcpy (&v, r->cur, 8);
+        r->bits |= le64toh (v) << r->nbits;
+        r->cur += (63 - r->nbits) >> 3;
+        r->nbits |= 56;
+    }
+    else
+    {
+        while (r->nbits <= 56)
+        {
+            uint64_t v = 0;
+            if (r->cur < r->end)
+                v = *(r->cur)++;
+            else
+                ++(r->pad);
+            r->bits |= v << r->nbits;
+            r->nbits += 8;
+        }
+    }
+}
+
+static inline uint64_t
+walk_position (const walk_reader_t* r)
+{
+    return ((uint64_t) (r->cur - r->start) + r->pad) * 8 -
+           (uint64_t) r->nbits;
+}
+
+static inline void
+walk_consume (walk_reader_t* r, int n)
+{
+    r->bits >>= n;
+    r->nbits -= n;
+}
+
+static inline uint32_t
+walk_decode (walk_reader_t* r, const walk_tree_t* t)
+{
+    uint32_t e = t->table[r->bits & (WALK_TABLE_SIZE - 1)];
+    if (!e) e = walk_decode_slow (t, r->bits);
+    if (e) walk_consume (r, (int) (e & 0xff));
+    return e;
+}
+
+static int
+walk_dynamic_trees (walk_reader_t* r, walk_tree_t* litlen, walk_tree_t* dist)
+{
+    uint8_t lens[286 + 30];
+    int     hlit, hdist, hclen, i, n;
+
+    walk_refill (r);
+    hlit  = (int) (r->bits & 31) + 257;
+    hdist = (int) ((r->bits >> 5) & 31) + 1;
+    hclen = (int) ((r->bits >> 10) & 15) + 4;
+    walk_consume (r, 14);
+    if (hlit > 286 || hdist > 30) return -1;
+
+    memset (lens, 0, 19);
+    for (i = 0; i < hclen; ++i)
+    {
+        walk_refill (r);
+        lens[walk_codelen_order[i]] = (uint8_t) (r->bits & 7);
+        walk_consume (r, 3);
+    }
+    /* the code length tree borrows the distance tree storage */
+    if (walk_build_tree (dist, lens, 19, WALK_TREE_CODELEN)) return -1;
+
+    n = 0;
+    while (n < hlit + hdist)
+    {
+        uint32_t e;
+        int      sym, rep;
+        uint8_t  val = 0;
+
+        walk_refill (r);
+        e = walk_decode (r, dist);
+        if (!e) return -1;
+        sym = (int) (e >> 16);
+        if (sym < 16)
+        {
+            lens[n++] = (uint8_t) sym;
+            continue;
+        }
+        if (sym == 16)
+        {
+            if (n == 0) return -1;
+            val = lens[n - 1];
+            rep = 3 + (int) (r->bits & 3);
+            walk_consume (r, 2);
+        }
+        else if (sym == 17)
+        {
+            rep = 3 + (int) (r->bits & 7);
+            walk_consume (r, 3);
+        }
+        else
+        {
+            rep = 11 + (int) (r->bits & 127);
+            walk_consume (r, 7);
+        }
+        if (n + rep > hlit + hdist) return -1;
+        memset (lens + n, val, (size_t) rep);
+        n += rep;
+    }
+
+    if (lens[256] == 0) return -1;
+    if (walk_build_tree (litlen, lens, hlit, WALK_TREE_LITLEN)) return -1;
+    if (walk_build_tree (dist, lens + hlit, hdist, WALK_TREE_DIST)) return -1;
+    return 0;
+}
+
+static void
+walk_fixed_trees (walk_tree_t* litlen, walk_tree_t* dist)
+{
+    uint8_t lens[288];
+
+    memset (lens, 8, 144);
+    memset (lens + 144, 9, 112);
+    memset (lens + 256, 7, 24);
+    memset (lens + 280, 8, 8);
+    walk_build_tree (litlen, lens, 288, WALK_TREE_LITLEN);
+    memset (lens, 5, 30);
+    walk_build_tree (dist, lens, 30, WALK_TREE_DIST);
+}
+
+/*
+ * Walks a raw deflate stream without producing output, returning the
+ * bit position of the final block header and of the end of the stream
+ */
+static int
+walk_deflate_stream (
+    const uint8_t* in, size_t in_bytes, uint64_t* final_hdr, uint64_t* end)
+{
+    walk_tree_t   litlen, dist;
+    walk_reader_t r     = {in, in, in + in_bytes, 0, 0, 0};
+    uint64_t      limit = (uint64_t) in_bytes * 8;
+    int           final;
+
+    do
+    {
+        uint64_t hdr;
+        int      type;
+
+        walk_refill (&r);
+        hdr   = walk_position (&r);
+        final = (int) (r.bits & 1);
+        type  = (int) ((r.bits >> 1) & 3);
+        walk_consume (&r, 3);
+        *final_hdr = hdr;
+
+        if (type == 0)
+        {
+            uint64_t len, nlen, pos;
+
+            walk_consume (&r, r.nbits & 7);
+            walk_refill (&r);
+            len  = r.bits & 0xffff;
+            nlen = (r.bits >> 16) & 0xffff;
+            walk_consume (&r, 32);
+            if (len != (~nlen & 0xffff)) return -1;
+
+            pos = walk_position (&r) / 8 + len;
+            if (pos > in_bytes) return -1;
+            r.cur   = in + pos;
+            r.bits  = 0;
+            r.nbits = 0;
+            r.pad   = 0;
+            continue;
+        }
+
+        if (type == 1)
+            walk_fixed_trees (&litlen, &dist);
+        else if (type == 2)
+        {
+            if (walk_dynamic_trees (&r, &litlen, &dist)) return -1;
+        }
+        else
+            return -1;
+
+        for (;;)
+        {
+            uint32_t e;
+
+            walk_refill (&r);
+            if (r.pad && walk_position (&r) > limit) return -1;
+
+            e = walk_decode (&r, &litlen);
+            if ((e & WALK_KIND_MASK) == WALK_KIND_LITERAL) continue;
+            if ((e & WALK_KIND_MASK) == WALK_KIND_END) break;
+            if (!e) return -1;
+            if (!walk_decode (&r, &dist)) return -1;
+        }
+    } while (!final);
+
+    *end = walk_position (&r);
+    return (*end > limit) ? -1 : 0;
+}
+
+static uint32_t
+split_adler32_combine (uint32_t a1, uint32_t a2, size_t len2)
+{
+    const uint32_t base = 65521;
+    uint32_t       rem  = (uint32_t) (len2 % base);
+    uint32_t       s1   = a1 & 0xffff;
+    uint32_t       s2   = (rem * s1) % base;
+
+    s1 += (a2 & 0xffff) + base - 1;
+    s2 += ((a1 >> 16) & 0xffff) + ((a2 >> 16) & 0xffff) + base - rem;
+    if (s1 >= base) s1 -= base;
+    if (s1 >= base) s1 -= base;
+    if (s2 >= (base << 1)) s2 -= (base << 1);
+    if (s2 >= base) s2 -= base;
+    return s1 | (s2 << 16);
+}
+
+typedef struct
+{
+    exr_const_context_t ctxt;
+    int                 level;
+    int                 is_last;
+    const uint8_t*      in;
+    size_t              in_bytes;
+    uint8_t*            out;
+    size_t              out_avail;
+    size_t              out_bytes;
+    uint32_t            adler;
+    exr_result_t        rv;
+} deflate_segment_t;
+
+static void
+compress_segment (void* arg)
+{
+    deflate_segment_t*            seg = (deflate_segment_t*) arg;
+    struct libdeflate_compressor* comp;
+    uint64_t                      hdr, end;
+    size_t                        nout;
+
+    seg->rv = EXR_ERR_OUT_OF_MEMORY;
+    comp    = alloc_compressor (seg->ctxt, seg->level);
+    if (!comp) return;
+    nout = libdeflate_deflate_compress (
+        comp, seg->in, seg->in_bytes, seg->out, seg->out_avail);
+    libdeflate_free_compressor (comp);
+    if (nout == 0) return;
+
+    seg->adler = libdeflate_adler32 (1, seg->in, seg->in_bytes);
+    if (!seg->is_last)
+    {
+        if (walk_deflate_stream (seg->out, nout, &hdr, &end))
+        {
+            seg->rv = EXR_ERR_CORRUPT_CHUNK;
+            return;
+        }
+
+        seg->out[hdr / 8] &= (uint8_t) ~(1u << (hdr % 8));
+        nout = (size_t) ((end + 7) / 8);
+        if (end % 8) seg->out[end / 8] &= (uint8_t) ((1u << (end % 8)) - 1);
+        /* the empty stored block's 3 header bits are zero too */
+        if ((end % 8) == 0 || (end % 8) > 5) seg->out[nout++] = 0;
+        if (nout + 4 > seg->out_avail) return;
+        seg->out[nout++] = 0x00;
+        seg->out[nout++] = 0x00;
+        seg->out[nout++] = 0xFF;
+        seg->out[nout++] = 0xFF;
+    }
+    seg->out_bytes = nout;
+    seg->rv        = EXR_ERR_SUCCESS;
+}
+
+static exr_result_t
+compress_buffer_split (
+    exr_const_context_t ctxt,
+    int                 level,
+    int                 nseg,
+    const uint8_t*      in,
+    size_t              in_bytes,
+    uint8_t*            out,
+    size_t              out_bytes_avail,
+    size_t*             actual_out)
+{
+    deflate_segment_t   segs[EXR_SPLIT_DEFLATE_MAX_SEGMENTS];
+    exr_worker_thread_t threads[EXR_SPLIT_DEFLATE_MAX_SEGMENTS];
+    int                 started[EXR_SPLIT_DEFLATE_MAX_SEGMENTS];
+    size_t              per = in_bytes / (size_t) nseg;
+    size_t              bound, total = 0, nout;
+    uint8_t*            scratch;
+    uint32_t            adler, hdr;
+    exr_result_t        rv = EXR_ERR_SUCCESS;
+    int                 i;
+
+    level = resolve_zip_level (level);
+    bound = libdeflate_deflate_compress_bound (NULL, per + (size_t) nseg) + 5;
+    scratch =
+        (ctxt ? ctxt->alloc_fn : internal_exr_alloc) (bound * (size_t) nseg);
+    if (!scratch) return EXR_ERR_OUT_OF_MEMORY;
+
+    for (i = 0; i < nseg; ++i)
+    {
+        deflate_segment_t* s = segs + i;
+        s->ctxt              = ctxt;
+        s->level             = level;
+        s->is_last           = (i == nseg - 1);
+        s->in                = in + total;
+        s->in_bytes          = s->is_last ? (in_bytes - total) : per;
+        s->out               = scratch + bound * (size_t) i;
+        s->out_avail         = bound;
+        s->out_bytes         = 0;
+        total += s->in_bytes;
+    }
+
+    started[0] = 0;
+    for (i = 1; i < nseg; ++i)
+        started[i] =
+            (worker_thread_start (threads + i, &compress_segment, segs + i) ==
+             0);
+    for (i = 0; i < nseg; ++i)
+        if (!started[i]) compress_segment (segs + i);
+    for (i = 1; i < nseg; ++i)
+        if (started[i]) worker_thread_join (threads + i);
+
+    /* zlib header, with the level hint matching libdeflate */
+    hdr = 0x7800;
+    if (level >= 2)
+        hdr |= (uint32_t) (level < 6 ? 1 : (level < 8 ? 2 : 3)) << 6;
+    hdr |= 31 - (hdr % 31);
+
+    nout = 2 + 4;
+    for (i = 0; i < nseg && rv == EXR_ERR_SUCCESS; ++i)
+    {
+        rv = segs[i].rv;
+        nout += segs[i].out_bytes;
+    }
+    if (rv == EXR_ERR_SUCCESS && nout > out_bytes_avail)
+        rv = EXR_ERR_OUT_OF_MEMORY;
+
+    if (rv == EXR_ERR_SUCCESS)
+    {
+        uint8_t* op = out;
+
+        *op++ = (uint8_t) (hdr >> 8);
+        *op++ = (uint8_t) (hdr);
+        adler = 1;
+        for (i = 0; i < nseg; ++i)
+        {
+            memcpy (op, segs[i].out, segs[i].out_bytes);
+            op += segs[i].out_bytes;
+            adler = split_adler32_combine (
+                adler, segs[i].adler, segs[i].in_bytes);
+        }
+        *op++ = (uint8_t) (adler >> 24);
+        *op++ = (uint8_t) (adler >> 16);
+        *op++ = (uint8_t) (adler >> 8);
+        *op++ = (uint8_t) (adler);
+        if (actual_out) *actual_out = nout;
+    }
+
+    (ctxt ? ctxt->free_fn : internal_exr_free) (scratch);
+    return rv;
+}
+
+exr_result_t
+internal_exr_compress_buffer (
+    const exr_encode_pipeline_t* encode,
+    int                          level,
+    const void*                  in,
+    size_t                       in_bytes,
+    void*                        out,
+    size_t                       out_bytes_avail,
+    size_t*                      actual_out)
+{
+#if ILMTHREAD_THREADING_ENABLED
+    size_t nseg = 1;
+
+    /* the hint is only there when the caller's struct declares it */
+    if (encode->pipe_size >=
+            offsetof (exr_encode_pipeline_t, intra_chunk_threads) +
+                sizeof (int32_t) &&
+        encode->intra_chunk_threads > 0)
+        nseg = (size_t) encode->intra_chunk_threads;
+
+    if (nseg > EXR_SPLIT_DEFLATE_MAX_SEGMENTS)
+        nseg = EXR_SPLIT_DEFLATE_MAX_SEGMENTS;
+    if (nseg > in_bytes / EXR_SPLIT_DEFLATE_MIN_SEGMENT)
+        nseg = in_bytes / EXR_SPLIT_DEFLATE_MIN_SEGMENT;
+
+    /* any failure here retries single threaded, which has the least
+     * overhead when the output buffer is tight */
+    if (nseg > 1 && compress_buffer_split (
+                        encode->context,
+                        level,
+                        (int) nseg,
+                        (const uint8_t*) in,
+                        in_bytes,
+                        (uint8_t*) out,
+                        out_bytes_avail,
+                        actual_out) == EXR_ERR_SUCCESS)
+        return EXR_ERR_SUCCESS;
+#endif
+    return exr_compress_buffer (
+        encode->context, level, in, in_bytes, out, out_bytes_avail, actual_out);
+}
+
+/**************************************/
+
 exr_result_t
 exr_uncompress_buffer (
     exr_const_context_t ctxt,
@@ -134,6 +134,10 @@ fill_context_data (const exr_context_initializer_t* ctxtdata)
         {
             inits.flags = ctxtdata->flags;
         }
+        if (ctxtdata->size >= sizeof (struct _exr_context_initializer_v4))
+        {
+            inits.read_batch_fn = ctxtdata->read_batch_fn;
+        }
     }
 
     internal_exr_update_default_handlers (&inits);
@@ -94,7 +94,8 @@ read_uncompressed_direct (exr_decode_pipeline_t* decode)
     int                 height, start_y;
     uint64_t            dataoffset, toread;
     uint8_t*            cdata;
-    exr_const_context_t ctxt = decode->context;
+    const uint8_t*      mapped = NULL;
+    exr_const_context_t ctxt   = decode->context;
 
     if (!ctxt) return EXR_ERR_MISSING_CONTEXT_ARG;
     if (ctxt->mode != EXR_CONTEXT_READ)
@@ -106,6 +107,16 @@ read_uncompressed_direct (exr_decode_pipeline_t* decode)
             "Part index (%d) out of range",
             decode->part_index);
 
+    if (ctxt->mapped_data)
+    {
+        rv = internal_exr_borrow_chunk (
+            ctxt,
+            decode->part_index,
+            &(decode->chunk),
+            (const void**) &mapped);
+        if (rv != EXR_ERR_SUCCESS) return rv;
+    }
+
     dataoffset = decode->chunk.data_offset;
 
     height  = decode->chunk.height;
@@ -132,9 +143,21 @@ read_uncompressed_direct (exr_decode_pipeline_t* decode)
             else { cdata += (uint64_t) y * (uint64_t) decc->user_line_stride; }
 
             /* actual read into the output pointer */
-            rv = ctxt->do_read (
-                ctxt, cdata, toread, &dataoffset, NULL, EXR_MUST_READ_ALL);
-            if (rv != EXR_ERR_SUCCESS) return rv;
+            if (mapped && (dataoffset - decode->chunk.data_offset) + toread <=
+                              decode->chunk.packed_size)
+            {
+                memcpy (
+                    cdata,
+                    mapped + (dataoffset - decode->chunk.data_offset),
+                    toread);
+                dataoffset += toread;
+            }
+            else
+            {
+                rv = ctxt->do_read (
+                    ctxt, cdata, toread, &dataoffset, NULL, EXR_MUST_READ_ALL);
+                if (rv != EXR_ERR_SUCCESS) return rv;
+            }
 
             // need to swab them to native
             if (decc->bytes_per_element == 2)
@@ -199,15 +222,41 @@ default_read_chunk (exr_decode_pipeline_t* decode)
     }
     else if (decode->chunk.packed_size > 0)
     {
-        rv = internal_decode_alloc_buffer (
-            decode,
-            EXR_TRANSCODE_BUFFER_PACKED,
-            &(decode->packed_buffer),
-            &(decode->packed_alloc_size),
-            decode->chunk.packed_size);
-        if (rv != EXR_ERR_SUCCESS) return rv;
-        rv = exr_read_chunk (
-            ctxt, decode->part_index, &(decode->chunk), decode->packed_buffer);
+        const void* mapped = NULL;
+
+        if (ctxt->mapped_data)
+        {
+            rv = internal_exr_borrow_chunk (
+                ctxt, decode->part_index, &(decode->chunk), &mapped);
+            if (rv != EXR_ERR_SUCCESS) return rv;
+        }
+
+        if (mapped)
+        {
+            /* use the file mapping in place, the zero alloc size marks
+             * the buffer as not owned by the pipeline */
+            internal_decode_free_buffer (
+                decode,
+                EXR_TRANSCODE_BUFFER_PACKED,
+                &(decode->packed_buffer),
+                &(decode->packed_alloc_size));
+            decode->packed_buffer = EXR_CONST_CAST (void*, mapped);
+        }
+        else
+        {
+            rv = internal_decode_alloc_buffer (
+                decode,
+                EXR_TRANSCODE_BUFFER_PACKED,
+                &(decode->packed_buffer),
+                &(decode->packed_alloc_size),
+                decode->chunk.packed_size);
+            if (rv != EXR_ERR_SUCCESS) return rv;
+            rv = exr_read_chunk (
+                ctxt,
+                decode->part_index,
+                &(decode->chunk),
+                decode->packed_buffer);
+        }
     }
     else
         rv = EXR_ERR_SUCCESS;
@@ -748,3 +797,138 @@ exr_decoding_destroy (exr_const_context_t ctxt, exr_decode_pipeline_t* decode)
     }
     return EXR_ERR_SUCCESS;
 }
+
+/**************************************/
+
+struct _priv_exr_decoding_queue
+{
+    exr_const_context_t     ctxt;
+    int                     part_index;
+    int                     depth;
+    int                     head;
+    int                     count;
+    exr_decode_pipeline_t** pending;
+};
+
+exr_result_t
+exr_decoding_queue_create (
+    exr_const_context_t   ctxt,
+    int                   part_index,
+    int                   depth,
+    exr_decoding_queue_t* queue)
+{
+    exr_decoding_queue_t q;
+
+    if (!ctxt) return EXR_ERR_MISSING_CONTEXT_ARG;
+    if (part_index < 0 || part_index >= ctxt->num_parts)
+        return ctxt->print_error (
+            ctxt,
+            EXR_ERR_ARGUMENT_OUT_OF_RANGE,
+            "Part index (%d) out of range",
+            part_index);
+    if (!queue) return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+    *queue = NULL;
+    if (depth < 1)
+        return ctxt->print_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Invalid decoding queue depth (%d), must be at least 1",
+            depth);
+
+    q = ctxt->alloc_fn (
+        sizeof (struct _priv_exr_decoding_queue) +
+        sizeof (exr_decode_pipeline_t*) * (size_t) depth);
+    if (!q) return ctxt->standard_error (ctxt, EXR_ERR_OUT_OF_MEMORY);
+
+    q->ctxt       = ctxt;
+    q->part_index = part_index;
+    q->depth      = depth;
+    q->head       = 0;
+    q->count      = 0;
+    q->pending    = (exr_decode_pipeline_t**) (q + 1);
+
+    *queue = q;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+exr_result_t
+exr_decoding_queue_submit (
+    exr_decoding_queue_t queue, exr_decode_pipeline_t* decode)
+{
+    exr_const_context_t     ctxt;
+    const exr_chunk_info_t* cinfo;
+
+    if (!queue) return EXR_ERR_INVALID_ARGUMENT;
+    ctxt = queue->ctxt;
+
+    if (!decode) return ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT);
+    if (decode->context != ctxt || decode->part_index != queue->part_index)
+        return ctxt->report_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Invalid request to queue decoding from different context / part");
+    if (queue->count == queue->depth)
+        return ctxt->print_error (
+            ctxt,
+            EXR_ERR_ARGUMENT_OUT_OF_RANGE,
+            "Decoding queue is full (%d pipelines), poll for a completed one first",
+            queue->depth);
+
+    /* start the i/o for this chunk now so it overlaps with the
+     * decompression of the ones ahead of it */
+    cinfo = &(decode->chunk);
+    if (ctxt->prefetch_fn)
+    {
+        if (cinfo->sample_count_table_size > 0)
+            ctxt->prefetch_fn (
+                ctxt,
+                cinfo->sample_count_data_offset,
+                cinfo->sample_count_table_size);
+        if (cinfo->packed_size > 0)
+            ctxt->prefetch_fn (ctxt, cinfo->data_offset, cinfo->packed_size);
+    }
+
+    queue->pending[(queue->head + queue->count) % queue->depth] = decode;
+    ++(queue->count);
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+exr_result_t
+exr_decoding_queue_poll (
+    exr_decoding_queue_t queue, exr_decode_pipeline_t** done)
+{
+    exr_decode_pipeline_t* decode;
+
+    if (!queue) return EXR_ERR_INVALID_ARGUMENT;
+    if (!done)
+        return queue->ctxt->standard_error (
+            queue->ctxt, EXR_ERR_INVALID_ARGUMENT);
+
+    *done = NULL;
+    if (queue->count == 0) return EXR_ERR_SUCCESS;
+
+    decode      = queue->pending[queue->head];
+    queue->head = (queue->head + 1) % queue->depth;
+    --(queue->count);
+
+    *done = decode;
+    return exr_decoding_run (queue->ctxt, queue->part_index, decode);
+}
+
+/**************************************/
+
+exr_result_t
+exr_decoding_queue_destroy (exr_decoding_queue_t* queue)
+{
+    if (!queue) return EXR_ERR_INVALID_ARGUMENT;
+    if (*queue)
+    {
+        (*queue)->ctxt->free_fn (*queue);
+        *queue = NULL;
+    }
+    return EXR_ERR_SUCCESS;
+}
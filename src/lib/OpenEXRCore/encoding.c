@@ -12,6 +12,15 @@
 
 #include "openexr_compression.h"
 
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <time.h>
+#endif
+
 /**************************************/
 
 static exr_result_t
@@ -95,6 +104,19 @@ default_write_chunk (exr_encode_pipeline_t* encode)
 
 /**************************************/
 
+/* Callers built against a header that predates intra_chunk_threads
+ * pass the smaller pipeline struct, so only the fields they declared
+ * through EXR_ENCODE_PIPELINE_INITIALIZER may be touched. */
+static size_t
+encode_pipe_size (const exr_encode_pipeline_t* encode)
+{
+    if (encode->pipe_size == sizeof (exr_encode_pipeline_t))
+        return sizeof (exr_encode_pipeline_t);
+    return offsetof (exr_encode_pipeline_t, intra_chunk_threads);
+}
+
+/**************************************/
+
 exr_result_t
 exr_encoding_initialize (
     exr_const_context_t     ctxt,
@@ -102,8 +124,8 @@ exr_encoding_initialize (
     const exr_chunk_info_t* cinfo,
     exr_encode_pipeline_t*  encode)
 {
-    exr_result_t          rv;
-    exr_encode_pipeline_t nil = {0};
+    exr_result_t rv;
+    size_t       psize;
 
     EXR_LOCK_WRITE_AND_DEFINE_PART (part_index);
     if (!cinfo || !encode)
@@ -120,7 +142,9 @@ exr_encoding_initialize (
             ctxt->standard_error (ctxt, EXR_ERR_NOT_OPEN_WRITE));
     }
 
-    *encode = nil;
+    psize = encode_pipe_size (encode);
+    memset (encode, 0, psize);
+    encode->pipe_size = psize;
 
     rv = internal_coding_fill_channel_info (
         &(encode->channels),
@@ -391,7 +415,7 @@ exr_encoding_destroy (exr_const_context_t ctxt, exr_encode_pipeline_t* encode)
 
     if (encode)
     {
-        exr_encode_pipeline_t nil = {0};
+        size_t psize = encode_pipe_size (encode);
         if (encode->channels != encode->_quick_chan_store)
             ctxt->free_fn (encode->channels);
 
@@ -420,7 +444,294 @@ exr_encoding_destroy (exr_const_context_t ctxt, exr_encode_pipeline_t* encode)
             EXR_TRANSCODE_BUFFER_PACKED_SAMPLES,
             &(encode->packed_sample_count_table),
             &(encode->packed_sample_count_alloc_size));
-        *encode = nil;
+        memset (encode, 0, psize);
+        encode->pipe_size = psize;
     }
     return EXR_ERR_SUCCESS;
 }
+
+/**************************************/
+
+static double
+trial_clock_seconds (void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency (&freq);
+    QueryPerformanceCounter (&now);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+static exr_result_t
+trial_compress (
+    exr_context_t                     tmp,
+    int                               tpart,
+    exr_compression_t                 ctype,
+    const exr_compression_selector_t* selector,
+    int                               sample_count,
+    int                               band_height,
+    exr_compression_trial_t*          trial)
+{
+    exr_result_t          rv;
+    exr_const_priv_part_t part;
+    exr_encode_pipeline_t encode = {0};
+    exr_chunk_info_t      cinfo;
+    exr_attr_box2i_t      dw, box;
+    int64_t               regionw, regionh, nregionsx, nregions;
+    int                   lpc, first = 1;
+    double                elapsed = 0.0;
+
+    trial->compression    = ctype;
+    trial->unpacked_bytes = 0;
+    trial->packed_bytes   = 0;
+    trial->mb_per_sec     = 0.0;
+
+    rv = exr_set_compression (tmp, tpart, ctype);
+    if (rv != EXR_ERR_SUCCESS) return rv;
+
+    /*
+     * Samples are taken from regions evenly spread over the part: a
+     * tile, or for scanlines a band as tall as the tallest chunk of
+     * any candidate, so every candidate compresses the same pixels.
+     */
+    part = tmp->parts[tpart];
+    dw   = part->data_window;
+    if (part->tiles)
+    {
+        regionw = (int64_t) part->tiles->tiledesc->x_size;
+        regionh = (int64_t) part->tiles->tiledesc->y_size;
+        lpc     = (int) regionh;
+    }
+    else
+    {
+        regionw = (int64_t) dw.max.x - dw.min.x + 1;
+        regionh = band_height;
+        lpc     = exr_compression_lines_per_chunk (ctype);
+    }
+    nregionsx = ((int64_t) dw.max.x - dw.min.x + regionw) / regionw;
+    nregions  = nregionsx * (((int64_t) dw.max.y - dw.min.y + regionh) / regionh);
+    if (sample_count > nregions) sample_count = (int) nregions;
+
+    /* the first pass over the first chunk is not timed, so one time
+     * table setup and cold caches do not count against the first
+     * candidate */
+    for (int s = -1; rv == EXR_ERR_SUCCESS && s < sample_count; ++s)
+    {
+        int64_t region = 0, y, endy;
+
+        if (s >= 0) region = ((2 * s + 1) * nregions) / (2 * sample_count);
+
+        box       = dw;
+        box.min.x = (int32_t) (dw.min.x + (region % nregionsx) * regionw);
+        y         = (int64_t) dw.min.y + (region / nregionsx) * regionh;
+        endy      = s < 0 ? y + 1 : y + regionh;
+        if (endy > (int64_t) dw.max.y + 1) endy = (int64_t) dw.max.y + 1;
+
+        for (; rv == EXR_ERR_SUCCESS && y < endy; y += lpc)
+        {
+            double start;
+
+            box.min.y = (int32_t) y;
+            rv = exr_chunk_default_initialize (tmp, tpart, &box, 0, 0, &cinfo);
+            if (rv != EXR_ERR_SUCCESS) break;
+
+            if (first)
+                rv = exr_encoding_initialize (tmp, tpart, &cinfo, &encode);
+            else
+                rv = exr_encoding_update (tmp, tpart, &cinfo, &encode);
+            if (rv != EXR_ERR_SUCCESS) break;
+
+            rv = selector->sample_fn (selector->userdata, &encode);
+            if (rv != EXR_ERR_SUCCESS) break;
+
+            if (first)
+            {
+                rv = exr_encoding_choose_default_routines (
+                    tmp, tpart, &encode);
+                if (rv != EXR_ERR_SUCCESS) break;
+                /* nothing is written, and there is no chunk order to
+                 * wait on */
+                encode.yield_until_ready_fn = NULL;
+                encode.write_fn             = NULL;
+                first                       = 0;
+            }
+
+            start = trial_clock_seconds ();
+            rv    = exr_encoding_run (tmp, tpart, &encode);
+            if (s < 0) continue;
+            elapsed += trial_clock_seconds () - start;
+
+            trial->unpacked_bytes += cinfo.unpacked_size;
+            trial->packed_bytes += encode.compressed_bytes;
+        }
+    }
+
+    if (rv == EXR_ERR_SUCCESS)
+    {
+        /* guard against a clock too coarse to see tiny samples */
+        if (elapsed <= 0.0) elapsed = 1e-9;
+        trial->mb_per_sec = (double) trial->unpacked_bytes / elapsed / 1e6;
+    }
+
+    exr_encoding_destroy (tmp, &encode);
+    return rv;
+}
+
+/**************************************/
+
+exr_result_t
+exr_select_compression (
+    exr_context_t                     ctxt,
+    int                               part_index,
+    const exr_compression_selector_t* selector,
+    exr_compression_t*                chosen,
+    exr_compression_trial_t*          trials)
+{
+    static const exr_compression_t default_candidates[] = {
+        EXR_COMPRESSION_RLE,
+        EXR_COMPRESSION_ZIPS,
+        EXR_COMPRESSION_ZIP,
+        EXR_COMPRESSION_PIZ};
+
+    exr_result_t              rv, firstfail = EXR_ERR_SUCCESS;
+    exr_context_t             tmp   = NULL;
+    exr_context_initializer_t inits = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    exr_storage_t             storage;
+    const exr_compression_t*  candidates;
+    int                       ncand, nsamples, tpart = 0;
+    int                       band = 1, best = -1, nmeasured = 0;
+    double                    bestratio = 0.0;
+
+    EXR_LOCK_AND_DEFINE_PART (part_index);
+
+    if (ctxt->mode != EXR_CONTEXT_WRITE)
+        return EXR_UNLOCK_AND_RETURN (
+            ctxt->standard_error (ctxt, EXR_ERR_NOT_OPEN_WRITE));
+
+    if (!selector || !selector->sample_fn ||
+        (selector->candidates && selector->candidate_count <= 0))
+        return EXR_UNLOCK_AND_RETURN (
+            ctxt->standard_error (ctxt, EXR_ERR_INVALID_ARGUMENT));
+
+    storage = part->storage_mode;
+    if (storage != EXR_STORAGE_SCANLINE && storage != EXR_STORAGE_TILED)
+        return EXR_UNLOCK_AND_RETURN (ctxt->report_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Compression selection is only available for scanline and tiled parts"));
+
+    if (!part->channels || part->channels->chlist->num_channels <= 0 ||
+        part->data_window.max.x < part->data_window.min.x ||
+        part->data_window.max.y < part->data_window.min.y ||
+        (storage == EXR_STORAGE_TILED && !part->tiles))
+        return EXR_UNLOCK_AND_RETURN (ctxt->report_error (
+            ctxt,
+            EXR_ERR_MISSING_REQ_ATTR,
+            "Channels, data window and tiling must be defined before selecting a compression"));
+
+    if (selector->candidates)
+    {
+        candidates = selector->candidates;
+        ncand      = selector->candidate_count;
+    }
+    else
+    {
+        candidates = default_candidates;
+        ncand      = sizeof (default_candidates) / sizeof (exr_compression_t);
+    }
+
+    for (int c = 0; c < ncand; ++c)
+    {
+        if ((int) candidates[c] < 0 ||
+            candidates[c] >= EXR_COMPRESSION_LAST_TYPE)
+            return EXR_UNLOCK_AND_RETURN (ctxt->print_error (
+                ctxt,
+                EXR_ERR_INVALID_ARGUMENT,
+                "Invalid compression candidate (%d)",
+                (int) candidates[c]));
+    }
+
+    nsamples = selector->sample_chunks > 0 ? selector->sample_chunks : 4;
+    for (int c = 0; c < ncand; ++c)
+    {
+        int lpc = exr_compression_lines_per_chunk (candidates[c]);
+        if (lpc > band) band = lpc;
+    }
+
+    /* the trials run on a copy of the header, so the part being
+     * defined is untouched until the decision is made */
+    inits.alloc_fn         = ctxt->alloc_fn;
+    inits.free_fn          = ctxt->free_fn;
+    inits.error_handler_fn = ctxt->error_handler_fn;
+    inits.user_data        = ctxt->real_user_data;
+
+    /* the temporary context comes with a part 0 to define */
+    rv = exr_start_temporary_context (&tmp, "compression selection", &inits);
+    if (rv == EXR_ERR_SUCCESS)
+        rv = exr_set_zip_compression_level (
+            tmp, tpart, part->zip_compression_level);
+    if (rv == EXR_ERR_SUCCESS)
+        rv = exr_set_dwa_compression_level (
+            tmp, tpart, part->dwa_compression_level);
+    for (int32_t r = 0;
+         rv == EXR_ERR_SUCCESS && r < part->dwa_channel_rule_count;
+         ++r)
+    {
+        const internal_exr_dwa_channel_rule_t* rule =
+            part->dwa_channel_rules + r;
+        rv = exr_add_dwa_channel_rule (
+            tmp,
+            tpart,
+            rule->suffix,
+            (exr_pixel_type_t) rule->type,
+            (exr_dwa_channel_scheme_t) rule->scheme,
+            rule->case_insensitive);
+    }
+    internal_exr_unlock (ctxt);
+
+    if (rv == EXR_ERR_SUCCESS)
+        rv = exr_copy_unset_attributes (tmp, tpart, ctxt, part_index);
+
+    for (int c = 0; rv == EXR_ERR_SUCCESS && c < ncand; ++c)
+    {
+        exr_compression_trial_t local;
+        exr_compression_trial_t* trial = trials ? (trials + c) : &local;
+        double                   ratio;
+
+        trial->result = trial_compress (
+            tmp, tpart, candidates[c], selector, nsamples, band, trial);
+        if (trial->result != EXR_ERR_SUCCESS)
+        {
+            if (firstfail == EXR_ERR_SUCCESS) firstfail = trial->result;
+            continue;
+        }
+        ++nmeasured;
+
+        if (selector->min_mb_per_sec > 0.f &&
+            trial->mb_per_sec < (double) selector->min_mb_per_sec)
+            continue;
+
+        ratio = (double) trial->packed_bytes / (double) trial->unpacked_bytes;
+        if (best < 0 || ratio < bestratio)
+        {
+            best      = c;
+            bestratio = ratio;
+        }
+    }
+
+    if (tmp) exr_finish (&tmp);
+    if (rv != EXR_ERR_SUCCESS) return rv;
+    /* most likely the sample function failing, not the codecs */
+    if (nmeasured == 0) return firstfail;
+
+    rv = exr_set_compression (
+        ctxt, part_index, best < 0 ? EXR_COMPRESSION_NONE : candidates[best]);
+    if (rv == EXR_ERR_SUCCESS && chosen)
+        *chosen = best < 0 ? EXR_COMPRESSION_NONE : candidates[best];
+    return rv;
+}
@@ -7,6 +7,7 @@
 #include "internal_decompress.h"
 
 #include "internal_coding.h"
+#include "internal_cpuid.h"
 #include "internal_xdr.h"
 
 #include <string.h>
@@ -335,6 +336,423 @@ unpack3 (const uint8_t b[3], uint16_t s[16])
 
 /**************************************/
 
+//
+// Vectorized block codec
+//
+// Each 4x4 block lives in one 256-bit register, pixel 4*k+j (row k,
+// column j) in 16-bit lane 4*k+j. The 16 6-bit fields of the 14-byte
+// encoding (the shift followed by r[0] ... r[14]) are laid out so
+// that field 4*j+k is the difference feeding lane 4*k+j: lane 0 holds
+// s[0], the rest of column 0 the vertical and the other columns the
+// horizontal running differences. Decoding is then a prefix sum over
+// each row plus a prefix sum over column 0, encoding the difference
+// of each lane against its left (or, in column 0, upper) neighbor.
+//
+// Intermediate values stay bit exact with pack / unpack14 above in
+// 16-bit lanes: tMax - t[i] is at most 0xfbff - 0x0400, so the
+// rounded shift never overflows, and the biased running differences
+// wrap to a value in [0, 63] exactly when the scalar int difference
+// lies in that range.
+//
+// The block functions only handle complete 4x4 blocks for which a
+// full 16-byte load or store stays inside the buffer, and return the
+// number of blocks processed; the caller finishes the remainder of the
+// row, including the padded edge block, with the scalar code.
+//
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__))
+#    define ENABLE_AVX2_B44
+#    include <immintrin.h>
+#endif
+
+static int
+b44_dec_blocks_scalar (
+    const uint8_t* in,
+    uint64_t       nIn,
+    uint16_t*      row0,
+    uint64_t       nx,
+    int            nblocks,
+    int            linear,
+    uint64_t*      nRead)
+{
+    (void) in;
+    (void) nIn;
+    (void) row0;
+    (void) nx;
+    (void) nblocks;
+    (void) linear;
+    *nRead = 0;
+    return 0;
+}
+
+static int
+b44_enc_blocks_scalar (
+    const uint16_t* row0,
+    uint64_t        nx,
+    int             nblocks,
+    int             flatfields,
+    int             linear,
+    uint8_t*        out,
+    uint64_t        nOut,
+    uint64_t*       nWritten)
+{
+    (void) row0;
+    (void) nx;
+    (void) nblocks;
+    (void) flatfields;
+    (void) linear;
+    (void) out;
+    (void) nOut;
+    *nWritten = 0;
+    return 0;
+}
+
+#ifdef ENABLE_AVX2_B44
+
+#    define B44_AVX2 __attribute__ ((target ("avx2")))
+
+/* the tables are padded so the 32-bit gather of the last entry is valid */
+B44_AVX2 static inline __m256i
+b44_lookup_avx2 (const uint16_t* table, __m256i s)
+{
+    const __m256i mask = _mm256_set1_epi32 (0xFFFF);
+    __m256i       lo   = _mm256_i32gather_epi32 (
+        (const int*) table,
+        _mm256_cvtepu16_epi32 (_mm256_castsi256_si128 (s)),
+        2);
+    __m256i hi = _mm256_i32gather_epi32 (
+        (const int*) table,
+        _mm256_cvtepu16_epi32 (_mm256_extracti128_si256 (s, 1)),
+        2);
+    __m256i r = _mm256_packus_epi32 (
+        _mm256_and_si256 (lo, mask), _mm256_and_si256 (hi, mask));
+    return _mm256_permute4x64_epi64 (r, 0xD8);
+}
+
+/* undo the ordered mapping: t & 0x8000 ? t & 0x7fff : ~t */
+B44_AVX2 static inline __m256i
+b44_from_ordered_avx2 (__m256i t)
+{
+    __m256i neg = _mm256_srai_epi16 (t, 15);
+    return _mm256_blendv_epi8 (
+        _mm256_xor_si256 (t, _mm256_set1_epi16 (-1)),
+        _mm256_and_si256 (t, _mm256_set1_epi16 (0x7fff)),
+        neg);
+}
+
+B44_AVX2 static inline __m256i
+b44_unpack14_avx2 (const uint8_t* b)
+{
+    //
+    // Gather, for each lane, the big endian 16-bit word holding its
+    // field: fields 0 and 1 of a 3-byte group sit in its first two
+    // bytes, fields 2 and 3 in its last two. The per row multiply
+    // moves the field to the top 6 bits.
+    //
+    const __m256i words = _mm256_setr_epi8 (
+        3, 2, 6, 5, 9, 8, 12, 11,      // row 0: field 0 of each group
+        3, 2, 6, 5, 9, 8, 12, 11,      // row 1: field 1
+        4, 3, 7, 6, 10, 9, 13, 12,     // row 2: field 2
+        4, 3, 7, 6, 10, 9, 13, 12);    // row 3: field 3
+    const __m256i align = _mm256_setr_epi16 (
+        1, 1, 1, 1, 64, 64, 64, 64, 16, 16, 16, 16, 1024, 1024, 1024, 1024);
+    const __m256i low  = _mm256_set_epi64x (0, 0, -1, -1);
+    __m128i       shift;
+    __m256i       v, p, c;
+
+    v = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i*) b));
+    v = _mm256_shuffle_epi8 (v, words);
+    v = _mm256_srli_epi16 (_mm256_mullo_epi16 (v, align), 10);
+
+    shift = _mm_cvtsi32_si128 (b[2] >> 2);
+    v     = _mm256_sub_epi16 (v, _mm256_set1_epi16 (0x20));
+    v     = _mm256_sll_epi16 (v, shift);
+    v     = _mm256_insert_epi16 (v, (int16_t) ((b[0] << 8) | b[1]), 0);
+
+    /* running sum along each row */
+    p = _mm256_add_epi16 (v, _mm256_slli_epi64 (v, 16));
+    p = _mm256_add_epi16 (p, _mm256_slli_epi64 (p, 32));
+
+    /* add the column 0 sums of all rows above */
+    c = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (p, 0), 0);
+    c = _mm256_add_epi16 (c, _mm256_slli_si256 (c, 8));
+    p = _mm256_add_epi16 (p, _mm256_slli_si256 (c, 8));
+    p = _mm256_add_epi16 (
+        p, _mm256_andnot_si256 (low, _mm256_permute4x64_epi64 (c, 0x55)));
+
+    return b44_from_ordered_avx2 (p);
+}
+
+B44_AVX2 static inline void
+b44_store_block_avx2 (uint16_t* row0, uint64_t nx, __m256i s)
+{
+    __m128i lo = _mm256_castsi256_si128 (s);
+    __m128i hi = _mm256_extracti128_si256 (s, 1);
+
+    _mm_storel_epi64 ((__m128i*) row0, lo);
+    _mm_storel_epi64 ((__m128i*) (row0 + nx), _mm_unpackhi_epi64 (lo, lo));
+    _mm_storel_epi64 ((__m128i*) (row0 + 2 * nx), hi);
+    _mm_storel_epi64 ((__m128i*) (row0 + 3 * nx), _mm_unpackhi_epi64 (hi, hi));
+}
+
+B44_AVX2 static inline __m256i
+b44_load_block_avx2 (const uint16_t* row0, uint64_t nx)
+{
+    __m128i lo = _mm_unpacklo_epi64 (
+        _mm_loadl_epi64 ((const __m128i*) row0),
+        _mm_loadl_epi64 ((const __m128i*) (row0 + nx)));
+    __m128i hi = _mm_unpacklo_epi64 (
+        _mm_loadl_epi64 ((const __m128i*) (row0 + 2 * nx)),
+        _mm_loadl_epi64 ((const __m128i*) (row0 + 3 * nx)));
+    return _mm256_inserti128_si256 (_mm256_castsi128_si256 (lo), hi, 1);
+}
+
+B44_AVX2 static inline __m256i
+b44_decode_avx2 (const uint8_t* b, int linear)
+{
+    __m256i s;
+
+    if (b[2] >= (13 << 2))
+    {
+        uint16_t t = (uint16_t) ((b[0] << 8) | b[1]);
+
+        t = (t & 0x8000) ? (t & 0x7fff) : (uint16_t) ~t;
+        if (linear) t = exrcore_logTable[t];
+        return _mm256_set1_epi16 ((int16_t) t);
+    }
+
+    s = b44_unpack14_avx2 (b);
+    if (linear) s = b44_lookup_avx2 (exrcore_logTable, s);
+    return s;
+}
+
+B44_AVX2 static int
+b44_dec_blocks_avx2 (
+    const uint8_t* in,
+    uint64_t       nIn,
+    uint16_t*      row0,
+    uint64_t       nx,
+    int            nblocks,
+    int            linear,
+    uint64_t*      nRead)
+{
+    uint64_t bIn = 0;
+    int      x   = 0;
+
+    //
+    // Two blocks per iteration: finding where the second block starts
+    // only needs the first one's third byte, so both decodes overlap.
+    //
+    for (; x + 1 < nblocks; x += 2)
+    {
+        uint64_t n0, n1;
+        __m256i  s0, s1;
+
+        /* the second block may start 14 bytes in and loads 16 */
+        if (bIn + 30 > nIn) break;
+        n0 = (in[bIn + 2] >= (13 << 2)) ? 3 : 14;
+        n1 = (in[bIn + n0 + 2] >= (13 << 2)) ? 3 : 14;
+
+        s0 = b44_decode_avx2 (in + bIn, linear);
+        s1 = b44_decode_avx2 (in + bIn + n0, linear);
+        b44_store_block_avx2 (row0 + 4 * x, nx, s0);
+        b44_store_block_avx2 (row0 + 4 * x + 4, nx, s1);
+        bIn += n0 + n1;
+    }
+
+    for (; x < nblocks; ++x)
+    {
+        if (bIn + 16 > nIn) break;
+        b44_store_block_avx2 (
+            row0 + 4 * x, nx, b44_decode_avx2 (in + bIn, linear));
+        bIn += (in[bIn + 2] >= (13 << 2)) ? 3 : 14;
+    }
+
+    *nRead = bIn;
+    return x;
+}
+
+B44_AVX2 static inline int
+b44_pack_avx2 (__m256i s, uint8_t* b, int flatfields, int exactmax)
+{
+    const __m256i ones  = _mm256_set1_epi16 (-1);
+    const __m256i bias  = _mm256_set1_epi16 (0x20);
+    const __m256i col0  = _mm256_set1_epi64x (0xFFFF);
+    const __m256i lane0 = _mm256_setr_epi16 (
+        -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i  t, x, d, r, up;
+    __m128i  m, sh;
+    uint16_t tMax, t0;
+    int      shift = -1;
+
+    /* map to the ordered representation, see pack */
+    t = _mm256_blendv_epi8 (
+        _mm256_or_si256 (s, _mm256_set1_epi16 ((int16_t) 0x8000)),
+        _mm256_xor_si256 (s, ones),
+        _mm256_srai_epi16 (s, 15));
+    x = _mm256_set1_epi16 (0x7c00);
+    t = _mm256_blendv_epi8 (
+        t,
+        _mm256_set1_epi16 ((int16_t) 0x8000),
+        _mm256_cmpeq_epi16 (_mm256_and_si256 (s, x), x));
+
+    m    = _mm_max_epu16 (
+        _mm256_castsi256_si128 (t), _mm256_extracti128_si256 (t, 1));
+    m    = _mm_minpos_epu16 (_mm_xor_si128 (m, _mm_set1_epi16 (-1)));
+    tMax = (uint16_t) ~_mm_cvtsi128_si32 (m);
+    t0   = (uint16_t) _mm256_extract_epi16 (t, 0);
+
+    x = _mm256_sub_epi16 (_mm256_set1_epi16 ((int16_t) tMax), t);
+
+    do
+    {
+        shift += 1;
+        sh = _mm_cvtsi32_si128 (shift);
+
+        //
+        // shiftAndRound: (x + 2^(shift-1) - 1 + (x >> shift & 1)) >> shift,
+        // which is x itself for shift 0
+        //
+        if (shift == 0)
+            d = x;
+        else
+        {
+            __m256i odd = _mm256_and_si256 (
+                _mm256_srl_epi16 (x, sh), _mm256_set1_epi16 (1));
+            d = _mm256_add_epi16 (
+                x, _mm256_set1_epi16 ((int16_t) ((1 << (shift - 1)) - 1)));
+            d = _mm256_srl_epi16 (_mm256_add_epi16 (d, odd), sh);
+        }
+
+        /* the neighbor to the left, or above for column 0 */
+        up = _mm256_alignr_epi8 (
+            d, _mm256_permute2x128_si256 (d, d, 0x08), 8);
+        r  = _mm256_blendv_epi8 (_mm256_slli_epi64 (d, 16), up, col0);
+        r  = _mm256_add_epi16 (_mm256_sub_epi16 (r, d), bias);
+        r  = _mm256_blendv_epi8 (r, bias, lane0);
+    } while (_mm256_movemask_epi8 (_mm256_cmpeq_epi16 (
+                 _mm256_min_epu16 (r, _mm256_set1_epi16 (0x3f)), r)) != -1);
+
+    if (flatfields &&
+        _mm256_movemask_epi8 (_mm256_cmpeq_epi16 (r, bias)) == -1)
+    {
+        b[0] = (uint8_t) (t0 >> 8);
+        b[1] = (uint8_t) t0;
+        b[2] = 0xfc;
+        return 3;
+    }
+
+    if (exactmax)
+        t0 = tMax - (uint16_t) (_mm256_extract_epi16 (d, 0) << shift);
+
+    //
+    // Field 4*j+k comes from lane 4*k+j: pair rows 0/1 and 2/3 of
+    // each column into 12 bits, join those into one 24-bit group per
+    // column and emit the groups big endian after t[0].
+    //
+    {
+        __m128i lo = _mm256_castsi256_si128 (r);
+        __m128i hi = _mm256_extracti128_si256 (r, 1);
+        __m128i k  = _mm_setr_epi16 (64, 1, 64, 1, 64, 1, 64, 1);
+        __m128i g;
+
+        lo = _mm_insert_epi16 (lo, shift, 0);
+        lo = _mm_unpacklo_epi16 (lo, _mm_srli_si128 (lo, 8));
+        hi = _mm_unpacklo_epi16 (hi, _mm_srli_si128 (hi, 8));
+        g  = _mm_or_si128 (
+            _mm_slli_epi32 (_mm_madd_epi16 (lo, k), 12),
+            _mm_madd_epi16 (hi, k));
+        g  = _mm_shuffle_epi8 (
+            g,
+            _mm_setr_epi8 (
+                -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1));
+        g = _mm_insert_epi16 (
+            g, (int16_t) (uint16_t) ((t0 >> 8) | (t0 << 8)), 0);
+        _mm_storeu_si128 ((__m128i*) b, g);
+    }
+
+    return 14;
+}
+
+B44_AVX2 static int
+b44_enc_blocks_avx2 (
+    const uint16_t* row0,
+    uint64_t        nx,
+    int             nblocks,
+    int             flatfields,
+    int             linear,
+    uint8_t*        out,
+    uint64_t        nOut,
+    uint64_t*       nWritten)
+{
+    uint64_t bOut = 0;
+    int      x    = 0;
+
+    for (; x + 1 < nblocks; x += 2)
+    {
+        __m256i s0, s1;
+
+        if (bOut + 30 > nOut) break;
+
+        s0 = b44_load_block_avx2 (row0 + 4 * x, nx);
+        s1 = b44_load_block_avx2 (row0 + 4 * x + 4, nx);
+        if (linear)
+        {
+            s0 = b44_lookup_avx2 (exrcore_expTable, s0);
+            s1 = b44_lookup_avx2 (exrcore_expTable, s1);
+        }
+        bOut += (uint64_t) b44_pack_avx2 (s0, out + bOut, flatfields, !linear);
+        bOut += (uint64_t) b44_pack_avx2 (s1, out + bOut, flatfields, !linear);
+    }
+
+    for (; x < nblocks; ++x)
+    {
+        __m256i s;
+
+        if (bOut + 16 > nOut) break;
+
+        s = b44_load_block_avx2 (row0 + 4 * x, nx);
+        if (linear) s = b44_lookup_avx2 (exrcore_expTable, s);
+        bOut += (uint64_t) b44_pack_avx2 (s, out + bOut, flatfields, !linear);
+    }
+
+    *nWritten = bOut;
+    return x;
+}
+
+#endif /* ENABLE_AVX2_B44 */
+
+static int (*b44_dec_blocks) (
+    const uint8_t*, uint64_t, uint16_t*, uint64_t, int, int, uint64_t*) =
+    &b44_dec_blocks_scalar;
+static int (*b44_enc_blocks) (
+    const uint16_t*, uint64_t, int, int, int, uint8_t*, uint64_t, uint64_t*) =
+    &b44_enc_blocks_scalar;
+
+static void
+choose_b44_impl (void)
+{
+#ifdef EXR_HAS_STD_ATOMICS
+    static atomic_int init_cpu_check = 1;
+#else
+    static int init_cpu_check = 1;
+#endif
+    if (init_cpu_check)
+    {
+#ifdef ENABLE_AVX2_B44
+        if (has_avx2 ())
+        {
+            b44_dec_blocks = &b44_dec_blocks_avx2;
+            b44_enc_blocks = &b44_enc_blocks_avx2;
+        }
+#endif
+        init_cpu_check = 0;
+    }
+}
+
+/**************************************/
+
 static exr_result_t
 compress_b44_impl (exr_encode_pipeline_t* encode, int flat_field)
 {
@@ -355,6 +773,7 @@ compress_b44_impl (exr_encode_pipeline_t* encode, int flat_field)
     if (rv != EXR_ERR_SUCCESS) return rv;
 
     exrcore_ensure_b44_tables ();
+    choose_b44_impl ();
 
     nOut   = 0;
     packed = encode->packed_buffer;
@@ -429,6 +848,7 @@ compress_b44_impl (exr_encode_pipeline_t* encode, int flat_field)
             uint16_t *row0, *row1, *row2, *row3;
             /* row offset in elements: use uint64_t so y*nx cannot overflow int */
             uint64_t row_off = (uint64_t) (y) * (uint64_t) (nx);
+            int      x0      = 0;
 
             row0 = (uint16_t*) scratch + row_off;
             row1 = row0 + (uint64_t) nx;
@@ -442,8 +862,34 @@ compress_b44_impl (exr_encode_pipeline_t* encode, int flat_field)
 
                 row3 = row2;
             }
+            else
+            {
+                uint64_t nw;
+
+                x0 = b44_enc_blocks (
+                    row0,
+                    (uint64_t) nx,
+                    nx / 4,
+                    flat_field,
+                    curc->p_linear,
+                    out,
+                    encode->compressed_alloc_size - nOut,
+                    &nw);
+                if (x0 > 0)
+                {
+                    out += nw;
+                    nOut += nw;
+                    if (nOut + 14 > encode->compressed_alloc_size)
+                        return EXR_ERR_OUT_OF_MEMORY;
+
+                    row0 += 4 * x0;
+                    row1 += 4 * x0;
+                    row2 += 4 * x0;
+                    row3 += 4 * x0;
+                }
+            }
 
-            for (int x = 0; x < nx; x += 4)
+            for (int x = 4 * x0; x < nx; x += 4)
             {
                 uint16_t s[16];
 
@@ -559,11 +1005,29 @@ uncompress_b44_impl (
         {
             /* row offset in elements: use uint64_t so y*nx cannot overflow int */
             uint64_t row_off = (uint64_t) (y) * (uint64_t) (nx);
+            int      x0      = 0;
             row0 = (uint16_t*) scratch + row_off;
             row1 = row0 + (uint64_t) nx;
             row2 = row1 + (uint64_t) nx;
             row3 = row2 + (uint64_t) nx;
-            for (int x = 0; x < nx; x += 4)
+            if (y + 3 < ny)
+            {
+                x0 = b44_dec_blocks (
+                    in,
+                    comp_buf_size - bIn,
+                    row0,
+                    (uint64_t) nx,
+                    nx / 4,
+                    curc->p_linear,
+                    &n);
+                in += n;
+                bIn += n;
+                row0 += 4 * x0;
+                row1 += 4 * x0;
+                row2 += 4 * x0;
+                row3 += 4 * x0;
+            }
+            for (int x = 4 * x0; x < nx; x += 4)
             {
                 if (bIn + 3 > comp_buf_size) return EXR_ERR_OUT_OF_MEMORY;
 
@@ -705,6 +1169,7 @@ internal_exr_undo_b44 (
     if (rv != EXR_ERR_SUCCESS) return rv;
 
     exrcore_ensure_b44_tables ();
+    choose_b44_impl ();
 
     return uncompress_b44_impl (
         decode,
@@ -734,6 +1199,7 @@ internal_exr_undo_b44a (
     if (rv != EXR_ERR_SUCCESS) return rv;
 
     exrcore_ensure_b44_tables ();
+    choose_b44_impl ();
 
     return uncompress_b44_impl (
         decode,
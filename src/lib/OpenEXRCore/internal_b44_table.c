@@ -8,8 +8,9 @@
 extern uint16_t* exrcore_expTable;
 extern uint16_t* exrcore_logTable;
 
-static uint16_t exrcore_expTable_data[65536];
+/* two spare entries keep 32-bit gathers of the last entry in bounds */
+static uint16_t exrcore_expTable_data[65536 + 2];
 uint16_t* exrcore_expTable = exrcore_expTable_data;
 
-static uint16_t exrcore_logTable_data[65536];
+static uint16_t exrcore_logTable_data[65536 + 2];
 uint16_t* exrcore_logTable = exrcore_logTable_data;
@@ -79,6 +79,15 @@ exr_result_t internal_validate_next_chunk (
     exr_const_context_t    pctxt,
     exr_const_priv_part_t  part);
 
+/* if the context has the file memory mapped, returns a pointer to the
+ * packed data for the chunk in the mapping, or NULL when the data must
+ * be read (not mapped, or the chunk extends past the end of the file) */
+exr_result_t internal_exr_borrow_chunk (
+    exr_const_context_t     ctxt,
+    int                     part_index,
+    const exr_chunk_info_t* cinfo,
+    const void**            packed_data);
+
 /**************************************/
 
 exr_result_t internal_encode_free_buffer (
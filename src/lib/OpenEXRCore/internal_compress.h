@@ -17,6 +17,16 @@ void internal_zip_deconstruct_bytes (
 void internal_zip_reconstruct_bytes (
     uint8_t* out, uint8_t* scratch_source, uint64_t count);
 
+/* exr_compress_buffer, honoring the pipeline's intra_chunk_threads hint */
+exr_result_t internal_exr_compress_buffer (
+    const exr_encode_pipeline_t* encode,
+    int                          level,
+    const void*                  in,
+    size_t                       in_bytes,
+    void*                        out,
+    size_t                       out_bytes_avail,
+    size_t*                      actual_out);
+
 exr_result_t internal_exr_apply_rle (exr_encode_pipeline_t* encode);
 
 exr_result_t internal_exr_apply_zip (exr_encode_pipeline_t* encode);
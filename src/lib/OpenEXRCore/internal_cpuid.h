@@ -139,5 +139,81 @@ has_native_half (void)
 #endif
 }
 
+static inline int
+has_sse41 (void)
+{
+#if defined(__SSE4_1__)
+    return 1;
+#elif OPENEXR_ENABLE_X86_SIMD_CHECK && !defined(__e2k__)
+#    if defined(_WIN32)
+    int regs[4] = {0};
+    __cpuid (regs, 0);
+    if (regs[0] < 1) return 0;
+    __cpuidex (regs, 1, 0);
+#    else
+    unsigned int regs[4] = {0};
+    if (__get_cpuid_max (0, NULL) < 1) return 0;
+    __cpuid (1, regs[0], regs[1], regs[2], regs[3]);
+#    endif
+    /* SSE4.1 is bit 19 of ECX (reg 2) of leaf 1 */
+    return (regs[2] & (1 << 19)) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+static inline int
+has_avx2 (void)
+{
+#if defined(__AVX2__)
+    return 1;
+#elif OPENEXR_ENABLE_X86_SIMD_CHECK && !defined(__e2k__)
+    int sse2, avx, f16c;
+    check_for_x86_simd (&f16c, &avx, &sse2);
+    /* avx is only reported when the OS saves the ymm registers */
+    if (!avx) return 0;
+
+#    if defined(_WIN32)
+    int regs[4] = {0};
+    __cpuid (regs, 0);
+    if (regs[0] < 7) return 0;
+    __cpuidex (regs, 7, 0);
+#    else
+    unsigned int regs[4] = {0};
+    if (__get_cpuid_max (0, NULL) < 7) return 0;
+    __cpuid_count (7, 0, regs[0], regs[1], regs[2], regs[3]);
+#    endif
+    /* AVX2 is bit 5 of EBX (reg 1) of leaf 7 */
+    return (regs[1] & (1 << 5)) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+static inline int
+has_avx512bw (void)
+{
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    return 1;
+#elif OPENEXR_ENABLE_X86_SIMD_CHECK && !defined(__e2k__) &&                    \
+    !defined(_WIN32) && defined(__x86_64__)
+    unsigned int regs[4] = {0};
+    if (!has_avx2 ()) return 0;
+
+    /* the OS has to save the opmask and all 32 zmm registers as well */
+    __asm__ __volatile__ ("xgetbv"
+                          : /* Output  */ "=a"(regs[0]), "=d"(regs[3])
+                          : /* Input   */ "c"(0)
+                          : /* Clobber */);
+    if ((regs[0] & 0xe6) != 0xe6) return 0;
+
+    __cpuid_count (7, 0, regs[0], regs[1], regs[2], regs[3]);
+    /* AVX512F is bit 16 and AVX512BW bit 30 of EBX (reg 1) of leaf 7 */
+    return ((regs[1] & (1 << 16)) && (regs[1] & (1u << 30))) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
 #undef OPENEXR_ENABLE_X86_SIMD_CHECK
 #endif
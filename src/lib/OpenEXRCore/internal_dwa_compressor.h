@@ -64,6 +64,12 @@ static exr_result_t DwaCompressor_uncompress (
 static exr_result_t
 DwaCompressor_initializeBuffers (DwaCompressor* me, size_t*);
 
+//
+// Pick the channel rules used to encode: the default rules,
+// followed by any the user registered on the part.
+//
+static exr_result_t DwaCompressor_setupChannelRules (DwaCompressor* me);
+
 static exr_result_t DwaCompressor_writeRelevantChannelRules (
     DwaCompressor* me, uint8_t** outPtr, uint64_t nAvail, uint64_t* nWritten);
 static exr_result_t DwaCompressor_readChannelRules (
@@ -100,6 +106,7 @@ DwaCompressor_construct (
     exr_result_t rv = EXR_ERR_SUCCESS;
 
     initializeFuncs ();
+    initializeEncodeFuncs ();
     exrcore_ensure_dwa_tables();
 
     memset (me, 0, sizeof (DwaCompressor));
@@ -254,8 +261,8 @@ DwaCompressor_compress (DwaCompressor* me)
 
     // Starting with DWA v2, we write the channel
     // classification rules into the file
-    me->_channelRules     = sDefaultChannelRules;
-    me->_channelRuleCount = sizeof (sDefaultChannelRules) / sizeof (Classifier);
+    rv = DwaCompressor_setupChannelRules (me);
+    if (rv != EXR_ERR_SUCCESS) return rv;
 
     rv = DwaCompressor_initializeBuffers (me, &outBufferSize);
 
@@ -513,8 +520,8 @@ DwaCompressor_compress (DwaCompressor* me)
     {
         size_t outSize;
 
-        rv = exr_compress_buffer (
-            me->_encode->context,
+        rv = internal_exr_compress_buffer (
+            me->_encode,
             9, // TODO: use default??? the old call to zlib had 9 hardcoded
             me->_planarUncBuffer[UNKNOWN],
             *unknownUncompressedSize,
@@ -575,8 +582,8 @@ DwaCompressor_compress (DwaCompressor* me)
                     *totalAcUncompressedCount * sizeof (uint16_t);
                 size_t destLen;
 
-                rv = exr_compress_buffer (
-                    me->_encode->context,
+                rv = internal_exr_compress_buffer (
+                    me->_encode,
                     9, // TODO: use default??? the old call to zlib had 9 hardcoded
                     me->_packedAcBuffer,
                     sourceLen,
@@ -619,8 +626,8 @@ DwaCompressor_compress (DwaCompressor* me)
         internal_zip_deconstruct_bytes (
             me->_encode->scratch_buffer_1, me->_packedDcBuffer, uncompBytes);
 
-        rv = exr_compress_buffer (
-            me->_encode->context,
+        rv = internal_exr_compress_buffer (
+            me->_encode,
             me->_zipLevel,
             me->_encode->scratch_buffer_1,
             uncompBytes,
@@ -649,8 +656,8 @@ DwaCompressor_compress (DwaCompressor* me)
             me->_planarUncBuffer[RLE],
             *rleRawSize);
 
-        rv = exr_compress_buffer (
-            me->_encode->context,
+        rv = internal_exr_compress_buffer (
+            me->_encode,
             9, // TODO: use default??? the old call to zlib had 9 hardcoded
             me->_rleBuffer,
             *rleUncompressedSize,
@@ -1534,6 +1541,69 @@ DwaCompressor_initializeBuffers (DwaCompressor* me, size_t* bufferSize)
 
 /**************************************/
 
+exr_result_t
+DwaCompressor_setupChannelRules (DwaCompressor* me)
+{
+    exr_const_priv_part_t part =
+        me->_encode->context->parts[me->_encode->part_index];
+    const size_t nDefault = sizeof (sDefaultChannelRules) / sizeof (Classifier);
+    size_t       nUser, nRules = 0;
+    Classifier*  rules;
+    Classifier*  userRules;
+
+    me->_channelRules     = sDefaultChannelRules;
+    me->_channelRuleCount = nDefault;
+
+    if (part->dwa_channel_rule_count <= 0) return EXR_ERR_SUCCESS;
+
+    nUser = (size_t) part->dwa_channel_rule_count;
+    rules = me->alloc_fn (sizeof (Classifier) * (nDefault + nUser));
+    if (!rules) return EXR_ERR_OUT_OF_MEMORY;
+
+    // the suffix strings stay owned by the part
+    userRules = rules + nDefault;
+    for (size_t r = 0; r < nUser; ++r)
+    {
+        const internal_exr_dwa_channel_rule_t* ur = part->dwa_channel_rules + r;
+
+        userRules[r]._suffix          = ur->suffix;
+        userRules[r]._scheme          = (CompressorScheme) ur->scheme;
+        userRules[r]._type            = (exr_pixel_type_t) ur->type;
+        userRules[r]._cscIdx          = -1;
+        userRules[r]._caseInsensitive = ur->case_insensitive
+                                            ? DWA_CLASSIFIER_TRUE
+                                            : DWA_CLASSIFIER_FALSE;
+        userRules[r]._stringStatic    = DWA_CLASSIFIER_TRUE;
+    }
+
+    //
+    // The last matching rule wins, so the user rules go last. A
+    // default rule that a user rule also matches is dropped, rather
+    // than left in front of it: its csc index would otherwise still
+    // pull the channel into an RGB set, in this reader as well as
+    // in any existing one.
+    //
+    for (size_t i = 0; i < nDefault; ++i)
+    {
+        const Classifier* def      = sDefaultChannelRules + i;
+        int               shadowed = DWA_CLASSIFIER_FALSE;
+
+        for (size_t r = 0; r < nUser && !shadowed; ++r)
+            shadowed = Classifier_match (userRules + r, def->_suffix, def->_type);
+
+        if (!shadowed) rules[nRules++] = *def;
+    }
+
+    memmove (rules + nRules, userRules, sizeof (Classifier) * nUser);
+    nRules += nUser;
+
+    me->_channelRules     = rules;
+    me->_channelRuleCount = nRules;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
 exr_result_t
 DwaCompressor_writeRelevantChannelRules (
     DwaCompressor* me, uint8_t** outPtr, uint64_t nAvail, uint64_t* nWritten)
@@ -890,27 +890,27 @@ static uint16_t algoQuantize (
     return sign | handleQuantizeCloseExp (abssrc, tolSig, errTol, srcFloat);
 }
 
+//static const int remap[] = {
+//    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+//    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+//    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+//    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+// inv_remap computed from original zigzag lookup remap so we can
+// deposit into a random destination instead of pulling from a source
+// and save a temporary and loop
+static const int inv_remap[] = {
+    0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
+    3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+    10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+    21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+
 static void
-quantizeCoeffAndZigXDR (
+quantizeCoeffAndZigXDR_scalar (
     uint16_t* restrict    halfZigCoeff,
     const float* restrict dctvals,
     const float* restrict tolerances,
     const uint16_t* restrict halftols)
 {
-    //static const int remap[] = {
-    //    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
-    //    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
-    //    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
-    //    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
-    // inv_remap computed from original zigzag lookup remap so we can
-    // deposit into a random destination instead of pulling from a source
-    // and save a temporary and loop
-    static const int inv_remap[] = {
-        0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
-        3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
-        10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
-        21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
-
     // manually unrolling seems to help on at least x86
     for ( int i = 0; i < 64; i += 4 )
     {
@@ -946,6 +946,208 @@ quantizeCoeffAndZigXDR (
 //    }
 }
 
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// Vector quantizers. Most coefficients either fall below their
+// tolerance, and become 0, or need the bit search in algoQuantize.
+// Sort the lanes out in bulk and only run the search where needed.
+//
+// vcvtps2ph rounds exactly like float_to_half, except for NaN
+// payloads, so NaN lanes redo that conversion in scalar. The
+// comparison against the tolerance is false for NaN and Inf, which
+// then reach the early out at the top of algoQuantize.
+//
+
+IMF_TARGET_AVX2 static void
+quantizeCoeffAndZigXDR_avx2 (
+    uint16_t* restrict    halfZigCoeff,
+    const float* restrict dctvals,
+    const float* restrict tolerances,
+    const uint16_t* restrict halftols)
+{
+    uint16_t     quant[64];
+    const __m256 absMask = _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff));
+
+    for (int i = 0; i < 64; i += 8)
+    {
+        __m256  src  = _mm256_loadu_ps (dctvals + i);
+        __m128i h    = _mm256_cvtps_ph (src, _MM_FROUND_TO_NEAREST_INT);
+        __m256  hf   = _mm256_and_ps (_mm256_cvtph_ps (h), absMask);
+        __m256  zero =
+            _mm256_cmp_ps (hf, _mm256_loadu_ps (tolerances + i), _CMP_LT_OQ);
+        __m256i zmask = _mm256_castps_si256 (zero);
+        int nan = _mm256_movemask_ps (_mm256_cmp_ps (src, src, _CMP_UNORD_Q));
+        int search = ~_mm256_movemask_ps (zero) & 0xff;
+
+        // narrow the 32-bit lane mask to 16 bits to clear the zero lanes
+        h = _mm_andnot_si128 (
+            _mm_packs_epi32 (
+                _mm256_castsi256_si128 (zmask),
+                _mm256_extracti128_si256 (zmask, 1)),
+            h);
+        _mm_storeu_si128 ((__m128i*) (quant + i), h);
+
+        while (search)
+        {
+            int      lane = __builtin_ctz ((unsigned) search);
+            int      x    = i + lane;
+            uint16_t hv   = quant[x];
+
+            search &= search - 1;
+            if (nan & (1 << lane)) hv = float_to_half (dctvals[x]);
+            quant[x] = algoQuantize (
+                hv, halftols[x], tolerances[x], half_to_float (hv));
+        }
+    }
+
+    for (int i = 0; i < 64; ++i)
+        halfZigCoeff[inv_remap[i]] = one_from_native16 (quant[i]);
+}
+
+//
+// Same as above, 16 lanes at a time, and the zig-zag is done with a
+// pair of word permutes over the whole block.
+//
+
+IMF_TARGET_AVX512 static void
+quantizeCoeffAndZigXDR_avx512 (
+    uint16_t* restrict    halfZigCoeff,
+    const float* restrict dctvals,
+    const float* restrict tolerances,
+    const uint16_t* restrict halftols)
+{
+    static const uint16_t remap[64] = {
+        0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+    uint16_t quant[64];
+    __m512i  lo, hi;
+
+    for (int i = 0; i < 64; i += 32)
+    {
+        __m512   src0  = _mm512_loadu_ps (dctvals + i);
+        __m512   src1  = _mm512_loadu_ps (dctvals + i + 16);
+        __m256i  h0    = _mm512_cvtps_ph (src0, _MM_FROUND_TO_NEAREST_INT);
+        __m256i  h1    = _mm512_cvtps_ph (src1, _MM_FROUND_TO_NEAREST_INT);
+        __mmask16 zero0 = _mm512_cmp_ps_mask (
+            _mm512_abs_ps (_mm512_cvtph_ps (h0)),
+            _mm512_loadu_ps (tolerances + i),
+            _CMP_LT_OQ);
+        __mmask16 zero1 = _mm512_cmp_ps_mask (
+            _mm512_abs_ps (_mm512_cvtph_ps (h1)),
+            _mm512_loadu_ps (tolerances + i + 16),
+            _CMP_LT_OQ);
+        uint32_t nan =
+            (uint32_t) _mm512_cmp_ps_mask (src0, src0, _CMP_UNORD_Q) |
+            ((uint32_t) _mm512_cmp_ps_mask (src1, src1, _CMP_UNORD_Q) << 16);
+        uint32_t search = ~((uint32_t) zero0 | ((uint32_t) zero1 << 16));
+
+        _mm512_storeu_si512 (
+            quant + i,
+            _mm512_maskz_mov_epi16 (
+                (__mmask32) search,
+                _mm512_inserti64x4 (_mm512_castsi256_si512 (h0), h1, 1)));
+
+        while (search)
+        {
+            int      lane = __builtin_ctz (search);
+            int      x    = i + lane;
+            uint16_t hv   = quant[x];
+
+            search &= search - 1;
+            if (nan & (1u << lane)) hv = float_to_half (dctvals[x]);
+            quant[x] = algoQuantize (
+                hv, halftols[x], tolerances[x], half_to_float (hv));
+        }
+    }
+
+    lo = _mm512_loadu_si512 (quant);
+    hi = _mm512_loadu_si512 (quant + 32);
+    _mm512_storeu_si512 (
+        halfZigCoeff,
+        _mm512_permutex2var_epi16 (lo, _mm512_loadu_si512 (remap), hi));
+    _mm512_storeu_si512 (
+        halfZigCoeff + 32,
+        _mm512_permutex2var_epi16 (lo, _mm512_loadu_si512 (remap + 32), hi));
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
+//
+// Convert a row of FLOAT XDR to HALF XDR for the DCT.
+//
+
+static void
+convertFloatRowToHalf_scalar (uint16_t* dst, const float* srcXdr, int n)
+{
+    for (int x = 0; x < n; ++x)
+    {
+        //
+        // Clamp to half ranges, instead of just casting. This
+        // avoids introducing Infs which end up getting zeroed later
+        //
+        float src = one_to_native_float (srcXdr[x]);
+        if (src > 65504.f)
+            src = 65504.f;
+        else if (src < -65504.f)
+            src = -65504.f;
+        dst[x] = one_from_native16 (float_to_half (src));
+    }
+}
+
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// min / max return their second operand when either one is NaN, so
+// NaN passes the clamp untouched, as in the scalar code. The NaN
+// payload from vcvtps2ph differs though, so those lanes use scalar.
+//
+
+IMF_TARGET_AVX2 static void
+convertFloatRowToHalf_avx2 (uint16_t* dst, const float* srcXdr, int n)
+{
+    const __m256 maxHalf = _mm256_set1_ps (65504.f);
+    const __m256 minHalf = _mm256_set1_ps (-65504.f);
+    int          x       = 0;
+
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 src = _mm256_loadu_ps (srcXdr + x);
+
+        if (_mm256_movemask_ps (_mm256_cmp_ps (src, src, _CMP_UNORD_Q)))
+        {
+            convertFloatRowToHalf_scalar (dst + x, srcXdr + x, 8);
+            continue;
+        }
+
+        src = _mm256_max_ps (minHalf, _mm256_min_ps (maxHalf, src));
+        _mm_storeu_si128 (
+            (__m128i*) (dst + x),
+            _mm256_cvtps_ph (src, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    convertFloatRowToHalf_scalar (dst + x, srcXdr + x, n - x);
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
+//
+// Dispatch for the float conversion and the quantizer, picked in
+// initializeEncodeFuncs ()
+//
+
+static void (*convertFloatRowToHalf) (uint16_t*, const float*, int) =
+    convertFloatRowToHalf_scalar;
+
+static void (*quantizeCoeffAndZigXDR) (
+    uint16_t* restrict,
+    const float* restrict,
+    const float* restrict,
+    const uint16_t* restrict) = quantizeCoeffAndZigXDR_scalar;
+
 /**************************************/
 
 //
@@ -966,6 +1168,7 @@ LossyDctEncoder_execute (
     int numBlocksY = (int) (ceilf ((float) e->_height / 8.0f));
 
     uint16_t halfZigCoef[64];
+    uint16_t halfBlock[64];
 
     uint16_t* currAcComp            = (uint16_t*) e->_packedAc;
     size_t    tmpHalfBufferElements = 0;
@@ -1009,19 +1212,7 @@ LossyDctEncoder_execute (
         {
             const float* srcXdr = (const float*) chanData[chan]->_rows[y];
 
-            for (int x = 0; x < e->_width; ++x)
-            {
-                //
-                // Clamp to half ranges, instead of just casting. This
-                // avoids introducing Infs which end up getting zeroed later
-                //
-                float src = one_to_native_float (srcXdr[x]);
-                if (src > 65504.f)
-                    src = 65504.f;
-                else if (src < -65504.f)
-                    src = -65504.f;
-                tmpHalfBufferPtr[x] = one_from_native16 (float_to_half (src));
-            }
+            convertFloatRowToHalf (tmpHalfBufferPtr, srcXdr, e->_width);
 
             chanData[chan]->_rows[y] = (uint8_t*) tmpHalfBufferPtr;
             tmpHalfBufferPtr += e->_width;
@@ -1064,29 +1255,35 @@ LossyDctEncoder_execute (
 
                 for (int y = 0; y < 8; ++y)
                 {
+                    const uint16_t* row;
+                    int             vy = 8 * blocky + y;
+
+                    if (vy >= e->_height)
+                        vy = e->_height - (vy - (e->_height - 1));
+
+                    if (vy < 0) vy = e->_height - 1;
+
+                    row = (const uint16_t*) (chanData[chan]->_rows)[vy];
+
                     for (int x = 0; x < 8; ++x)
                     {
                         int vx = 8 * blockx + x;
-                        int vy = 8 * blocky + y;
 
                         if (vx >= e->_width)
                             vx = e->_width - (vx - (e->_width - 1));
 
                         if (vx < 0) vx = e->_width - 1;
 
-                        if (vy >= e->_height)
-                            vy = e->_height - (vy - (e->_height - 1));
-
-                        if (vy < 0) vy = e->_height - 1;
-
-                        h = ((const uint16_t*) (chanData[chan]->_rows)[vy])[vx];
+                        h = row[vx];
 
                         if (e->_toNonlinear) { h = e->_toNonlinear[h]; }
                         else { h = one_to_native16 (h); }
 
-                        chanData[chan]->_dctData[y * 8 + x] = half_to_float (h);
+                        halfBlock[y * 8 + x] = h;
                     } // x
                 }     // y
+
+                convertHalfToFloat64 (chanData[chan]->_dctData, halfBlock);
             }         // chan
 
             //
@@ -1158,17 +1355,17 @@ LossyDctEncoder_execute (
 // of 3 0's, starting at the current location.
 //
 // block is our block of 64 coefficients
-// acPtr a pointer to back the RLE'd values into.
+// curAC a pointer to back the RLE'd values into.
 //
-// This will advance the counter, _numAcComp.
+// This returns the new end of the RLE'd values, and
+// LossyDctEncoder_rleAc advances the counter, _numAcComp.
 //
 
-void
-LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
+static uint16_t*
+rleAc_scalar (const uint16_t* block, uint16_t* curAC)
 {
-    int       dctComp   = 1;
-    uint16_t  rleSymbol = 0x0;
-    uint16_t* curAC     = *acPtr;
+    int      dctComp   = 1;
+    uint16_t rleSymbol = 0x0;
 
     while (dctComp < 64)
     {
@@ -1181,7 +1378,6 @@ LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
         if (block[dctComp] != rleSymbol)
         {
             *curAC++ = block[dctComp];
-            e->_numAcComp++;
 
             dctComp += runLen;
             continue;
@@ -1211,7 +1407,6 @@ LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
         {
             runLen   = 1;
             *curAC++ = block[dctComp];
-            e->_numAcComp++;
 
             //
             // Using 0xff00 for "end of block"
@@ -1224,7 +1419,6 @@ LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
             //
 
             *curAC++ = 0xff00;
-            e->_numAcComp++;
         }
         else
         {
@@ -1233,7 +1427,6 @@ LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
             //
 
             *curAC++ = (uint16_t) 0xff00 | runLen;
-            e->_numAcComp++;
         }
 
         //
@@ -1242,5 +1435,130 @@ LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
 
         dctComp += runLen;
     }
+    return curAC;
+}
+
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// The same RLE, driven by a mask with a bit set for every non-zero
+// coefficient. Runs of zeros and of literals are found with a bit
+// scan instead of testing each coefficient.
+//
+
+static inline uint16_t*
+rleAcMask (const uint16_t* block, uint64_t nonzero, uint16_t* curAC)
+{
+    int dctComp = 1;
+
+    while (dctComp < 64)
+    {
+        uint64_t rest = nonzero >> dctComp;
+        int      runLen;
+
+        if (rest & 1)
+        {
+            //
+            // Copy all the non-zero values up to the next 0 verbatim.
+            // The bits shifted in above the block are 0, so ~rest
+            // always has a bit set.
+            //
+
+            runLen = __builtin_ctzll (~rest);
+            for (int i = 0; i < runLen; ++i)
+                *curAC++ = block[dctComp + i];
+        }
+        else
+        {
+            runLen = rest ? __builtin_ctzll (rest) : 64 - dctComp;
+
+            if (runLen == 1)
+                *curAC++ = block[dctComp];
+            else if (runLen + dctComp == 64)
+                *curAC++ = 0xff00;
+            else
+                *curAC++ = (uint16_t) 0xff00 | (uint16_t) runLen;
+        }
+
+        dctComp += runLen;
+    }
+    return curAC;
+}
+
+IMF_TARGET_AVX2 static uint16_t*
+rleAc_avx2 (const uint16_t* block, uint16_t* curAC)
+{
+    const __m256i zero    = _mm256_setzero_si256 ();
+    uint64_t      nonzero = 0;
+
+    for (int i = 0; i < 64; i += 32)
+    {
+        __m256i a = _mm256_cmpeq_epi16 (
+            _mm256_loadu_si256 ((const __m256i*) (block + i)), zero);
+        __m256i b = _mm256_cmpeq_epi16 (
+            _mm256_loadu_si256 ((const __m256i*) (block + i + 16)), zero);
+
+        // packs works per 128-bit lane, put the quadwords back in order
+        __m256i z = _mm256_permute4x64_epi64 (_mm256_packs_epi16 (a, b), 0xD8);
+
+        nonzero |= (uint64_t) (uint32_t) ~_mm256_movemask_epi8 (z) << i;
+    }
+
+    return rleAcMask (block, nonzero, curAC);
+}
+
+IMF_TARGET_AVX512 static uint16_t*
+rleAc_avx512 (const uint16_t* block, uint16_t* curAC)
+{
+    __m512i  lo = _mm512_loadu_si512 (block);
+    __m512i  hi = _mm512_loadu_si512 (block + 32);
+    uint64_t nonzero =
+        (uint64_t) _mm512_test_epi16_mask (lo, lo) |
+        ((uint64_t) _mm512_test_epi16_mask (hi, hi) << 32);
+
+    return rleAcMask (block, nonzero, curAC);
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
+//
+// Dispatch for the RLE of each block, picked along with the quantizer
+// in initializeEncodeFuncs ()
+//
+
+static uint16_t* (*rleAc) (const uint16_t*, uint16_t*) = rleAc_scalar;
+
+static void
+initializeEncodeFuncs (void)
+{
+    static int done = 0;
+    if (done) return;
+    done = 1;
+
+#ifdef IMF_HAVE_TARGET_AVX2
+    int f16c = 0, avx = 0, sse2 = 0;
+    check_for_x86_simd (&f16c, &avx, &sse2);
+
+    if (avx && f16c && has_avx2 ())
+    {
+        convertFloatRowToHalf  = convertFloatRowToHalf_avx2;
+        quantizeCoeffAndZigXDR = quantizeCoeffAndZigXDR_avx2;
+        rleAc                  = rleAc_avx2;
+
+        if (has_avx512bw ())
+        {
+            quantizeCoeffAndZigXDR = quantizeCoeffAndZigXDR_avx512;
+            rleAc                  = rleAc_avx512;
+        }
+    }
+#endif
+}
+
+void
+LossyDctEncoder_rleAc (LossyDctEncoder* e, uint16_t* block, uint16_t** acPtr)
+{
+    uint16_t* curAC = rleAc (block, *acPtr);
+
+    e->_numAcComp += (uint64_t) (curAC - *acPtr);
     *acPtr = curAC;
 }
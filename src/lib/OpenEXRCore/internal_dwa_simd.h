@@ -62,6 +62,21 @@
 #    endif /* __LP64__ */
 #endif     /* OPENEXR_IMF_HAVE_GCC_INLINE_ASM_AVX */
 
+//
+// The encoder kernels are built with the target attribute, so they
+// don't need -mavx2 and are picked by runtime cpuid checks. Every
+// AVX2 capable cpu also has POPCNT, which the quantizer leans on.
+//
+
+#if defined(IMF_HAVE_SSE2) && (defined(__x86_64__) || defined(_M_X64)) &&     \
+    (defined(__GNUC__) || defined(__clang__))
+#    define IMF_HAVE_TARGET_AVX2 1
+#    define IMF_TARGET_AVX2 __attribute__ ((target ("avx2,f16c,popcnt")))
+#    define IMF_TARGET_AVX512                                                  \
+        __attribute__ ((target ("avx512f,avx512bw,f16c,popcnt")))
+#    include <immintrin.h>
+#endif
+
 #define _SSE_ALIGNMENT 32
 #define _SSE_ALIGNMENT_MASK 0x0F
 #define _AVX_ALIGNMENT_MASK 0x1F
@@ -188,8 +203,8 @@ csc709Inverse64 (float* comp0, float* comp1, float* comp2)
 // primary chromaticies, with no scaling or offsets.
 //
 
-static inline void
-csc709Forward64 (float* comp0, float* comp1, float* comp2)
+static void
+csc709Forward64_scalar (float* comp0, float* comp1, float* comp2)
 {
     float src[3];
 
@@ -205,6 +220,85 @@ csc709Forward64 (float* comp0, float* comp1, float* comp2)
     }
 }
 
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// With two NaN operands, the order of the operands decides which
+// payload an add or multiply returns, and the compiler is free to
+// swap them. So the vector transforms below hand blocks holding any
+// NaN or Inf to the code used before, to keep the output identical.
+//
+
+IMF_TARGET_AVX2 static inline int
+hasNonFinite64_avx2 (const float* src)
+{
+    const __m256i expMask = _mm256_set1_epi32 (0x7f800000);
+    __m256i       found   = _mm256_setzero_si256 ();
+
+    for (int i = 0; i < 64; i += 8)
+    {
+        __m256i v = _mm256_and_si256 (
+            _mm256_loadu_si256 ((const __m256i*) (src + i)), expMask);
+        found = _mm256_or_si256 (found, _mm256_cmpeq_epi32 (v, expMask));
+    }
+    return !_mm256_testz_si256 (found, found);
+}
+
+//
+// Same sums, in the same order, 8 pixels at a time. Products and
+// sums are kept separate (no fma) so the result matches the
+// scalar version bit for bit.
+//
+
+IMF_TARGET_AVX2 static void
+csc709Forward64_avx2 (float* comp0, float* comp1, float* comp2)
+{
+    const __m256 y0  = _mm256_set1_ps (0.2126f);
+    const __m256 y1  = _mm256_set1_ps (0.7152f);
+    const __m256 y2  = _mm256_set1_ps (0.0722f);
+    const __m256 cb0 = _mm256_set1_ps (-0.1146f);
+    const __m256 cb1 = _mm256_set1_ps (0.3854f);
+    const __m256 cb2 = _mm256_set1_ps (0.5000f);
+    const __m256 cr0 = _mm256_set1_ps (0.5000f);
+    const __m256 cr1 = _mm256_set1_ps (0.4542f);
+    const __m256 cr2 = _mm256_set1_ps (0.0458f);
+
+    if (hasNonFinite64_avx2 (comp0) || hasNonFinite64_avx2 (comp1) ||
+        hasNonFinite64_avx2 (comp2))
+    {
+        csc709Forward64_scalar (comp0, comp1, comp2);
+        return;
+    }
+
+    for (int i = 0; i < 64; i += 8)
+    {
+        __m256 src0 = _mm256_loadu_ps (comp0 + i);
+        __m256 src1 = _mm256_loadu_ps (comp1 + i);
+        __m256 src2 = _mm256_loadu_ps (comp2 + i);
+
+        _mm256_storeu_ps (
+            comp0 + i,
+            _mm256_add_ps (
+                _mm256_add_ps (
+                    _mm256_mul_ps (y0, src0), _mm256_mul_ps (y1, src1)),
+                _mm256_mul_ps (y2, src2)));
+        _mm256_storeu_ps (
+            comp1 + i,
+            _mm256_add_ps (
+                _mm256_sub_ps (
+                    _mm256_mul_ps (cb0, src0), _mm256_mul_ps (cb1, src1)),
+                _mm256_mul_ps (cb2, src2)));
+        _mm256_storeu_ps (
+            comp2 + i,
+            _mm256_sub_ps (
+                _mm256_sub_ps (
+                    _mm256_mul_ps (cr0, src0), _mm256_mul_ps (cr1, src1)),
+                _mm256_mul_ps (cr2, src2)));
+    }
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
 //
 // Byte interleaving of 2 byte arrays:
 //    src0 = AAAA
@@ -453,6 +547,49 @@ convertFloatToHalf64_f16c (uint16_t* dst, float* src)
 #endif /* IMF_HAVE_GCC_INLINEASM_X86 */
 }
 
+//
+// And the other direction, for loading an 8x8 block of HALF
+// into the encoder. No alignment requirements.
+//
+
+static void
+convertHalfToFloat64_scalar (float* dst, const uint16_t* src)
+{
+    for (int i = 0; i < 64; ++i)
+        dst[i] = half_to_float (src[i]);
+}
+
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// vcvtph2ps quiets signaling NaNs, half_to_float keeps them as
+// they are. Rows holding a NaN take the scalar path so the DCT
+// input is the same either way.
+//
+
+IMF_TARGET_AVX2 static void
+convertHalfToFloat64_avx2 (float* dst, const uint16_t* src)
+{
+    const __m128i absMask = _mm_set1_epi16 (0x7fff);
+    const __m128i infBits = _mm_set1_epi16 (0x7c00);
+
+    for (int i = 0; i < 64; i += 8)
+    {
+        __m128i h   = _mm_loadu_si128 ((const __m128i*) (src + i));
+        __m128i nan = _mm_cmpgt_epi16 (_mm_and_si128 (h, absMask), infBits);
+
+        if (_mm_movemask_epi8 (nan))
+        {
+            for (int x = i; x < i + 8; ++x)
+                dst[x] = half_to_float (src[x]);
+        }
+        else
+            _mm256_storeu_ps (dst + i, _mm256_cvtph_ps (h));
+    }
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
 //
 // Convert an 8x8 block of HALF from zig-zag order to
 // FLOAT in normal order. The order we want is:
@@ -1924,7 +2061,7 @@ dctInverse8x8_avx_7 (float* data)
 //
 
 static void
-dctForward8x8 (float* data)
+dctForward8x8_scalar (float* data)
 {
     float A0, A1, A2, A3, A4, A5, A6, A7;
     float K0, K1, rot_x, rot_y;
@@ -2106,7 +2243,7 @@ dctForward8x8 (float* data)
 //
 
 static void
-dctForward8x8 (float* data)
+dctForward8x8_sse2 (float* data)
 {
     __m128* srcVec = (__m128*) data;
     __m128  a0Vec, a1Vec, a2Vec, a3Vec, a4Vec, a5Vec, a6Vec, a7Vec;
@@ -2307,6 +2444,155 @@ dctForward8x8 (float* data)
 
 #endif /* IMF_HAVE_SSE2 */
 
+#ifdef IMF_HAVE_TARGET_AVX2
+
+//
+// AVX2 implementation
+//
+// The same column-wise passes as the SSE2 version, but a full row
+// of the block fits in one register. So each pass is a single 1D
+// DCT down all 8 columns, followed by an 8x8 transpose. The math
+// per element is unchanged, so the result matches the SSE2 version
+// bit for bit (blocks with NaN or Inf simply go to that version).
+//
+
+IMF_TARGET_AVX2 static void
+dctForward8x8_avx2 (float* data)
+{
+    __m256 row[8];
+    __m256 a0Vec, a1Vec, a2Vec, a3Vec, a4Vec, a5Vec, a6Vec, a7Vec;
+    __m256 k0Vec, k1Vec, rotXVec, rotYVec;
+    __m256 transTmp[8], transTmp2[8];
+
+    const __m256 c4Vec    = _mm256_set1_ps (.70710678f);
+    const __m256 c4NegVec = _mm256_set1_ps (-.70710678f);
+
+    const __m256 c1HalfVec = _mm256_set1_ps (.490392640f);
+    const __m256 c2HalfVec = _mm256_set1_ps (.461939770f);
+    const __m256 c3HalfVec = _mm256_set1_ps (.415734810f);
+    const __m256 c5HalfVec = _mm256_set1_ps (.277785120f);
+    const __m256 c6HalfVec = _mm256_set1_ps (.191341720f);
+    const __m256 c7HalfVec = _mm256_set1_ps (.097545161f);
+
+    const __m256 halfVec = _mm256_set1_ps (.5f);
+
+    if (hasNonFinite64_avx2 (data))
+    {
+        dctForward8x8_sse2 (data);
+        return;
+    }
+
+    for (int i = 0; i < 8; ++i)
+        row[i] = _mm256_loadu_ps (data + 8 * i);
+
+    for (int iter = 0; iter < 2; ++iter)
+    {
+        a0Vec = _mm256_add_ps (row[0], row[7]);
+        a1Vec = _mm256_add_ps (row[1], row[2]);
+        a3Vec = _mm256_add_ps (row[3], row[4]);
+        a5Vec = _mm256_add_ps (row[5], row[6]);
+
+        a7Vec = _mm256_sub_ps (row[0], row[7]);
+        a2Vec = _mm256_sub_ps (row[1], row[2]);
+        a4Vec = _mm256_sub_ps (row[3], row[4]);
+        a6Vec = _mm256_sub_ps (row[5], row[6]);
+
+        //
+        // First stage; Compute out_0 and out_4
+        //
+
+        k0Vec = _mm256_mul_ps (c4Vec, _mm256_add_ps (a0Vec, a3Vec));
+        k1Vec = _mm256_mul_ps (c4Vec, _mm256_add_ps (a1Vec, a5Vec));
+
+        row[0] = _mm256_mul_ps (_mm256_add_ps (k0Vec, k1Vec), halfVec);
+        row[4] = _mm256_mul_ps (_mm256_sub_ps (k0Vec, k1Vec), halfVec);
+
+        //
+        // Second stage; Compute out_2 and out_6
+        //
+
+        k0Vec = _mm256_sub_ps (a2Vec, a6Vec);
+        k1Vec = _mm256_sub_ps (a0Vec, a3Vec);
+
+        row[2] = _mm256_add_ps (
+            _mm256_mul_ps (c6HalfVec, k0Vec), _mm256_mul_ps (c2HalfVec, k1Vec));
+
+        row[6] = _mm256_sub_ps (
+            _mm256_mul_ps (c6HalfVec, k1Vec), _mm256_mul_ps (c2HalfVec, k0Vec));
+
+        //
+        // Precompute K0 and K1 for the remaining stages
+        //
+
+        k0Vec = _mm256_mul_ps (_mm256_sub_ps (a1Vec, a5Vec), c4Vec);
+        k1Vec = _mm256_mul_ps (_mm256_add_ps (a2Vec, a6Vec), c4NegVec);
+
+        //
+        // Third Stage, compute out_3 and out_5
+        //
+
+        rotXVec = _mm256_sub_ps (a7Vec, k0Vec);
+        rotYVec = _mm256_add_ps (a4Vec, k1Vec);
+
+        row[3] = _mm256_sub_ps (
+            _mm256_mul_ps (c3HalfVec, rotXVec),
+            _mm256_mul_ps (c5HalfVec, rotYVec));
+
+        row[5] = _mm256_add_ps (
+            _mm256_mul_ps (c5HalfVec, rotXVec),
+            _mm256_mul_ps (c3HalfVec, rotYVec));
+
+        //
+        // Fourth Stage, compute out_1 and out_7
+        //
+
+        rotXVec = _mm256_add_ps (a7Vec, k0Vec);
+        rotYVec = _mm256_sub_ps (k1Vec, a4Vec);
+
+        row[1] = _mm256_sub_ps (
+            _mm256_mul_ps (c1HalfVec, rotXVec),
+            _mm256_mul_ps (c7HalfVec, rotYVec));
+
+        row[7] = _mm256_add_ps (
+            _mm256_mul_ps (c7HalfVec, rotXVec),
+            _mm256_mul_ps (c1HalfVec, rotYVec));
+
+        //
+        // Transpose: interleave pairs of rows, then pairs of pairs,
+        // and finally swap the 128-bit halves between rows 0-3 and 4-7.
+        //
+
+        for (int i = 0; i < 8; i += 2)
+        {
+            transTmp[i]     = _mm256_unpacklo_ps (row[i], row[i + 1]);
+            transTmp[i + 1] = _mm256_unpackhi_ps (row[i], row[i + 1]);
+        }
+
+        for (int i = 0; i < 8; i += 4)
+        {
+            transTmp2[i] = _mm256_shuffle_ps (transTmp[i], transTmp[i + 2], 0x44);
+            transTmp2[i + 1] =
+                _mm256_shuffle_ps (transTmp[i], transTmp[i + 2], 0xEE);
+            transTmp2[i + 2] =
+                _mm256_shuffle_ps (transTmp[i + 1], transTmp[i + 3], 0x44);
+            transTmp2[i + 3] =
+                _mm256_shuffle_ps (transTmp[i + 1], transTmp[i + 3], 0xEE);
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            row[i] = _mm256_permute2f128_ps (transTmp2[i], transTmp2[i + 4], 0x20);
+            row[i + 4] =
+                _mm256_permute2f128_ps (transTmp2[i], transTmp2[i + 4], 0x31);
+        }
+    }
+
+    for (int i = 0; i < 8; ++i)
+        _mm256_storeu_ps (data + 8 * i, row[i]);
+}
+
+#endif /* IMF_HAVE_TARGET_AVX2 */
+
 /**************************************/
 
 //
@@ -2337,6 +2623,19 @@ static void (*dctInverse8x8_5) (float*) = dctInverse8x8_scalar_5;
 static void (*dctInverse8x8_6) (float*) = dctInverse8x8_scalar_6;
 static void (*dctInverse8x8_7) (float*) = dctInverse8x8_scalar_7;
 
+//
+// Encoder side: HALF -> FLOAT block load, forward CSC and forward DCT
+//
+static void (*convertHalfToFloat64) (float*, const uint16_t*) =
+    convertHalfToFloat64_scalar;
+static void (*csc709Forward64) (float*, float*, float*) =
+    csc709Forward64_scalar;
+#ifdef IMF_HAVE_SSE2
+static void (*dctForward8x8) (float*) = dctForward8x8_sse2;
+#else
+static void (*dctForward8x8) (float*) = dctForward8x8_scalar;
+#endif
+
 static void
 initializeFuncs (void)
 {
@@ -2396,5 +2695,21 @@ initializeFuncs (void)
         dctInverse8x8_6 = dctInverse8x8_sse2_6;
         dctInverse8x8_7 = dctInverse8x8_sse2_7;
     }
+
+#    ifdef IMF_HAVE_TARGET_AVX2
+    if (avx && f16c && has_avx2 ())
+    {
+        convertHalfToFloat64 = convertHalfToFloat64_avx2;
+#        ifndef __FMA__
+        //
+        // When the whole build may use fma, the compiler is free to
+        // fuse the multiply-adds of the existing transforms, and the
+        // vector versions would no longer round the same way.
+        //
+        csc709Forward64 = csc709Forward64_avx2;
+        dctForward8x8   = dctForward8x8_avx2;
+#        endif
+    }
+#    endif
 #endif
 }
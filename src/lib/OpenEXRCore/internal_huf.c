@@ -16,11 +16,8 @@
 #include <string.h>
 
 #define HUF_ENCBITS 16
-#define HUF_DECBITS 14
 
 #define HUF_ENCSIZE ((1 << HUF_ENCBITS) + 1)
-#define HUF_DECSIZE (1 << HUF_DECBITS)
-#define HUF_DECMASK (HUF_DECSIZE - 1)
 
 #define SHORT_ZEROCODE_RUN 59
 #define LONG_ZEROCODE_RUN 63
@@ -47,13 +44,6 @@
 #    define NO_ALIAS
 #endif
 
-typedef struct _HufDec
-{
-    int32_t   len;
-    uint32_t  lit;
-    uint32_t* p;
-} HufDec;
-
 /**************************************/
 
 //static inline int
@@ -108,21 +98,6 @@ typedef struct _HufDec
         }                                                       \
     }
 
-static inline uint64_t
-getBits (uint32_t nBits, uint64_t* c, uint32_t* lc, const uint8_t** inptr)
-{
-    const uint8_t* in = *inptr;
-    while (*lc < nBits)
-    {
-        *c = (*c << 8) | (uint64_t) (*in++);
-        *lc += 8;
-    }
-
-    *inptr = in;
-    *lc -= nBits;
-    return (*c >> *lc) & ((1 << nBits) - 1);
-}
-
 //
 // ENCODING TABLE BUILDING & (UN)PACKING
 //
@@ -197,109 +172,45 @@ hufCanonicalCodeTable (uint64_t* hcode)
 //	- max code length is 58 bits;
 //	- codes outside the range [im-iM] have a null length (unused values);
 //	- original frequencies are destroyed;
-//	- encoding tables are used by hufEncode() and hufBuildDecTable();
+//	- encoding tables are used by hufEncode() and hufPackEncTable();
 //
-// NB: The following code "(*a == *b) && (a > b))" was added to ensure
-//     elements in the heap with the same value are sorted by index.
-//     This is to ensure, the STL make_heap()/pop_heap()/push_heap() methods
-//     produced a resultant sorted heap that is identical across OSes.
+// NB: Nodes with the same frequency must be taken off the heap in
+//     order of symbol index, as the STL make_heap()/pop_heap()/push_heap()
+//     based implementation did ("(*a == *b) && (a > b)"), otherwise the
+//     code lengths, and so the files, differ. Packing the frequency
+//     above the index into a single integer key gives exactly that order
+//     with a plain integer compare, and since every key is unique the
+//     sequence of nodes merged does not depend on the heap layout.
 //
 
-static inline int
-FHeapCompare (uint64_t* a, uint64_t* b)
-{
-    return ((*a > *b) || ((*a == *b) && (a > b)));
-}
-
-static inline void
-intern_push_heap (
-    uint64_t** first, size_t holeIndex, size_t topIndex, uint64_t* value)
-{
-    size_t parent = (holeIndex - 1) / 2;
-    while (holeIndex > topIndex && FHeapCompare (*(first + parent), value))
-    {
-        *(first + holeIndex) = *(first + parent);
-        holeIndex            = parent;
-        parent               = (holeIndex - 1) / 2;
-    }
-    *(first + holeIndex) = value;
-}
-
-static inline void
-adjust_heap (uint64_t** first, size_t holeIndex, size_t len, uint64_t* value)
-{
-    const size_t topIndex    = holeIndex;
-    size_t       secondChild = holeIndex;
-
-    while (secondChild < (len - 1) / 2)
-    {
-        secondChild = 2 * (secondChild + 1);
-        if (FHeapCompare (*(first + secondChild), *(first + (secondChild - 1))))
-            --secondChild;
-        *(first + holeIndex) = *(first + secondChild);
-        holeIndex            = secondChild;
-    }
-
-    if ((len & 1) == 0 && secondChild == (len - 2) / 2)
-    {
-        secondChild          = 2 * (secondChild + 1);
-        *(first + holeIndex) = *(first + (secondChild - 1));
-        holeIndex            = secondChild - 1;
-    }
-
-    intern_push_heap (first, holeIndex, topIndex, value);
-}
-
-static inline void
-push_heap (uint64_t** first, uint64_t** last)
-{
-    uint64_t* value = *(last - 1);
-    intern_push_heap (first, (size_t) (last - first) - 1, 0, value);
-}
+#define HUF_KEY_BITS 17
+#define HUF_KEY_MASK ((((uint64_t) 1) << HUF_KEY_BITS) - 1)
+#define HUF_NO_PARENT UINT32_MAX
 
 static inline void
-intern_pop_heap (uint64_t** first, uint64_t** last, uint64_t** result)
+hufSiftDown (uint64_t* heap, uint32_t hole, uint32_t len, uint64_t key)
 {
-    uint64_t* value = *result;
-    *result         = *first;
-    adjust_heap (first, 0, (size_t) (last - first), value);
-}
+    uint32_t child = 2 * hole + 1;
 
-static inline void
-pop_heap (uint64_t** first, uint64_t** last)
-{
-    if (last - first > 1)
+    while (child < len)
     {
-        --last;
-        intern_pop_heap (first, last, last);
-    }
-}
-
-static void
-make_heap (uint64_t** first, uint64_t len)
-{
-    size_t parent;
-
-    if (len < 2) return;
-    parent = (len - 2) / 2;
-
-    while (1)
-    {
-        uint64_t* value = *(first + parent);
-        adjust_heap (first, parent, len, value);
-        if (parent == 0) return;
-        --parent;
+        if (child + 1 < len && heap[child + 1] < heap[child]) ++child;
+        if (key <= heap[child]) break;
+        heap[hole] = heap[child];
+        hole       = child;
+        child      = 2 * hole + 1;
     }
+    heap[hole] = key;
 }
 
 static void
 hufBuildEncTable (
-    uint64_t*  frq,
-    uint32_t*  im,
-    uint32_t*  iM,
-    uint32_t*  hlink,
-    uint64_t** fHeap,
-    uint64_t*  scode)
+    uint64_t* frq,
+    uint32_t* im,
+    uint32_t* iM,
+    uint32_t* hlink,
+    uint64_t* fHeap,
+    uint64_t* scode)
 {
     //
     // This function assumes that when it is called, array frq
@@ -315,13 +226,19 @@ hufBuildEncTable (
     //     frq[im] != 0, and frq[i] == 0 for all i < im
     //     frq[iM] != 0, and frq[i] == 0 for all i > iM
     //
-    // 2) Fills array fHeap with pointers to all non-zero
-    //    entries in frq.
+    // 2) Fills array fHeap with the (frequency, index) keys of all
+    //    non-zero entries in frq.
+    //
+    // 3) Marks every entry of hlink as not (yet) having a parent.
     //
-    // 3) Initializes array hlink such that hlink[i] == i
-    //    for all array entries.
+    // Frequencies are bounded by the number of input values, which
+    // internal_huf_compress() keeps well below 2^47.
     //
-    uint32_t nf = 0;
+    uint32_t  nf = 0;
+    uint32_t  nodes;
+    uint32_t* intParent;
+    uint32_t* intDepth;
+    uint32_t* slotNode = (uint32_t*) scode;
 
     *im = 0;
 
@@ -330,11 +247,11 @@ hufBuildEncTable (
 
     for (uint32_t i = *im; i < HUF_ENCSIZE; i++)
     {
-        hlink[i] = i;
+        hlink[i] = HUF_NO_PARENT;
 
         if (frq[i])
         {
-            fHeap[nf] = &frq[i];
+            fHeap[nf] = (frq[i] << HUF_KEY_BITS) | i;
             ++nf;
             *iM = i;
         }
@@ -342,18 +259,16 @@ hufBuildEncTable (
 
     //
     // Add a pseudo-symbol, with a frequency count of 1, to frq;
-    // adjust the fHeap and hlink array accordingly.  Function
-    // hufEncode() uses the pseudo-symbol for run-length encoding.
+    // adjust the fHeap array accordingly.  Function hufEncode()
+    // uses the pseudo-symbol for run-length encoding.
     //
 
     (*iM)++;
-    frq[*iM]  = 1;
-    fHeap[nf] = &frq[*iM];
+    fHeap[nf] = (((uint64_t) 1) << HUF_KEY_BITS) | *iM;
     ++nf;
 
     //
-    // Build an array, scode, such that scode[i] contains the number
-    // of bits assigned to symbol i.  Conceptually this is done by
+    // Compute the number of bits assigned to each symbol by
     // constructing a tree whose leaves are the symbols with non-zero
     // frequency:
     //
@@ -365,87 +280,89 @@ hufBuildEncTable (
     //         Take the two least frequent symbols off the top of the heap.
     //         Create a new node that has first two nodes as children, and
     //         whose frequency is the sum of the frequencies of the first
-    //         two nodes.  Put the new node back into the heap.
+    //         two nodes.  Put the new node back into the heap, keyed by
+    //         the index of the second node.
     //
     // The last node left on the heap is the root of the tree.  For each
     // leaf node, the distance between the root and the leaf is the length
     // of the code for the corresponding symbol.
     //
-    // The loop below doesn't actually build the tree; instead we compute
-    // the distances of the leaves from the root on the fly.  When a new
-    // node is added to the heap, then that node's descendants are linked
-    // into a single linear list that starts at the new node, and the code
-    // lengths of the descendants (that is, their distance from the root
-    // of the tree) are incremented by one.
+    // Only the parent of each node is recorded while merging: leaves
+    // in hlink, and the internal nodes, numbered in order of creation,
+    // in the (no longer needed) frq array. Parents are always created
+    // after their children, so a single pass from the root down then
+    // gives every depth, instead of walking every descendant list on
+    // each merge.
     //
 
-    make_heap (fHeap, nf);
+    intParent = (uint32_t*) frq;
+    intDepth  = intParent + HUF_ENCSIZE;
+    nodes     = 0;
 
-    memset (scode, 0, sizeof (uint64_t) * HUF_ENCSIZE);
+    //
+    // slotNode[i] is the node currently keyed by index i on the heap,
+    // leaves are numbered by symbol and internal nodes from HUF_ENCSIZE
+    //
+    for (uint32_t i = 0; i < nf; i++)
+    {
+        uint32_t idx  = (uint32_t) (fHeap[i] & HUF_KEY_MASK);
+        slotNode[idx] = idx;
+    }
+
+    for (uint32_t i = nf / 2; i-- > 0;)
+        hufSiftDown (fHeap, i, nf, fHeap[i]);
 
     while (nf > 1)
     {
-        uint32_t mm, m;
+        uint64_t mmKey, mKey;
+        uint32_t mm, m, a, b;
         //
-        // Find the indices, mm and m, of the two smallest non-zero frq
-        // values in fHeap, add the smallest frq to the second-smallest
-        // frq, and remove the smallest frq value from fHeap.
+        // Find the keys of the two smallest non-zero frq values in
+        // fHeap, and replace them by a single node keyed by the
+        // index of the second-smallest with the sum of both.
         //
 
-        mm = (uint32_t) (fHeap[0] - frq);
-        pop_heap (&fHeap[0], &fHeap[nf]);
+        mmKey = fHeap[0];
         --nf;
+        hufSiftDown (fHeap, 0, nf, fHeap[nf]);
+        mKey = fHeap[0];
 
-        m = (uint32_t) (fHeap[0] - frq);
-        pop_heap (&fHeap[0], &fHeap[nf]);
-
-        frq[m] += frq[mm];
-        push_heap (&fHeap[0], &fHeap[nf]);
-
-        //
-        // The entries in scode are linked into lists with the
-        // entries in hlink serving as "next" pointers and with
-        // the end of a list marked by hlink[j] == j.
-        //
-        // Traverse the lists that start at scode[m] and scode[mm].
-        // For each element visited, increment the length of the
-        // corresponding code by one bit. (If we visit scode[j]
-        // during the traversal, then the code for symbol j becomes
-        // one bit longer.)
-        //
-        // Merge the lists that start at scode[m] and scode[mm]
-        // into a single list that starts at scode[m].
-        //
+        mm = (uint32_t) (mmKey & HUF_KEY_MASK);
+        m  = (uint32_t) (mKey & HUF_KEY_MASK);
+        a  = slotNode[mm];
+        b  = slotNode[m];
 
-        //
-        // Add a bit to all codes in the first list.
-        //
-
-        for (uint32_t j = m;; j = hlink[j])
-        {
-            scode[j]++;
-
-            if (hlink[j] == j)
-            {
-                //
-                // Merge the two lists.
-                //
-
-                hlink[j] = mm;
-                break;
-            }
-        }
+        if (a < HUF_ENCSIZE)
+            hlink[a] = nodes;
+        else
+            intParent[a - HUF_ENCSIZE] = nodes;
+        if (b < HUF_ENCSIZE)
+            hlink[b] = nodes;
+        else
+            intParent[b - HUF_ENCSIZE] = nodes;
+        slotNode[m] = HUF_ENCSIZE + nodes;
+        ++nodes;
+
+        mKey = (((mKey >> HUF_KEY_BITS) + (mmKey >> HUF_KEY_BITS))
+                << HUF_KEY_BITS) |
+               m;
+        hufSiftDown (fHeap, 0, nf, mKey);
+    }
 
-        //
-        // Add a bit to all codes in the second list
-        //
+    //
+    // The last internal node is the root, every other node is one
+    // deeper than its parent. Store the code lengths in scode.
+    //
 
-        for (uint32_t j = mm;; j = hlink[j])
-        {
-            scode[j]++;
+    intDepth[nodes - 1] = 0;
+    for (uint32_t k = nodes - 1; k-- > 0;)
+        intDepth[k] = intDepth[intParent[k]] + 1;
 
-            if (hlink[j] == j) break;
-        }
+    memset (scode, 0, sizeof (uint64_t) * HUF_ENCSIZE);
+    for (uint32_t i = *im; i <= *iM; i++)
+    {
+        if (hlink[i] != HUF_NO_PARENT)
+            scode[i] = intDepth[hlink[i]] + 1;
     }
 
     //
@@ -529,263 +446,93 @@ hufPackEncTable (
 }
 
 //
-// Unpack an encoding table packed by hufPackEncTable():
-//
-
-static exr_result_t
-hufUnpackEncTable (
-    const uint8_t** pcode, // io: ptr to packed table (updated)
-    uint64_t*       nLeft, // io: input size (in bytes), bytes left
-    uint32_t        im,    // i : min hcode index
-    uint32_t        iM,    // i : max hcode index
-    uint64_t*       hcode)       // o : encoding table [HUF_ENCSIZE]
-{
-    const uint8_t* p  = *pcode;
-    uint64_t       c  = 0;
-    uint64_t       ni = *nLeft;
-    uint64_t       nr;
-    uint32_t       lc = 0;
-    uint64_t       l, zerun;
-
-    memset (hcode, 0, sizeof (uint64_t) * HUF_ENCSIZE);
-    for (; im <= iM; im++)
-    {
-        nr = (((uintptr_t) p) - ((uintptr_t) *pcode));
-        if (lc < 6 && nr >= ni) return EXR_ERR_OUT_OF_MEMORY;
-
-        l = hcode[im] = getBits (6, &c, &lc, &p); // code length
-
-        if (l == (uint64_t) LONG_ZEROCODE_RUN)
-        {
-            nr = (((uintptr_t) p) - ((uintptr_t) *pcode));
-            if (lc < 8 && nr >= ni) return EXR_ERR_OUT_OF_MEMORY;
-
-            zerun = getBits (8, &c, &lc, &p) + SHORTEST_LONG_RUN;
-
-            if (im + zerun > iM + 1) return EXR_ERR_CORRUPT_CHUNK;
-
-            while (zerun--)
-                hcode[im++] = 0;
-
-            im--;
-        }
-        else if (l >= (uint64_t) SHORT_ZEROCODE_RUN)
-        {
-            zerun = l - SHORT_ZEROCODE_RUN + 2;
-
-            if (im + zerun > iM + 1) return EXR_ERR_CORRUPT_CHUNK;
-
-            while (zerun--)
-                hcode[im++] = 0;
-
-            im--;
-        }
-    }
-
-    nr = (((uintptr_t) p) - ((uintptr_t) *pcode));
-    *nLeft -= nr;
-    *pcode = p;
-
-    hufCanonicalCodeTable (hcode);
-    return EXR_ERR_SUCCESS;
-}
-
-//
-// DECODING TABLE BUILDING
+// ENCODING
 //
 
 //
-// Clear a newly allocated decoding table so that it contains only zeroes.
+// The encoder keeps pending bits left aligned in a 64-bit register,
+// oldest bit first. After every code the register is stored whole, as
+// 8 big-endian bytes, and the output pointer only advances by the
+// number of complete bytes, so the common path has no per-byte loop
+// and no data dependent branch. This produces the same bit stream as
+// writing a byte at a time with outputBits().
 //
-
-static void
-hufClearDecTable (HufDec* hdecod)
-{
-    memset (hdecod, 0, sizeof (HufDec) * HUF_DECSIZE);
-}
-
+// Within HUF_WRITE_SLOP bytes of the end of the output, complete
+// bytes are written one at a time with a range check instead.
 //
-// Build a decoding hash table based on the encoding table hcode:
-//	- short codes (<= HUF_DECBITS) are resolved with a single table access;
-//	- long code entry allocations are not optimized, because long codes are
-//	  unfrequent;
-//	- decoding tables are used by hufDecode();
+// putBits() requires lc < 8 on entry, and leaves lc < 8 behind. Codes
+// longer than 56 bits are split in two.
 //
 
-static exr_result_t
-hufBuildDecTable (
-    exr_const_context_t pctxt,
-    const uint64_t*     hcode,
-    uint32_t            im,
-    uint32_t            iM,
-    HufDec*             hdecod)
-{
-    void* (*alloc_fn) (size_t) = pctxt ? pctxt->alloc_fn : internal_exr_alloc;
-    void (*free_fn) (void*)    = pctxt ? pctxt->free_fn : internal_exr_free;
-
-    //
-    // Init hashtable & loop on all codes.
-    // Assumes that hufClearDecTable(hdecod) has already been called.
-    //
-
-    for (; im <= iM; im++)
-    {
-        uint64_t c = hufCode (hcode[im]);
-        int      l = hufLength (hcode[im]);
-
-        if (c >> l)
-        {
-            //
-            // Error: c is supposed to be an l-bit code,
-            // but c contains a value that is greater
-            // than the largest l-bit number.
-            //
-
-            return EXR_ERR_CORRUPT_CHUNK;
-        }
-
-        if (l > HUF_DECBITS)
-        {
-            //
-            // Long code: add a secondary entry
-            //
-
-            HufDec* pl = hdecod + (c >> (l - HUF_DECBITS));
-
-            if (pl->len)
-            {
-                //
-                // Error: a short code has already
-                // been stored in table entry *pl.
-                //
-
-                return EXR_ERR_CORRUPT_CHUNK;
-            }
-
-            pl->lit++;
+#define HUF_WRITE_SLOP 8
 
-            if (pl->p)
-            {
-                uint32_t* p = pl->p;
-                pl->p = (uint32_t*) alloc_fn (sizeof (uint32_t) * pl->lit);
-
-                if (pl->p)
-                {
-                    for (uint32_t i = 0; i < pl->lit - 1; ++i)
-                        pl->p[i] = p[i];
-                }
-
-                free_fn (p);
-            }
-            else { pl->p = (uint32_t*) alloc_fn (sizeof (uint32_t)); }
-
-            if (!pl->p) return EXR_ERR_OUT_OF_MEMORY;
-
-            pl->p[pl->lit - 1] = im;
-        }
-        else if (l)
-        {
-            //
-            // Short code: init all primary entries
-            //
-
-            HufDec* pl = hdecod + (c << (HUF_DECBITS - l));
-
-            for (uint64_t i = ((uint64_t) 1) << (HUF_DECBITS - l); i > 0;
-                 i--, pl++)
-            {
-                if (pl->len || pl->p)
-                {
-                    //
-                    // Error: a short code or a long code has
-                    // already been stored in table entry *pl.
-                    //
-
-                    return EXR_ERR_CORRUPT_CHUNK;
-                }
-
-                pl->len = (int32_t) l;
-                pl->lit = im;
-            }
-        }
+#define flushBits(c, lc, out, outend)                               \
+    if (OUR_LIKELY ((outend - out) >= HUF_WRITE_SLOP))              \
+    {                                                               \
+        out[0] = (uint8_t) (c >> 56);                               \
+        out[1] = (uint8_t) (c >> 48);                               \
+        out[2] = (uint8_t) (c >> 40);                               \
+        out[3] = (uint8_t) (c >> 32);                               \
+        out[4] = (uint8_t) (c >> 24);                               \
+        out[5] = (uint8_t) (c >> 16);                               \
+        out[6] = (uint8_t) (c >> 8);                                \
+        out[7] = (uint8_t) (c);                                     \
+        out += lc >> 3;                                             \
+        c <<= lc & ~7;                                              \
+        lc &= 7;                                                    \
+    }                                                               \
+    else                                                            \
+    {                                                               \
+        while (lc >= 8)                                             \
+        {                                                           \
+            if (OUR_UNLIKELY (out >= outend))                       \
+                return EXR_ERR_ARGUMENT_OUT_OF_RANGE;               \
+            *out++ = (uint8_t) (c >> 56);                           \
+            c <<= 8;                                                \
+            lc -= 8;                                                \
+        }                                                           \
     }
-    return EXR_ERR_SUCCESS;
-}
 
-//
-// Free the long code entries of a decoding table built by hufBuildDecTable()
-//
-
-static void
-hufFreeDecTable (exr_const_context_t pctxt, HufDec* hdecod)
-{
-    void (*free_fn) (void*) = pctxt ? pctxt->free_fn : internal_exr_free;
-    for (int i = 0; i < HUF_DECSIZE; i++)
-    {
-        if (hdecod[i].p)
-        {
-            free_fn (hdecod[i].p);
-            hdecod[i].p = NULL;
-        }
+#define putBits(nBits, bits, c, lc, out, outend)                    \
+    {                                                               \
+        int      xnBits = nBits;                                    \
+        uint64_t xbits  = bits;                                     \
+        if (OUR_UNLIKELY (xnBits > 56))                             \
+        {                                                           \
+            xnBits -= 24;                                           \
+            c |= (xbits >> 24) << (64 - lc - xnBits);               \
+            lc += xnBits;                                           \
+            flushBits (c, lc, out, outend);                         \
+            xbits &= 0xFFFFFF;                                      \
+            xnBits = 24;                                            \
+        }                                                           \
+        c |= xbits << (64 - lc - xnBits);                           \
+        lc += xnBits;                                               \
+        flushBits (c, lc, out, outend);                             \
     }
-}
+
+#define putCode(code, c, lc, out, outend)                           \
+    putBits (hufLength (code), hufCode (code), c, lc, out, outend)
 
 //
-// ENCODING
+// Send runCount + 1 copies of sCode, either literally or as sCode
+// followed by the run-length pseudo-symbol and an 8-bit count,
+// whichever is shorter.
 //
 
-//static inline exr_result_t
-//outputCode (uint64_t code, uint64_t* c, int* lc, uint8_t** out, uint8_t* outend)
-//{
-//    return outputBits (hufLength (code), hufCode (code), c, lc, out, outend);
-//}
-#define outputCode(code, c, lc, out, outend) \
-    outputBits (hufLength (code), hufCode (code), c, lc, out, outend)
-
-//static inline exr_result_t
-//sendCode (
-//    uint64_t  sCode,
-//    int       runCount,
-//    uint64_t  runCode,
-//    uint64_t* c,
-//    int*      lc,
-//    uint8_t** out,
-//    uint8_t*  outend)
-//{
-//    exr_result_t rv;
-//    if (hufLength (sCode) + hufLength (runCode) + 8 <
-//        hufLength (sCode) * runCount)
-//    {
-//        rv = outputCode (sCode, c, lc, out, outend);
-//        if (rv == EXR_ERR_SUCCESS)
-//            rv = outputCode (runCode, c, lc, out, outend);
-//        if (rv == EXR_ERR_SUCCESS)
-//            rv = outputBits (8, (uint64_t) runCount, c, lc, out, outend);
-//    }
-//    else
-//    {
-//        rv = EXR_ERR_SUCCESS;
-//        while (runCount-- >= 0)
-//        {
-//            rv = outputCode (sCode, c, lc, out, outend);
-//            if (rv != EXR_ERR_SUCCESS) break;
-//        }
-//    }
-//    return rv;
-//}
 #define sendCode(sCode, runCount, runCode, c, lc, out, outend)      \
     if ((hufLength (sCode) + hufLength (runCode) + 8) <             \
         (hufLength (sCode) * runCount))                             \
     {                                                               \
-        outputCode (sCode, c, lc, out, outend);                     \
-        outputCode (runCode, c, lc, out, outend);                   \
-        outputBits (8, (uint64_t) runCount, c, lc, out, outend);    \
+        putCode (sCode, c, lc, out, outend);                        \
+        putCode (runCode, c, lc, out, outend);                      \
+        putBits (8, (uint64_t) runCount, c, lc, out, outend);       \
     }                                                               \
     else                                                            \
     {                                                               \
-        while ( runCount-- >= 0 )                                   \
+        while (runCount-- >= 0)                                     \
         {                                                           \
-            outputCode (sCode, c, lc, out, outend);                 \
+            putCode (sCode, c, lc, out, outend);                    \
         }                                                           \
     }
 
@@ -805,7 +552,7 @@ hufEncode (
 {
     uint8_t* outStart = out;
     uint64_t c        = 0; // bits not yet written to out
-    int      lc       = 0; // number of valid bits in c (LSB)
+    int      lc       = 0; // number of valid bits in c (MSB)
     uint32_t s        = in[0];
     int      cs       = 0;
     uint64_t runCode  = hcode[rlc];
@@ -837,10 +584,14 @@ hufEncode (
     //
     sendCode (hcode[s], cs, runCode, c, lc, out, outend);
 
+    //
+    // Write the final partial byte, c is left aligned so the unused
+    // low bits are already zero
+    //
     if (lc)
     {
         if (out >= outend) return EXR_ERR_ARGUMENT_OUT_OF_RANGE;
-        *out = (c << (8 - lc)) & 0xff;
+        *out = (uint8_t) (c >> 56);
     }
 
     c = (((uintptr_t) out) - ((uintptr_t) outStart)) * 8 + (uint64_t) (lc);
@@ -851,173 +602,59 @@ hufEncode (
 }
 
 //
-// DECODING
+// Below this many values the single table loop wins, clearing and
+// summing the split histograms costs more than it saves
 //
+#define HUF_SPLIT_COUNT_MIN (1 << 18)
 
 //
-// In order to force the compiler to inline them,
-// getChar() and getCode() are implemented as macros
-// instead of "inline" functions.
-//
-
-#define getChar(c, lc, in)                                                     \
-    c = (c << 8) | (uint64_t) (*in++);                                         \
-    lc += 8
-
-#define getCode(po, rlc, c, lc, in, ie, out, ob, oe)                           \
-    do                                                                         \
-    {                                                                          \
-        if (po == rlc)                                                         \
-        {                                                                      \
-            uint8_t  cs;                                                       \
-            uint16_t s;                                                        \
-            if (lc < 8)                                                        \
-            {                                                                  \
-                if (in >= ie) return EXR_ERR_OUT_OF_MEMORY;                    \
-                getChar (c, lc, in);                                           \
-            }                                                                  \
-                                                                               \
-            lc -= 8;                                                           \
-                                                                               \
-            cs = (uint8_t) (c >> lc);                                          \
-                                                                               \
-            if (out + cs > oe)                                                 \
-                return EXR_ERR_CORRUPT_CHUNK;                                  \
-            else if (out - 1 < ob)                                             \
-                return EXR_ERR_OUT_OF_MEMORY;                                  \
-                                                                               \
-            s = out[-1];                                                       \
-                                                                               \
-            while (cs-- > 0)                                                   \
-                *out++ = s;                                                    \
-        }                                                                      \
-        else if (out < oe) { *out++ = (uint16_t) po; }                         \
-        else { return EXR_ERR_CORRUPT_CHUNK; }                                 \
-    } while (0)
-
+// Count symbol frequencies. Wavelet output is dominated by long runs
+// of the same few values, so a single table serializes on the
+// load-increment-store of one counter. For large inputs, count into
+// four 32-bit tables in the (not yet used) scratch space instead so
+// consecutive values land in different counters, then sum them; the
+// final sum is a straight loop the compiler vectorizes.
 //
-// Decode (uncompress) ni bits based on encoding & decoding tables:
+// scratch must hold 4 * 65536 uint32_t values.
 //
 
-static exr_result_t
-hufDecode (
-    const uint64_t* hcode,  // i : encoding table
-    const HufDec*   hdecod, // i : decoding table
-    const uint8_t*  in,     // i : compressed input buffer
-    uint64_t        ni,     // i : input size (in bits)
-    uint32_t        rlc,    // i : run-length code
-    uint64_t        no,     // i : expected output size (count of uint16 items)
-    uint16_t*       out)
+static inline void
+countFrequencies (
+    uint64_t* NO_ALIAS       freq,
+    const uint16_t* NO_ALIAS data,
+    uint64_t                 n,
+    uint32_t* NO_ALIAS       scratch)
 {
-    uint64_t       i;
-    uint64_t       c    = 0;
-    int            lc   = 0;
-    uint16_t*      outb = out;
-    uint16_t*      oe   = out + no;
-    const uint8_t* ie   = in + (ni + 7) / 8; // input byte size
-
-    //
-    // Loop on input bytes
-    //
+    uint32_t *h0, *h1, *h2, *h3;
+    uint64_t  i = 0;
 
-    while (in < ie)
+    memset (freq, 0, HUF_ENCSIZE * sizeof (uint64_t));
+    if (n < HUF_SPLIT_COUNT_MIN || n > (uint64_t) UINT32_MAX)
     {
-        getChar (c, lc, in);
-
-        //
-        // Access decoding table
-        //
-
-        while (lc >= HUF_DECBITS)
-        {
-            uint64_t      decoffset = (c >> (lc - HUF_DECBITS)) & HUF_DECMASK;
-            const HufDec* pl        = hdecod + decoffset;
-
-            if (pl->len)
-            {
-                //
-                // Get short code
-                //
-
-                if (pl->len > lc) return EXR_ERR_CORRUPT_CHUNK;
-
-                lc -= pl->len;
-                getCode (pl->lit, rlc, c, lc, in, ie, out, outb, oe);
-            }
-            else
-            {
-                uint32_t        j;
-                const uint32_t* decbuf = pl->p;
-                if (!pl->p) return EXR_ERR_CORRUPT_CHUNK; // wrong code
-
-                //
-                // Search long code
-                //
-
-                for (j = 0; j < pl->lit; j++)
-                {
-                    int l = hufLength (hcode[decbuf[j]]);
-
-                    while (lc < l && in < ie) // get more bits
-                    {
-                        getChar (c, lc, in);
-                    }
-
-                    if (lc >= l)
-                    {
-                        if (hufCode (hcode[decbuf[j]]) ==
-                            ((c >> (lc - l)) & (((uint64_t) (1) << l) - 1)))
-                        {
-                            //
-                            // Found : get long code
-                            //
-
-                            lc -= l;
-                            getCode (
-                                decbuf[j], rlc, c, lc, in, ie, out, outb, oe);
-                            break;
-                        }
-                    }
-                }
-
-                if (j == pl->lit) return EXR_ERR_CORRUPT_CHUNK;
-            }
-        }
+        for (; i < n; ++i)
+            ++freq[data[i]];
+        return;
     }
 
-    //
-    // Get remaining (short) codes
-    //
-
-    i = (8 - ni) & 7;
-    c >>= i;
-    lc -= (int) i;
+    h0 = scratch;
+    h1 = h0 + 65536;
+    h2 = h1 + 65536;
+    h3 = h2 + 65536;
+    memset (scratch, 0, 4 * 65536 * sizeof (uint32_t));
 
-    while (lc > 0)
+    for (; i + 4 <= n; i += 4)
     {
-        uint64_t      decoffset = (c << (HUF_DECBITS - lc)) & HUF_DECMASK;
-        const HufDec* pl        = hdecod + decoffset;
-
-        if (pl->len)
-        {
-            if (pl->len > lc) return EXR_ERR_CORRUPT_CHUNK;
-            lc -= pl->len;
-            getCode (pl->lit, rlc, c, lc, in, ie, out, outb, oe);
-        }
-        else
-            return EXR_ERR_CORRUPT_CHUNK;
+        ++h0[data[i]];
+        ++h1[data[i + 1]];
+        ++h2[data[i + 2]];
+        ++h3[data[i + 3]];
     }
+    for (; i < n; ++i)
+        ++h0[data[i]];
 
-    if (out != oe) return EXR_ERR_OUT_OF_MEMORY;
-    return EXR_ERR_SUCCESS;
-}
-
-static inline void
-countFrequencies (uint64_t* freq, const uint16_t* data, uint64_t n)
-{
-    memset (freq, 0, HUF_ENCSIZE * sizeof (uint64_t));
-    for (uint64_t i = 0; i < n; ++i)
-        ++freq[data[i]];
+    for (i = 0; i < 65536; ++i)
+        freq[i] = (uint64_t) h0[i] + (uint64_t) h1[i] + (uint64_t) h2[i] +
+                  (uint64_t) h3[i];
 }
 
 static inline void
@@ -1048,15 +685,33 @@ readUInt (const uint8_t* b)
 // old c++ code was only 12 bits, not 14 as you might expect from the encode
 // but only having a memory page for the lookup does seem marginally faster
 #define TABLE_LOOKUP_BITS 12
-//#define TABLE_LOOKUP_BITS HUF_DECBITS
 #define INDEX_BIT_SHIFT (64 - TABLE_LOOKUP_BITS)
 
+// Most symbols decoded by a single table lookup. Short codes are
+// packed into one entry as long as they fit in TABLE_LOOKUP_BITS.
+#define TABLE_MAX_SYMBOLS 4
+
+// Layout of the _tableInfo entries
+#define TABLE_INFO_LEN0(info) ((info) & 0xf)
+#define TABLE_INFO_TOTAL(info) (((info) >> 4) & 0xf)
+#define TABLE_INFO_COUNT(info) (((info) >> 8) & 0x7)
+#define TABLE_INFO_RLE 0x800
+
 #include <inttypes.h>
 
 /* unaligned reads are UB, so can't just cast the way c++ used to
  * (chars are special and we don't want to use those anyway) so just
  * do the simple thing... */
-#if defined(__has_builtin)
+#if EXR_HOST_IS_NOT_LITTLE_ENDIAN
+#    define HAVE_READ64
+static inline uint64_t
+READ64(const uint8_t * c)
+{
+    uint64_t x;
+    memcpy(&x, c, sizeof(uint64_t));
+    return x;
+}
+#elif defined(__has_builtin)
 #    if __has_builtin(__builtin_bswap64)
 #        define HAVE_READ64
 static inline uint64_t
@@ -1113,20 +768,21 @@ typedef struct FastHufDecoder
 
     //
     // We can accelerate the 'left justified' processing by running the
-    // top TABLE_LOOKUP_BITS through a LUT, to find the symbol and code
-    // length. These are those acceleration tables.
-    //
-    // Even though our eventual 'symbols' are ushort's, the encoder adds
-    // a symbol to indicate RLE. So with a dense code book, we could
-    // have 2^16+1 codes, hence 'symbol' could  be bigger than 16 bits.
-    //
-    // It is more memory efficient to store as value = (codeLen << 24)
-    // | symbol rather than storing two tables, however does seem to
-    // be measurably slower. Given this is the fast path, let's waste
-    // some RAM
-    int      _tableSymbol[1 << TABLE_LOOKUP_BITS];
-    uint8_t  _tableCodeLen[1 << TABLE_LOOKUP_BITS];
-    uint64_t _tableMin;
+    // top TABLE_LOOKUP_BITS through a LUT, to find the symbols and code
+    // lengths. These are those acceleration tables.
+    //
+    // Each entry holds every whole code that fits in its
+    // TABLE_LOOKUP_BITS, up to TABLE_MAX_SYMBOLS of them, so runs of
+    // short codes come out several symbols per lookup. _tableSymbols
+    // has the symbols in output order, ready to be copied as a block.
+    // _tableInfo has the length of the first code, the total length
+    // and the number of symbols. When the first code is the RLE
+    // symbol, which could be 2^16 and so does not fit, it only has
+    // the first length and TABLE_INFO_RLE. Zero means the first code
+    // is longer than TABLE_LOOKUP_BITS.
+    //
+    uint16_t _tableSymbols[1 << TABLE_LOOKUP_BITS][TABLE_MAX_SYMBOLS];
+    uint16_t _tableInfo[1 << TABLE_LOOKUP_BITS];
 } FastHufDecoder;
 
 static exr_result_t
@@ -1136,7 +792,7 @@ FastHufDecoder_buildTables (
     uint64_t*           base,
     uint64_t*           offset)
 {
-    int minIdx = TABLE_LOOKUP_BITS;
+    int maxLen;
 
     //
     // Build the 'left justified' base table, by shifting base left..
@@ -1172,27 +828,35 @@ FastHufDecoder_buildTables (
 
     //
     // Build the acceleration tables for the lookups of
-    // short codes ( <= TABLE_LOOKUP_BITS long)
+    // short codes ( <= TABLE_LOOKUP_BITS long). First the
+    // single code each entry starts with...
     //
 
+    maxLen = fhd->_maxCodeLength;
+    if (maxLen > TABLE_LOOKUP_BITS) maxLen = TABLE_LOOKUP_BITS;
+
     for (uint64_t i = 0; i < 1 << TABLE_LOOKUP_BITS; ++i)
     {
         uint64_t value = i << INDEX_BIT_SHIFT;
 
-        fhd->_tableSymbol[i] = 0xffff;
-        fhd->_tableCodeLen[i] = 0;
+        fhd->_tableInfo[i] = 0;
 
-        for (int codeLen = fhd->_minCodeLength; codeLen <= fhd->_maxCodeLength;
-             ++codeLen)
+        for (int codeLen = fhd->_minCodeLength; codeLen <= maxLen; ++codeLen)
         {
             if (fhd->_ljBase[codeLen] <= value)
             {
-                fhd->_tableCodeLen[i] = codeLen;
                 uint64_t id =
                     fhd->_ljOffset[codeLen] + (value >> (64 - codeLen));
                 if (id < (uint64_t) (fhd->_numSymbols))
                 {
-                    fhd->_tableSymbol[i] = fhd->_idToSymbol[id];
+                    uint32_t symbol = fhd->_idToSymbol[id];
+
+                    fhd->_tableSymbols[i][0] = (uint16_t) symbol;
+                    if (symbol == (uint32_t) fhd->_rleSymbol)
+                        fhd->_tableInfo[i] =
+                            (uint16_t) (TABLE_INFO_RLE | codeLen);
+                    else
+                        fhd->_tableInfo[i] = (uint16_t) codeLen;
                 }
                 else
                 {
@@ -1209,105 +873,75 @@ FastHufDecoder_buildTables (
     }
 
     //
-    // Store the smallest value in the table that points to real data.
-    // This should be the entry for the largest length that has
-    // valid data (in our case, non-dummy _ljBase)
+    // ...then append the codes that follow it while they fit. The
+    // code starting after the first used bits of entry i is the one
+    // entry (i << used) starts with, as long as it is no longer than
+    // the bits left. The first length and RLE flag of an entry are
+    // never changed below, so entries can be extended in place.
     //
 
-    while (minIdx > 0 && fhd->_ljBase[minIdx] == 0xffffffffffffffffULL)
-        minIdx--;
-
-    if (minIdx < 0)
+    for (uint32_t i = 0; i < 1 << TABLE_LOOKUP_BITS; ++i)
     {
-        //
-        // Error, no codes with lengths 0-TABLE_LOOKUP_BITS used.
-        // Set the min value such that the table is never tested.
-        //
+        uint32_t info = fhd->_tableInfo[i];
+        uint32_t used, count;
 
-        fhd->_tableMin = 0xffffffffffffffffULL;
-    }
-    else { fhd->_tableMin = fhd->_ljBase[minIdx]; }
-    return EXR_ERR_SUCCESS;
-}
-
-static inline void
-FastHufDecoder_refill (
-    uint64_t* NO_ALIAS                 buffer,
-    int                                numBits,           // number of bits to refill
-    uint64_t* NO_ALIAS                 bufferBack,        // the next 64-bits, to refill from
-    int*                               bufferBackNumBits, // number of bits left in bufferBack
-    const uint8_t* NO_ALIAS * NO_ALIAS currByte,          // current byte in the bitstream
-    uint64_t* NO_ALIAS                 currBitsLeft)
-{
-    int needBits;
+        if (info == 0 || (info & TABLE_INFO_RLE)) continue;
 
-    do
-    {
-        // shifting right by 64 on a uint64_t is a bad time...
-#if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER)
-        if (__builtin_expect ((numBits > 0), 1))
-#else
-        if (numBits > 0)
-#endif
+        used  = TABLE_INFO_LEN0 (info);
+        count = 1;
+        while (count < TABLE_MAX_SYMBOLS && used < TABLE_LOOKUP_BITS)
         {
-            needBits = 64 - numBits;
-            *buffer |= (*bufferBack) >> numBits;
-            if (*bufferBackNumBits >= needBits)
-            {
-                *bufferBack <<= needBits;
-                *bufferBackNumBits -= needBits;
+            uint32_t j    = (i << used) & ((1 << TABLE_LOOKUP_BITS) - 1);
+            uint32_t next = fhd->_tableInfo[j];
+
+            if (next == 0 || (next & TABLE_INFO_RLE) ||
+                TABLE_INFO_LEN0 (next) > TABLE_LOOKUP_BITS - used)
                 break;
-            }
-            numBits += *bufferBackNumBits;
-            *bufferBackNumBits = 0;
-        }
-        else
-        {
-            *buffer = *bufferBack;
-            numBits = *bufferBackNumBits;
-            *bufferBackNumBits = 0;
+
+            fhd->_tableSymbols[i][count++] = fhd->_tableSymbols[j][0];
+            used += TABLE_INFO_LEN0 (next);
         }
 
-        if (*bufferBackNumBits <= 0)
-        {
-#if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER)
-            if (__builtin_expect ((*currBitsLeft >= 64), 1))
-#else
-            if (*currBitsLeft >= 64)
-#endif
-            {
-                *bufferBack        = READ64 (*currByte);
-                *bufferBackNumBits = 64;
-                *currByte += sizeof (uint64_t);
-                *currBitsLeft -= 8 * sizeof (uint64_t);
-            }
-            else
-            {
-                uint64_t shift = 56;
+        fhd->_tableInfo[i] =
+            (uint16_t) (TABLE_INFO_LEN0 (info) | (used << 4) | (count << 8));
+    }
 
-                *bufferBack        = 0;
-                *bufferBackNumBits = 64;
+    return EXR_ERR_SUCCESS;
+}
 
-                while (*currBitsLeft >= 8)
-                {
-                    *bufferBack |= ((uint64_t) (**currByte)) << shift;
+//
+// Peek at the 64 bits starting at bit pos of the stream, reading
+// zeroes past its end.
+//
 
-                    (*currByte)++;
-                    shift -= 8;
-                    *currBitsLeft -= 8;
-                }
+static inline uint64_t
+fasthuf_peek (const uint8_t* src, uint64_t numSrcBytes, uint64_t pos)
+{
+    uint64_t byte = pos >> 3;
+    uint64_t bits = 0;
 
-                if (*currBitsLeft > 0)
-                {
-                    *bufferBack |= ((uint64_t) (**currByte)) << shift;
+    if (OUR_LIKELY (byte + sizeof (uint64_t) <= numSrcBytes))
+        return READ64 (src + byte) << (pos & 7);
 
-                    (*currByte)++;
-                    shift -= 8;
-                    *currBitsLeft = 0;
-                }
-            }
-        }
-    } while (numBits < 64);
+    for (uint64_t i = byte; i < byte + sizeof (uint64_t); ++i)
+        bits = (bits << 8) | (i < numSrcBytes ? (uint64_t) src[i] : 0);
+    return bits << (pos & 7);
+}
+
+//
+// As fasthuf_peek, but with the low (pos & 7) bits filled in as well,
+// as codes can be up to MAX_CODE_LEN bits long
+//
+
+static inline uint64_t
+fasthuf_peek_long (const uint8_t* src, uint64_t numSrcBytes, uint64_t pos)
+{
+    uint64_t bits = fasthuf_peek (src, numSrcBytes, pos);
+    uint64_t next = (pos >> 3) + sizeof (uint64_t);
+
+    if ((pos & 7) && next < numSrcBytes)
+        bits |= ((uint64_t) src[next]) >> (8 - (pos & 7));
+    return bits;
 }
 
 static inline uint64_t
@@ -1550,50 +1184,6 @@ fasthuf_initialize (
     return FastHufDecoder_buildTables (pctxt, fhd, base, offset);
 }
 
-static inline int
-fasthuf_decode_enabled (void)
-{
-    //
-    // Enabled for clang on Apple platforms (tested)
-    //
-#if defined(__APPLE__) && defined(__clang__)
-    return 1;
-#elif defined(__INTEL_COMPILER) || defined(__GNUC__)
-
-    //
-    // Enabled for ICC, GCC:
-    //       __i386__   -> x86
-    //       __x86_64__ -> 64-bit x86
-    //       __e2k__    -> e2k (MCST Elbrus 2000)
-
-#    if defined(__i386__) || defined(__x86_64__) || defined(__e2k__)
-    return 1;
-#    else
-    return 0;
-#    endif
-
-#elif defined(_MSC_VER)
-
-    //
-    // Enabled for Visual Studio:
-    //        _M_IX86 -> x86
-    //        _M_X64  -> 64bit x86
-
-#    if defined(_M_IX86) || defined(_M_X64)
-    return 1;
-#    else
-    return 0;
-#    endif
-
-#else
-
-    //
-    // Unknown compiler - Be safe and disable.
-    //
-    return 0;
-#endif
-}
-
 static exr_result_t
 fasthuf_decode (
     exr_const_context_t         pctxt,
@@ -1604,76 +1194,80 @@ fasthuf_decode (
     uint64_t                    numDstElems)
 {
     //
-    // Current position (byte/bit) in the src data stream
-    // (after the first buffer fill)
+    // Bit position of buffer in the src data stream, and the
+    // 64-bit buffer holding the current bits in the stream, of
+    // which bufferNumBits are valid
     //
-    uint64_t buffer, bufferBack, dstIdx, tMin;
-    int      bufferNumBits, bufferBackNumBits;
-    uint32_t rleSym;
+    uint64_t pos = 0, buffer = 0;
+    int      bufferNumBits = 0;
+    uint32_t rleSym        = (uint32_t) fhd->_rleSymbol;
 
-    const uint8_t* NO_ALIAS currByte = src + 2 * sizeof (uint64_t);
+    const uint64_t      numSrcBytes = (numSrcBits + 7) / 8;
+    uint16_t* NO_ALIAS  dstStart    = dst;
+    uint16_t* NO_ALIAS  dstEnd      = dst + numDstElems;
 
-    numSrcBits -= 8 * 2 * sizeof (uint64_t);
-
-    //
-    // 64-bit buffer holding the current bits in the stream
-    //
+    while (dst < dstEnd)
+    {
+        uint32_t symbol, tableIdx, info;
+        int      codeLen;
 
-    buffer        = READ64 (src);
-    bufferNumBits = 64;
+        //
+        // The table only needs TABLE_LOOKUP_BITS valid bits, and a
+        // reload always gives at least 57
+        //
 
-    //
-    // 64-bit buffer holding the next bits in the stream
-    //
+        if (bufferNumBits < TABLE_LOOKUP_BITS)
+        {
+            buffer        = fasthuf_peek (src, numSrcBytes, pos);
+            bufferNumBits = 64 - (int) (pos & 7);
+        }
 
-    bufferBack        = READ64 ((src + sizeof (uint64_t)));
-    bufferBackNumBits = 64;
-    dstIdx            = 0;
+        tableIdx = (uint32_t) (buffer >> INDEX_BIT_SHIFT);
+        info     = fhd->_tableInfo[tableIdx];
 
-    tMin = fhd->_tableMin;
-    rleSym = fhd->_rleSymbol;
+        if (OUR_LIKELY (TABLE_INFO_COUNT (info) != 0))
+        {
+            //
+            // Write out all the symbols of the entry at once when
+            // there is room, otherwise only the first one
+            //
 
-    while (dstIdx < numDstElems)
-    {
-        int symbol, codeLen;
+            if (OUR_LIKELY (dstEnd - dst >= TABLE_MAX_SYMBOLS))
+            {
+                memcpy (
+                    dst,
+                    fhd->_tableSymbols[tableIdx],
+                    sizeof (fhd->_tableSymbols[tableIdx]));
+                dst += TABLE_INFO_COUNT (info);
+                codeLen = (int) TABLE_INFO_TOTAL (info);
+            }
+            else
+            {
+                *dst++  = fhd->_tableSymbols[tableIdx][0];
+                codeLen = (int) TABLE_INFO_LEN0 (info);
+            }
 
-        //
-        // Test if we can be table accelerated. If so, directly
-        // lookup the output symbol. Otherwise, we need to fall
-        // back to searching for the code.
-        //
-        // If we're doing table lookups, we don't really need
-        // a re-filled buffer, so long as we have TABLE_LOOKUP_BITS
-        // left. But for a search, we do need a refilled table.
-        //
+            buffer <<= codeLen;
+            bufferNumBits -= codeLen;
+            pos += (uint64_t) codeLen;
+            continue;
+        }
 
-        if (tMin <= buffer)
+        if (info & TABLE_INFO_RLE)
         {
-            int tableIdx = buffer >> INDEX_BIT_SHIFT;
-            codeLen = fhd->_tableCodeLen[tableIdx];
-            symbol  = fhd->_tableSymbol[tableIdx];
+            symbol  = rleSym;
+            codeLen = (int) TABLE_INFO_LEN0 (info);
         }
         else
         {
             uint64_t id;
 
-            if (bufferNumBits < 64)
-            {
-                FastHufDecoder_refill (
-                    &buffer,
-                    bufferNumBits,
-                    &bufferBack,
-                    &bufferBackNumBits,
-                    &currByte,
-                    &numSrcBits);
-                bufferNumBits = 64;
-            }
-
             //
             // Brute force search:
             // Find the smallest length where _ljBase[length] <= buffer
             //
 
+            buffer  = fasthuf_peek_long (src, numSrcBytes, pos);
             codeLen = TABLE_LOOKUP_BITS + 1;
 
             /* sentinel zero can never be greater than buffer */
@@ -1705,43 +1299,30 @@ fasthuf_decode (
                         "Huffman decode error (Decoded an invalid symbol)");
                 return EXR_ERR_CORRUPT_CHUNK;
             }
-
         }
 
         //
-        // Shift over bit stream, and update the bit count in the buffer
+        // Long codes and runs are rare enough to just reload the
+        // buffer from the new position on the next symbol
         //
 
-        buffer = buffer << codeLen;
-        bufferNumBits -= codeLen;
+        pos += (uint64_t) codeLen;
+        bufferNumBits = 0;
 
         //
         // If we received a RLE symbol (_rleSymbol), then we need
         // to read ahead 8 bits to know how many times to repeat
-        // the previous symbol. Need to ensure we at least have
-        // 8 bits of data in the buffer
+        // the previous symbol.
         //
 
-        if (symbol == (int) rleSym)
+        if (symbol == rleSym)
         {
             uint32_t rleCount;
 
-            if (bufferNumBits < 8)
-            {
-                FastHufDecoder_refill (
-                    &buffer,
-                    bufferNumBits,
-                    &bufferBack,
-                    &bufferBackNumBits,
-                    &currByte,
-                    &numSrcBits);
-
-                bufferNumBits = 64;
-            }
-
-            rleCount = buffer >> 56;
+            rleCount = (uint32_t) (fasthuf_peek (src, numSrcBytes, pos) >> 56);
+            pos += 8;
 
-            if (OUR_UNLIKELY(dstIdx < 1))
+            if (OUR_UNLIKELY(dst == dstStart))
             {
                 if (pctxt)
                     pctxt->print_error (
@@ -1751,7 +1332,7 @@ fasthuf_decode (
                 return EXR_ERR_CORRUPT_CHUNK;
             }
 
-            if (OUR_UNLIKELY(dstIdx + (uint64_t) rleCount > numDstElems))
+            if (OUR_UNLIKELY((uint64_t) (dstEnd - dst) < (uint64_t) rleCount))
             {
                 if (pctxt)
                     pctxt->print_error (
@@ -1761,7 +1342,7 @@ fasthuf_decode (
                 return EXR_ERR_CORRUPT_CHUNK;
             }
 
-            if (OUR_UNLIKELY(rleCount == 0 || rleCount >= (uint32_t)INT32_MAX))
+            if (OUR_UNLIKELY(rleCount == 0))
             {
                 if (pctxt)
                     pctxt->print_error (
@@ -1772,46 +1353,24 @@ fasthuf_decode (
             }
 
             for (uint32_t i = 0; i < rleCount; ++i)
-                dst[dstIdx + (uint64_t) i] = dst[dstIdx - 1];
+                dst[i] = dst[-1];
 
-            dstIdx += rleCount;
-
-            buffer = buffer << 8;
-            bufferNumBits -= 8;
+            dst += rleCount;
         }
         else
         {
-            dst[dstIdx] = (uint16_t) symbol;
-            dstIdx++;
-        }
-
-        //
-        // refill bit stream buffer if we're below the number of
-        // bits needed for a table lookup
-        //
-
-        if (bufferNumBits < TABLE_LOOKUP_BITS)
-        {
-            FastHufDecoder_refill (
-                &buffer,
-                bufferNumBits,
-                &bufferBack,
-                &bufferBackNumBits,
-                &currByte,
-                &numSrcBits);
-
-            bufferNumBits = 64;
+            *dst++ = (uint16_t) symbol;
         }
     }
 
-    if (OUR_UNLIKELY(numSrcBits != 0))
+    if (OUR_UNLIKELY(pos != numSrcBits))
     {
         if (pctxt)
             pctxt->print_error (
                 pctxt,
                 EXR_ERR_CORRUPT_CHUNK,
                 "Huffman decode error (%d bits of compressed data remains after filling expected output buffer)",
-                (int) numSrcBits);
+                (int) ((int64_t) numSrcBits - (int64_t) pos));
         return EXR_ERR_CORRUPT_CHUNK;
     }
 
@@ -1826,7 +1385,7 @@ internal_exr_huf_compress_spare_bytes (void)
     uint64_t ret = 0;
     ret += HUF_ENCSIZE * sizeof (uint64_t);  // freq
     ret += HUF_ENCSIZE * sizeof (uint64_t);  // scode
-    ret += HUF_ENCSIZE * sizeof (uint64_t*); // fheap
+    ret += HUF_ENCSIZE * sizeof (uint64_t);  // fheap
     ret += HUF_ENCSIZE * sizeof (uint32_t);  // hlink
     return ret;
 }
@@ -1834,13 +1393,7 @@ internal_exr_huf_compress_spare_bytes (void)
 uint64_t
 internal_exr_huf_decompress_spare_bytes (void)
 {
-    uint64_t ret = 0;
-    ret += HUF_ENCSIZE * sizeof (uint64_t); // freq
-    ret += HUF_DECSIZE * sizeof (HufDec);   // hdec
-    //    ret += HUF_ENCSIZE * sizeof (uint64_t*); // fheap
-    //    ret += HUF_ENCSIZE * sizeof (uint64_t);  // scode
-    if (sizeof (FastHufDecoder) > ret) ret = sizeof (FastHufDecoder);
-    return ret;
+    return sizeof (FastHufDecoder);
 }
 
 exr_result_t
@@ -1856,7 +1409,7 @@ internal_huf_compress (
     exr_result_t rv;
     uint64_t*    freq;
     uint32_t*    hlink;
-    uint64_t**   fHeap;
+    uint64_t*    fHeap;
     uint64_t*    scode;
     uint32_t     im = 0;
     uint32_t     iM = 0;
@@ -1874,15 +1427,20 @@ internal_huf_compress (
     }
 
     if (outsz < 20) return EXR_ERR_INVALID_ARGUMENT;
+    // frequencies share a 64-bit heap key with the symbol index
+    if (nRaw >= (((uint64_t) 1) << (63 - HUF_KEY_BITS)))
+        return EXR_ERR_ARGUMENT_OUT_OF_RANGE;
     if (sparebytes != internal_exr_huf_compress_spare_bytes ())
         return EXR_ERR_INVALID_ARGUMENT;
 
     freq  = (uint64_t*) spare;
     scode = freq + HUF_ENCSIZE;
-    fHeap = (uint64_t**) (scode + HUF_ENCSIZE);
+    fHeap = scode + HUF_ENCSIZE;
     hlink = (uint32_t*) (fHeap + HUF_ENCSIZE);
 
-    countFrequencies (freq, raw, nRaw);
+    // scode and fHeap are only filled in by hufBuildEncTable, so they
+    // double as the 1MB of scratch needed for counting
+    countFrequencies (freq, raw, nRaw, (uint32_t*) scode);
 
     hufBuildEncTable (freq, &im, &iM, hlink, fHeap, scode);
 
@@ -1925,6 +1483,7 @@ internal_huf_decompress (
     const uint8_t*      ptr;
     exr_result_t        rv;
     exr_const_context_t pctxt            = NULL;
+    FastHufDecoder*     fhd              = (FastHufDecoder*) spare;
     const uint64_t      hufInfoBlockSize = 5 * sizeof (uint32_t);
 
     if (decode) pctxt = decode->context;
@@ -1937,7 +1496,8 @@ internal_huf_decompress (
         return EXR_ERR_SUCCESS;
     }
 
-    if (sparebytes != internal_exr_huf_decompress_spare_bytes ())
+    /* pooled scratch buffers may be rounded up past the request */
+    if (sparebytes < internal_exr_huf_decompress_spare_bytes ())
         return EXR_ERR_INVALID_ARGUMENT;
 
     im = readUInt (compressed);
@@ -1956,39 +1516,16 @@ internal_huf_decompress (
     if (hufInfoBlockSize + nBytes > nCompressed) return EXR_ERR_OUT_OF_MEMORY;
 
     //
-    // Fast decoder needs at least 2x64-bits of compressed data, and
-    // needs to be run-able on this platform. Otherwise, fall back
-    // to the original decoder
+    // The table driven decoder handles any valid code table and
+    // stream length, on every platform
     //
-    if (fasthuf_decode_enabled () && nBits > 128)
+    rv = fasthuf_initialize (
+        pctxt, fhd, &ptr, nCompressed - hufInfoBlockSize, im, iM, (int) iM);
+    if (rv == EXR_ERR_SUCCESS)
     {
-        FastHufDecoder* fhd = (FastHufDecoder*) spare;
-
-        rv = fasthuf_initialize (
-            pctxt, fhd, &ptr, nCompressed - hufInfoBlockSize, im, iM, (int) iM);
-        if (rv == EXR_ERR_SUCCESS)
-        {
-            if ((uint64_t) (ptr - compressed) + nBytes > nCompressed)
-                return EXR_ERR_OUT_OF_MEMORY;
-            rv = fasthuf_decode (pctxt, fhd, ptr, nBits, raw, nRaw);
-        }
-    }
-    else
-    {
-        uint64_t* freq  = (uint64_t*) spare;
-        HufDec*   hdec  = (HufDec*) (freq + HUF_ENCSIZE);
-        uint64_t  nLeft = nCompressed - 20;
-
-        hufClearDecTable (hdec);
-        hufUnpackEncTable (&ptr, &nLeft, im, iM, freq);
-
-        if (nBits > 8 * nLeft) return EXR_ERR_CORRUPT_CHUNK;
-
-        rv = hufBuildDecTable (pctxt, freq, im, iM, hdec);
-        if (rv == EXR_ERR_SUCCESS)
-            rv = hufDecode (freq, hdec, ptr, nBits, iM, nRaw, raw);
-
-        hufFreeDecTable (pctxt, hdec);
+        if ((uint64_t) (ptr - compressed) + nBytes > nCompressed)
+            return EXR_ERR_OUT_OF_MEMORY;
+        rv = fasthuf_decode (pctxt, fhd, ptr, nBits, raw, nRaw);
     }
     return rv;
 }
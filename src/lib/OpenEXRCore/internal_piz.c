@@ -7,6 +7,7 @@
 #include "internal_decompress.h"
 
 #include "internal_coding.h"
+#include "internal_cpuid.h"
 #include "internal_huf.h"
 #include "internal_xdr.h"
 
@@ -228,6 +229,356 @@ wdec16 (uint16_t l, uint16_t h, uint16_t* a, uint16_t* b)
     *a     = (uint16_t) aa;
 }
 
+/**************************************/
+//
+// Vectorized finest level of the 2D transform for single word
+// channels (HALF data), which is 3/4 of the wavelet work. There the
+// 2x2 blocks of a row pair are adjacent in memory, so each row
+// deinterleaves into the even (px / p10) and odd (p01 / p11)
+// columns and a vector lane handles one block.
+//
+// Everything is done in 16-bit lanes yet stays bit exact with the
+// scalar functions above: the only values wider than 16 bits are
+// the (a+b)/2 style halvings, which are computed without overflow
+// as (a>>1) + (b>>1) + (a&b&1) (floor) or (a|b)&1 (ceiling), and
+// x + ceil(y/2) is rewritten as x + y - (y>>1).
+//
+// The row functions return the number of 2x2 blocks processed,
+// the caller finishes the remainder with the scalar code.
+//
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__))
+#    define ENABLE_AVX2_WAVELET
+#    include <immintrin.h>
+#endif
+
+#if (defined(__aarch64__) || defined(_M_ARM64)) &&                            \
+    (defined(__GNUC__) || defined(__clang__))
+#    define USE_NEON_WAVELET
+#    include <arm_neon.h>
+#endif
+
+#ifndef USE_NEON_WAVELET
+static int
+wav_rows_scalar (uint16_t* r0, uint16_t* r1, int nblocks, int w14)
+{
+    (void) r0;
+    (void) r1;
+    (void) nblocks;
+    (void) w14;
+    return 0;
+}
+#endif
+
+#ifdef ENABLE_AVX2_WAVELET
+
+#    define WAV_AVX2 __attribute__ ((target ("avx2")))
+
+/* split 32 consecutive values into the 16 even and the 16 odd ones */
+WAV_AVX2 static inline void
+wav_load_avx2 (const uint16_t* p, __m256i* ev, __m256i* od)
+{
+    const __m256i mask = _mm256_set1_epi32 (0xFFFF);
+    __m256i       x0   = _mm256_loadu_si256 ((const __m256i*) p);
+    __m256i       x1   = _mm256_loadu_si256 ((const __m256i*) (p + 16));
+    __m256i e = _mm256_packus_epi32 (
+        _mm256_and_si256 (x0, mask), _mm256_and_si256 (x1, mask));
+    __m256i o = _mm256_packus_epi32 (
+        _mm256_srli_epi32 (x0, 16), _mm256_srli_epi32 (x1, 16));
+    *ev = _mm256_permute4x64_epi64 (e, 0xD8);
+    *od = _mm256_permute4x64_epi64 (o, 0xD8);
+}
+
+WAV_AVX2 static inline void
+wav_store_avx2 (uint16_t* p, __m256i ev, __m256i od)
+{
+    __m256i lo = _mm256_unpacklo_epi16 (ev, od);
+    __m256i hi = _mm256_unpackhi_epi16 (ev, od);
+    _mm256_storeu_si256 ((__m256i*) p, _mm256_permute2x128_si256 (lo, hi, 0x20));
+    _mm256_storeu_si256 (
+        (__m256i*) (p + 16), _mm256_permute2x128_si256 (lo, hi, 0x31));
+}
+
+/* wenc14: l = floor ((a + b) / 2), h = a - b */
+WAV_AVX2 static inline void
+wenc14_avx2 (__m256i a, __m256i b, __m256i* l, __m256i* h)
+{
+    const __m256i one = _mm256_set1_epi16 (1);
+    *l                = _mm256_add_epi16 (
+        _mm256_add_epi16 (_mm256_srai_epi16 (a, 1), _mm256_srai_epi16 (b, 1)),
+        _mm256_and_si256 (_mm256_and_si256 (a, b), one));
+    *h = _mm256_sub_epi16 (a, b);
+}
+
+/* wenc16 with the A_OFFSET / M_OFFSET arithmetic done as a sign flip */
+WAV_AVX2 static inline void
+wenc16_avx2 (__m256i a, __m256i b, __m256i* l, __m256i* h)
+{
+    const __m256i one  = _mm256_set1_epi16 (1);
+    const __m256i off  = _mm256_set1_epi16 ((short) 0x8000);
+    __m256i       ao   = _mm256_xor_si256 (a, off);
+    __m256i       m    = _mm256_add_epi16 (
+        _mm256_add_epi16 (_mm256_srli_epi16 (ao, 1), _mm256_srli_epi16 (b, 1)),
+        _mm256_and_si256 (_mm256_and_si256 (ao, b), one));
+    __m256i ge = _mm256_cmpeq_epi16 (_mm256_max_epu16 (ao, b), ao);
+    *l         = _mm256_xor_si256 (m, _mm256_andnot_si256 (ge, off));
+    *h         = _mm256_sub_epi16 (ao, b);
+}
+
+WAV_AVX2 static inline void
+wdec16_avx2 (__m256i l, __m256i h, __m256i* a, __m256i* b)
+{
+    const __m256i off = _mm256_set1_epi16 ((short) 0x8000);
+    __m256i       bb  = _mm256_sub_epi16 (l, _mm256_srli_epi16 (h, 1));
+    *b                = bb;
+    *a = _mm256_xor_si256 (_mm256_add_epi16 (h, bb), off);
+}
+
+WAV_AVX2 static int
+wav_enc_rows_avx2 (uint16_t* r0, uint16_t* r1, int nblocks, int w14)
+{
+    int done = 0;
+    for (; done + 16 <= nblocks; done += 16, r0 += 32, r1 += 32)
+    {
+        __m256i p00, p01, p10, p11, i00, i01, i10, i11;
+
+        wav_load_avx2 (r0, &p00, &p01);
+        wav_load_avx2 (r1, &p10, &p11);
+        if (w14)
+        {
+            wenc14_avx2 (p00, p01, &i00, &i01);
+            wenc14_avx2 (p10, p11, &i10, &i11);
+            wenc14_avx2 (i00, i10, &p00, &p10);
+            wenc14_avx2 (i01, i11, &p01, &p11);
+        }
+        else
+        {
+            wenc16_avx2 (p00, p01, &i00, &i01);
+            wenc16_avx2 (p10, p11, &i10, &i11);
+            wenc16_avx2 (i00, i10, &p00, &p10);
+            wenc16_avx2 (i01, i11, &p01, &p11);
+        }
+        wav_store_avx2 (r0, p00, p01);
+        wav_store_avx2 (r1, p10, p11);
+    }
+    return done;
+}
+
+WAV_AVX2 static int
+wav_dec_rows_avx2 (uint16_t* r0, uint16_t* r1, int nblocks, int w14)
+{
+    const __m256i one  = _mm256_set1_epi16 (1);
+    const __m256i zero = _mm256_setzero_si256 ();
+    int           done = 0;
+    for (; done + 16 <= nblocks; done += 16, r0 += 32, r1 += 32)
+    {
+        __m256i p00, p01, p10, p11;
+
+        wav_load_avx2 (r0, &p00, &p01);
+        wav_load_avx2 (r1, &p10, &p11);
+        if (w14)
+        {
+            /* wdec14_4 with a = px, b = p10, c = p01, d = p11 */
+            __m256i hb  = _mm256_srai_epi16 (p10, 1);
+            __m256i i00 = _mm256_add_epi16 (p00, _mm256_sub_epi16 (p10, hb));
+            __m256i i10 = _mm256_sub_epi16 (p00, hb);
+            __m256i hd  = _mm256_srai_epi16 (p11, 1);
+            __m256i ed  = _mm256_sub_epi16 (p11, hd); /* ceil (d / 2) */
+            __m256i fd  = _mm256_sub_epi16 (zero, hd); /* -floor (d / 2) */
+            __m256i hc  = _mm256_srai_epi16 (p01, 1);
+            /* i01 = c + ed and i11 = c + fd are 17 bit */
+            __m256i b01 = _mm256_add_epi16 (hc, _mm256_srai_epi16 (ed, 1));
+            __m256i b11 = _mm256_add_epi16 (hc, _mm256_srai_epi16 (fd, 1));
+            __m256i fl01 = _mm256_add_epi16 (
+                b01, _mm256_and_si256 (_mm256_and_si256 (p01, ed), one));
+            __m256i ce01 = _mm256_add_epi16 (
+                b01, _mm256_and_si256 (_mm256_or_si256 (p01, ed), one));
+            __m256i fl11 = _mm256_add_epi16 (
+                b11, _mm256_and_si256 (_mm256_and_si256 (p01, fd), one));
+            __m256i ce11 = _mm256_add_epi16 (
+                b11, _mm256_and_si256 (_mm256_or_si256 (p01, fd), one));
+
+            p00 = _mm256_add_epi16 (i00, ce01);
+            p01 = _mm256_sub_epi16 (i00, fl01);
+            p10 = _mm256_add_epi16 (i10, ce11);
+            p11 = _mm256_sub_epi16 (i10, fl11);
+        }
+        else
+        {
+            __m256i i00, i01, i10, i11;
+            wdec16_avx2 (p00, p10, &i00, &i10);
+            wdec16_avx2 (p01, p11, &i01, &i11);
+            wdec16_avx2 (i00, i01, &p00, &p01);
+            wdec16_avx2 (i10, i11, &p10, &p11);
+        }
+        wav_store_avx2 (r0, p00, p01);
+        wav_store_avx2 (r1, p10, p11);
+    }
+    return done;
+}
+
+#endif /* ENABLE_AVX2_WAVELET */
+
+#ifdef USE_NEON_WAVELET
+
+static inline void
+wenc14_neon (int16x8_t a, int16x8_t b, int16x8_t* l, int16x8_t* h)
+{
+    const int16x8_t one = vdupq_n_s16 (1);
+    *l                  = vaddq_s16 (
+        vaddq_s16 (vshrq_n_s16 (a, 1), vshrq_n_s16 (b, 1)),
+        vandq_s16 (vandq_s16 (a, b), one));
+    *h = vsubq_s16 (a, b);
+}
+
+static inline void
+wenc16_neon (uint16x8_t a, uint16x8_t b, uint16x8_t* l, uint16x8_t* h)
+{
+    const uint16x8_t one = vdupq_n_u16 (1);
+    const uint16x8_t off = vdupq_n_u16 (0x8000);
+    uint16x8_t       ao  = veorq_u16 (a, off);
+    uint16x8_t       m   = vaddq_u16 (
+        vaddq_u16 (vshrq_n_u16 (ao, 1), vshrq_n_u16 (b, 1)),
+        vandq_u16 (vandq_u16 (ao, b), one));
+    *l = veorq_u16 (m, vandq_u16 (vcltq_u16 (ao, b), off));
+    *h = vsubq_u16 (ao, b);
+}
+
+static inline void
+wdec16_neon (uint16x8_t l, uint16x8_t h, uint16x8_t* a, uint16x8_t* b)
+{
+    uint16x8_t bb = vsubq_u16 (l, vshrq_n_u16 (h, 1));
+    *b            = bb;
+    *a            = veorq_u16 (vaddq_u16 (h, bb), vdupq_n_u16 (0x8000));
+}
+
+static int
+wav_enc_rows_neon (uint16_t* r0, uint16_t* r1, int nblocks, int w14)
+{
+    int done = 0;
+    for (; done + 8 <= nblocks; done += 8, r0 += 16, r1 += 16)
+    {
+        uint16x8x2_t top = vld2q_u16 (r0);
+        uint16x8x2_t bot = vld2q_u16 (r1);
+        if (w14)
+        {
+            int16x8_t i00, i01, i10, i11, p00, p01, p10, p11;
+            wenc14_neon (
+                vreinterpretq_s16_u16 (top.val[0]),
+                vreinterpretq_s16_u16 (top.val[1]),
+                &i00,
+                &i01);
+            wenc14_neon (
+                vreinterpretq_s16_u16 (bot.val[0]),
+                vreinterpretq_s16_u16 (bot.val[1]),
+                &i10,
+                &i11);
+            wenc14_neon (i00, i10, &p00, &p10);
+            wenc14_neon (i01, i11, &p01, &p11);
+            top.val[0] = vreinterpretq_u16_s16 (p00);
+            top.val[1] = vreinterpretq_u16_s16 (p01);
+            bot.val[0] = vreinterpretq_u16_s16 (p10);
+            bot.val[1] = vreinterpretq_u16_s16 (p11);
+        }
+        else
+        {
+            uint16x8_t i00, i01, i10, i11;
+            wenc16_neon (top.val[0], top.val[1], &i00, &i01);
+            wenc16_neon (bot.val[0], bot.val[1], &i10, &i11);
+            wenc16_neon (i00, i10, &top.val[0], &bot.val[0]);
+            wenc16_neon (i01, i11, &top.val[1], &bot.val[1]);
+        }
+        vst2q_u16 (r0, top);
+        vst2q_u16 (r1, bot);
+    }
+    return done;
+}
+
+static int
+wav_dec_rows_neon (uint16_t* r0, uint16_t* r1, int nblocks, int w14)
+{
+    int done = 0;
+    for (; done + 8 <= nblocks; done += 8, r0 += 16, r1 += 16)
+    {
+        uint16x8x2_t top = vld2q_u16 (r0);
+        uint16x8x2_t bot = vld2q_u16 (r1);
+        if (w14)
+        {
+            /* wdec14_4 with a = px, b = p10, c = p01, d = p11 */
+            const int16x8_t one = vdupq_n_s16 (1);
+            int16x8_t       a   = vreinterpretq_s16_u16 (top.val[0]);
+            int16x8_t       c   = vreinterpretq_s16_u16 (top.val[1]);
+            int16x8_t       b   = vreinterpretq_s16_u16 (bot.val[0]);
+            int16x8_t       d   = vreinterpretq_s16_u16 (bot.val[1]);
+            int16x8_t       hb  = vshrq_n_s16 (b, 1);
+            int16x8_t       i00 = vaddq_s16 (a, vsubq_s16 (b, hb));
+            int16x8_t       i10 = vsubq_s16 (a, hb);
+            int16x8_t       hd  = vshrq_n_s16 (d, 1);
+            int16x8_t       ed  = vsubq_s16 (d, hd);
+            int16x8_t       fd  = vnegq_s16 (hd);
+            int16x8_t       hc  = vshrq_n_s16 (c, 1);
+            int16x8_t       b01 = vaddq_s16 (hc, vshrq_n_s16 (ed, 1));
+            int16x8_t       b11 = vaddq_s16 (hc, vshrq_n_s16 (fd, 1));
+            int16x8_t fl01 = vaddq_s16 (b01, vandq_s16 (vandq_s16 (c, ed), one));
+            int16x8_t ce01 = vaddq_s16 (b01, vandq_s16 (vorrq_s16 (c, ed), one));
+            int16x8_t fl11 = vaddq_s16 (b11, vandq_s16 (vandq_s16 (c, fd), one));
+            int16x8_t ce11 = vaddq_s16 (b11, vandq_s16 (vorrq_s16 (c, fd), one));
+
+            top.val[0] = vreinterpretq_u16_s16 (vaddq_s16 (i00, ce01));
+            top.val[1] = vreinterpretq_u16_s16 (vsubq_s16 (i00, fl01));
+            bot.val[0] = vreinterpretq_u16_s16 (vaddq_s16 (i10, ce11));
+            bot.val[1] = vreinterpretq_u16_s16 (vsubq_s16 (i10, fl11));
+        }
+        else
+        {
+            uint16x8_t i00, i01, i10, i11;
+            wdec16_neon (top.val[0], bot.val[0], &i00, &i10);
+            wdec16_neon (top.val[1], bot.val[1], &i01, &i11);
+            wdec16_neon (i00, i01, &top.val[0], &top.val[1]);
+            wdec16_neon (i10, i11, &bot.val[0], &bot.val[1]);
+        }
+        vst2q_u16 (r0, top);
+        vst2q_u16 (r1, bot);
+    }
+    return done;
+}
+
+#endif /* USE_NEON_WAVELET */
+
+#if defined(USE_NEON_WAVELET)
+static int (*wav_enc_rows) (uint16_t*, uint16_t*, int, int) =
+    &wav_enc_rows_neon;
+static int (*wav_dec_rows) (uint16_t*, uint16_t*, int, int) =
+    &wav_dec_rows_neon;
+#else
+static int (*wav_enc_rows) (uint16_t*, uint16_t*, int, int) =
+    &wav_rows_scalar;
+static int (*wav_dec_rows) (uint16_t*, uint16_t*, int, int) =
+    &wav_rows_scalar;
+#endif
+
+static void
+choose_wavelet_impl (void)
+{
+#ifdef EXR_HAS_STD_ATOMICS
+    static atomic_int init_cpu_check = 1;
+#else
+    static int init_cpu_check = 1;
+#endif
+    if (init_cpu_check)
+    {
+#ifdef ENABLE_AVX2_WAVELET
+        if (has_avx2 ())
+        {
+            wav_enc_rows = &wav_enc_rows_avx2;
+            wav_dec_rows = &wav_dec_rows_avx2;
+        }
+#endif
+        init_cpu_check = 0;
+    }
+}
+
 /**************************************/
 
 static void
@@ -266,6 +617,8 @@ wav_2D_encode (uint16_t* in, int nx, int ox, int ny, int oy, uint16_t mx)
             // X loop
             //
 
+            if (ox1 == 1) px += 2 * wav_enc_rows (px, px + oy1, nx / 2, w14);
+
             for (; px <= ex; px += ox2)
             {
                 uint16_t* p01 = px + ox1;
@@ -391,6 +744,8 @@ wav_2D_decode (
             // X loop
             //
 
+            if (ox1 == 1) px += 2 * wav_dec_rows (px, px + oy1, nx / 2, w14);
+
             for (; px <= ex; px += ox2)
             {
                 uint16_t* p01 = px + ox1;
@@ -480,6 +835,8 @@ internal_exr_apply_piz (exr_encode_pipeline_t* encode)
     uint64_t       ndata       = packedbytes / 2;
     uint16_t*      wavbuf;
 
+    choose_wavelet_impl ();
+
     rv = internal_encode_alloc_buffer (
         encode,
         EXR_TRANSCODE_BUFFER_SCRATCH1,
@@ -645,6 +1002,8 @@ internal_exr_undo_piz (
     uint16_t*      wavbuf;
     uint32_t       hufbytes;
 
+    choose_wavelet_impl ();
+
     rv = internal_decode_alloc_buffer (
         decode,
         EXR_TRANSCODE_BUFFER_SCRATCH1,
@@ -9,6 +9,8 @@
 #include <errno.h>
 
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -28,15 +30,41 @@
 #    define CAN_USE_PREAD 0
 #endif
 
+#if CAN_USE_PREAD &&                                                           \
+    ((defined(__linux__) && defined(__USE_MISC)) || defined(__FreeBSD__) ||    \
+     defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
+#    include <limits.h>
+#    include <sys/uio.h>
+#    define CAN_USE_PREADV 1
+/* bound the stack used for the scatter list of a single transfer */
+#    if defined(IOV_MAX) && IOV_MAX < 256
+#        define EXR_READ_BATCH_MAX_IOV IOV_MAX
+#    else
+#        define EXR_READ_BATCH_MAX_IOV 256
+#    endif
+#else
+#    define CAN_USE_PREADV 0
+#endif
+
+#if defined(POSIX_FADV_WILLNEED) || defined(F_RDADVISE)
+#    define CAN_USE_READ_ADVISE 1
+#else
+#    define CAN_USE_READ_ADVISE 0
+#endif
+
 #if CAN_USE_PREAD
 struct _internal_exr_filehandle
 {
-    int fd;
+    int      fd;
+    void*    map_base;
+    uint64_t map_size;
 };
 #else
 struct _internal_exr_filehandle
 {
-    int fd;
+    int      fd;
+    void*    map_base;
+    uint64_t map_size;
 #    if ILMTHREAD_THREADING_ENABLED
     pthread_mutex_t mutex;
 #    endif
@@ -52,6 +80,9 @@ default_shutdown (exr_const_context_t c, void* userdata, int failed)
     struct _internal_exr_filehandle* fh = userdata;
     if (fh)
     {
+        if (fh->map_base) munmap (fh->map_base, (size_t) fh->map_size);
+        fh->map_base = NULL;
+        fh->map_size = 0;
         if (fh->fd >= 0) close (fh->fd);
 #if !CAN_USE_PREAD
 #    if ILMTHREAD_THREADING_ENABLED
@@ -209,6 +240,202 @@ default_read_func (
 
 /**************************************/
 
+static int64_t
+default_read_batch_func (
+    exr_const_context_t         ctxt,
+    void*                       userdata,
+    const exr_read_request_t*   requests,
+    int                         count,
+    exr_stream_error_func_ptr_t error_cb)
+{
+    struct _internal_exr_filehandle* fh    = userdata;
+    int64_t                          retsz = 0;
+    int                              i     = 0;
+#if CAN_USE_PREADV
+    struct iovec  iov[EXR_READ_BATCH_MAX_IOV];
+    struct iovec* curiov;
+    ssize_t       rv;
+    uint64_t      offset, runsz, done;
+    int           niov;
+#else
+    int64_t rv;
+#endif
+
+    if (!fh || fh->fd < 0)
+    {
+        if (error_cb)
+            error_cb (
+                ctxt, EXR_ERR_INVALID_ARGUMENT, "Invalid file handle pointer");
+        return -1;
+    }
+
+#if CAN_USE_PREADV
+    while (i < count)
+    {
+        /* gather the run of abutting requests into one transfer */
+        offset = requests[i].offset;
+        runsz  = 0;
+        niov   = 0;
+        do
+        {
+            if (requests[i].size > (uint64_t) (SIZE_MAX >> 1) - runsz) break;
+            iov[niov].iov_base = requests[i].buffer;
+            iov[niov].iov_len  = (size_t) requests[i].size;
+            runsz += requests[i].size;
+            ++niov;
+            ++i;
+        } while (i < count && niov < EXR_READ_BATCH_MAX_IOV &&
+                 requests[i].offset == offset + runsz);
+
+        if (niov == 0)
+        {
+            if (error_cb)
+                error_cb (
+                    ctxt,
+                    EXR_ERR_INVALID_ARGUMENT,
+                    "read request size too large for architecture");
+            return -1;
+        }
+
+        curiov = iov;
+        done   = 0;
+        while (done < runsz)
+        {
+            rv = preadv (fh->fd, curiov, niov, (off_t) (offset + done));
+            if (rv < 0)
+            {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) continue;
+                if (error_cb)
+                    error_cb (
+                        ctxt,
+                        EXR_ERR_READ_IO,
+                        "Unable to read %" PRIu64 " bytes: %s",
+                        runsz,
+                        strerror (errno));
+                return -1;
+            }
+            /* end of file, report the short read */
+            if (rv == 0) return retsz;
+
+            retsz += rv;
+            done += (uint64_t) rv;
+
+            /* partial transfer, skip what was filled and continue */
+            while (niov > 0 && (size_t) rv >= curiov->iov_len)
+            {
+                rv -= (ssize_t) curiov->iov_len;
+                ++curiov;
+                --niov;
+            }
+            if (niov > 0)
+            {
+                curiov->iov_base = ((uint8_t*) curiov->iov_base) + rv;
+                curiov->iov_len -= (size_t) rv;
+            }
+        }
+    }
+#else
+    for (; i < count; ++i)
+    {
+        rv = default_read_func (
+            ctxt,
+            userdata,
+            requests[i].buffer,
+            requests[i].size,
+            requests[i].offset,
+            error_cb);
+        if (rv < 0) return -1;
+        retsz += rv;
+        if (rv < (int64_t) requests[i].size) break;
+    }
+#endif
+    return retsz;
+}
+
+/**************************************/
+
+#if CAN_USE_READ_ADVISE
+static void
+default_prefetch_func (exr_const_context_t ctxt, uint64_t offset, uint64_t sz)
+{
+    struct _internal_exr_filehandle* fh = ctxt->user_data;
+
+    if (!fh || fh->fd < 0 || sz == 0) return;
+    if (offset > (uint64_t) INT64_MAX || sz > (uint64_t) INT64_MAX) return;
+
+    /* purely a hint, the kernel starts reading ahead in the
+     * background and any failure just means a normal read later */
+#    if defined(POSIX_FADV_WILLNEED)
+    (void) posix_fadvise (
+        fh->fd, (off_t) offset, (off_t) sz, POSIX_FADV_WILLNEED);
+#    else
+    {
+        struct radvisory ra;
+        ra.ra_offset = (off_t) offset;
+        ra.ra_count  = (sz > (uint64_t) INT_MAX) ? INT_MAX : (int) sz;
+        (void) fcntl (fh->fd, F_RDADVISE, &ra);
+    }
+#    endif
+}
+#endif
+
+/**************************************/
+
+#ifdef POSIX_MADV_WILLNEED
+static void
+default_mmap_prefetch_func (
+    exr_const_context_t ctxt, uint64_t offset, uint64_t sz)
+{
+    struct _internal_exr_filehandle* fh = ctxt->user_data;
+    uint64_t                         pagesz, start;
+    long                             sysps;
+
+    if (!fh || !fh->map_base || sz == 0 || offset >= fh->map_size) return;
+    if (sz > fh->map_size - offset) sz = fh->map_size - offset;
+
+    sysps  = sysconf (_SC_PAGESIZE);
+    pagesz = (sysps > 0) ? (uint64_t) sysps : 4096;
+    start  = offset - (offset % pagesz);
+
+    (void) posix_madvise (
+        ((uint8_t*) fh->map_base) + start,
+        (size_t) (offset + sz - start),
+        POSIX_MADV_WILLNEED);
+}
+#endif
+
+/**************************************/
+
+static int64_t
+default_mmap_read_func (
+    exr_const_context_t         ctxt,
+    void*                       userdata,
+    void*                       buffer,
+    uint64_t                    sz,
+    uint64_t                    offset,
+    exr_stream_error_func_ptr_t error_cb)
+{
+    struct _internal_exr_filehandle* fh = userdata;
+
+    if (!fh || !fh->map_base)
+    {
+        if (error_cb)
+            error_cb (
+                ctxt, EXR_ERR_INVALID_ARGUMENT, "Invalid file handle pointer");
+        return -1;
+    }
+
+    /* behave as pread would at (or past) the end of the file */
+    if (offset >= fh->map_size) return 0;
+    if (sz > fh->map_size - offset) sz = fh->map_size - offset;
+
+    memcpy (buffer, ((const uint8_t*) fh->map_base) + offset, (size_t) sz);
+    return (int64_t) sz;
+}
+
+/**************************************/
+
 static int64_t
 default_write_func (
     exr_const_context_t         ctxt,
@@ -324,13 +551,47 @@ default_write_func (
 
 /**************************************/
 
+static void
+default_map_read_file (exr_context_t file)
+{
+    struct stat                      sbuf;
+    void*                            base;
+    struct _internal_exr_filehandle* fh = file->user_data;
+
+    /* any failure here is not fatal, we just use normal reads */
+    if (fstat (fh->fd, &sbuf) != 0 || sbuf.st_size <= 0) return;
+    if ((uint64_t) sbuf.st_size > (uint64_t) SIZE_MAX) return;
+
+    base =
+        mmap (NULL, (size_t) sbuf.st_size, PROT_READ, MAP_PRIVATE, fh->fd, 0);
+    if (base == MAP_FAILED) return;
+
+    fh->map_base      = base;
+    fh->map_size      = (uint64_t) sbuf.st_size;
+    file->mapped_data = (const uint8_t*) base;
+    file->mapped_size = fh->map_size;
+    file->read_fn     = &default_mmap_read_func;
+#ifdef POSIX_MADV_WILLNEED
+    file->prefetch_fn = &default_mmap_prefetch_func;
+#else
+    file->prefetch_fn = NULL;
+#endif
+
+    /* there is no syscall to save, batched reads just copy each range */
+    file->read_batch_fn = NULL;
+}
+
+/**************************************/
+
 static exr_result_t
 default_init_read_file (exr_context_t file)
 {
     int                              fd;
     struct _internal_exr_filehandle* fh = file->user_data;
 
-    fh->fd = -1;
+    fh->fd       = -1;
+    fh->map_base = NULL;
+    fh->map_size = 0;
 #if !CAN_USE_PREAD
 #    if ILMTHREAD_THREADING_ENABLED
     fd = pthread_mutex_init (&(fh->mutex), NULL);
@@ -343,8 +604,12 @@ default_init_read_file (exr_context_t file)
 #    endif
 #endif
 
-    file->destroy_fn = &default_shutdown;
-    file->read_fn    = &default_read_func;
+    file->destroy_fn    = &default_shutdown;
+    file->read_fn       = &default_read_func;
+    file->read_batch_fn = &default_read_batch_func;
+#if CAN_USE_READ_ADVISE
+    file->prefetch_fn   = &default_prefetch_func;
+#endif
 
     fd = open (file->filename.str, O_RDONLY | O_CLOEXEC);
     if (fd < 0)
@@ -355,6 +620,9 @@ default_init_read_file (exr_context_t file)
             strerror (errno));
 
     fh->fd = fd;
+
+    if (file->memory_map_read) default_map_read_file (file);
+
     return EXR_ERR_SUCCESS;
 }
 
@@ -381,6 +649,8 @@ default_init_write_file (exr_context_t file)
 #endif
 
     fh->fd           = -1;
+    fh->map_base     = NULL;
+    fh->map_size     = 0;
     file->destroy_fn = &default_shutdown;
     file->write_fn   = &default_write_func;
 
@@ -7,6 +7,7 @@
 #include "internal_decompress.h"
 
 #include "internal_coding.h"
+#include "internal_cpuid.h"
 #include "internal_xdr.h"
 
 #include <string.h>
@@ -86,6 +87,319 @@ float_to_float24 (float f)
 
 /**************************************/
 
+//
+// Vectorized row conversions
+//
+// The float24 rounding, the horizontal predictor and the split into
+// byte planes are all done in registers: the difference against the
+// previous pixel comes from the same vector rotated by one lane, and
+// decoding runs a prefix sum over the lanes, carrying the last pixel
+// into the next vector. The arithmetic is the same modulo 2^32 (2^16
+// for HALF) as in the scalar loops, so the output is bit exact.
+//
+// Each function takes the row of pixels (encode) or the first byte
+// plane of the row (decode, the planes are w bytes apart), converts
+// as many pixels as fill whole vectors, updates the running previous
+// pixel and returns the number of pixels done; the caller finishes
+// the row with the scalar loop.
+//
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__))
+#    define ENABLE_AVX2_PXR24
+#    include <immintrin.h>
+#endif
+
+static int
+pxr24_rows_scalar (const uint8_t* in, uint8_t* out, int w, uint32_t* prev)
+{
+    (void) in;
+    (void) out;
+    (void) w;
+    (void) prev;
+    return 0;
+}
+
+#ifdef ENABLE_AVX2_PXR24
+
+#    define PXR24_AVX2 __attribute__ ((target ("avx2")))
+
+/* float_to_float24 on 8 lanes */
+PXR24_AVX2 static inline __m256i
+float_to_float24_avx2 (__m256i u)
+{
+    const __m256i mag = _mm256_set1_epi32 (0x7fffffff);
+    const __m256i inf = _mm256_set1_epi32 (0x7f800000);
+    __m256i       a   = _mm256_and_si256 (u, mag);
+    __m256i       t   = _mm256_srli_epi32 (a, 8);
+    __m256i       i, nan;
+
+    //
+    // Round the significand to 15 bits, truncating where that would
+    // overflow the exponent. Infinities and NANs always take the
+    // truncated value, NANs that would turn into an infinity keep
+    // one significand bit.
+    //
+    i = _mm256_add_epi32 (a, _mm256_and_si256 (a, _mm256_set1_epi32 (0x80)));
+    i = _mm256_srli_epi32 (i, 8);
+    i = _mm256_blendv_epi8 (
+        i, t, _mm256_cmpgt_epi32 (i, _mm256_set1_epi32 (0x7f7fff)));
+
+    nan = _mm256_and_si256 (
+        _mm256_cmpgt_epi32 (a, inf),
+        _mm256_cmpeq_epi32 (
+            _mm256_and_si256 (a, _mm256_set1_epi32 (0x7fff00)),
+            _mm256_setzero_si256 ()));
+    i = _mm256_or_si256 (i, _mm256_and_si256 (nan, _mm256_set1_epi32 (1)));
+
+    return _mm256_or_si256 (
+        i, _mm256_srli_epi32 (_mm256_andnot_si256 (mag, u), 8));
+}
+
+/* difference of each 32-bit lane against the one before, last is the
+ * previous vector */
+PXR24_AVX2 static inline __m256i
+pxr24_delta32_avx2 (__m256i v, __m256i last)
+{
+    const __m256i rot = _mm256_setr_epi32 (7, 0, 1, 2, 3, 4, 5, 6);
+    __m256i       p   = _mm256_blend_epi32 (
+        _mm256_permutevar8x32_epi32 (v, rot),
+        _mm256_permutevar8x32_epi32 (last, rot),
+        0x01);
+    return _mm256_sub_epi32 (v, p);
+}
+
+/* running sum over the 32-bit lanes plus the carried pixel */
+PXR24_AVX2 static inline __m256i
+pxr24_prefix32_avx2 (__m256i d, __m256i carry)
+{
+    d = _mm256_add_epi32 (d, _mm256_slli_si256 (d, 4));
+    d = _mm256_add_epi32 (d, _mm256_slli_si256 (d, 8));
+    d = _mm256_add_epi32 (
+        d,
+        _mm256_shuffle_epi32 (_mm256_permute2x128_si256 (d, d, 0x08), 0xFF));
+    return _mm256_add_epi32 (d, carry);
+}
+
+/*
+ * gather byte k of the 8 lanes into dword k (for 4 planes) or, for
+ * 3 planes, byte 2 - k into dword k, most significant plane first
+ */
+PXR24_AVX2 static inline __m256i
+pxr24_planes32_avx2 (__m256i d, __m256i order)
+{
+    return _mm256_permutevar8x32_epi32 (
+        _mm256_shuffle_epi8 (d, order),
+        _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+PXR24_AVX2 static int
+pxr24_enc_uint_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* prev)
+{
+    const __m256i order = _mm256_setr_epi8 (
+        3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12,
+        3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12);
+    __m256i last = _mm256_set1_epi32 ((int32_t) *prev);
+    int     x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i v = _mm256_loadu_si256 ((const __m256i*) (in + 4 * x));
+        __m256i p = pxr24_planes32_avx2 (pxr24_delta32_avx2 (v, last), order);
+        __m128i lo = _mm256_castsi256_si128 (p);
+        __m128i hi = _mm256_extracti128_si256 (p, 1);
+
+        _mm_storel_epi64 ((__m128i*) (out + x), lo);
+        _mm_storel_epi64 (
+            (__m128i*) (out + w + x), _mm_unpackhi_epi64 (lo, lo));
+        _mm_storel_epi64 ((__m128i*) (out + 2 * w + x), hi);
+        _mm_storel_epi64 (
+            (__m128i*) (out + 3 * w + x), _mm_unpackhi_epi64 (hi, hi));
+        last = v;
+    }
+    *prev = (uint32_t) _mm256_extract_epi32 (last, 7);
+    return x;
+}
+
+PXR24_AVX2 static int
+pxr24_enc_float_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* prev)
+{
+    const __m256i order = _mm256_setr_epi8 (
+        2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12, -1, -1, -1, -1,
+        2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12, -1, -1, -1, -1);
+    __m256i last = _mm256_set1_epi32 ((int32_t) *prev);
+    int     x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i v = float_to_float24_avx2 (
+            _mm256_loadu_si256 ((const __m256i*) (in + 4 * x)));
+        __m256i p = pxr24_planes32_avx2 (pxr24_delta32_avx2 (v, last), order);
+        __m128i lo = _mm256_castsi256_si128 (p);
+
+        _mm_storel_epi64 ((__m128i*) (out + x), lo);
+        _mm_storel_epi64 (
+            (__m128i*) (out + w + x), _mm_unpackhi_epi64 (lo, lo));
+        _mm_storel_epi64 (
+            (__m128i*) (out + 2 * w + x), _mm256_extracti128_si256 (p, 1));
+        last = v;
+    }
+    *prev = (uint32_t) _mm256_extract_epi32 (last, 7);
+    return x;
+}
+
+PXR24_AVX2 static int
+pxr24_enc_half_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* prev)
+{
+    const __m256i order = _mm256_setr_epi8 (
+        1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10, 12, 14,
+        1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10, 12, 14);
+    __m256i last = _mm256_set1_epi16 ((int16_t) *prev);
+    int     x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m256i v = _mm256_loadu_si256 ((const __m256i*) (in + 2 * x));
+        __m256i p = _mm256_alignr_epi8 (
+            v, _mm256_permute2x128_si256 (last, v, 0x21), 14);
+
+        p = _mm256_shuffle_epi8 (_mm256_sub_epi16 (v, p), order);
+        p = _mm256_permute4x64_epi64 (p, 0xD8);
+        _mm_storeu_si128 ((__m128i*) (out + x), _mm256_castsi256_si128 (p));
+        _mm_storeu_si128 (
+            (__m128i*) (out + w + x), _mm256_extracti128_si256 (p, 1));
+        last = v;
+    }
+    *prev = (uint32_t) (uint16_t) _mm256_extract_epi16 (last, 15);
+    return x;
+}
+
+#    define PXR24_LOAD_PLANE(p, s)                                             \
+        _mm256_slli_epi32 (                                                    \
+            _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i*) (p))),     \
+            s)
+
+PXR24_AVX2 static int
+pxr24_dec_uint_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* pixel)
+{
+    const __m256i last  = _mm256_set1_epi32 (7);
+    __m256i       carry = _mm256_set1_epi32 ((int32_t) *pixel);
+    int           x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i d = _mm256_or_si256 (
+            _mm256_or_si256 (
+                PXR24_LOAD_PLANE (in + x, 24),
+                PXR24_LOAD_PLANE (in + w + x, 16)),
+            _mm256_or_si256 (
+                PXR24_LOAD_PLANE (in + 2 * w + x, 8),
+                PXR24_LOAD_PLANE (in + 3 * w + x, 0)));
+
+        d = pxr24_prefix32_avx2 (d, carry);
+        _mm256_storeu_si256 ((__m256i*) (out + 4 * x), d);
+        carry = _mm256_permutevar8x32_epi32 (d, last);
+    }
+    *pixel = (uint32_t) _mm256_extract_epi32 (carry, 0);
+    return x;
+}
+
+PXR24_AVX2 static int
+pxr24_dec_float_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* pixel)
+{
+    const __m256i last  = _mm256_set1_epi32 (7);
+    __m256i       carry = _mm256_set1_epi32 ((int32_t) *pixel);
+    int           x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i d = _mm256_or_si256 (
+            _mm256_or_si256 (
+                PXR24_LOAD_PLANE (in + x, 24),
+                PXR24_LOAD_PLANE (in + w + x, 16)),
+            PXR24_LOAD_PLANE (in + 2 * w + x, 8));
+
+        d = pxr24_prefix32_avx2 (d, carry);
+        _mm256_storeu_si256 ((__m256i*) (out + 4 * x), d);
+        carry = _mm256_permutevar8x32_epi32 (d, last);
+    }
+    *pixel = (uint32_t) _mm256_extract_epi32 (carry, 0);
+    return x;
+}
+
+#    undef PXR24_LOAD_PLANE
+
+PXR24_AVX2 static int
+pxr24_dec_half_avx2 (const uint8_t* in, uint8_t* out, int w, uint32_t* pixel)
+{
+    __m256i carry = _mm256_set1_epi16 ((int16_t) *pixel);
+    int     x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i hi = _mm_loadu_si128 ((const __m128i*) (in + x));
+        __m128i lo = _mm_loadu_si128 ((const __m128i*) (in + w + x));
+        __m256i d  = _mm256_inserti128_si256 (
+            _mm256_castsi128_si256 (_mm_unpacklo_epi8 (lo, hi)),
+            _mm_unpackhi_epi8 (lo, hi),
+            1);
+        __m256i t;
+
+        d = _mm256_add_epi16 (d, _mm256_slli_si256 (d, 2));
+        d = _mm256_add_epi16 (d, _mm256_slli_si256 (d, 4));
+        d = _mm256_add_epi16 (d, _mm256_slli_si256 (d, 8));
+        t = _mm256_shufflehi_epi16 (
+            _mm256_permute2x128_si256 (d, d, 0x08), 0xFF);
+        d = _mm256_add_epi16 (d, _mm256_unpackhi_epi64 (t, t));
+        d = _mm256_add_epi16 (d, carry);
+        _mm256_storeu_si256 ((__m256i*) (out + 2 * x), d);
+
+        carry = _mm256_shuffle_epi8 (
+            _mm256_permutevar8x32_epi32 (d, _mm256_set1_epi32 (7)),
+            _mm256_set1_epi16 (0x0302));
+    }
+    *pixel = (uint32_t) (uint16_t) _mm256_extract_epi16 (carry, 0);
+    return x;
+}
+
+#endif /* ENABLE_AVX2_PXR24 */
+
+typedef int (*pxr24_rows_fn) (const uint8_t*, uint8_t*, int, uint32_t*);
+
+static pxr24_rows_fn pxr24_enc_uint  = &pxr24_rows_scalar;
+static pxr24_rows_fn pxr24_enc_half  = &pxr24_rows_scalar;
+static pxr24_rows_fn pxr24_enc_float = &pxr24_rows_scalar;
+static pxr24_rows_fn pxr24_dec_uint  = &pxr24_rows_scalar;
+static pxr24_rows_fn pxr24_dec_half  = &pxr24_rows_scalar;
+static pxr24_rows_fn pxr24_dec_float = &pxr24_rows_scalar;
+
+static void
+choose_pxr24_impl (void)
+{
+#ifdef EXR_HAS_STD_ATOMICS
+    static atomic_int init_cpu_check = 1;
+#else
+    static int init_cpu_check = 1;
+#endif
+    if (init_cpu_check)
+    {
+#ifdef ENABLE_AVX2_PXR24
+        if (has_avx2 ())
+        {
+            pxr24_enc_uint  = &pxr24_enc_uint_avx2;
+            pxr24_enc_half  = &pxr24_enc_half_avx2;
+            pxr24_enc_float = &pxr24_enc_float_avx2;
+            pxr24_dec_uint  = &pxr24_dec_uint_avx2;
+            pxr24_dec_half  = &pxr24_dec_half_avx2;
+            pxr24_dec_float = &pxr24_dec_float_avx2;
+        }
+#endif
+        init_cpu_check = 0;
+    }
+}
+
+/**************************************/
+
 static exr_result_t
 apply_pxr24_impl (exr_encode_pipeline_t* encode)
 {
@@ -104,6 +418,7 @@ apply_pxr24_impl (exr_encode_pipeline_t* encode)
             const exr_coding_channel_info_t* curc   = encode->channels + c;
             int                              w      = curc->width;
             uint64_t                         nBytes = (uint64_t) (w);
+            int                              x0;
 
             if (curc->height == 0 ||
                 (curc->y_samples > 1 && (cury % curc->y_samples) != 0))
@@ -131,7 +446,15 @@ apply_pxr24_impl (exr_encode_pipeline_t* encode)
                     ptr[3] = out;
                     out += w;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_enc_uint (
+                        (const uint8_t*) din, ptr[0], w, &prevPixel);
+                    din += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+                    ptr[2] += x0;
+                    ptr[3] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         uint32_t pixel = unaligned_load32 (din);
                         uint32_t diff  = pixel - prevPixel;
@@ -161,7 +484,13 @@ apply_pxr24_impl (exr_encode_pipeline_t* encode)
                     ptr[1] = out;
                     out += w;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_enc_half (
+                        (const uint8_t*) din, ptr[0], w, &prevPixel);
+                    din += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         uint32_t pixel = (uint32_t) unaligned_load16 (din);
                         uint32_t diff  = pixel - prevPixel;
@@ -191,7 +520,14 @@ apply_pxr24_impl (exr_encode_pipeline_t* encode)
                     ptr[2] = out;
                     out += w;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_enc_float (
+                        (const uint8_t*) din, ptr[0], w, &prevPixel);
+                    din += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+                    ptr[2] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         union
                         {
@@ -216,8 +552,8 @@ apply_pxr24_impl (exr_encode_pipeline_t* encode)
         }
     }
 
-    rv = exr_compress_buffer (
-        encode->context,
+    rv = internal_exr_compress_buffer (
+        encode,
         -1,
         encode->scratch_buffer_1,
         nOut,
@@ -252,6 +588,7 @@ internal_exr_apply_pxr24 (exr_encode_pipeline_t* encode)
         encode->packed_bytes);
     if (rv != EXR_ERR_SUCCESS) return rv;
 
+    choose_pxr24_impl ();
     return apply_pxr24_impl (encode);
 }
 
@@ -296,6 +633,7 @@ undo_pxr24_impl (
             int                              w    = curc->width;
             uint64_t                         nBytes =
                 (uint64_t) (w) * (uint64_t) (curc->bytes_per_element);
+            int                              x0;
 
             if (curc->height == 0 ||
                 (curc->y_samples > 1 && (cury % curc->y_samples) != 0))
@@ -323,7 +661,14 @@ undo_pxr24_impl (
                     if (nDec + nBytes > outSize)
                         return EXR_ERR_CORRUPT_CHUNK;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_dec_uint (ptr[0], out, w, &pixel);
+                    dout += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+                    ptr[2] += x0;
+                    ptr[3] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         uint32_t diff =
                             (((uint32_t) (*(ptr[0]++)) << 24) |
@@ -350,7 +695,12 @@ undo_pxr24_impl (
                     if (nDec + nBytes > outSize)
                         return EXR_ERR_CORRUPT_CHUNK;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_dec_half (ptr[0], out, w, &pixel);
+                    dout += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         uint32_t diff =
                             (((uint32_t) (*(ptr[0]++)) << 8) |
@@ -377,7 +727,13 @@ undo_pxr24_impl (
                     if (nDec + (uint64_t) w * 3 > outSize)
                         return EXR_ERR_CORRUPT_CHUNK;
 
-                    for (int x = 0; x < w; ++x)
+                    x0 = pxr24_dec_float (ptr[0], out, w, &pixel);
+                    dout += x0;
+                    ptr[0] += x0;
+                    ptr[1] += x0;
+                    ptr[2] += x0;
+
+                    for (int x = x0; x < w; ++x)
                     {
                         uint32_t diff =
                             (((uint32_t) (*(ptr[0]++)) << 24) |
@@ -416,6 +772,8 @@ internal_exr_undo_pxr24 (
         &(decode->scratch_alloc_size_1),
         exr_compress_max_buffer_size (uncompressed_size));
     if (rv != EXR_ERR_SUCCESS) return rv;
+
+    choose_pxr24_impl ();
     return undo_pxr24_impl (
         decode,
         compressed_data,
@@ -11,52 +11,243 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined __SSE2__ || (_MSC_VER >= 1300 && (_M_IX86 || _M_X64) && !defined(_M_ARM64EC))
+#    define IMF_HAVE_SSE2 1
+#    include <emmintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(_M_ARM64EC)
+#    define IMF_HAVE_NEON_ARM64 1
+#    if defined(_MSC_VER)
+#        include <arm64_neon.h>
+#    else
+#        include <arm_neon.h>
+#    endif
+#endif
+#if defined(_MSC_VER) && (defined(IMF_HAVE_SSE2) || defined(IMF_HAVE_NEON_ARM64))
+#    include <intrin.h>
+#endif
+
 #define MIN_RUN_LENGTH 3
 #define MAX_RUN_LENGTH 127
 
+/**************************************/
+
+/*
+ * The run and literal scans below look at 16 bytes per step, turning
+ * the byte compares into a bit mask and picking the first interesting
+ * lane out of that. Near the end of the buffer (or without SIMD) they
+ * fall back to the byte-at-a-time loop, so the token stream is
+ * exactly the same either way.
+ */
+
+#if defined(IMF_HAVE_SSE2)
+
+#    define RLE_SCAN_BYTES 16
+
+static inline int
+rle_first_set (uint32_t m)
+{
+#    if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward (&idx, m);
+    return (int) idx;
+#    else
+    return __builtin_ctz (m);
+#    endif
+}
+
+/*
+ * index of the first of the 16 positions at p whose byte differs from
+ * the next one, or 16. Reads 17 bytes
+ */
+static inline int
+rle_scan_pairs (const uint8_t* p)
+{
+    __m128i  a = _mm_loadu_si128 ((const __m128i*) p);
+    __m128i  b = _mm_loadu_si128 ((const __m128i*) (p + 1));
+    uint32_t m = (uint32_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (a, b)) ^ 0xFFFFu;
+    return m ? rle_first_set (m) : 16;
+}
+
+/*
+ * index of the first of the 16 positions at p that starts three equal
+ * bytes, or 16. Reads 18 bytes
+ */
+static inline int
+rle_scan_triple (const uint8_t* p)
+{
+    __m128i  a = _mm_loadu_si128 ((const __m128i*) p);
+    __m128i  b = _mm_loadu_si128 ((const __m128i*) (p + 1));
+    __m128i  c = _mm_loadu_si128 ((const __m128i*) (p + 2));
+    uint32_t m = (uint32_t) _mm_movemask_epi8 (
+        _mm_and_si128 (_mm_cmpeq_epi8 (a, b), _mm_cmpeq_epi8 (b, c)));
+    return m ? rle_first_set (m) : 16;
+}
+
+static inline void
+rle_copy16 (uint8_t* dst, const uint8_t* src)
+{
+    _mm_storeu_si128 ((__m128i*) dst, _mm_loadu_si128 ((const __m128i*) src));
+}
+
+static inline void
+rle_fill (uint8_t* dst, uint8_t v, uint64_t count)
+{
+    __m128i vv = _mm_set1_epi8 ((char) v);
+    for (uint64_t i = 0; i < count; i += 16)
+        _mm_storeu_si128 ((__m128i*) (dst + i), vv);
+}
+
+#elif defined(IMF_HAVE_NEON_ARM64)
+
+#    define RLE_SCAN_BYTES 16
+
+/*
+ * NEON has no movemask, narrowing the compare result gives a nibble
+ * per lane instead
+ */
+static inline int
+rle_first_set_nibble (uint8x16_t eq)
+{
+    uint64_t m = vget_lane_u64 (
+        vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eq), 4)), 0);
+    if (!m) return 16;
+#    if defined(_MSC_VER)
+    {
+        unsigned long idx;
+        _BitScanForward64 (&idx, m);
+        return (int) (idx >> 2);
+    }
+#    else
+    return __builtin_ctzll (m) >> 2;
+#    endif
+}
+
+static inline int
+rle_scan_pairs (const uint8_t* p)
+{
+    uint8x16_t a = vld1q_u8 (p);
+    uint8x16_t b = vld1q_u8 (p + 1);
+    return rle_first_set_nibble (vmvnq_u8 (vceqq_u8 (a, b)));
+}
+static inline int
+rle_scan_triple (const uint8_t* p)
+{
+    uint8x16_t a = vld1q_u8 (p);
+    uint8x16_t b = vld1q_u8 (p + 1);
+    uint8x16_t c = vld1q_u8 (p + 2);
+    return rle_first_set_nibble (vandq_u8 (vceqq_u8 (a, b), vceqq_u8 (b, c)));
+}
+
+static inline void
+rle_copy16 (uint8_t* dst, const uint8_t* src)
+{
+    vst1q_u8 (dst, vld1q_u8 (src));
+}
+
+static inline void
+rle_fill (uint8_t* dst, uint8_t v, uint64_t count)
+{
+    uint8x16_t vv = vdupq_n_u8 (v);
+    for (uint64_t i = 0; i < count; i += 16)
+        vst1q_u8 (dst + i, vv);
+}
+
+#endif
+
+/*
+ * number of bytes following p[0] (up to maxcount) that are equal to
+ * it. Comparing neighbouring bytes rather than against a broadcast of
+ * p[0] keeps the next scan independent of loading that byte
+ */
+static inline uint64_t
+rle_match_run (const uint8_t* p, const uint8_t* end, uint64_t maxcount)
+{
+    uint64_t n = 0;
+#ifdef RLE_SCAN_BYTES
+    /* most runs end inside the first vector, keep that path short */
+    if ((uint64_t) (end - p) > RLE_SCAN_BYTES)
+    {
+        int i = rle_scan_pairs (p);
+        if (i < RLE_SCAN_BYTES)
+            return (uint64_t) i < maxcount ? (uint64_t) i : maxcount;
+        n = RLE_SCAN_BYTES;
+        while (n < maxcount && (uint64_t) (end - p) - n > RLE_SCAN_BYTES)
+        {
+            i = rle_scan_pairs (p + n);
+            n += (uint64_t) i;
+            if (i < RLE_SCAN_BYTES) break;
+        }
+        if (n >= maxcount) return maxcount;
+        if (i < RLE_SCAN_BYTES) return n;
+    }
+#endif
+    while (n < maxcount && p + n + 1 < end && p[n + 1] == p[0])
+        ++n;
+    return n;
+}
+
+/*
+ * first position in [p, limit) where a run of three equal bytes
+ * starts, or limit if there is none
+ */
+static inline const uint8_t*
+rle_find_run_start (const uint8_t* p, const uint8_t* limit, const uint8_t* end)
+{
+#ifdef RLE_SCAN_BYTES
+    while (p < limit && end - p >= RLE_SCAN_BYTES + 2)
+    {
+        int i = rle_scan_triple (p);
+        p += i;
+        if (i < RLE_SCAN_BYTES) return p < limit ? p : limit;
+    }
+    if (p >= limit) return limit;
+#endif
+    while (p < limit && (p + 2 >= end || p[0] != p[1] || p[1] != p[2]))
+        ++p;
+    return p;
+}
+
 uint64_t
 internal_rle_compress (
     void* out, uint64_t outbytes, const void* src, uint64_t srcbytes)
 {
-    int8_t*       cbuf = out;
-    const int8_t* runs = src;
-    const int8_t* end  = runs + srcbytes;
-    const int8_t* rune = runs + 1;
-    uint64_t      outb = 0;
+    int8_t*        cbuf = out;
+    const uint8_t* runs = src;
+    const uint8_t* end  = runs + srcbytes;
+    uint64_t       outb = 0;
 
     while (runs < end)
     {
-        uint8_t curcount = 0;
-        while (rune < end && *runs == *rune && curcount < MAX_RUN_LENGTH)
-        {
-            ++rune;
-            ++curcount;
-        }
+        uint64_t avail    = (uint64_t) (end - runs);
+        uint64_t curcount = rle_match_run (
+            runs, end, avail - 1 < MAX_RUN_LENGTH ? avail - 1 : MAX_RUN_LENGTH);
 
         if (curcount >= (MIN_RUN_LENGTH - 1))
         {
             cbuf[outb++] = (int8_t) curcount;
-            cbuf[outb++] = *runs;
+            cbuf[outb++] = (int8_t) *runs;
 
-            runs = rune;
+            runs += curcount + 1;
         }
         else
         {
-            /* incompressible */
-            ++curcount;
-            while (rune < end &&
-                   ((rune + 1 >= end || *rune != *(rune + 1)) ||
-                    (rune + 2 >= end || *(rune + 1) != *(rune + 2))) &&
-                   curcount < MAX_RUN_LENGTH)
-            {
-                ++curcount;
-                ++rune;
-            }
+            /*
+             * incompressible, up to the next run of at least
+             * MIN_RUN_LENGTH bytes (a pair at the start is kept in
+             * the literal)
+             */
+            const uint8_t* rune = rle_find_run_start (
+                runs + curcount + 1,
+                runs + (avail < MAX_RUN_LENGTH ? avail : MAX_RUN_LENGTH),
+                end);
+
+            curcount     = (uint64_t) (rune - runs);
             cbuf[outb++] = (int8_t) (-((int) curcount));
-            while (runs < rune)
-                cbuf[outb++] = *runs++;
+            memcpy (cbuf + outb, runs, curcount);
+            outb += curcount;
+            runs = rune;
         }
-        ++rune;
         if (outb >= outbytes) break;
     }
     return outb;
@@ -64,32 +255,6 @@ internal_rle_compress (
 
 /**************************************/
 
-static void
-reorder_and_predict (void* scratch, const void* packed, uint64_t packedbytes)
-{
-    int8_t*       t1   = scratch;
-    int8_t*       t2   = t1 + (packedbytes + 1) / 2;
-    const int8_t* in   = packed;
-    const int8_t* stop = in + packedbytes;
-    int           d, p;
-
-    while (in < stop)
-    {
-        *(t1++) = *(in++);
-        if (in < stop) *(t2++) = *(in++);
-    }
-
-    t1   = scratch;
-    stop = t1 + packedbytes;
-    p    = *(t1++);
-    while (t1 < stop)
-    {
-        d     = (int) (*t1) - p + (128 + 256);
-        p     = *t1;
-        *t1++ = (int8_t) (d);
-    }
-}
-
 exr_result_t
 internal_exr_apply_rle (exr_encode_pipeline_t* encode)
 {
@@ -106,7 +271,9 @@ internal_exr_apply_rle (exr_encode_pipeline_t* encode)
         srcb);
     if (rv != EXR_ERR_SUCCESS) return rv;
 
-    reorder_and_predict (encode->scratch_buffer_1, encode->packed_buffer, srcb);
+    /* same byte split and delta predictor as zip */
+    internal_zip_deconstruct_bytes (
+        encode->scratch_buffer_1, encode->packed_buffer, srcb);
 
     outb = internal_rle_compress (
         encode->compressed_buffer,
@@ -143,7 +310,21 @@ internal_rle_decompress (
             if (unpackbytes + count > packsz) return 0;
             if (outbytes + count > outsz) return 0;
 
-            memcpy (dst, in, count);
+#ifdef RLE_SCAN_BYTES
+            /*
+             * copy whole vectors when both buffers have room for the
+             * over-read / over-write, the extra bytes are replaced by
+             * the following tokens
+             */
+            uint64_t vcount = (count + 15) & ~((uint64_t) 15);
+            if (unpackbytes + vcount <= packsz && outbytes + vcount <= outsz)
+            {
+                for (uint64_t i = 0; i < count; i += 16)
+                    rle_copy16 (dst + i, (const uint8_t*) in + i);
+            }
+            else
+#endif
+                memcpy (dst, in, count);
             in += count;
             dst += count;
             unpackbytes += count;
@@ -158,7 +339,12 @@ internal_rle_decompress (
             ++count;
             if (outbytes + count > outsz) return 0;
 
-            memset (dst, *(const uint8_t*) in, count);
+#ifdef RLE_SCAN_BYTES
+            if (outbytes + ((count + 15) & ~((uint64_t) 15)) <= outsz)
+                rle_fill (dst, *(const uint8_t*) in, count);
+            else
+#endif
+                memset (dst, *(const uint8_t*) in, count);
             dst += count;
             outbytes += count;
             ++in;
@@ -167,31 +353,6 @@ internal_rle_decompress (
     return outbytes;
 }
 
-static void
-unpredict_and_reorder (void* out, void* scratch, uint64_t packedbytes)
-{
-    int8_t*       t1   = scratch;
-    int8_t*       t2   = t1 + (packedbytes + 1) / 2;
-    int8_t*       s    = out;
-    const int8_t* stop = t1 + packedbytes;
-
-    ++t1;
-    while (t1 < stop)
-    {
-        int d = (int) (t1[-1]) + (int) (t1[0]) - 128;
-        t1[0] = (int8_t) d;
-        ++t1;
-    }
-
-    t1   = scratch;
-    stop = s + packedbytes;
-    while (s < stop)
-    {
-        *(s++) = *(t1++);
-        if (s < stop) *(s++) = *(t2++);
-    }
-}
-
 exr_result_t
 internal_exr_undo_rle (
     exr_decode_pipeline_t* decode,
@@ -222,7 +383,8 @@ internal_exr_undo_rle (
     if (unpackb != outsz)
         return EXR_ERR_CORRUPT_CHUNK;
 
-    unpredict_and_reorder (out, decode->scratch_buffer_1, unpackb);
+    if (unpackb > 0)
+        internal_zip_reconstruct_bytes (out, decode->scratch_buffer_1, unpackb);
 
     decode->bytes_decompressed = unpackb;
 
@@ -153,6 +153,13 @@ internal_exr_destroy_part (exr_context_t ctxt, exr_priv_part_t cur)
     /* we stack x and y together so only have to free the first */
     if (cur->tile_level_tile_count_x) dofree (cur->tile_level_tile_count_x);
 
+    if (cur->dwa_channel_rules)
+    {
+        for (int32_t r = 0; r < cur->dwa_channel_rule_count; ++r)
+            dofree (cur->dwa_channel_rules[r].suffix);
+        dofree (cur->dwa_channel_rules);
+    }
+
 #if defined(_MSC_VER)
     ctable = (uint64_t*) InterlockedOr64 (
         (int64_t volatile*) &(cur->chunk_table), 0);
@@ -383,13 +390,18 @@ internal_exr_alloc_context (
              EXR_CONTEXT_FLAG_DISABLE_CHUNK_RECONSTRUCTION);
         ret->legacy_header =
             (initializers->flags & EXR_CONTEXT_FLAG_WRITE_LEGACY_HEADER);
+        if (mode == EXR_CONTEXT_READ &&
+            (initializers->flags & EXR_CONTEXT_FLAG_MEMORY_MAP_READ))
+            ret->memory_map_read = 1;
 
-        ret->file_size       = -1;
-        ret->max_name_length = EXR_SHORTNAME_MAXLEN;
+        ret->file_size         = -1;
+        ret->max_name_length   = EXR_SHORTNAME_MAXLEN;
+        ret->buffer_pool_limit = EXR_DEFAULT_BUFFER_POOL_LIMIT;
 
-        ret->destroy_fn = initializers->destroy_fn;
-        ret->read_fn    = initializers->read_fn;
-        ret->write_fn   = initializers->write_fn;
+        ret->destroy_fn    = initializers->destroy_fn;
+        ret->read_fn       = initializers->read_fn;
+        ret->read_batch_fn = initializers->read_batch_fn;
+        ret->write_fn      = initializers->write_fn;
 
 #if ILMTHREAD_THREADING_ENABLED
 #    ifdef _WIN32
@@ -448,6 +460,7 @@ internal_exr_destroy_context (exr_context_t ctxt)
     exr_attr_string_destroy (ctxt, &(ctxt->tmp_filename));
     exr_attr_list_destroy (ctxt, &(ctxt->custom_handlers));
     internal_exr_destroy_parts (ctxt);
+    internal_exr_destroy_buffer_pool (ctxt);
 #if ILMTHREAD_THREADING_ENABLED
 #    ifdef _WIN32
     DeleteCriticalSection (&(ctxt->mutex));
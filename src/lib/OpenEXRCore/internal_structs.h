@@ -88,6 +88,15 @@ atomic_compare_exchange_strong (
 #    endif
 #endif
 
+/** user registered dwa channel classification rule, see exr_add_dwa_channel_rule */
+typedef struct _internal_exr_dwa_channel_rule
+{
+    char*   suffix;
+    uint8_t type;
+    uint8_t scheme;
+    uint8_t case_insensitive;
+} internal_exr_dwa_channel_rule_t;
+
 struct _priv_exr_part_t
 {
     int part_index;
@@ -126,6 +135,9 @@ struct _priv_exr_part_t
     int32_t zip_compression_level;
     float   dwa_compression_level;
 
+    int32_t                          dwa_channel_rule_count;
+    internal_exr_dwa_channel_rule_t* dwa_channel_rules;
+
     int32_t  num_tile_levels_x;
     int32_t  num_tile_levels_y;
     int32_t* tile_level_tile_count_x;
@@ -212,8 +224,18 @@ struct _priv_exr_context_t
     void*                         user_data;
     exr_destroy_stream_func_ptr_t destroy_fn;
 
-    int64_t             file_size;
-    exr_read_func_ptr_t read_fn;
+    int64_t                   file_size;
+    exr_read_func_ptr_t       read_fn;
+    exr_read_batch_func_ptr_t read_batch_fn;
+    /* advise the stream a range will be read soon so the i/o can
+     * start in the background, only set by the default file
+     * implementations */
+    void (*prefetch_fn) (exr_const_context_t, uint64_t, uint64_t);
+
+    /* read-only mapping of the entire file when the default file
+     * implementation memory maps it, used to borrow chunk data */
+    const uint8_t* mapped_data;
+    uint64_t       mapped_size;
 
     exr_write_func_ptr_t write_fn;
     /* used when writing under a mutex, is there a better way? */
@@ -232,6 +254,11 @@ struct _priv_exr_context_t
 
     exr_attribute_list_t custom_handlers;
 
+    /* pool of decode pipeline buffers, allocated on first use and
+     * guarded by the mutex below, see coding.c */
+    struct _internal_exr_buffer_pool* buffer_pool;
+    uint64_t                          buffer_pool_limit;
+
     /* mostly needed for writing, but used during read to ensure
      * custom attribute handlers are safe */
 #if ILMTHREAD_THREADING_ENABLED
@@ -243,12 +270,18 @@ struct _priv_exr_context_t
 #endif
     uint8_t disable_chunk_reconstruct;
     uint8_t legacy_header;
-    uint8_t _pad[2];
+    uint8_t memory_map_read;
+    uint8_t _pad[1];
     uint32_t orig_version_and_flags;
 };
 
 #define EXR_CONST_CAST(t, v) ((t) (uintptr_t) v)
 
+/* default maximum number of bytes held by the decode buffer pool */
+#define EXR_DEFAULT_BUFFER_POOL_LIMIT ((uint64_t) 128 * 1024 * 1024)
+
+void internal_exr_destroy_buffer_pool (exr_context_t ctxt);
+
 static inline void
 internal_exr_lock (exr_const_context_t c)
 {
@@ -41,6 +41,7 @@ call_once (once_flag* flag, void (*func) (void))
  * No <threads.h> on macOS and older Linux distros: fall back to pthreads
  */
 #        include <pthread.h>
+#        define EXR_HAS_PTHREADS 1
 #        define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
 typedef pthread_once_t once_flag;
 static inline void
@@ -70,5 +71,92 @@ call_once (once_flag* flag, void (*func) (void))
 }
 #endif
 
+/*
+ * Minimal worker threads, used when a single chunk is split across
+ * threads (see internal_exr_compress_buffer). The caller owns the
+ * exr_worker_thread_t and must join it before it goes out of scope. If
+ * the thread could not be started (or threading is disabled), start
+ * returns non-zero and the caller should run the work itself.
+ */
+typedef struct _exr_worker_thread
+{
+    void (*fn) (void*);
+    void* arg;
+#if ILMTHREAD_THREADING_ENABLED
+#    if defined(_WIN32)
+    HANDLE handle;
+#    elif defined(EXR_HAS_PTHREADS)
+    pthread_t handle;
+#    else
+    thrd_t handle;
+#    endif
+#endif
+} exr_worker_thread_t;
+
+#if ILMTHREAD_THREADING_ENABLED
+#    if defined(_WIN32)
+static inline DWORD WINAPI
+worker_thread_entry (LPVOID param)
+{
+    exr_worker_thread_t* t = (exr_worker_thread_t*) param;
+    t->fn (t->arg);
+    return 0;
+}
+#    elif defined(EXR_HAS_PTHREADS)
+static inline void*
+worker_thread_entry (void* param)
+{
+    exr_worker_thread_t* t = (exr_worker_thread_t*) param;
+    t->fn (t->arg);
+    return NULL;
+}
+#    else
+static inline int
+worker_thread_entry (void* param)
+{
+    exr_worker_thread_t* t = (exr_worker_thread_t*) param;
+    t->fn (t->arg);
+    return 0;
+}
+#    endif
+#endif /* ILMTHREAD_THREADING_ENABLED */
+
+static inline int
+worker_thread_start (exr_worker_thread_t* t, void (*fn) (void*), void* arg)
+{
+    t->fn  = fn;
+    t->arg = arg;
+#if ILMTHREAD_THREADING_ENABLED
+#    if defined(_WIN32)
+    t->handle = CreateThread (NULL, 0, worker_thread_entry, t, 0, NULL);
+    return t->handle ? 0 : 1;
+#    elif defined(EXR_HAS_PTHREADS)
+    return pthread_create (&(t->handle), NULL, worker_thread_entry, t);
+#    else
+    return thrd_create (&(t->handle), worker_thread_entry, t) == thrd_success
+               ? 0
+               : 1;
+#    endif
+#else
+    return 1;
+#endif
+}
+
+static inline void
+worker_thread_join (exr_worker_thread_t* t)
+{
+#if ILMTHREAD_THREADING_ENABLED
+#    if defined(_WIN32)
+    WaitForSingleObject (t->handle, INFINITE);
+    CloseHandle (t->handle);
+#    elif defined(EXR_HAS_PTHREADS)
+    (void) pthread_join (t->handle, NULL);
+#    else
+    (void) thrd_join (t->handle, NULL);
+#    endif
+#else
+    (void) t;
+#endif
+}
 
 #endif /* OPENEXR_PRIVATE_THREAD_H */
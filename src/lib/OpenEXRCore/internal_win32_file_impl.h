@@ -95,7 +95,10 @@ widen_filename (exr_context_t file, const char* fn)
 
 struct _internal_exr_filehandle
 {
-    HANDLE fd;
+    HANDLE   fd;
+    HANDLE   mapping;
+    void*    map_base;
+    uint64_t map_size;
 };
 
 /**************************************/
@@ -107,6 +110,11 @@ default_shutdown (exr_const_context_t c, void* userdata, int failed)
     struct _internal_exr_filehandle* fh = userdata;
     if (fh)
     {
+        if (fh->map_base) UnmapViewOfFile (fh->map_base);
+        if (fh->mapping) CloseHandle (fh->mapping);
+        fh->map_base = NULL;
+        fh->mapping  = NULL;
+        fh->map_size = 0;
         if (fh->fd != INVALID_HANDLE_VALUE) CloseHandle (fh->fd);
         fh->fd = INVALID_HANDLE_VALUE;
     }
@@ -221,6 +229,55 @@ default_read_func (
 
 /**************************************/
 
+static int64_t
+default_mmap_read_func (
+    exr_const_context_t         ctxt,
+    void*                       userdata,
+    void*                       buffer,
+    uint64_t                    sz,
+    uint64_t                    offset,
+    exr_stream_error_func_ptr_t error_cb)
+{
+    struct _internal_exr_filehandle* fh = userdata;
+
+    if (!fh || !fh->map_base)
+    {
+        if (error_cb)
+            error_cb (
+                ctxt, EXR_ERR_INVALID_ARGUMENT, "Invalid file handle pointer");
+        return -1;
+    }
+
+    /* behave as ReadFile would at (or past) the end of the file */
+    if (offset >= fh->map_size) return 0;
+    if (sz > fh->map_size - offset) sz = fh->map_size - offset;
+
+    memcpy (buffer, ((const uint8_t*) fh->map_base) + offset, (size_t) sz);
+    return (int64_t) sz;
+}
+
+/**************************************/
+
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+static void
+default_mmap_prefetch_func (
+    exr_const_context_t ctxt, uint64_t offset, uint64_t sz)
+{
+    struct _internal_exr_filehandle* fh = ctxt->user_data;
+    WIN32_MEMORY_RANGE_ENTRY         range;
+
+    if (!fh || !fh->map_base || sz == 0 || offset >= fh->map_size) return;
+    if (sz > fh->map_size - offset) sz = fh->map_size - offset;
+
+    /* purely a hint, pages are faulted in asynchronously */
+    range.VirtualAddress = ((uint8_t*) fh->map_base) + offset;
+    range.NumberOfBytes  = (SIZE_T) sz;
+    (void) PrefetchVirtualMemory (GetCurrentProcess (), 1, &range, 0);
+}
+#endif
+
+/**************************************/
+
 static int64_t
 default_write_func (
     exr_const_context_t         ctxt,
@@ -287,6 +344,41 @@ default_write_func (
 
 /**************************************/
 
+static void
+default_map_read_file (exr_context_t file)
+{
+    LARGE_INTEGER                    lint = {0};
+    HANDLE                           mapping;
+    void*                            base;
+    struct _internal_exr_filehandle* fh = file->user_data;
+
+    /* any failure here is not fatal, we just use normal reads */
+    if (!GetFileSizeEx (fh->fd, &lint) || lint.QuadPart <= 0) return;
+    if ((uint64_t) lint.QuadPart > (uint64_t) SIZE_MAX) return;
+
+    mapping = CreateFileMappingW (fh->fd, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return;
+
+    base = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base)
+    {
+        CloseHandle (mapping);
+        return;
+    }
+
+    fh->mapping       = mapping;
+    fh->map_base      = base;
+    fh->map_size      = (uint64_t) lint.QuadPart;
+    file->mapped_data = (const uint8_t*) base;
+    file->mapped_size = fh->map_size;
+    file->read_fn     = &default_mmap_read_func;
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    file->prefetch_fn = &default_mmap_prefetch_func;
+#endif
+}
+
+/**************************************/
+
 static exr_result_t
 default_init_read_file (exr_context_t file)
 {
@@ -294,9 +386,15 @@ default_init_read_file (exr_context_t file)
     HANDLE                           fd;
     struct _internal_exr_filehandle* fh = file->user_data;
 
-    fh->fd           = INVALID_HANDLE_VALUE;
-    file->destroy_fn = &default_shutdown;
-    file->read_fn    = &default_read_func;
+    fh->fd              = INVALID_HANDLE_VALUE;
+    fh->mapping         = NULL;
+    fh->map_base        = NULL;
+    fh->map_size        = 0;
+    file->destroy_fn    = &default_shutdown;
+    file->read_fn       = &default_read_func;
+    /* ReadFileScatter requires unbuffered, page aligned i/o, so
+     * batched reads are issued one overlapped read at a time */
+    file->read_batch_fn = NULL;
 
     wcFn = widen_filename (file, file->filename.str);
     if (wcFn)
@@ -330,6 +428,8 @@ default_init_read_file (exr_context_t file)
 
     fh->fd = fd;
 
+    if (file->memory_map_read) default_map_read_file (file);
+
     return EXR_ERR_SUCCESS;
 }
 
@@ -346,6 +446,9 @@ default_init_write_file (exr_context_t file)
     if (outfn == NULL) outfn = file->filename.str;
 
     fh->fd           = INVALID_HANDLE_VALUE;
+    fh->mapping      = NULL;
+    fh->map_base     = NULL;
+    fh->map_size     = 0;
     file->destroy_fn = &default_shutdown;
     file->write_fn   = &default_write_func;
 
@@ -378,8 +378,8 @@ apply_zip_impl (exr_encode_pipeline_t* encode)
     internal_zip_deconstruct_bytes (
         encode->scratch_buffer_1, encode->packed_buffer, encode->packed_bytes);
 
-    rv = exr_compress_buffer (
-        encode->context,
+    rv = internal_exr_compress_buffer (
+        encode,
         level,
         encode->scratch_buffer_1,
         encode->packed_bytes,
@@ -98,6 +98,29 @@ exr_result_t exr_read_chunk (
     const exr_chunk_info_t* cinfo,
     void*                   packed_data);
 
+/** Read the packed data blocks for a number of chunks at once.
+ *
+ * Equivalent to calling exr_read_chunk() for each of the @p count
+ * entries of @p cinfos, reading the packed data for chunk \c i into
+ * \c packed_data[i], which must be large enough to hold that
+ * chunk's packed_size bytes. The chunks may be given in any order.
+ *
+ * The requests are sorted by file offset, chunks which are adjacent
+ * in the file are coalesced into single larger transfers, and the
+ * whole set is handed to the stream in one go (using vectored I/O
+ * for the default file implementation, or the \c read_batch_fn
+ * of a custom stream), which substantially reduces the number of
+ * I/O requests when reading a full part, especially on high latency
+ * (network) file systems.
+ */
+EXR_EXPORT
+exr_result_t exr_read_chunks (
+    exr_const_context_t     ctxt,
+    int                     part_index,
+    int                     count,
+    const exr_chunk_info_t* cinfos,
+    void* const*            packed_data);
+
 /**
  * Read chunk for deep data.
  *
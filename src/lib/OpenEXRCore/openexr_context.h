@@ -126,8 +126,8 @@ typedef int64_t (*exr_query_size_func_ptr_t) (
  * caching of data to give the appearance of being able to seek/read
  * atomically.
  *
- * TODO: This does not handle the ability to mmap a file and get to
- * zero copy
+ * For zero-copy reads of files using the default file
+ * implementation, see \c EXR_CONTEXT_FLAG_MEMORY_MAP_READ.
  */
 typedef int64_t (*exr_read_func_ptr_t) (
     exr_const_context_t         ctxt,
@@ -137,6 +137,44 @@ typedef int64_t (*exr_read_func_ptr_t) (
     uint64_t                    offset,
     exr_stream_error_func_ptr_t error_cb);
 
+/** @brief A single range to read as part of a batched read request.
+ *
+ * @sa exr_read_batch_func_ptr_t
+ */
+typedef struct _exr_read_request
+{
+    void*    buffer; /**< Destination for the data, at least \c size bytes */
+    uint64_t size;   /**< Number of bytes to read */
+    uint64_t offset; /**< Offset in the stream to read from */
+} exr_read_request_t;
+
+/** @brief Batched (scatter) read custom function pointer
+ *
+ * Optional companion to \c exr_read_func_ptr_t used by
+ * exr_read_chunks() to read many ranges of a stream with a single
+ * call, allowing a stream to implement vectored I/O or to issue
+ * multiple outstanding requests at once.
+ *
+ * The requests are sorted by ascending offset, and the ranges of
+ * neighboring requests will frequently abut (request \c i+1 starts
+ * where request \c i ends) such that they may be coalesced into one
+ * larger transfer scattered into the individual buffers.
+ *
+ * Should return the total number of bytes read across all requests,
+ * or -1 upon error (after calling the error callback). Returning
+ * fewer bytes than requested (i.e. at the end of a truncated file)
+ * is not an error: the library will then retry the requests
+ * individually using the normal read function to determine which
+ * were short. The same thread-safety requirements as the read
+ * function apply.
+ */
+typedef int64_t (*exr_read_batch_func_ptr_t) (
+    exr_const_context_t         ctxt,
+    void*                       userdata,
+    const exr_read_request_t*   requests,
+    int                         count,
+    exr_stream_error_func_ptr_t error_cb);
+
 /** Write custom function pointer
  *
  *  Used to write data to a custom output. Expects similar semantics to
@@ -190,7 +228,7 @@ typedef int64_t (*exr_write_func_ptr_t) (
  * \endcode
  *
  */
-typedef struct _exr_context_initializer_v3
+typedef struct _exr_context_initializer_v4
 {
     /** @brief Size member to tag initializer for version stability.
      *
@@ -324,6 +362,17 @@ typedef struct _exr_context_initializer_v3
     int flags;
 
     uint8_t pad[4];
+
+    /** @brief Optional custom batched read routine.
+     *
+     * Only used when a custom \c read_fn is also provided (the
+     * internal file implementation provides its own). If this is
+     * `NULL`, batched reads fall back to calling \c read_fn for each
+     * request.
+     *
+     * @sa exr_read_batch_func_ptr_t
+     */
+    exr_read_batch_func_ptr_t read_batch_fn;
 } exr_context_initializer_t;
 
 /** @brief context flag which will enforce strict header validation
@@ -350,10 +399,27 @@ typedef struct _exr_context_initializer_v3
 /** @brief Writes an old-style, sorted header with minimal information */
 #define EXR_CONTEXT_FLAG_WRITE_LEGACY_HEADER (1 << 3)
 
+/** @brief Memory map the file when reading using the default file
+ * implementation.
+ *
+ * The file is mapped read-only into the address space of the
+ * process, and the default decode routines will then use the mapped
+ * chunk data in place instead of reading it into an intermediate
+ * buffer. The \c packed_buffer of a decode pipeline may then point
+ * into the mapping, indicated by a \c packed_alloc_size of 0, and
+ * must not be freed or adopted by the caller.
+ *
+ * The file should not be truncated while the context is open. If the
+ * mapping cannot be established, reads fall back to the normal
+ * I/O. This is ignored when a custom read function is provided, and
+ * is only valid for reading contexts.
+ */
+#define EXR_CONTEXT_FLAG_MEMORY_MAP_READ (1 << 4)
+
 /* clang-format off */
 /** @brief Simple macro to initialize the context initializer with default values. */
 #define EXR_DEFAULT_CONTEXT_INITIALIZER                                        \
-    { sizeof (exr_context_initializer_t), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -2, -1.f, 0, { 0, 0, 0, 0 } }
+    { sizeof (exr_context_initializer_t), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -2, -1.f, 0, { 0, 0, 0, 0 }, 0 }
 /* clang-format on */
 
 /** @} */ /* context function pointer declarations */
@@ -54,6 +54,26 @@ extern "C" {
  */
 #define EXR_DECODE_SAMPLE_DATA_ONLY ((uint16_t) (1 << 2))
 
+/** Can be bit-wise or'ed into the decode_flags in the decode pipeline.
+ *
+ * Like \ref EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS, but with one
+ * pointer per line of the chunk instead of one per pixel. The samples
+ * of all the pixels of a line are written one after the other
+ * starting at that line's pointer (if not `NULL`), each taking
+ * user_bytes_per_element bytes, so a whole line is converted in one
+ * go. The user_line_stride is used to advance between the line
+ * pointers, user_pixel_stride is ignored.
+ *
+ * This suits output where each channel keeps all its samples in one
+ * block, addressed through a table of per pixel sample offsets: the
+ * pointer for a line is the block base plus the offset of the first
+ * pixel of the line in the chunk.
+ *
+ * Takes precedence over \ref EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS
+ * when both are set.
+ */
+#define EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS ((uint16_t) (1 << 3))
+
 /**
  * Struct meant to be used on a per-thread basis for reading exr data
  *
@@ -327,6 +347,94 @@ EXR_EXPORT
 exr_result_t
 exr_decoding_destroy (exr_const_context_t ctxt, exr_decode_pipeline_t* decode);
 
+/** @brief Opaque queue of decode pipelines run in submission order.
+ *
+ * A single threaded reader can keep several chunks in flight: each
+ * submitted pipeline immediately advises the file it will be read,
+ * so for the default file implementation the operating system
+ * fetches those bytes in the background while earlier pipelines are
+ * decompressed and unpacked by exr_decoding_queue_poll(). Custom
+ * streams behave the same, just without the read ahead.
+ *
+ * A queue is not thread-safe, it is intended to be driven by one
+ * thread. Use separate pipelines (and so separate output buffers)
+ * for every chunk in flight.
+ */
+typedef struct _priv_exr_decoding_queue* exr_decoding_queue_t;
+
+/** Create a queue holding up to \p depth pipelines for the part. */
+EXR_EXPORT
+exr_result_t exr_decoding_queue_create (
+    exr_const_context_t   ctxt,
+    int                   part_index,
+    int                   depth,
+    exr_decoding_queue_t* queue);
+
+/** Add a pipeline to the queue.
+ *
+ * The pipeline must be ready to be passed to exr_decoding_run(),
+ * that is initialized (or updated) for its chunk with the routines
+ * chosen and the channel outputs set. It is owned by the queue until
+ * returned by exr_decoding_queue_poll(). Returns
+ * EXR_ERR_ARGUMENT_OUT_OF_RANGE if the queue already holds \p depth
+ * pipelines.
+ */
+EXR_EXPORT
+exr_result_t exr_decoding_queue_submit (
+    exr_decoding_queue_t queue, exr_decode_pipeline_t* decode);
+
+/** Run the oldest pipeline in the queue and return it in \p done.
+ *
+ * The result is that of exr_decoding_run() for that pipeline, which
+ * is returned in \p done even on failure. If the queue is empty,
+ * \p done is set to `NULL` and EXR_ERR_SUCCESS returned.
+ */
+EXR_EXPORT
+exr_result_t exr_decoding_queue_poll (
+    exr_decoding_queue_t queue, exr_decode_pipeline_t** done);
+
+/** Free the queue. Pipelines still pending are not run, and remain
+ * owned (and to be destroyed) by the caller.
+ */
+EXR_EXPORT
+exr_result_t exr_decoding_queue_destroy (exr_decoding_queue_t* queue);
+
+/** Statistics for the pool of decode pipeline buffers owned by a context.
+ *
+ * When a decode pipeline does not provide custom \c alloc_fn /
+ * \c free_fn routines, the intermediate buffers (packed, unpacked,
+ * scratch and sample count buffers) are checked out of and back in to
+ * a thread-safe pool owned by the context, keyed by buffer id and
+ * size class. Pipelines on any thread then re-use previously
+ * allocated memory instead of repeatedly allocating and freeing it
+ * for every chunk.
+ */
+typedef struct
+{
+    uint64_t requests;     /**< Buffers requested by decode pipelines. */
+    uint64_t hits;         /**< Requests satisfied by a pooled buffer. */
+    uint64_t returns;      /**< Buffers released back to the pool. */
+    uint64_t discards;     /**< Released buffers freed as the pool was full. */
+    uint64_t cached_bytes; /**< Bytes currently held by the pool. */
+    uint64_t limit;        /**< Maximum number of bytes held by the pool. */
+} exr_decode_buffer_pool_stats_t;
+
+/** Retrieve the statistics of the decode buffer pool of the
+ * context. The hit rate is \c hits / \c requests.
+ */
+EXR_EXPORT
+exr_result_t exr_get_decode_buffer_pool_stats (
+    exr_const_context_t ctxt, exr_decode_buffer_pool_stats_t* stats);
+
+/** Set the maximum number of bytes the decode buffer pool of the
+ * context holds on to (128 MiB by default). Buffers released beyond
+ * that are freed, and any currently pooled beyond the new limit are
+ * freed immediately. A limit of 0 disables the pool.
+ */
+EXR_EXPORT
+exr_result_t
+exr_set_decode_buffer_pool_limit (exr_context_t ctxt, uint64_t maxbytes);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -277,6 +277,21 @@ typedef struct _exr_encode_pipeline
      * this being used.
      */
     exr_coding_channel_info_t _quick_chan_store[5];
+
+    /** Hint for the number of threads the deflate step of a single
+     * chunk may use (ZIP, ZIPS, PXR24 and the deflate parts of DWAA /
+     * DWAB).
+     *
+     * 0 or 1 compresses on the calling thread. Larger values allow big
+     * chunks to be split into independently deflated segments which are
+     * joined into one standard zlib stream, so the file format does not
+     * change, although the result is slightly larger than a single
+     * threaded compression. This is reset by exr_encoding_initialize(),
+     * so set it afterwards. It is only honored if the pipeline was
+     * declared with \ref EXR_ENCODE_PIPELINE_INITIALIZER, which tags it
+     * with the size of this struct.
+     */
+    int32_t intra_chunk_threads;
 } exr_encode_pipeline_t;
 
 /** @brief Simple macro to initialize an empty decode pipeline. */
@@ -343,6 +358,89 @@ EXR_EXPORT
 exr_result_t exr_encoding_destroy (
     exr_const_context_t ctxt, exr_encode_pipeline_t* encode_pipe);
 
+/** Callback used by exr_select_compression() to point the channels of
+ * a trial encode at the pixels of the chunk described by
+ * `encode_pipe->chunk`, which is filled in the same way
+ * exr_write_scanline_chunk_info() or exr_write_tile_chunk_info() would.
+ *
+ * This is expected to fill in the same fields as one would before
+ * calling exr_encoding_run() when writing that chunk
+ * (`encode_from_ptr`, `user_pixel_stride`, `user_line_stride`,
+ * `user_data_type` and `user_bytes_per_element`).
+ */
+typedef exr_result_t (*exr_sample_chunk_func_t) (
+    void* userdata, exr_encode_pipeline_t* encode_pipe);
+
+/** Settings for exr_select_compression(). */
+typedef struct _exr_compression_selector
+{
+    /** Compression methods to try, in order of preference when two
+     * give the same size. If `NULL`, the lossless methods RLE, ZIPS,
+     * ZIP and PIZ are tried. */
+    const exr_compression_t* candidates;
+    /** Number of entries in candidates. */
+    int32_t candidate_count;
+    /** Number of places, evenly spread over the part, to trial
+     * compress with each candidate. Each is a tile, or for scanline
+     * parts as many scanlines as the tallest chunk of the candidates,
+     * so all candidates see the same pixels. 0 uses a default of 4. */
+    int32_t sample_chunks;
+    /** Slowest acceptable encode throughput, in MB/s (10^6 bytes per
+     * second) of unpacked pixel data. 0 just picks the smallest
+     * result. */
+    float min_mb_per_sec;
+
+    /** Fills in the channel pointers of each trial encode, required. */
+    exr_sample_chunk_func_t sample_fn;
+    /** Passed to sample_fn. */
+    void* userdata;
+} exr_compression_selector_t;
+
+/** Measurement of one candidate of exr_select_compression(). */
+typedef struct _exr_compression_trial
+{
+    exr_compression_t compression;
+    /** EXR_ERR_SUCCESS, or why this candidate could not be used. */
+    exr_result_t result;
+    /** Unpacked bytes of the sampled chunks. */
+    uint64_t unpacked_bytes;
+    /** Bytes the sampled chunks took once compressed. */
+    uint64_t packed_bytes;
+    /** Measured throughput of packing and compressing the samples. */
+    double mb_per_sec;
+} exr_compression_trial_t;
+
+/** @brief Pick a compression method for a part by trial compressing
+ * some of its chunks.
+ *
+ * This must be called while defining the header of a scanline or tiled
+ * part (i.e. before exr_write_header()), once the channels, data window
+ * and any tile description are set. Each candidate compresses the
+ * sampled areas in a temporary context, with the zip / dwa levels and
+ * dwa channel rules of the part. The candidate giving the smallest result whose
+ * throughput meets selector->min_mb_per_sec wins, and is set as the
+ * compression of the part. When no candidate is fast enough, the part
+ * is left uncompressed.
+ *
+ * The timings are wall clock times on the calling thread, so are only
+ * as stable as the machine is quiet.
+ *
+ * @param ctxt Context being written
+ * @param part_index Part to choose the compression for
+ * @param selector Candidates, budget and pixel source
+ * @param chosen Optional, receives the chosen compression
+ * @param trials Optional, receives a measurement per candidate, so
+ *        must have room for selector->candidate_count entries (or 4 when
+ *        using the default candidates)
+ */
+EXR_EXPORT
+exr_result_t exr_select_compression (
+    exr_context_t                     ctxt,
+    int                               part_index,
+    const exr_compression_selector_t* selector,
+    exr_compression_t*                chosen,
+    exr_compression_trial_t*          trials);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
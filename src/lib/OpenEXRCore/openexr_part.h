@@ -234,6 +234,64 @@ EXR_EXPORT exr_result_t exr_get_dwa_compression_level (
 EXR_EXPORT exr_result_t
 exr_set_dwa_compression_level (exr_context_t ctxt, int part_index, float level);
 
+/** Enum declaring how DWAA/DWAB compresses a channel (see
+ * \ref exr_add_dwa_channel_rule).
+ *
+ * The values are stored in the channel rules of each DWA chunk, so
+ * they can not be changed.
+ */
+typedef enum exr_dwa_channel_scheme
+{
+    EXR_DWA_CHANNEL_UNKNOWN = 0, /**< Lossless, deflated along with any
+                                  * other unclassified channels */
+    EXR_DWA_CHANNEL_LOSSY_DCT, /**< Lossy DCT, half and float only */
+    EXR_DWA_CHANNEL_RLE, /**< Lossless run length encoding of the bytes,
+                          * cheap and effective for flat data */
+    EXR_DWA_CHANNEL_LAST_TYPE /**< Invalid value, provided for range checking. */
+} exr_dwa_channel_scheme_t;
+
+/** @brief Add a rule to decide how DWAA/DWAB compresses some channels
+ * of the specified part.
+ *
+ * DWA classifies each channel by the suffix of the channel name (the
+ * portion after the last '.', or the whole name when there is no '.')
+ * and the pixel type. By default, R, G, B, Y, RY and BY are lossy,
+ * A is run length encoded, and everything else is losslessly deflated.
+ * A rule added here takes precedence over the default rule for the
+ * same suffix and type, and over any rule added before it. So a
+ * writer can send flat utility channels through the cheaper RLE
+ * path, or keep a channel named R lossless.
+ *
+ * The rules which match a channel are stored in every chunk, so any
+ * reader supporting DWA decodes the file without knowing about
+ * them. Rules added here never take part in the RGB to Y'CbCr
+ * conversion.
+ *
+ * Like the compression level, the rules only exist for the lifetime
+ * of the context, and so must be added before the chunks are written.
+ *
+ * @param ctxt Context to modify
+ * @param part_index Part to modify
+ * @param suffix Channel name suffix to match, up to 128 characters and
+ *        not containing a '.'
+ * @param type Pixel type of the channels to match
+ * @param scheme Compression to use for the matching channels
+ * @param case_insensitive Non-zero to ignore case when matching the suffix
+ */
+EXR_EXPORT exr_result_t exr_add_dwa_channel_rule (
+    exr_context_t            ctxt,
+    int                      part_index,
+    const char*              suffix,
+    exr_pixel_type_t         type,
+    exr_dwa_channel_scheme_t scheme,
+    int                      case_insensitive);
+
+/** @brief Remove any rules added with \ref exr_add_dwa_channel_rule
+ * for the specified part, restoring the default classification.
+ */
+EXR_EXPORT exr_result_t
+exr_clear_dwa_channel_rules (exr_context_t ctxt, int part_index);
+
 /**************************************/
 
 /** @defgroup PartMetadata Functions to get and set metadata for a particular part.
@@ -7,6 +7,122 @@
 
 #include "internal_coding.h"
 #include "internal_xdr.h"
+#include "internal_cpuid.h"
+
+#include <string.h>
+
+/**************************************/
+
+#if (defined(__x86_64__) || defined(_M_X64))
+#    if defined(__AVX__) && defined(__F16C__) && (defined(__GNUC__) || defined(__clang__))
+#        define USE_F16C_INTRINSICS
+#    elif (defined(__GNUC__) || defined(__clang__))
+#        define ENABLE_F16C_TEST
+#    endif
+#endif
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) &&      \
+    !EXR_HOST_IS_NOT_LITTLE_ENDIAN
+#    define USE_NEON_HALF_INTRINSICS
+#    include <arm_neon.h>
+#endif
+
+/*
+ * The hardware conversions round to nearest even like float_to_half,
+ * but quiet a signaling NaN instead of keeping its payload, so any
+ * vector holding a NaN is redone with the scalar routine to keep the
+ * output bit-identical regardless of cpu.
+ */
+#if defined(USE_F16C_INTRINSICS) || defined(ENABLE_F16C_TEST)
+#    if defined(USE_F16C_INTRINSICS)
+static inline void
+float_to_half_buffer (uint16_t* out, const float* in, int w)
+#    elif defined(ENABLE_F16C_TEST)
+__attribute__ ((target ("f16c"))) static void
+float_to_half_buffer_f16c (uint16_t* out, const float* in, int w)
+#    endif
+{
+    while (w >= 8)
+    {
+        __m256 v = _mm256_loadu_ps (in);
+        if (_mm256_movemask_ps (_mm256_cmp_ps (v, v, _CMP_UNORD_Q)) == 0)
+        {
+            _mm_storeu_si128 (
+                (__m128i*) out,
+                _mm256_cvtps_ph (v, _MM_FROUND_TO_NEAREST_INT));
+        }
+        else
+        {
+            for (int x = 0; x < 8; ++x)
+                out[x] = float_to_half (in[x]);
+        }
+        out += 8;
+        in += 8;
+        w -= 8;
+    }
+    while (w > 0)
+    {
+        *out++ = float_to_half (*in++);
+        --w;
+    }
+}
+#endif
+
+#ifdef ENABLE_F16C_TEST
+static void
+float_to_half_buffer_impl (uint16_t* out, const float* in, int w)
+{
+    for (int x = 0; x < w; ++x)
+        out[x] = float_to_half (in[x]);
+}
+
+static void (*float_to_half_buffer) (uint16_t*, const float*, int) =
+    &float_to_half_buffer_impl;
+
+static inline void
+choose_float_to_half_impl (void)
+{
+    if (has_native_half ())
+        float_to_half_buffer = &float_to_half_buffer_f16c;
+}
+#elif defined(USE_F16C_INTRINSICS)
+/* when we explicitly compile against f16, force it in, do not need a chooser */
+static inline void
+choose_float_to_half_impl (void)
+{}
+#else
+static inline void
+float_to_half_buffer (uint16_t* out, const float* in, int w)
+{
+#    if defined(USE_NEON_HALF_INTRINSICS)
+    while (w >= 4)
+    {
+        float32x4_t v = vld1q_f32 (in);
+        if (vminvq_u32 (vceqq_f32 (v, v)) != 0)
+        {
+            vst1_u16 (out, vreinterpret_u16_f16 (vcvt_f16_f32 (v)));
+        }
+        else
+        {
+            for (int x = 0; x < 4; ++x)
+                out[x] = float_to_half (in[x]);
+        }
+        out += 4;
+        in += 4;
+        w -= 4;
+    }
+#    endif
+    while (w > 0)
+    {
+        *out++ = float_to_half (*in++);
+        --w;
+    }
+}
+
+static inline void
+choose_float_to_half_impl (void)
+{}
+#endif
 
 /**************************************/
 
@@ -187,11 +303,340 @@ default_pack (exr_encode_pipeline_t* encode)
     return EXR_ERR_SUCCESS;
 }
 
+#if !EXR_HOST_IS_NOT_LITTLE_ENDIAN
+
+/* the packed buffer is little endian, so the fast paths below can
+ * store native values directly */
+
+/**************************************/
+
+static exr_result_t
+pack_planar_copy (exr_encode_pipeline_t* encode)
+{
+    /* no type change, no subsampling, every channel tightly packed */
+    uint8_t* dstbuffer    = encode->packed_buffer;
+    uint64_t packed_bytes = 0;
+    uint64_t chan_bytes;
+
+    for (int y = 0; y < encode->chunk.height; ++y)
+    {
+        for (int c = 0; c < encode->channel_count; ++c)
+        {
+            exr_coding_channel_info_t* encc = (encode->channels + c);
+
+            if (encc->height == 0) continue;
+
+            chan_bytes = (uint64_t) (encc->width) *
+                         (uint64_t) (encc->bytes_per_element);
+            memcpy (
+                dstbuffer,
+                encc->encode_from_ptr +
+                    (uint64_t) y * (uint64_t) encc->user_line_stride,
+                chan_bytes);
+            dstbuffer += chan_bytes;
+            packed_bytes += chan_bytes;
+        }
+    }
+
+    encode->packed_bytes = packed_bytes;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+static exr_result_t
+pack_16bit_3chan_interleave (exr_encode_pipeline_t* encode)
+{
+    /* we know we're packing all the channels and there is no subsampling */
+    uint8_t*        dstbuffer = encode->packed_buffer;
+    const uint8_t*  in0;
+    const uint16_t* src;
+    uint16_t *      out0, *out1, *out2;
+    int             w, h;
+    int             linc0;
+
+    w     = encode->channels[0].width;
+    h     = encode->chunk.height;
+    linc0 = encode->channels[0].user_line_stride;
+
+    in0 = encode->channels[0].encode_from_ptr;
+
+    for (int y = 0; y < h; ++y)
+    {
+        src  = (const uint16_t*) in0;
+        out0 = (uint16_t*) dstbuffer;
+        out1 = out0 + w;
+        out2 = out1 + w;
+
+        dstbuffer += (int64_t) w * 6; // 3 * sizeof(uint16_t), avoid type conversion
+        for (int x = 0; x < w; ++x)
+        {
+            out0[x] = src[0];
+            out1[x] = src[1];
+            out2[x] = src[2];
+            src += 3;
+        }
+        in0 += linc0;
+    }
+
+    encode->packed_bytes = (uint64_t) h * (uint64_t) w * 6;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+static exr_result_t
+pack_16bit_4chan_interleave (exr_encode_pipeline_t* encode)
+{
+    /* we know we're packing all the channels and there is no subsampling */
+    uint8_t*        dstbuffer = encode->packed_buffer;
+    const uint8_t*  in0;
+    const uint16_t* src;
+    uint16_t *      out0, *out1, *out2, *out3;
+    int             w, h;
+    int             linc0;
+
+    w     = encode->channels[0].width;
+    h     = encode->chunk.height;
+    linc0 = encode->channels[0].user_line_stride;
+
+    in0 = encode->channels[0].encode_from_ptr;
+
+    for (int y = 0; y < h; ++y)
+    {
+        src  = (const uint16_t*) in0;
+        out0 = (uint16_t*) dstbuffer;
+        out1 = out0 + w;
+        out2 = out1 + w;
+        out3 = out2 + w;
+
+        dstbuffer += (int64_t) w * 8; // 4 * sizeof(uint16_t), avoid type conversion
+        for (int x = 0; x < w; ++x)
+        {
+            out0[x] = src[0];
+            out1[x] = src[1];
+            out2[x] = src[2];
+            out3[x] = src[3];
+            src += 4;
+        }
+        in0 += linc0;
+    }
+
+    encode->packed_bytes = (uint64_t) h * (uint64_t) w * 8;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+/* floats converted at a time by the float to half packers */
+#define PACK_HALF_BLOCK 256
+
+static exr_result_t
+pack_float_to_half_interleave (exr_encode_pipeline_t* encode)
+{
+    /* we know we're packing all the channels (3 or 4) of an
+     * interleaved float buffer and there is no subsampling, so
+     * convert the contiguous run of floats then split it out */
+    uint8_t*       dstbuffer = encode->packed_buffer;
+    const uint8_t* in0;
+    uint16_t       hbuf[PACK_HALF_BLOCK];
+    uint16_t*      out[4];
+    int            w, h, nc, bw;
+    int            linc0;
+
+    nc    = encode->channel_count;
+    w     = encode->channels[0].width;
+    h     = encode->chunk.height;
+    linc0 = encode->channels[0].user_line_stride;
+
+    in0 = encode->channels[0].encode_from_ptr;
+
+    for (int y = 0; y < h; ++y)
+    {
+        const float* src = (const float*) in0;
+
+        for (int c = 0; c < nc; ++c)
+            out[c] = ((uint16_t*) dstbuffer) + (int64_t) c * w;
+
+        for (int x = 0; x < w; x += bw)
+        {
+            bw = w - x;
+            if (bw > PACK_HALF_BLOCK / 4) bw = PACK_HALF_BLOCK / 4;
+
+            float_to_half_buffer (hbuf, src, bw * nc);
+            src += bw * nc;
+
+            if (nc == 4)
+            {
+                for (int p = 0; p < bw; ++p)
+                {
+                    out[0][x + p] = hbuf[p * 4 + 0];
+                    out[1][x + p] = hbuf[p * 4 + 1];
+                    out[2][x + p] = hbuf[p * 4 + 2];
+                    out[3][x + p] = hbuf[p * 4 + 3];
+                }
+            }
+            else
+            {
+                for (int p = 0; p < bw; ++p)
+                {
+                    out[0][x + p] = hbuf[p * 3 + 0];
+                    out[1][x + p] = hbuf[p * 3 + 1];
+                    out[2][x + p] = hbuf[p * 3 + 2];
+                }
+            }
+        }
+
+        dstbuffer += (int64_t) w * nc * 2;
+        in0 += linc0;
+    }
+
+    encode->packed_bytes = (uint64_t) h * (uint64_t) w * (uint64_t) nc * 2;
+    return EXR_ERR_SUCCESS;
+}
+
+/**************************************/
+
+static exr_result_t
+pack_float_to_half (exr_encode_pipeline_t* encode)
+{
+    /* all channels float to half, any strides, no subsampling */
+    uint8_t* dstbuffer = encode->packed_buffer;
+    float    fbuf[PACK_HALF_BLOCK];
+    int      w, h, ubpc, bw;
+
+    w = encode->channels[0].width;
+    h = encode->chunk.height;
+
+    for (int y = 0; y < h; ++y)
+    {
+        for (int c = 0; c < encode->channel_count; ++c)
+        {
+            exr_coding_channel_info_t* encc = (encode->channels + c);
+            const uint8_t*             cdata;
+            uint16_t*                  dst = (uint16_t*) dstbuffer;
+
+            ubpc  = encc->user_pixel_stride;
+            cdata = encc->encode_from_ptr +
+                    (uint64_t) y * (uint64_t) encc->user_line_stride;
+
+            if (ubpc == 4)
+            {
+                float_to_half_buffer (dst, (const float*) cdata, w);
+            }
+            else
+            {
+                for (int x = 0; x < w; x += bw)
+                {
+                    bw = w - x;
+                    if (bw > PACK_HALF_BLOCK) bw = PACK_HALF_BLOCK;
+                    for (int p = 0; p < bw; ++p)
+                    {
+                        fbuf[p] = *((const float*) cdata);
+                        cdata += ubpc;
+                    }
+                    float_to_half_buffer (dst + x, fbuf, bw);
+                }
+            }
+            dstbuffer += (int64_t) w * 2;
+        }
+    }
+
+    encode->packed_bytes =
+        (uint64_t) h * (uint64_t) w * (uint64_t) encode->channel_count * 2;
+    return EXR_ERR_SUCCESS;
+}
+
+#endif /* !EXR_HOST_IS_NOT_LITTLE_ENDIAN */
+
+/**************************************/
+
 internal_exr_pack_fn
 internal_exr_match_encode (exr_encode_pipeline_t* encode, int isdeep)
 {
-    (void) encode;
+#ifdef EXR_HAS_STD_ATOMICS
+    static atomic_int init_cpu_check = 1;
+#else
+    static int init_cpu_check = 1;
+#endif
+    int            hassampling = 0, hastypechange = 0, tightlypacked = 1;
+    int            halffromfloat = 1, samebpc = 0, sameoutinc = 0;
+    int            simpinterleave = 1;
+    const uint8_t* interleaveptr  = NULL;
+
+    if (init_cpu_check)
+    {
+        choose_float_to_half_impl ();
+        init_cpu_check = 0;
+    }
+
     if (isdeep) return &default_pack_deep;
 
+    for (int c = 0; c < encode->channel_count; ++c)
+    {
+        const exr_coding_channel_info_t* encc = (encode->channels + c);
+
+        if (encc->x_samples != 1 || encc->y_samples != 1) hassampling = 1;
+        if (encc->user_data_type != encc->data_type) hastypechange = 1;
+        if (encc->user_pixel_stride != encc->bytes_per_element)
+            tightlypacked = 0;
+        if (encc->data_type != EXR_PIXEL_HALF ||
+            encc->user_data_type != EXR_PIXEL_FLOAT)
+            halffromfloat = 0;
+
+        if (samebpc == 0)
+            samebpc = encc->bytes_per_element;
+        else if (samebpc != encc->bytes_per_element)
+            samebpc = -1;
+
+        if (sameoutinc == 0)
+            sameoutinc = encc->user_pixel_stride;
+        else if (sameoutinc != encc->user_pixel_stride)
+            sameoutinc = -1;
+
+        if (c == 0)
+            interleaveptr = encc->encode_from_ptr;
+        else if (
+            !interleaveptr ||
+            encc->encode_from_ptr !=
+                (interleaveptr + c * encc->user_bytes_per_element) ||
+            encc->user_line_stride != encode->channels[0].user_line_stride)
+            simpinterleave = 0;
+    }
+
+    if (hassampling || encode->channel_count == 0) return &default_pack;
+
+#if !EXR_HOST_IS_NOT_LITTLE_ENDIAN
+    if (!hastypechange)
+    {
+        if (tightlypacked) return &pack_planar_copy;
+
+        if (samebpc == 2 && simpinterleave &&
+            sameoutinc == 2 * encode->channel_count)
+        {
+            if (encode->channel_count == 4)
+                return &pack_16bit_4chan_interleave;
+            if (encode->channel_count == 3)
+                return &pack_16bit_3chan_interleave;
+        }
+        return &default_pack;
+    }
+
+    if (halffromfloat)
+    {
+        if (simpinterleave && sameoutinc == 4 * encode->channel_count &&
+            (encode->channel_count == 4 || encode->channel_count == 3))
+            return &pack_float_to_half_interleave;
+        return &pack_float_to_half;
+    }
+#else
+    (void) hastypechange;
+    (void) tightlypacked;
+    (void) halffromfloat;
+    (void) samebpc;
+    (void) sameoutinc;
+    (void) simpinterleave;
+#endif
+
     return &default_pack;
 }
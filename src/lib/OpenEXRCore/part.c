@@ -627,3 +627,111 @@ exr_set_dwa_compression_level (exr_context_t ctxt, int part_index, float level)
 
     return EXR_UNLOCK_AND_RETURN (rv);
 }
+
+/**************************************/
+
+exr_result_t
+exr_add_dwa_channel_rule (
+    exr_context_t            ctxt,
+    int                      part_index,
+    const char*              suffix,
+    exr_pixel_type_t         type,
+    exr_dwa_channel_scheme_t scheme,
+    int                      case_insensitive)
+{
+    internal_exr_dwa_channel_rule_t* nrules;
+    char*                            nsuffix;
+    size_t                           len;
+    EXR_LOCK_AND_DEFINE_PART (part_index);
+
+    if (ctxt->mode != EXR_CONTEXT_WRITE && ctxt->mode != EXR_CONTEXT_TEMPORARY)
+        return EXR_UNLOCK_AND_RETURN (
+            ctxt->standard_error (ctxt, EXR_ERR_NOT_OPEN_WRITE));
+
+    if (!suffix || suffix[0] == '\0')
+        return EXR_UNLOCK_AND_RETURN (ctxt->report_error (
+            ctxt, EXR_ERR_INVALID_ARGUMENT, "Missing dwa channel rule suffix"));
+
+    /* the suffix is compared against the portion after the last '.',
+     * and readers only accept up to 128 characters */
+    len = strlen (suffix);
+    if (len > 128 || strchr (suffix, '.'))
+        return EXR_UNLOCK_AND_RETURN (ctxt->print_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Invalid dwa channel rule suffix '%s'",
+            suffix));
+
+    if ((int) type < 0 || type >= EXR_PIXEL_LAST_TYPE)
+        return EXR_UNLOCK_AND_RETURN (ctxt->print_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Invalid pixel type (%d) for dwa channel rule",
+            (int) type));
+
+    if ((int) scheme < 0 || scheme >= EXR_DWA_CHANNEL_LAST_TYPE ||
+        (scheme == EXR_DWA_CHANNEL_LOSSY_DCT && type == EXR_PIXEL_UINT))
+        return EXR_UNLOCK_AND_RETURN (ctxt->print_error (
+            ctxt,
+            EXR_ERR_INVALID_ARGUMENT,
+            "Invalid dwa channel scheme (%d) for pixel type (%d)",
+            (int) scheme,
+            (int) type));
+
+    nrules = ctxt->alloc_fn (
+        sizeof (internal_exr_dwa_channel_rule_t) *
+        (size_t) (part->dwa_channel_rule_count + 1));
+    nsuffix = ctxt->alloc_fn (len + 1);
+    if (!nrules || !nsuffix)
+    {
+        if (nrules) ctxt->free_fn (nrules);
+        if (nsuffix) ctxt->free_fn (nsuffix);
+        return EXR_UNLOCK_AND_RETURN (
+            ctxt->standard_error (ctxt, EXR_ERR_OUT_OF_MEMORY));
+    }
+    memcpy (nsuffix, suffix, len + 1);
+
+    if (part->dwa_channel_rules)
+    {
+        memcpy (
+            nrules,
+            part->dwa_channel_rules,
+            sizeof (internal_exr_dwa_channel_rule_t) *
+                (size_t) part->dwa_channel_rule_count);
+        ctxt->free_fn (part->dwa_channel_rules);
+    }
+
+    nrules[part->dwa_channel_rule_count].suffix           = nsuffix;
+    nrules[part->dwa_channel_rule_count].type             = (uint8_t) type;
+    nrules[part->dwa_channel_rule_count].scheme           = (uint8_t) scheme;
+    nrules[part->dwa_channel_rule_count].case_insensitive =
+        case_insensitive ? 1 : 0;
+
+    part->dwa_channel_rules = nrules;
+    ++part->dwa_channel_rule_count;
+
+    return EXR_UNLOCK_AND_RETURN (EXR_ERR_SUCCESS);
+}
+
+/**************************************/
+
+exr_result_t
+exr_clear_dwa_channel_rules (exr_context_t ctxt, int part_index)
+{
+    EXR_LOCK_AND_DEFINE_PART (part_index);
+
+    if (ctxt->mode != EXR_CONTEXT_WRITE && ctxt->mode != EXR_CONTEXT_TEMPORARY)
+        return EXR_UNLOCK_AND_RETURN (
+            ctxt->standard_error (ctxt, EXR_ERR_NOT_OPEN_WRITE));
+
+    if (part->dwa_channel_rules)
+    {
+        for (int32_t r = 0; r < part->dwa_channel_rule_count; ++r)
+            ctxt->free_fn (part->dwa_channel_rules[r].suffix);
+        ctxt->free_fn (part->dwa_channel_rules);
+    }
+    part->dwa_channel_rules      = NULL;
+    part->dwa_channel_rule_count = 0;
+
+    return EXR_UNLOCK_AND_RETURN (EXR_ERR_SUCCESS);
+}
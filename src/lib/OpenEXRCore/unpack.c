@@ -13,7 +13,6 @@
 
 /**************************************/
 
-/* TODO: learn arm neon intrinsics for this */
 #if (defined(__x86_64__) || defined(_M_X64))
 #    if defined(__AVX__) && defined(__F16C__) && (defined(__GNUC__) || defined(__clang__))
 #        define USE_F16C_INTRINSICS
@@ -22,6 +21,13 @@
 #    endif
 #endif
 
+/* aarch64 always has the half conversion instructions, no chooser needed */
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) &&      \
+    !EXR_HOST_IS_NOT_LITTLE_ENDIAN
+#    define USE_NEON_HALF_INTRINSICS
+#    include <arm_neon.h>
+#endif
+
 #if defined(USE_F16C_INTRINSICS) || defined(ENABLE_F16C_TEST)
 #    if defined(USE_F16C_INTRINSICS)
 static inline void
@@ -78,6 +84,57 @@ half_to_float_buffer_f16c (float* out, const uint16_t* in, int w)
     }
 #    endif
 }
+
+/* convert into every stride bytes of out, e.g. one channel of an
+ * interleaved pixel struct, storing straight from the vector lanes */
+#    if defined(USE_F16C_INTRINSICS)
+static inline void
+half_to_float_strided (uint8_t* out, int stride, const uint16_t* in, int w)
+#    elif defined(ENABLE_F16C_TEST)
+__attribute__ ((target ("f16c"))) static void
+half_to_float_strided_f16c (
+    uint8_t* out, int stride, const uint16_t* in, int w)
+#    endif
+{
+    /* the stride is the caller's, so the destination may be
+     * unaligned: store each lane's bits with memcpy */
+    int32_t lane;
+    float   f;
+
+    while (w >= 8)
+    {
+        __m256 v  = _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i*) in));
+        __m128 lo = _mm256_castps256_ps128 (v);
+        __m128 hi = _mm256_extractf128_ps (v, 1);
+
+        lane = _mm_extract_ps (lo, 0);
+        memcpy (out, &lane, 4);
+        lane = _mm_extract_ps (lo, 1);
+        memcpy (out + stride, &lane, 4);
+        lane = _mm_extract_ps (lo, 2);
+        memcpy (out + 2 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_ps (lo, 3);
+        memcpy (out + 3 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_ps (hi, 0);
+        memcpy (out + 4 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_ps (hi, 1);
+        memcpy (out + 5 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_ps (hi, 2);
+        memcpy (out + 6 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_ps (hi, 3);
+        memcpy (out + 7 * (int64_t) stride, &lane, 4);
+        out += 8 * (int64_t) stride;
+        in += 8;
+        w -= 8;
+    }
+    while (w > 0)
+    {
+        f = half_to_float (*in++);
+        memcpy (out, &f, sizeof (float));
+        out += stride;
+        --w;
+    }
+}
 #endif
 
 #ifndef USE_F16C_INTRINSICS
@@ -145,13 +202,124 @@ half_to_float_buffer_impl (float* out, const uint16_t* in, int w)
     }
 }
 
+static void
+half_to_float_strided_impl (
+    uint8_t* out, int stride, const uint16_t* in, int w)
+{
+    for (int x = 0; x < w; ++x, out += stride)
+    {
+        float f = half_to_float (in[x]);
+        memcpy (out, &f, sizeof (float));
+    }
+}
+
+/*
+ * cpus with SSE4.1 but no F16C (older cores, and Atom class cores
+ * up to recent years) convert in software, four at a time. Normal,
+ * infinite and NaN halves only need their exponent rebiased, and a
+ * denormal is its mantissa times 2^-24, which a float holds exactly,
+ * so this matches half_to_float bit for bit.
+ */
+__attribute__ ((target ("sse4.1"))) static inline __m128i
+half_to_float4_sse41 (const uint16_t* in)
+{
+    const __m128i signmask = _mm_set1_epi32 (0x7fff);
+    const __m128i bias     = _mm_set1_epi32 (0x38000000);
+    const __m128i maxnorm  = _mm_set1_epi32 (0x7bff);
+    const __m128i minnorm  = _mm_set1_epi32 (0x0400);
+    const __m128  denscale = _mm_set1_ps (1.f / 16777216.f);
+    __m128i       h, em, sign, r, den;
+
+    h    = _mm_cvtepu16_epi32 (_mm_loadl_epi64 ((const __m128i*) in));
+    em   = _mm_and_si128 (h, signmask);
+    sign = _mm_slli_epi32 (_mm_xor_si128 (h, em), 16);
+    r    = _mm_add_epi32 (_mm_slli_epi32 (em, 13), bias);
+    /* infinities and NaNs take the exponent all the way to 255 */
+    r   = _mm_add_epi32 (r, _mm_and_si128 (_mm_cmpgt_epi32 (em, maxnorm), bias));
+    den = _mm_castps_si128 (_mm_mul_ps (_mm_cvtepi32_ps (em), denscale));
+    r   = _mm_blendv_epi8 (r, den, _mm_cmplt_epi32 (em, minnorm));
+    return _mm_or_si128 (r, sign);
+}
+
+__attribute__ ((target ("sse4.1"))) static void
+half_to_float_buffer_sse41 (float* out, const uint16_t* in, int w)
+{
+    while (w >= 4)
+    {
+        _mm_storeu_si128 ((__m128i*) out, half_to_float4_sse41 (in));
+        out += 4;
+        in += 4;
+        w -= 4;
+    }
+    while (w > 0)
+    {
+        *out++ = half_to_float (*in++);
+        --w;
+    }
+}
+
+__attribute__ ((target ("sse4.1"))) static void
+half_to_float_strided_sse41 (
+    uint8_t* out, int stride, const uint16_t* in, int w)
+{
+    int32_t lane;
+
+    while (w >= 4)
+    {
+        __m128i v = half_to_float4_sse41 (in);
+
+        /* memcpy, as the destination may be unaligned */
+        lane = _mm_extract_epi32 (v, 0);
+        memcpy (out, &lane, 4);
+        lane = _mm_extract_epi32 (v, 1);
+        memcpy (out + stride, &lane, 4);
+        lane = _mm_extract_epi32 (v, 2);
+        memcpy (out + 2 * (int64_t) stride, &lane, 4);
+        lane = _mm_extract_epi32 (v, 3);
+        memcpy (out + 3 * (int64_t) stride, &lane, 4);
+        out += 4 * (int64_t) stride;
+        in += 4;
+        w -= 4;
+    }
+    half_to_float_strided_impl (out, stride, in, w);
+}
+
+/* 16 at a time, the rest through the 8 wide F16C path */
+__attribute__ ((target ("avx512f,f16c"))) static void
+half_to_float_buffer_avx512 (float* out, const uint16_t* in, int w)
+{
+    while (w >= 16)
+    {
+        _mm512_storeu_ps (
+            out, _mm512_cvtph_ps (_mm256_loadu_si256 ((const __m256i*) in)));
+        out += 16;
+        in += 16;
+        w -= 16;
+    }
+    if (w > 0) half_to_float_buffer_f16c (out, in, w);
+}
+
 static void (*half_to_float_buffer) (float*, const uint16_t*, int) =
     &half_to_float_buffer_impl;
 
+static void (*half_to_float_strided) (uint8_t*, int, const uint16_t*, int) =
+    &half_to_float_strided_impl;
+
 static inline void
 choose_half_to_float_impl (void)
 {
-    if (has_native_half ()) half_to_float_buffer = &half_to_float_buffer_f16c;
+    if (has_native_half ())
+    {
+        half_to_float_buffer  = &half_to_float_buffer_f16c;
+        half_to_float_strided = &half_to_float_strided_f16c;
+        if (has_avx512bw ())
+            half_to_float_buffer = &half_to_float_buffer_avx512;
+    }
+    else if (has_sse41 ())
+    {
+        half_to_float_buffer  = &half_to_float_buffer_sse41;
+        half_to_float_strided = &half_to_float_strided_sse41;
+    }
 }
 
 #endif /* ENABLE_F16C_TEST */
@@ -164,6 +332,28 @@ half_to_float_buffer (float* out, const uint16_t* in, int w)
 #    if EXR_HOST_IS_NOT_LITTLE_ENDIAN
     for (int x = 0; x < w; ++x)
         out[x] = half_to_float (one_to_native16 (in[x]));
+#    elif defined(USE_NEON_HALF_INTRINSICS)
+    while (w >= 8)
+    {
+        float16x8_t h = vreinterpretq_f16_u16 (vld1q_u16 (in));
+        vst1q_f32 (out, vcvt_f32_f16 (vget_low_f16 (h)));
+        vst1q_f32 (out + 4, vcvt_high_f32_f16 (h));
+        out += 8;
+        in += 8;
+        w -= 8;
+    }
+    if (w >= 4)
+    {
+        vst1q_f32 (out, vcvt_f32_f16 (vreinterpret_f16_u16 (vld1_u16 (in))));
+        out += 4;
+        in += 4;
+        w -= 4;
+    }
+    while (w > 0)
+    {
+        *out++ = half_to_float (*in++);
+        --w;
+    }
 #    else
     while (w >= 8)
     {
@@ -204,6 +394,23 @@ half_to_float_buffer (float* out, const uint16_t* in, int w)
 #    endif
 }
 
+static inline void
+half_to_float_strided (uint8_t* out, int stride, const uint16_t* in, int w)
+{
+    float fbuf[8];
+
+    while (w > 0)
+    {
+        int n = w < 8 ? w : 8;
+
+        half_to_float_buffer (fbuf, in, n);
+        for (int x = 0; x < n; ++x, out += stride)
+            memcpy (out, fbuf + x, sizeof (float));
+        in += n;
+        w -= n;
+    }
+}
+
 static void
 choose_half_to_float_impl (void)
 {}
@@ -1291,6 +1498,92 @@ generic_unpack (exr_decode_pipeline_t* decode)
     return EXR_ERR_SUCCESS;
 }
 
+/* pixels per channel converted at a time by unpack_nchan, small
+ * enough that one block of every channel of an interleaved output
+ * line stays in cache */
+#define UNPACK_NCHAN_BLOCK 64
+
+static exr_result_t
+unpack_nchan (exr_decode_pipeline_t* decode)
+{
+    /* no subsampling, so every channel has the same width and each
+     * line of the unpacked buffer is all channels back to back. Walk
+     * the line in blocks across all channels instead of a channel at
+     * a time, handing contiguous runs to the vector conversions */
+    const uint8_t* srcline = decode->unpacked_buffer;
+    uint8_t*       cdata;
+    int            w, h, bw, bpc, ubpc, uls;
+    int64_t        linebytes = 0;
+
+    uls = decode->user_line_begin_skip;
+    h   = decode->chunk.height - decode->user_line_end_ignore;
+    w   = decode->channels[0].width;
+
+    for (int c = 0; c < decode->channel_count; ++c)
+        linebytes += (int64_t) w * decode->channels[c].bytes_per_element;
+
+    srcline += (int64_t) uls * linebytes;
+    for (int y = uls; y < h; ++y, srcline += linebytes)
+    {
+        for (int x = 0; x < w; x += UNPACK_NCHAN_BLOCK)
+        {
+            const uint8_t* chansrc = srcline;
+
+            bw = w - x;
+            if (bw > UNPACK_NCHAN_BLOCK) bw = UNPACK_NCHAN_BLOCK;
+
+            for (int c = 0; c < decode->channel_count;
+                 ++c, chansrc += (int64_t) w * bpc)
+            {
+                exr_coding_channel_info_t* decc = (decode->channels + c);
+                const uint8_t*             srcbuffer;
+
+                bpc   = decc->bytes_per_element;
+                ubpc  = decc->user_pixel_stride;
+                cdata = decc->decode_to_ptr;
+                if (!cdata) continue;
+
+                cdata += ((uint64_t) (y - uls)) *
+                         ((uint64_t) decc->user_line_stride);
+                cdata += (int64_t) x * ubpc;
+                srcbuffer = chansrc + (int64_t) x * bpc;
+
+#if EXR_HOST_IS_NOT_LITTLE_ENDIAN
+                {
+                    UNPACK_SAMPLES (bw)
+                }
+#else
+                if (decc->data_type == decc->user_data_type &&
+                    bpc == ubpc)
+                {
+                    memcpy (cdata, srcbuffer, (size_t) bw * (size_t) bpc);
+                }
+                else if (
+                    decc->data_type == EXR_PIXEL_HALF &&
+                    decc->user_data_type == EXR_PIXEL_FLOAT)
+                {
+                    if (ubpc == 4)
+                    {
+                        half_to_float_buffer (
+                            (float*) cdata, (const uint16_t*) srcbuffer, bw);
+                    }
+                    else
+                    {
+                        half_to_float_strided (
+                            cdata, ubpc, (const uint16_t*) srcbuffer, bw);
+                    }
+                }
+                else
+                {
+                    UNPACK_SAMPLES (bw)
+                }
+#endif
+            }
+        }
+    }
+    return EXR_ERR_SUCCESS;
+}
+
 #define PREPARE_SAMPLES(sampbuffer, prevsamps, decode)              \
                 int32_t samps = sampbuffer[x];                      \
                 if (0 == (decode->decode_flags &                    \
@@ -1507,6 +1800,79 @@ generic_unpack_deep_pointers (exr_decode_pipeline_t* decode)
     return EXR_ERR_SUCCESS;
 }
 
+static exr_result_t
+generic_unpack_deep_line_pointers (exr_decode_pipeline_t* decode)
+{
+    const uint8_t* srcbuffer  = decode->unpacked_buffer;
+    const int32_t* sampbuffer = decode->sample_count_table;
+    int            w, h, bpc, ubpc, uls;
+
+    w   = decode->chunk.width;
+    h   = decode->chunk.height - decode->user_line_end_ignore;
+    uls = decode->user_line_begin_skip;
+    for (int y = 0; y < h; ++y)
+    {
+        /*
+         * the samples of a line are contiguous per channel on disk,
+         * and in the output, so only the line total is needed
+         */
+        int32_t linesamps = 0;
+        if ((decode->decode_flags & EXR_DECODE_SAMPLE_COUNTS_AS_INDIVIDUAL))
+        {
+            for (int x = 0; x < w; ++x)
+                linesamps += sampbuffer[x];
+        }
+        else
+            linesamps = sampbuffer[w - 1];
+
+        for (int c = 0; c < decode->channel_count; ++c)
+        {
+            exr_coding_channel_info_t* decc = (decode->channels + c);
+            uint8_t*                   cdata;
+
+            bpc  = decc->bytes_per_element;
+            ubpc = decc->user_bytes_per_element;
+
+            if (y < uls || !decc->decode_to_ptr)
+            {
+                srcbuffer += ((size_t) bpc) * ((size_t) linesamps);
+                continue;
+            }
+
+            cdata = *((uint8_t**) (decc->decode_to_ptr +
+                                   ((size_t) y - uls) *
+                                       ((size_t) decc->user_line_stride)));
+            if (!cdata || linesamps == 0)
+            {
+                srcbuffer += ((size_t) bpc) * ((size_t) linesamps);
+                continue;
+            }
+
+#if !EXR_HOST_IS_NOT_LITTLE_ENDIAN
+            if (decc->data_type == decc->user_data_type && bpc == ubpc)
+            {
+                memcpy (
+                    cdata, srcbuffer, ((size_t) bpc) * ((size_t) linesamps));
+            }
+            else if (
+                decc->data_type == EXR_PIXEL_HALF &&
+                decc->user_data_type == EXR_PIXEL_FLOAT && ubpc == 4)
+            {
+                half_to_float_buffer (
+                    (float*) cdata, (const uint16_t*) srcbuffer, linesamps);
+            }
+            else
+#endif
+            {
+                UNPACK_SAMPLES (linesamps)
+            }
+            srcbuffer += ((size_t) bpc) * ((size_t) linesamps);
+        }
+        sampbuffer += w;
+    }
+    return EXR_ERR_SUCCESS;
+}
+
 static exr_result_t
 generic_unpack_deep (exr_decode_pipeline_t* decode)
 {
@@ -1716,11 +2082,23 @@ internal_exr_match_decode (
 
     if (isdeep)
     {
+        if ((decode->decode_flags & EXR_DECODE_NON_IMAGE_DATA_AS_LINE_POINTERS))
+            return &generic_unpack_deep_line_pointers;
         if ((decode->decode_flags & EXR_DECODE_NON_IMAGE_DATA_AS_POINTERS))
             return &generic_unpack_deep_pointers;
         return &generic_unpack_deep;
     }
 
+    /* hassampling only reflects the channels being filled, but the
+     * unpackers below walk every channel in the chunk at full
+     * resolution, so a subsampled channel that is skipped still
+     * shifts the data of the others */
+    for (int c = 0; c < decode->channel_count; ++c)
+    {
+        const exr_coding_channel_info_t* decc = decode->channels + c;
+        if (decc->x_samples != 1 || decc->y_samples != 1) hassampling = 1;
+    }
+
     if (hastypechange > 0)
     {
         /* other optimizations would not be difficult, but this will
@@ -1756,12 +2134,15 @@ internal_exr_match_decode (
             }
         }
 
-        return &generic_unpack;
+        return hassampling ? &generic_unpack : &unpack_nchan;
     }
 
-    if (hassampling || chanstofill != decode->channel_count || samebpc <= 0 ||
+    if (hassampling) return &generic_unpack;
+
+    /* mixed channel sizes or only filling some of the channels */
+    if (chanstofill != decode->channel_count || samebpc <= 0 ||
         sameoutbpc <= 0)
-        return &generic_unpack;
+        return &unpack_nchan;
 
     (void) chanstounpack;
     (void) simplineoff;
@@ -0,0 +1,751 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+//----------------------------------------------------------------------------
+//
+//      Functions tidyDeepImageLevel(), tidyDeepImage()
+//
+//----------------------------------------------------------------------------
+
+#include "ImfDeepImageTidy.h"
+#include "IlmThreadPool.h"
+#include "ImfHeader.h"
+#include "ImfStandardAttributes.h"
+#include "Iex.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+using namespace IMATH_NAMESPACE;
+using namespace IEX_NAMESPACE;
+using namespace std;
+
+using ILMTHREAD_NAMESPACE::Task;
+using ILMTHREAD_NAMESPACE::TaskGroup;
+using ILMTHREAD_NAMESPACE::ThreadPool;
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
+
+namespace
+{
+
+//
+// Below this alpha, log1p() and expm1() lose too much precision
+// for the split and merge formulas; alpha and color are scaled
+// linearly instead.
+//
+
+const double TINY_ALPHA = 1e-9;
+
+struct TidyChannel
+{
+    DeepImageChannel* channel;
+    PixelType         type;
+    bool              isAlpha;
+    int               alpha; // index of the governing alpha channel, or -1
+};
+
+struct TidyLevel
+{
+    DeepImageLevel*     level;
+    vector<TidyChannel> channels;
+    int                 z;      // index of the Z channel
+    int                 zBack;  // index of the ZBack channel, or -1
+    vector<int>         alphas; // indices of the alpha channels
+
+    //
+    // The tidy samples of each row, channel by channel within a sample,
+    // and whether the row differs from the original at all
+    //
+
+    vector<vector<unsigned int>> counts;
+    vector<vector<double>>       values;
+    vector<char>                 changed;
+
+    mutex         errorMutex;
+    exception_ptr error;
+
+    void setError (exception_ptr e)
+    {
+        lock_guard<mutex> lock (errorMutex);
+        if (!error) error = e;
+    }
+};
+
+//
+// Scratch space for tidying the pixels of one row
+//
+
+struct TidyScratch
+{
+    vector<double> split;   // samples after splitting
+    vector<double> bounds;  // sorted Z and ZBack values of a pixel
+    vector<int>    order;   // sort order of samples
+    vector<double> part;    // per channel alpha of a split part
+    vector<double> scale;   // per channel color scale of a split part
+    vector<double> weights; // per alpha, per sample merge weights
+};
+
+inline double
+clampAlpha (double a)
+{
+    return a < 0 ? 0 : (a > 1 ? 1 : a);
+}
+
+inline void
+storeSample (half& dst, double v)
+{
+    dst = half (static_cast<float> (v));
+}
+
+inline void
+storeSample (float& dst, double v)
+{
+    dst = static_cast<float> (v);
+}
+
+inline void
+storeSample (unsigned int& dst, double v)
+{
+    dst = static_cast<unsigned int> (v);
+}
+
+template <class T>
+void
+gatherRow (
+    const DeepImageChannel& channel,
+    int                     r,
+    int                     ci,
+    int                     nc,
+    const unsigned int*     numSamples,
+    vector<double>&         dst)
+{
+    const T* const* row =
+        static_cast<const TypedDeepImageChannel<T>&> (channel).row (r);
+
+    double* out = dst.data () + ci;
+    for (int x = 0; x < channel.pixelsPerRow (); ++x)
+    {
+        const T* s = row[x];
+        for (unsigned int i = 0; i < numSamples[x]; ++i, out += nc)
+            *out = s[i];
+    }
+}
+
+template <class T>
+void
+scatterRow (
+    DeepImageChannel&     channel,
+    int                   r,
+    int                   ci,
+    int                   nc,
+    const unsigned int*   numSamples,
+    const vector<double>& src)
+{
+    T* const* row = static_cast<TypedDeepImageChannel<T>&> (channel).row (r);
+
+    const double* in = src.data () + ci;
+    for (int x = 0; x < channel.pixelsPerRow (); ++x)
+    {
+        T* s = row[x];
+        for (unsigned int i = 0; i < numSamples[x]; ++i, in += nc)
+            storeSample (s[i], *in);
+    }
+}
+
+//
+// Sort the n samples in buf, which are nc values each, front to back
+// by Z, then ZBack, then by their position in buf
+//
+
+void
+sortSamples (
+    const TidyLevel& t, const double* buf, int n, int nc, vector<int>& order)
+{
+    int zb = t.zBack >= 0 ? t.zBack : t.z;
+
+    order.resize (n);
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+
+    sort (order.begin (), order.end (), [&] (int a, int b) {
+        const double* sa = buf + size_t (a) * nc;
+        const double* sb = buf + size_t (b) * nc;
+        if (sa[t.z] != sb[t.z]) return sa[t.z] < sb[t.z];
+        if (sa[zb] != sb[zb]) return sa[zb] < sb[zb];
+        return a < b;
+    });
+}
+
+//
+// Append the part between depths front and back of volume sample s,
+// which spans depths z to zBack, to out
+//
+
+void
+appendPart (
+    const TidyLevel& t,
+    const double*    s,
+    double           z,
+    double           zBack,
+    double           front,
+    double           back,
+    TidyScratch&     scratch,
+    vector<double>&  out)
+{
+    size_t nc = t.channels.size ();
+    size_t o  = out.size ();
+    out.insert (out.end (), s, s + nc);
+
+    if (front == z && back == zBack) return;
+
+    //
+    // The part covers fraction x of the sample's depth range.  An alpha
+    // a becomes 1-(1-a)^x, and colors scale with alpha.
+    //
+
+    double x = (back - front) / (zBack - z);
+
+    for (int k: t.alphas)
+    {
+        double a = clampAlpha (s[k]);
+
+        if (a >= 1)
+        {
+            scratch.part[k]  = 1;
+            scratch.scale[k] = 1;
+        }
+        else if (a < TINY_ALPHA)
+        {
+            scratch.part[k]  = a * x;
+            scratch.scale[k] = x;
+        }
+        else
+        {
+            scratch.part[k]  = -expm1 (x * log1p (-a));
+            scratch.scale[k] = scratch.part[k] / a;
+        }
+    }
+
+    for (size_t c = 0; c < nc; ++c)
+    {
+        const TidyChannel& tc = t.channels[c];
+
+        if (int (c) == t.z)
+            out[o + c] = front;
+        else if (int (c) == t.zBack)
+            out[o + c] = back;
+        else if (tc.isAlpha)
+            out[o + c] = scratch.part[c];
+        else if (tc.type != UINT && tc.alpha >= 0)
+            out[o + c] = s[c] * scratch.scale[tc.alpha];
+    }
+}
+
+//
+// Append the merge of the m samples in split selected by order[0]
+// to order[m-1] to out.  All of them have the same Z and ZBack.
+//
+
+void
+appendMerged (
+    const TidyLevel& t,
+    const double*    split,
+    const int*       order,
+    int              m,
+    TidyScratch&     scratch,
+    vector<double>&  out)
+{
+    size_t nc = t.channels.size ();
+    size_t o  = out.size ();
+    out.insert (
+        out.end (),
+        split + size_t (order[0]) * nc,
+        split + size_t (order[0] + 1) * nc);
+
+    if (m == 1) return;
+
+    //
+    // For each alpha channel, find the merged alpha and the weights
+    // of the samples' colors.  Merging the samples must give the same
+    // result as compositing the thin slabs they turn into when they
+    // are split ever finer:
+    //
+    //      u_i = -log(1-a_i)       v_i = u_i / a_i
+    //      a   = 1 - exp(-sum u_i) w   = a / sum u_i
+    //      c   = w * sum (v_i * c_i)
+    //
+    // If any samples are opaque, their colors are averaged instead.
+    //
+
+    scratch.weights.resize (nc * size_t (m));
+
+    for (int k: t.alphas)
+    {
+        double* w      = scratch.weights.data () + size_t (k) * m;
+        int     opaque = 0;
+
+        for (int i = 0; i < m; ++i)
+            if (clampAlpha (split[size_t (order[i]) * nc + k]) >= 1) ++opaque;
+
+        if (opaque > 0)
+        {
+            for (int i = 0; i < m; ++i)
+            {
+                double a = clampAlpha (split[size_t (order[i]) * nc + k]);
+                w[i]     = a >= 1 ? 1.0 / opaque : 0;
+            }
+
+            out[o + k] = 1;
+            continue;
+        }
+
+        double u = 0;
+        for (int i = 0; i < m; ++i)
+        {
+            double a = clampAlpha (split[size_t (order[i]) * nc + k]);
+            double ui = -log1p (-a);
+            w[i]      = a < TINY_ALPHA ? 1 : ui / a;
+            u += ui;
+        }
+
+        double am = -expm1 (-u);
+        double wm = u < TINY_ALPHA ? 1 : am / u;
+
+        for (int i = 0; i < m; ++i)
+            w[i] *= wm;
+
+        out[o + k] = am;
+    }
+
+    for (size_t c = 0; c < nc; ++c)
+    {
+        const TidyChannel& tc = t.channels[c];
+
+        if (int (c) == t.z || int (c) == t.zBack || tc.isAlpha ||
+            tc.type == UINT)
+            continue;
+
+        double v = 0;
+        if (tc.alpha >= 0)
+        {
+            const double* w = scratch.weights.data () + size_t (tc.alpha) * m;
+            for (int i = 0; i < m; ++i)
+                v += w[i] * split[size_t (order[i]) * nc + c];
+        }
+        else
+        {
+            for (int i = 0; i < m; ++i)
+                v += split[size_t (order[i]) * nc + c];
+            v /= m;
+        }
+
+        out[o + c] = v;
+    }
+}
+
+//
+// Append the tidy form of the n samples of a pixel in buf to out,
+// and return the number of samples appended
+//
+
+unsigned int
+tidyPixel (
+    const TidyLevel& t,
+    const double*    buf,
+    int              n,
+    TidyScratch&     scratch,
+    vector<double>&  out)
+{
+    int nc = int (t.channels.size ());
+    int zb = t.zBack >= 0 ? t.zBack : t.z;
+
+    if (n == 0) return 0;
+
+    //
+    // Samples at a NaN depth cannot be ordered; leave such pixels alone
+    //
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (std::isnan (buf[size_t (i) * nc + t.z]) ||
+            std::isnan (buf[size_t (i) * nc + zb]))
+        {
+            out.insert (out.end (), buf, buf + size_t (n) * nc);
+            return n;
+        }
+    }
+
+    //
+    // Split volume samples at every Z and ZBack of the pixel
+    // that falls inside them
+    //
+
+    scratch.bounds.clear ();
+    for (int i = 0; i < n; ++i)
+    {
+        scratch.bounds.push_back (buf[size_t (i) * nc + t.z]);
+        scratch.bounds.push_back (buf[size_t (i) * nc + zb]);
+    }
+
+    sort (scratch.bounds.begin (), scratch.bounds.end ());
+    scratch.bounds.erase (
+        unique (scratch.bounds.begin (), scratch.bounds.end ()),
+        scratch.bounds.end ());
+
+    //
+    // Split the samples in front to back order, so that when parts
+    // are merged, the one from the front-most sample comes first
+    //
+
+    sortSamples (t, buf, n, nc, scratch.order);
+
+    scratch.split.clear ();
+    for (int i = 0; i < n; ++i)
+    {
+        const double* s     = buf + size_t (scratch.order[i]) * nc;
+        double        z     = s[t.z];
+        double        zBack = s[zb];
+
+        if (!(zBack > z))
+        {
+            scratch.split.insert (scratch.split.end (), s, s + nc);
+            continue;
+        }
+
+        vector<double>::const_iterator b = upper_bound (
+            scratch.bounds.begin (), scratch.bounds.end (), z);
+
+        for (double front = z;;)
+        {
+            double back = (b != scratch.bounds.end () && *b < zBack) ? *b++
+                                                                      : zBack;
+
+            appendPart (t, s, z, zBack, front, back, scratch, scratch.split);
+
+            if (back == zBack) break;
+            front = back;
+        }
+    }
+
+    //
+    // Sort the parts and merge the ones with the same depth range
+    //
+
+    int m = int (scratch.split.size () / nc);
+    sortSamples (t, scratch.split.data (), m, nc, scratch.order);
+
+    unsigned int count = 0;
+    for (int i = 0; i < m;)
+    {
+        const double* s =
+            scratch.split.data () + size_t (scratch.order[i]) * nc;
+
+        int j = i + 1;
+        while (j < m)
+        {
+            const double* sj =
+                scratch.split.data () + size_t (scratch.order[j]) * nc;
+            if (sj[t.z] != s[t.z] || sj[zb] != s[zb]) break;
+            ++j;
+        }
+
+        appendMerged (
+            t,
+            scratch.split.data (),
+            scratch.order.data () + i,
+            j - i,
+            scratch,
+            out);
+
+        ++count;
+        i = j;
+    }
+
+    return count;
+}
+
+void
+tidyRow (TidyLevel& t, int r)
+{
+    const SampleCountChannel& scc = t.level->sampleCounts ();
+    const unsigned int*       n   = scc.row (r);
+    int                       w   = scc.pixelsPerRow ();
+    int                       nc  = int (t.channels.size ());
+
+    size_t total = 0;
+    for (int x = 0; x < w; ++x)
+        total += n[x];
+
+    vector<double> in (total * nc);
+    for (int c = 0; c < nc; ++c)
+    {
+        const DeepImageChannel& channel = *t.channels[c].channel;
+
+        switch (t.channels[c].type)
+        {
+            case HALF: gatherRow<half> (channel, r, c, nc, n, in); break;
+            case FLOAT: gatherRow<float> (channel, r, c, nc, n, in); break;
+            case UINT:
+                gatherRow<unsigned int> (channel, r, c, nc, n, in);
+                break;
+            default: assert (false);
+        }
+    }
+
+    TidyScratch scratch;
+    scratch.part.resize (nc);
+    scratch.scale.resize (nc);
+
+    vector<unsigned int>& counts = t.counts[r];
+    vector<double>&       out    = t.values[r];
+    bool                  changed = false;
+
+    counts.resize (w);
+    out.reserve (in.size ());
+
+    const double* pixel = in.data ();
+    for (int x = 0; x < w; ++x)
+    {
+        size_t o  = out.size ();
+        counts[x] = tidyPixel (t, pixel, n[x], scratch, out);
+
+        if (counts[x] != n[x] ||
+            !equal (out.begin () + o, out.end (), pixel))
+        {
+            changed = true;
+        }
+
+        pixel += size_t (n[x]) * nc;
+    }
+
+    t.changed[r] = changed;
+}
+
+void
+storeRow (TidyLevel& t, int r)
+{
+    const unsigned int* n  = t.counts[r].data ();
+    int                 nc = int (t.channels.size ());
+
+    for (int c = 0; c < nc; ++c)
+    {
+        DeepImageChannel& channel = *t.channels[c].channel;
+
+        switch (t.channels[c].type)
+        {
+            case HALF:
+                scatterRow<half> (channel, r, c, nc, n, t.values[r]);
+                break;
+            case FLOAT:
+                scatterRow<float> (channel, r, c, nc, n, t.values[r]);
+                break;
+            case UINT:
+                scatterRow<unsigned int> (channel, r, c, nc, n, t.values[r]);
+                break;
+            default: assert (false);
+        }
+    }
+}
+
+class TidyRowTask : public Task
+{
+public:
+    TidyRowTask (TaskGroup* group, TidyLevel* level, int row, bool store)
+        : Task (group), _level (level), _row (row), _store (store)
+    {}
+
+    virtual void execute ()
+    {
+        try
+        {
+            if (_store)
+                storeRow (*_level, _row);
+            else
+                tidyRow (*_level, _row);
+        }
+        catch (...)
+        {
+            _level->setError (current_exception ());
+        }
+    }
+
+private:
+    TidyLevel* _level;
+    int        _row;
+    bool       _store; // write the tidy samples back to the level
+};
+
+void
+runRowTasks (TidyLevel& t, bool store)
+{
+    {
+        TaskGroup g;
+        for (int r = 0; r < int (t.counts.size ()); ++r)
+        {
+            if (store && !t.changed[r]) continue;
+            ThreadPool::addGlobalTask (new TidyRowTask (&g, &t, r, store));
+        }
+    }
+
+    if (t.error) rethrow_exception (t.error);
+}
+
+//
+// The layer of a channel is the part of its name
+// up to and including the last '.'
+//
+
+string
+layerOf (const string& name)
+{
+    size_t dot = name.rfind ('.');
+    return dot == string::npos ? string () : name.substr (0, dot + 1);
+}
+
+} // namespace
+
+void
+tidyDeepImageLevel (DeepImageLevel& level)
+{
+    TidyLevel t;
+    t.level = &level;
+    t.z     = -1;
+    t.zBack = -1;
+
+    vector<string> names;
+    for (DeepImageLevel::Iterator i = level.begin (); i != level.end (); ++i)
+    {
+        DeepImageChannel& c = i.channel ();
+
+        if (c.xSampling () != 1 || c.ySampling () != 1)
+        {
+            THROW (
+                ArgExc,
+                "Cannot tidy deep image channel \""
+                    << i.name ()
+                    << "\" because its x or y sampling rate is not 1.");
+        }
+
+        const string& name = i.name ();
+        TidyChannel   tc   = {&c, c.pixelType (), false, -1};
+
+        if (name == "Z")
+            t.z = int (t.channels.size ());
+        else if (name == "ZBack")
+            t.zBack = int (t.channels.size ());
+        else if (tc.type != UINT && layerOf (name) + "A" == name)
+        {
+            tc.isAlpha = true;
+            t.alphas.push_back (int (t.channels.size ()));
+        }
+
+        t.channels.push_back (tc);
+        names.push_back (name);
+    }
+
+    if (t.z < 0)
+        throw ArgExc ("Cannot tidy a deep image level without a Z channel.");
+
+    for (size_t c = 0; c < t.channels.size (); ++c)
+    {
+        TidyChannel& tc = t.channels[c];
+        if (tc.isAlpha || int (c) == t.z || int (c) == t.zBack) continue;
+
+        string layer = layerOf (names[c]);
+        for (int k: t.alphas)
+        {
+            if (names[k] == layer + "A") tc.alpha = k;
+            if (names[k] == "A" && tc.alpha < 0) tc.alpha = k;
+        }
+    }
+
+    int rows = level.sampleCounts ().pixelsPerColumn ();
+    t.counts.resize (rows);
+    t.values.resize (rows);
+    t.changed.resize (rows);
+
+    runRowTasks (t, false);
+
+    //
+    // Samples need to be moved only if some row changed, and the
+    // sample lists reallocated only if some sample count changed.
+    // Reallocating zeroes all samples, so every row is rewritten.
+    //
+
+    bool countsChanged = false;
+    bool anyChanged    = false;
+    for (int r = 0; r < rows; ++r)
+    {
+        if (!t.changed[r]) continue;
+
+        anyChanged = true;
+        if (!equal (
+                t.counts[r].begin (),
+                t.counts[r].end (),
+                level.sampleCounts ().row (r)))
+        {
+            countsChanged = true;
+        }
+    }
+
+    if (!anyChanged) return;
+
+    if (countsChanged)
+    {
+        SampleCountChannel::Edit edit (level.sampleCounts ());
+        int w = level.sampleCounts ().pixelsPerRow ();
+
+        for (int r = 0; r < rows; ++r)
+        {
+            copy (
+                t.counts[r].begin (),
+                t.counts[r].end (),
+                edit.sampleCounts () + size_t (r) * w);
+        }
+
+        fill (t.changed.begin (), t.changed.end (), 1);
+    }
+
+    runRowTasks (t, true);
+}
+
+void
+tidyDeepImage (DeepImage& img)
+{
+    switch (img.levelMode ())
+    {
+        case ONE_LEVEL: tidyDeepImageLevel (img.level ()); break;
+
+        case MIPMAP_LEVELS:
+
+            for (int x = 0; x < img.numLevels (); ++x)
+                tidyDeepImageLevel (img.level (x, x));
+
+            break;
+
+        case RIPMAP_LEVELS:
+
+            for (int y = 0; y < img.numYLevels (); ++y)
+                for (int x = 0; x < img.numXLevels (); ++x)
+                    tidyDeepImageLevel (img.level (x, y));
+
+            break;
+
+        default: assert (false);
+    }
+}
+
+void
+tidyDeepImage (Header& hdr, DeepImage& img)
+{
+    tidyDeepImage (img);
+    addDeepImageState (hdr, DIS_TIDY);
+}
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_EXIT
@@ -0,0 +1,78 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifndef INCLUDED_IMF_DEEP_IMAGE_TIDY_H
+#define INCLUDED_IMF_DEEP_IMAGE_TIDY_H
+
+//----------------------------------------------------------------------------
+//
+//      Functions to convert deep images into "tidy" form.
+//
+//      A deep pixel is tidy if its samples are sorted front to back,
+//      no two samples overlap in depth, and no two samples have the
+//      same depth range; see "Interpreting OpenEXR Deep Pixels" in
+//      the OpenEXR documentation.  Tidy images can be composited and
+//      flattened without re-sorting or splitting their samples.
+//
+//----------------------------------------------------------------------------
+
+#include "ImfNamespace.h"
+#include "ImfUtilExport.h"
+
+#include "ImfDeepImage.h"
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
+
+class Header;
+
+//
+// tidyDeepImageLevel (l)
+//
+//      Makes every pixel of deep image level l tidy:
+//
+//      - The samples in each pixel are sorted by Z, then by ZBack.
+//
+//      - A volume sample (ZBack > Z) that contains the Z or ZBack
+//        of another sample of the same pixel is split at that depth.
+//        The parts of the sample get the alpha and color that the
+//        original sample would have over their part of its depth
+//        range.
+//
+//      - Samples with the same Z and ZBack are merged into a single
+//        sample that has the combined alpha and color of the originals.
+//
+//      The level must have a Z channel; the ZBack channel is optional.
+//      A channel whose name is "A", or ends in ".A", is an alpha channel.
+//      Alpha channel "L.A" governs the other channels in layer L, or, if
+//      there is no such channel, "A" does.  Channels without an alpha
+//      channel are treated as opaque.  UINT channels, for example object
+//      ids, are copied when a sample is split, and the front-most sample
+//      wins when samples are merged.
+//
+//      Pixels are processed in parallel, one row per task in the global
+//      thread pool.  If a level has a channel with x or y sampling other
+//      than 1, or no Z channel, tidyDeepImageLevel() throws an
+//      Iex::ArgExc exception and leaves the level unchanged.
+//
+// tidyDeepImage (i) or
+// tidyDeepImage (h, i)
+//
+//      Makes every level of deep image i tidy.  If header h is given,
+//      then its deepImageState attribute is set to DIS_TIDY, so that
+//      readers of a file saved with h can skip sorting the samples.
+//
+
+IMFUTIL_EXPORT
+void tidyDeepImageLevel (DeepImageLevel& level);
+
+IMFUTIL_EXPORT
+void tidyDeepImage (DeepImage& img);
+
+IMFUTIL_EXPORT
+void tidyDeepImage (Header& hdr, DeepImage& img);
+
+OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_EXIT
+
+#endif
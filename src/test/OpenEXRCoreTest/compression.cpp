@@ -695,6 +695,9 @@ static const int IMG_STRIDE_X = 1376;
 static const int IMG_DATA_X   = 17;
 static const int IMG_DATA_Y   = 29;
 
+// intra_chunk_threads hint given to the encoders
+static int s_intra_chunk_threads = 0;
+
 ////////////////////////////////////////
 
 static void
@@ -767,8 +770,8 @@ doEncodeScan (exr_context_t f, pixels& p, int xs, int ys)
     int32_t               scansperchunk = 0;
     int                   y, starty, endy;
     exr_chunk_info_t      cinfo;
-    exr_encode_pipeline_t encoder;
-    bool                  first = true;
+    exr_encode_pipeline_t encoder = EXR_ENCODE_PIPELINE_INITIALIZER;
+    bool                  first   = true;
 
     EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, 0, &scansperchunk));
     starty = IMG_DATA_Y * ys;
@@ -780,6 +783,7 @@ doEncodeScan (exr_context_t f, pixels& p, int xs, int ys)
         {
             EXRCORE_TEST_RVAL (
                 exr_encoding_initialize (f, 0, &cinfo, &encoder));
+            encoder.intra_chunk_threads = s_intra_chunk_threads;
         }
         else
         {
@@ -837,8 +841,8 @@ doEncodeTile (exr_context_t f, pixels& p, int xs, int ys)
     int                   y, endy;
     int                   x, endx;
     exr_chunk_info_t      cinfo;
-    exr_encode_pipeline_t encoder;
-    bool                  first = true;
+    exr_encode_pipeline_t encoder = EXR_ENCODE_PIPELINE_INITIALIZER;
+    bool                  first   = true;
 
     EXRCORE_TEST (xs == 1 && ys == 1);
     EXRCORE_TEST_RVAL (exr_get_tile_levels (f, 0, &tlevx, &tlevy));
@@ -864,6 +868,7 @@ doEncodeTile (exr_context_t f, pixels& p, int xs, int ys)
             {
                 EXRCORE_TEST_RVAL (
                     exr_encoding_initialize (f, 0, &cinfo, &encoder));
+                encoder.intra_chunk_threads = s_intra_chunk_threads;
             }
             else
             {
@@ -1372,7 +1377,10 @@ doWriteRead (
     }
 
 #ifdef __linux
-    if (0 != compare_files (filename.c_str (), cppfilename.c_str ()))
+    // splitting a chunk changes the compressed bytes, so only the
+    // decoded pixels below can match the C++ file
+    if (s_intra_chunk_threads <= 1 &&
+        0 != compare_files (filename.c_str (), cppfilename.c_str ()))
     {
         EXRCORE_TEST_FAIL (compare_files);
     }
@@ -1510,12 +1518,10 @@ testHUF (const std::string& tempdir)
     uint64_t dsize = internal_exr_huf_decompress_spare_bytes ();
     // decsize 1 << 16 + 1
     // decsize 1 << 14
-    EXRCORE_TEST (esize == 65537 * (8 + 8 + sizeof (uint64_t*) + 4));
-    const uint64_t hufdecsize =
-        (sizeof (uint32_t*) + sizeof (int32_t) + sizeof (uint32_t));
+    EXRCORE_TEST (esize == 65537 * (8 + 8 + 8 + 4));
     // sizeof(FastHufDecoder) is bother to manually compute, just assume it's ok
-    // if it's returning at least enough for the slow path
-    EXRCORE_TEST (dsize >= (65537 * sizeof (uint64_t) + 16383 * hufdecsize));
+    // if it's returning at least enough for the id to symbol map
+    EXRCORE_TEST (dsize >= 65537 * sizeof (uint32_t));
 
     std::vector<uint8_t> hspare;
 
@@ -1635,6 +1641,32 @@ testHUF (const std::string& tempdir)
     {
         EXRCORE_TEST (decode.h[i] == p.h[i]);
     }
+
+    // streams of only a few bits, and outputs shorter than one
+    // multi-symbol table entry
+    for (uint64_t n = 1; n <= 40; ++n)
+    {
+        EXRCORE_TEST_RVAL (internal_huf_compress (
+            &ebytes,
+            encoded.data (),
+            encoded.size (),
+            p.h.data (),
+            n,
+            hspare.data (),
+            esize));
+        EXRCORE_TEST_RVAL (internal_huf_decompress (
+            NULL,
+            encoded.data (),
+            ebytes,
+            decode.h.data (),
+            n,
+            hspare.data (),
+            dsize));
+        for (size_t i = 0; i < n; ++i)
+        {
+            EXRCORE_TEST (decode.h[i] == p.h[i]);
+        }
+    }
 }
 
 ////////////////////////////////////////
@@ -1699,6 +1731,390 @@ testDWABCompression (const std::string& tempdir)
     testComp (tempdir, EXR_COMPRESSION_DWAB);
 }
 
+void
+testIntraChunkCompression (const std::string& tempdir)
+{
+    // large chunks get their deflate work split into several segments,
+    // which must still read back through the regular (and C++) paths
+    s_intra_chunk_threads = 4;
+    testComp (tempdir, EXR_COMPRESSION_ZIP);
+    testComp (tempdir, EXR_COMPRESSION_PXR24);
+    testComp (tempdir, EXR_COMPRESSION_DWAB);
+    s_intra_chunk_threads = 0;
+}
+
+void
+testDWAChannelRules (const std::string& tempdir)
+{
+    // rgb plus a handful of utility channels, where user rules send
+    // the utility channels and B through the lossless paths
+    const int              w = 317, h = 83, nc = 6;
+    const char*            names[nc] = {"R", "G", "B", "depth.Z", "id", "mask.matte"};
+    const exr_pixel_type_t types[nc] = {
+        EXR_PIXEL_HALF,
+        EXR_PIXEL_HALF,
+        EXR_PIXEL_HALF,
+        EXR_PIXEL_FLOAT,
+        EXR_PIXEL_UINT,
+        EXR_PIXEL_HALF};
+    std::string filename = tempdir + std::string ("imf_test_dwa_rules.exr");
+
+    std::vector<uint32_t> orig[nc], restore[nc];
+    for (int c = 0; c < nc; ++c)
+    {
+        orig[c].resize (w * h);
+        restore[c].resize (w * h, 0);
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                float v;
+                if (c < 3)
+                    v = 40.f * sinf (x * 0.013f + c) * cosf (y * 0.021f);
+                else
+                    v = (float) ((x / 37) + (y / 23) * 3);
+
+                // halves are handed over as float, so every channel
+                // can share the 32-bit storage
+                uint32_t& o = orig[c][y * w + x];
+                if (types[c] == EXR_PIXEL_HALF) v = (float) half (v);
+                if (types[c] == EXR_PIXEL_UINT)
+                    o = (uint32_t) v;
+                else
+                    memcpy (&o, &v, sizeof (float));
+            }
+        }
+    }
+
+    for (int comp = EXR_COMPRESSION_DWAA; comp <= EXR_COMPRESSION_DWAB; ++comp)
+    {
+        exr_context_t             f;
+        exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+        exr_encode_pipeline_t     encoder;
+        exr_decode_pipeline_t     decoder;
+        exr_chunk_info_t          cinfo;
+        int                       partidx, lpc;
+        bool                      first = true;
+
+        EXRCORE_TEST_RVAL (exr_start_write (
+            &f, filename.c_str (), EXR_WRITE_FILE_DIRECTLY, &cinit));
+        EXRCORE_TEST_RVAL (
+            exr_add_part (f, "scan", EXR_STORAGE_SCANLINE, &partidx));
+        EXRCORE_TEST_RVAL (exr_initialize_required_attr_simple (
+            f, partidx, w, h, (exr_compression_t) comp));
+        for (int c = 0; c < nc; ++c)
+        {
+            EXRCORE_TEST_RVAL (exr_add_channel (
+                f,
+                partidx,
+                names[c],
+                types[c],
+                EXR_PERCEPTUALLY_LOGARITHMIC,
+                1,
+                1));
+        }
+        EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+            f, partidx, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+        EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+            f, partidx, "ID", EXR_PIXEL_UINT, EXR_DWA_CHANNEL_RLE, 1));
+        EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+            f, partidx, "matte", EXR_PIXEL_HALF, EXR_DWA_CHANNEL_RLE, 0));
+        // overrides the default lossy rule, B must drop out of the rgb set
+        EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+            f, partidx, "B", EXR_PIXEL_HALF, EXR_DWA_CHANNEL_UNKNOWN, 0));
+        EXRCORE_TEST_RVAL (exr_write_header (f));
+        EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, partidx, &lpc));
+
+        for (int y = 0; y < h; y += lpc)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_write_scanline_chunk_info (f, partidx, y, &cinfo));
+            if (first)
+            {
+                EXRCORE_TEST_RVAL (
+                    exr_encoding_initialize (f, partidx, &cinfo, &encoder));
+            }
+            else
+            {
+                EXRCORE_TEST_RVAL (
+                    exr_encoding_update (f, partidx, &cinfo, &encoder));
+            }
+
+            for (int c = 0; c < encoder.channel_count; ++c)
+            {
+                exr_coding_channel_info_t& curch = encoder.channels[c];
+                int                        idx   = 0;
+                while (strcmp (curch.channel_name, names[idx])) ++idx;
+
+                curch.encode_from_ptr =
+                    reinterpret_cast<const uint8_t*> (&orig[idx][y * w]);
+                curch.user_pixel_stride = sizeof (uint32_t);
+                curch.user_line_stride  = w * sizeof (uint32_t);
+                curch.user_data_type         = types[idx] == EXR_PIXEL_UINT
+                                                       ? EXR_PIXEL_UINT
+                                                       : EXR_PIXEL_FLOAT;
+                curch.user_bytes_per_element = sizeof (uint32_t);
+            }
+
+            if (first)
+            {
+                EXRCORE_TEST_RVAL (exr_encoding_choose_default_routines (
+                    f, partidx, &encoder));
+            }
+            EXRCORE_TEST_RVAL (exr_encoding_run (f, partidx, &encoder));
+            first = false;
+        }
+        EXRCORE_TEST_RVAL (exr_encoding_destroy (f, &encoder));
+        EXRCORE_TEST_RVAL (exr_finish (&f));
+
+        // the rules travel in the chunks, so a plain reader gets the
+        // lossless channels back exactly
+        first = true;
+        EXRCORE_TEST_RVAL (exr_start_read (&f, filename.c_str (), &cinit));
+        for (int y = 0; y < h; y += lpc)
+        {
+            EXRCORE_TEST_RVAL (exr_read_scanline_chunk_info (f, 0, y, &cinfo));
+            if (first)
+            {
+                EXRCORE_TEST_RVAL (
+                    exr_decoding_initialize (f, 0, &cinfo, &decoder));
+            }
+            else
+            {
+                EXRCORE_TEST_RVAL (
+                    exr_decoding_update (f, 0, &cinfo, &decoder));
+            }
+
+            for (int c = 0; c < decoder.channel_count; ++c)
+            {
+                exr_coding_channel_info_t& curch = decoder.channels[c];
+                int                        idx   = 0;
+                while (strcmp (curch.channel_name, names[idx])) ++idx;
+
+                curch.decode_to_ptr =
+                    reinterpret_cast<uint8_t*> (&restore[idx][y * w]);
+                curch.user_pixel_stride = sizeof (uint32_t);
+                curch.user_line_stride  = w * sizeof (uint32_t);
+                curch.user_data_type         = types[idx] == EXR_PIXEL_UINT
+                                                       ? EXR_PIXEL_UINT
+                                                       : EXR_PIXEL_FLOAT;
+                curch.user_bytes_per_element = sizeof (uint32_t);
+            }
+
+            if (first)
+            {
+                EXRCORE_TEST_RVAL (
+                    exr_decoding_choose_default_routines (f, 0, &decoder));
+            }
+            EXRCORE_TEST_RVAL (exr_decoding_run (f, 0, &decoder));
+            first = false;
+        }
+        EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
+        EXRCORE_TEST_RVAL (exr_finish (&f));
+
+        for (int c = 2; c < nc; ++c)
+            EXRCORE_TEST (orig[c] == restore[c]);
+        EXRCORE_TEST (orig[0] != restore[0]);
+        remove (filename.c_str ());
+    }
+}
+
+struct select_comp_image
+{
+    int                   w, h;
+    int                   min_x = 0, min_y = 0;   // data window origin
+    int                   tile_w = 0, tile_h = 0; // 0 for scanline parts
+    int                   samples = 0;
+    std::vector<uint16_t> pix[3];
+};
+
+static exr_result_t
+select_comp_sample (void* userdata, exr_encode_pipeline_t* encode)
+{
+    select_comp_image* img = static_cast<select_comp_image*> (userdata);
+    int                x, y;
+
+    if (img->tile_w > 0)
+    {
+        // tiled chunks are placed by tile, not by pixel
+        x = encode->chunk.start_x * img->tile_w;
+        y = encode->chunk.start_y * img->tile_h;
+        if (encode->chunk.width != std::min (img->tile_w, img->w - x) ||
+            encode->chunk.height != std::min (img->tile_h, img->h - y))
+            return EXR_ERR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        x = encode->chunk.start_x - img->min_x;
+        y = encode->chunk.start_y - img->min_y;
+    }
+    if (x < 0 || y < 0 || x + encode->chunk.width > img->w ||
+        y + encode->chunk.height > img->h)
+        return EXR_ERR_INVALID_ARGUMENT;
+    ++img->samples;
+
+    for (int c = 0; c < encode->channel_count; ++c)
+    {
+        exr_coding_channel_info_t& curch = encode->channels[c];
+        // channels come sorted (B, G, R)
+        curch.encode_from_ptr = reinterpret_cast<const uint8_t*> (
+            img->pix[c].data () + y * img->w + x);
+        curch.user_pixel_stride      = 2;
+        curch.user_line_stride       = 2 * img->w;
+        curch.user_data_type         = EXR_PIXEL_HALF;
+        curch.user_bytes_per_element = 2;
+    }
+    return EXR_ERR_SUCCESS;
+}
+
+void
+testSelectCompression (const std::string& tempdir)
+{
+    std::string       filename = tempdir + std::string ("imf_test_select.exr");
+    select_comp_image img;
+    img.w = 371;
+    img.h = 157;
+    for (int c = 0; c < 3; ++c)
+    {
+        img.pix[c].resize (img.w * img.h);
+        for (int i = 0; i < img.w * img.h; ++i)
+            img.pix[c][i] = half (sinf ((i % img.w) * 0.03f + c)).bits ();
+    }
+
+    exr_compression_selector_t sel = {};
+    exr_compression_trial_t    trials[4];
+    exr_compression_t          chosen = EXR_COMPRESSION_LAST_TYPE;
+    exr_compression_t          partcomp;
+    exr_context_t              f;
+    exr_context_initializer_t  cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    int                        partidx;
+
+    EXRCORE_TEST_RVAL (exr_start_write (
+        &f, filename.c_str (), EXR_WRITE_FILE_DIRECTLY, &cinit));
+    EXRCORE_TEST_RVAL (
+        exr_add_part (f, "scan", EXR_STORAGE_SCANLINE, &partidx));
+    EXRCORE_TEST_RVAL (exr_initialize_required_attr_simple (
+        f, partidx, img.w, img.h, EXR_COMPRESSION_NONE));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "R", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "G", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "B", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_select_compression (f, partidx, &sel, &chosen, trials));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_select_compression (f, partidx, NULL, &chosen, trials));
+
+    // no budget, the default lossless candidates, smallest wins
+    sel.sample_fn = &select_comp_sample;
+    sel.userdata  = &img;
+    EXRCORE_TEST_RVAL (
+        exr_select_compression (f, partidx, &sel, &chosen, trials));
+    int best = 0;
+    for (int t = 0; t < 4; ++t)
+    {
+        EXRCORE_TEST (trials[t].result == EXR_ERR_SUCCESS);
+        EXRCORE_TEST (trials[t].unpacked_bytes == trials[0].unpacked_bytes);
+        EXRCORE_TEST (trials[t].packed_bytes > 0);
+        EXRCORE_TEST (trials[t].mb_per_sec > 0.0);
+        if (trials[t].packed_bytes < trials[best].packed_bytes) best = t;
+    }
+    EXRCORE_TEST (chosen == trials[best].compression);
+    EXRCORE_TEST_RVAL (exr_get_compression (f, partidx, &partcomp));
+    EXRCORE_TEST (partcomp == chosen);
+
+    // nothing is that fast, so the part is left uncompressed
+    exr_compression_t candidates[] = {
+        EXR_COMPRESSION_ZIP, EXR_COMPRESSION_PXR24};
+    sel.candidates      = candidates;
+    sel.candidate_count = 2;
+    sel.min_mb_per_sec  = 1e15f;
+    EXRCORE_TEST_RVAL (
+        exr_select_compression (f, partidx, &sel, &chosen, trials));
+    EXRCORE_TEST (chosen == EXR_COMPRESSION_NONE);
+    EXRCORE_TEST (trials[1].compression == EXR_COMPRESSION_PXR24);
+    EXRCORE_TEST_RVAL (exr_get_compression (f, partidx, &partcomp));
+    EXRCORE_TEST (partcomp == EXR_COMPRESSION_NONE);
+
+    EXRCORE_TEST_RVAL (exr_write_header (f));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_NOT_OPEN_WRITE,
+        exr_select_compression (f, partidx, &sel, &chosen, trials));
+    exr_finish (&f);
+    remove (filename.c_str ());
+
+    // a tiled part, with a data window away from the origin and
+    // partial tiles on the right and bottom edges
+    exr_attr_box2i_t dw  = {{-13, 7}, {-13 + img.w - 1, 7 + img.h - 1}};
+    exr_attr_v2f_t   swc = {0.f, 0.f};
+    img.min_x            = dw.min.x;
+    img.min_y            = dw.min.y;
+    img.tile_w           = 64;
+    img.tile_h           = 48;
+
+    EXRCORE_TEST_RVAL (exr_start_write (
+        &f, filename.c_str (), EXR_WRITE_FILE_DIRECTLY, &cinit));
+    EXRCORE_TEST_RVAL (
+        exr_add_part (f, "tiled", EXR_STORAGE_TILED, &partidx));
+    EXRCORE_TEST_RVAL (exr_initialize_required_attr (
+        f,
+        partidx,
+        &dw,
+        &dw,
+        1.f,
+        &swc,
+        1.f,
+        EXR_LINEORDER_INCREASING_Y,
+        EXR_COMPRESSION_NONE));
+    EXRCORE_TEST_RVAL (exr_set_tile_descriptor (
+        f,
+        partidx,
+        img.tile_w,
+        img.tile_h,
+        EXR_TILE_ONE_LEVEL,
+        EXR_TILE_ROUND_DOWN));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "R", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "G", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+    EXRCORE_TEST_RVAL (exr_add_channel (
+        f, partidx, "B", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+
+    // every tile, so the edge tiles are sampled too
+    int tiles = ((img.w + img.tile_w - 1) / img.tile_w) *
+                ((img.h + img.tile_h - 1) / img.tile_h);
+    sel                 = {};
+    sel.sample_fn       = &select_comp_sample;
+    sel.userdata        = &img;
+    sel.sample_chunks   = tiles;
+    img.samples         = 0;
+    EXRCORE_TEST_RVAL (
+        exr_select_compression (f, partidx, &sel, &chosen, trials));
+    best = 0;
+    for (int t = 0; t < 4; ++t)
+    {
+        EXRCORE_TEST (trials[t].result == EXR_ERR_SUCCESS);
+        // every candidate sees each pixel once
+        EXRCORE_TEST (
+            trials[t].unpacked_bytes == uint64_t (img.w) * img.h * 3 * 2);
+        EXRCORE_TEST (trials[t].packed_bytes > 0);
+        if (trials[t].packed_bytes < trials[best].packed_bytes) best = t;
+    }
+    // one untimed warm up tile per candidate, then every tile
+    EXRCORE_TEST (img.samples == 4 * (tiles + 1));
+    EXRCORE_TEST (chosen == trials[best].compression);
+    EXRCORE_TEST_RVAL (exr_get_compression (f, partidx, &partcomp));
+    EXRCORE_TEST (partcomp == chosen);
+
+    EXRCORE_TEST_RVAL (exr_write_header (f));
+    exr_finish (&f);
+    remove (filename.c_str ());
+}
+
 struct ht_channel_map_tests {
     exr_coding_channel_info_t   channels[6];
     int                         channel_count;
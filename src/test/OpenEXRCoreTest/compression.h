@@ -22,6 +22,9 @@ void testB44Compression (const std::string& tempdir);
 void testB44ACompression (const std::string& tempdir);
 void testDWAACompression (const std::string& tempdir);
 void testDWABCompression (const std::string& tempdir);
+void testIntraChunkCompression (const std::string& tempdir);
+void testDWAChannelRules (const std::string& tempdir);
+void testSelectCompression (const std::string& tempdir);
 void testHTChannelMap (const std::string& tempdir);
 void testHTHeaderBounds (const std::string& tempdir);
 
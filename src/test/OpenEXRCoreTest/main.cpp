@@ -178,6 +178,10 @@ main (int argc, char* argv[])
     TEST (testReadMultiPart, "core_read");
     TEST (testReadDeep, "core_read");
     TEST (testReadUnpack, "core_read");
+    TEST (testReadMemoryMapped, "core_read");
+    TEST (testReadChunksBatched, "core_read");
+    TEST (testDecodeBufferPool, "core_read");
+    TEST (testDecodingQueue, "core_read");
     TEST (testSamplingCalcs, "core_read");
 
     TEST (testWriteBadArgs, "core_write");
@@ -209,6 +213,9 @@ main (int argc, char* argv[])
     TEST (testB44ACompression, "core_compression");
     TEST (testDWAACompression, "core_compression");
     TEST (testDWABCompression, "core_compression");
+    TEST (testIntraChunkCompression, "core_compression");
+    TEST (testDWAChannelRules, "core_compression");
+    TEST (testSelectCompression, "core_compression");
     TEST (testHTChannelMap, "core_compression");
     TEST (testHTHeaderBounds, "core_compression");
 
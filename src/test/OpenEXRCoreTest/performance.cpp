@@ -4,11 +4,15 @@
 #include <errno.h>
 #include <iomanip>
 #include <iostream>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -396,11 +400,549 @@ readImf (
     }
 }
 
+class SmallTask : public Task
+{
+public:
+    SmallTask (TaskGroup* g, std::atomic<uint64_t>& sum, int work)
+        : Task (g), _sum (sum), _work (work)
+    {}
+    void execute () override
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < _work; ++i)
+            v += (uint64_t) i * 2654435761u;
+        _sum.fetch_add (v | 1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t>& _sum;
+    int                    _work;
+};
+
+class FanOutTask : public Task
+{
+public:
+    FanOutTask (
+        TaskGroup* g, ThreadPool& pool, std::atomic<uint64_t>& sum, int depth)
+        : Task (g), _pool (pool), _sum (sum), _depth (depth)
+    {}
+    void execute () override
+    {
+        _sum.fetch_add (1, std::memory_order_relaxed);
+        if (_depth > 0)
+        {
+            for (int i = 0; i < 8; ++i)
+                _pool.addTask (
+                    new FanOutTask (group (), _pool, _sum, _depth - 1));
+        }
+    }
+
+private:
+    ThreadPool&            _pool;
+    std::atomic<uint64_t>& _sum;
+    int                    _depth;
+};
+
+static uint64_t
+timeFlatTasks (ThreadPool& pool, int ntasks, int work)
+{
+    std::atomic<uint64_t> sum{0};
+    auto                  start = std::chrono::steady_clock::now ();
+    {
+        TaskGroup g;
+        for (int t = 0; t < ntasks; ++t)
+            pool.addTask (new SmallTask (&g, sum, work));
+    }
+    auto end = std::chrono::steady_clock::now ();
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (end - start)
+        .count ();
+}
+
+static uint64_t
+timeFanOutTasks (ThreadPool& pool, int depth)
+{
+    std::atomic<uint64_t> sum{0};
+    auto                  start = std::chrono::steady_clock::now ();
+    {
+        TaskGroup g;
+        pool.addTask (new FanOutTask (&g, pool, sum, depth));
+    }
+    auto end = std::chrono::steady_clock::now ();
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (end - start)
+        .count ();
+}
+
+static int
+benchThreadPool ()
+{
+    // many small tasks is the pattern the chunk-per-task decode
+    // paths produce, where queue contention rather than the work
+    // dominates
+    constexpr int ntasks = 200000;
+    constexpr int depth  = 5; // 8^0 + ... + 8^5 = 37449 tasks
+    constexpr int reps   = 5;
+
+    std::vector<int> counts = {1, 2, 4, 8};
+    int              hw     = ThreadPool::estimateThreadCountForFileIO ();
+    if (hw > 8) counts.push_back (hw);
+
+    std::cout << "Thread pool: " << ntasks
+              << " flat tasks, fan-out depth " << depth << ", best of "
+              << reps << " (ns)\n\n"
+              << std::setw (8) << std::left << "threads" << std::setw (15)
+              << "flat default" << std::setw (15) << "flat steal"
+              << std::setw (15) << "fan default" << std::setw (15)
+              << "fan steal" << std::endl;
+
+    for (int n: counts)
+    {
+        uint64_t best[4] = {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX};
+        for (int r = 0; r < reps; ++r)
+        {
+            for (int p = 0; p < 2; ++p)
+            {
+                ThreadPool pool (0);
+                if (p == 0)
+                    pool.setNumThreads (n);
+                else
+                    pool.setThreadProvider (
+                        ThreadPool::createWorkStealingProvider (n));
+
+                best[p] =
+                    std::min (best[p], timeFlatTasks (pool, ntasks, 64));
+                best[p + 2] =
+                    std::min (best[p + 2], timeFanOutTasks (pool, depth));
+            }
+        }
+        std::cout << std::setw (8) << std::left << n;
+        for (int b = 0; b < 4; ++b)
+            std::cout << std::setw (15) << best[b];
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+//
+// Streams over a block of memory, standing in for a decode task
+// writing its destination frame buffer slice
+//
+class StreamTask : public Task
+{
+public:
+    StreamTask (TaskGroup* g, uint64_t* block, size_t count, int passes)
+        : Task (g), _block (block), _count (count), _passes (passes)
+    {}
+    void execute () override
+    {
+        for (int p = 0; p < _passes; ++p)
+            for (size_t i = 0; i < _count; ++i)
+                _block[i] = _block[i] * 3 + 1;
+    }
+
+private:
+    uint64_t* _block;
+    size_t    _count;
+    int       _passes;
+};
+
+static uint64_t
+timeStreamTasks (
+    ThreadPool&                   pool,
+    const std::vector<uint64_t*>& blocks,
+    const std::vector<int>&       nodes,
+    size_t                        count,
+    int                           passes)
+{
+    auto start = std::chrono::steady_clock::now ();
+    {
+        TaskGroup g;
+        for (size_t b = 0; b < blocks.size (); ++b)
+        {
+            Task* t = new StreamTask (&g, blocks[b], count, passes);
+            if (!nodes.empty ()) t->setPreferredNode (nodes[b]);
+            pool.addTask (t);
+        }
+    }
+    auto end = std::chrono::steady_clock::now ();
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (end - start)
+        .count ();
+}
+
+static int
+benchAffinity ()
+{
+    // blocks are first touched by threads spread over the NUMA nodes,
+    // then streamed over by tasks that either run anywhere or are
+    // hinted to run on the node holding their block
+    constexpr size_t blockBytes = 4 << 20;
+    constexpr size_t nblocks    = 64;
+    constexpr size_t count      = blockBytes / sizeof (uint64_t);
+    constexpr int    passes     = 4;
+    constexpr int    reps       = 5;
+
+    int nthreads = ThreadPool::estimateThreadCountForFileIO ();
+    int nnodes   = ThreadPool::numNumaNodes ();
+
+    std::vector<std::unique_ptr<uint64_t[]>> storage;
+    std::vector<uint64_t*>                   blocks;
+    for (size_t b = 0; b < nblocks; ++b)
+    {
+        // left uninitialized such that the first touch places it
+        storage.emplace_back (new uint64_t[count]);
+        blocks.push_back (storage.back ().get ());
+    }
+
+    ThreadPool pool (0);
+    pool.setThreadAffinity (THREAD_AFFINITY_SCATTER);
+    pool.setThreadProvider (ThreadPool::createWorkStealingProvider (nthreads));
+    timeStreamTasks (pool, blocks, std::vector<int> (), count, 1);
+
+    std::vector<int> nodes;
+    std::vector<int> perNode (nnodes, 0);
+    for (uint64_t* b: blocks)
+    {
+        nodes.push_back (ThreadPool::numaNodeOfAddress (b));
+        if (nodes.back () >= 0 && nodes.back () < nnodes)
+            ++perNode[nodes.back ()];
+    }
+
+    std::cout << "Thread affinity: " << nthreads << " threads, " << nnodes
+              << " NUMA node(s), " << nblocks << " x " << (blockBytes >> 20)
+              << " MiB blocks, best of " << reps << "\n";
+    for (int n = 0; n < nnodes; ++n)
+        std::cout << "  node " << n << ": " << perNode[n] << " blocks\n";
+    if (nnodes < 2)
+        std::cout << "  (single node, no cross-node traffic to save)\n";
+    std::cout << "\n"
+              << std::setw (24) << std::left << "mode" << std::setw (15)
+              << "ns" << "GB/s" << std::endl;
+
+    static const char* names[] = {
+        "unpinned", "scatter", "scatter + node hints"};
+    for (int m = 0; m < 3; ++m)
+    {
+        pool.setThreadAffinity (
+            m == 0 ? THREAD_AFFINITY_NONE : THREAD_AFFINITY_SCATTER);
+
+        uint64_t best = UINT64_MAX;
+        for (int r = 0; r < reps; ++r)
+            best = std::min (
+                best,
+                timeStreamTasks (
+                    pool,
+                    blocks,
+                    m == 2 ? nodes : std::vector<int> (),
+                    count,
+                    passes));
+
+        // each pass reads and writes every block
+        double bytes = 2.0 * double (blockBytes) * double (nblocks) * passes;
+        std::cout << std::setw (24) << std::left << names[m] << std::setw (15)
+                  << best << std::fixed << std::setprecision (2)
+                  << bytes / double (best) << std::endl;
+    }
+    return 0;
+}
+
+static int
+benchPiz ()
+{
+    // one full PIZ chunk of RGBA half data, where the wavelet
+    // transform and the huffman coder dominate. Smooth data keeps
+    // the lut-compacted values below 14 bits, noise forces the
+    // 16 bit (modulo arithmetic) wavelet
+    constexpr int width = 4096;
+    constexpr int nchan = 4;
+    constexpr int reps  = 50;
+
+    Header hdr (width, 32);
+    hdr.compression () = PIZ_COMPRESSION;
+    hdr.channels ().insert ("A", Channel (HALF));
+    hdr.channels ().insert ("B", Channel (HALF));
+    hdr.channels ().insert ("G", Channel (HALF));
+    hdr.channels ().insert ("R", Channel (HALF));
+
+    std::unique_ptr<Compressor> comp (
+        newCompressor (PIZ_COMPRESSION, width * nchan * 2, hdr));
+    int lines = comp->numScanLines ();
+
+    std::cout << "PIZ: " << width << " x " << lines << " x " << nchan
+              << " half chunk, best of " << reps << "\n\n"
+              << std::setw (10) << std::left << "data" << std::setw (15)
+              << "compress ns" << std::setw (10) << "MB/s" << std::setw (15)
+              << "uncompress ns" << "MB/s" << std::endl;
+
+    static const char* names[] = {"smooth", "noise"};
+    for (int d = 0; d < 2; ++d)
+    {
+        std::vector<uint16_t> raw ((size_t) width * lines * nchan);
+        uint32_t              seed = 1;
+        for (int y = 0; y < lines; ++y)
+            for (int c = 0; c < nchan; ++c)
+                for (int x = 0; x < width; ++x)
+                {
+                    uint16_t v;
+                    if (d == 0)
+                        v = (uint16_t) (0x3800 + ((x / 8 + y + c * 64) & 0x3FF));
+                    else
+                    {
+                        seed = seed * 1664525u + 1013904223u;
+                        v    = (uint16_t) (seed >> 16);
+                    }
+                    raw[((size_t) y * nchan + c) * width + x] = v;
+                }
+
+        const char* rawPtr  = reinterpret_cast<const char*> (raw.data ());
+        int         rawSize = (int) (raw.size () * sizeof (uint16_t));
+
+        const char*       outPtr;
+        std::vector<char> packed;
+        uint64_t          bestC = UINT64_MAX, bestU = UINT64_MAX;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  csize = comp->compress (rawPtr, rawSize, 0, outPtr);
+            auto end   = std::chrono::steady_clock::now ();
+            bestC      = std::min<uint64_t> (
+                bestC,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            packed.assign (outPtr, outPtr + csize);
+        }
+
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  usize = comp->uncompress (
+                packed.data (), (int) packed.size (), 0, outPtr);
+            auto end = std::chrono::steady_clock::now ();
+            bestU    = std::min<uint64_t> (
+                bestU,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            if (usize != rawSize || memcmp (outPtr, rawPtr, rawSize) != 0)
+            {
+                std::cerr << "ERROR: PIZ round trip mismatch" << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << std::setw (10) << std::left << names[d] << std::setw (15)
+                  << bestC << std::setw (10) << std::fixed
+                  << std::setprecision (1)
+                  << double (rawSize) * 1e3 / double (bestC) << std::setw (15)
+                  << bestU << double (rawSize) * 1e3 / double (bestU)
+                  << std::endl;
+    }
+    return 0;
+}
+
+static int
+benchPxr24 ()
+{
+    // one full PXR24 chunk of the FLOAT channels of a depth / position
+    // AOV. The float24 rounding, predictor and byte plane split run
+    // before zlib; smooth data compresses well so their share of the
+    // total is largest there, noise is dominated by zlib
+    constexpr int width = 4096;
+    constexpr int nchan = 4;
+    constexpr int reps  = 50;
+
+    Header hdr (width, 16);
+    hdr.compression () = PXR24_COMPRESSION;
+    hdr.channels ().insert ("P.x", Channel (FLOAT));
+    hdr.channels ().insert ("P.y", Channel (FLOAT));
+    hdr.channels ().insert ("P.z", Channel (FLOAT));
+    hdr.channels ().insert ("Z", Channel (FLOAT));
+
+    std::unique_ptr<Compressor> comp (
+        newCompressor (PXR24_COMPRESSION, width * nchan * 4, hdr));
+    int lines = comp->numScanLines ();
+
+    std::cout << "PXR24: " << width << " x " << lines << " x " << nchan
+              << " float chunk, best of " << reps << "\n\n"
+              << std::setw (10) << std::left << "data" << std::setw (15)
+              << "compress ns" << std::setw (10) << "MB/s" << std::setw (15)
+              << "uncompress ns" << "MB/s" << std::endl;
+
+    static const char* names[] = {"smooth", "noise"};
+    for (int d = 0; d < 2; ++d)
+    {
+        std::vector<float> raw ((size_t) width * lines * nchan);
+        uint32_t           seed = 1;
+        for (int y = 0; y < lines; ++y)
+            for (int c = 0; c < nchan; ++c)
+                for (int x = 0; x < width; ++x)
+                {
+                    float v;
+                    if (d == 0)
+                        v = 10.f + float (x / 256) * 0.5f + float (x) * 0.01f +
+                            float (y + c) * 0.25f;
+                    else
+                    {
+                        seed = seed * 1664525u + 1013904223u;
+                        v    = float (seed >> 8) * 1e-4f - 800.f;
+                    }
+                    raw[((size_t) y * nchan + c) * width + x] = v;
+                }
+
+        const char* rawPtr  = reinterpret_cast<const char*> (raw.data ());
+        int         rawSize = (int) (raw.size () * sizeof (float));
+
+        const char*       outPtr;
+        std::vector<char> packed, expect;
+        uint64_t          bestC = UINT64_MAX, bestU = UINT64_MAX;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  csize = comp->compress (rawPtr, rawSize, 0, outPtr);
+            auto end   = std::chrono::steady_clock::now ();
+            bestC      = std::min<uint64_t> (
+                bestC,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            packed.assign (outPtr, outPtr + csize);
+        }
+
+        // FLOAT is lossy in PXR24, so only check that every pass
+        // decodes to the same thing
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  usize = comp->uncompress (
+                packed.data (), (int) packed.size (), 0, outPtr);
+            auto end = std::chrono::steady_clock::now ();
+            bestU    = std::min<uint64_t> (
+                bestU,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            if (r == 0) expect.assign (outPtr, outPtr + usize);
+            if (usize != rawSize || memcmp (outPtr, expect.data (), rawSize))
+            {
+                std::cerr << "ERROR: PXR24 round trip mismatch" << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << std::setw (10) << std::left << names[d] << std::setw (15)
+                  << bestC << std::setw (10) << std::fixed
+                  << std::setprecision (1)
+                  << double (rawSize) * 1e3 / double (bestC) << std::setw (15)
+                  << bestU << double (rawSize) * 1e3 / double (bestU)
+                  << std::endl;
+    }
+    return 0;
+}
+
+static int
+benchRle ()
+{
+    // one RLE scanline of RGBA half data. The byte predictor leaves
+    // long runs of zero deltas on flat regions, where the run scan
+    // dominates, noise is almost all literals
+    constexpr int width = 4096;
+    constexpr int nchan = 4;
+    constexpr int reps  = 200;
+
+    Header hdr (width, 16);
+    hdr.compression () = RLE_COMPRESSION;
+    hdr.channels ().insert ("A", Channel (HALF));
+    hdr.channels ().insert ("B", Channel (HALF));
+    hdr.channels ().insert ("G", Channel (HALF));
+    hdr.channels ().insert ("R", Channel (HALF));
+
+    std::unique_ptr<Compressor> comp (
+        newCompressor (RLE_COMPRESSION, width * nchan * 2, hdr));
+    int lines = comp->numScanLines ();
+
+    std::cout << "RLE: " << width << " x " << lines << " x " << nchan
+              << " half chunk, best of " << reps << "\n\n"
+              << std::setw (10) << std::left << "data" << std::setw (15)
+              << "compress ns" << std::setw (10) << "MB/s" << std::setw (15)
+              << "uncompress ns" << "MB/s" << std::endl;
+
+    static const char* names[] = {"flat", "noise"};
+    for (int d = 0; d < 2; ++d)
+    {
+        std::vector<uint16_t> raw ((size_t) width * lines * nchan);
+        uint32_t              seed = 1;
+        for (int y = 0; y < lines; ++y)
+            for (int c = 0; c < nchan; ++c)
+                for (int x = 0; x < width; ++x)
+                {
+                    uint16_t v;
+                    if (d == 0)
+                        v = (uint16_t) (0x3800 +
+                                        ((x / 96 + y + c * 64) & 0x3FF));
+                    else
+                    {
+                        seed = seed * 1664525u + 1013904223u;
+                        v    = (uint16_t) (seed >> 16);
+                    }
+                    raw[((size_t) y * nchan + c) * width + x] = v;
+                }
+
+        const char* rawPtr  = reinterpret_cast<const char*> (raw.data ());
+        int         rawSize = (int) (raw.size () * sizeof (uint16_t));
+
+        const char*       outPtr;
+        std::vector<char> packed;
+        uint64_t          bestC = UINT64_MAX, bestU = UINT64_MAX;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  csize = comp->compress (rawPtr, rawSize, 0, outPtr);
+            auto end   = std::chrono::steady_clock::now ();
+            bestC      = std::min<uint64_t> (
+                bestC,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            packed.assign (outPtr, outPtr + csize);
+        }
+
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now ();
+            int  usize = comp->uncompress (
+                packed.data (), (int) packed.size (), 0, outPtr);
+            auto end = std::chrono::steady_clock::now ();
+            bestU    = std::min<uint64_t> (
+                bestU,
+                std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    end - start)
+                    .count ());
+            if (usize != rawSize || memcmp (outPtr, rawPtr, rawSize) != 0)
+            {
+                std::cerr << "ERROR: RLE round trip mismatch" << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << std::setw (10) << std::left << names[d] << std::setw (15)
+                  << bestC << std::setw (10) << std::fixed
+                  << std::setprecision (1)
+                  << double (rawSize) * 1e3 / double (bestC) << std::setw (15)
+                  << bestU << double (rawSize) * 1e3 / double (bestU)
+                  << std::endl;
+    }
+    return 0;
+}
+
 static int
 usageAndExit (const char* argv0, int ec)
 {
     std::cerr << "Usage: " << argv0 << "[--imf|--core] <file1> [<file2>...]"
-              << std::endl;
+              << std::endl
+              << "       " << argv0 << " --threadpool" << std::endl
+              << "       " << argv0 << " --affinity" << std::endl
+              << "       " << argv0 << " --piz" << std::endl
+              << "       " << argv0 << " --pxr24" << std::endl
+              << "       " << argv0 << " --rle" << std::endl;
     return ec;
 }
 
@@ -426,6 +968,26 @@ main (int argc, char* argv[])
                 return usageAndExit (argv[0], 1);
             }
         }
+        else if (!strcmp (argv[a], "--threadpool"))
+        {
+            return benchThreadPool ();
+        }
+        else if (!strcmp (argv[a], "--affinity"))
+        {
+            return benchAffinity ();
+        }
+        else if (!strcmp (argv[a], "--piz"))
+        {
+            return benchPiz ();
+        }
+        else if (!strcmp (argv[a], "--pxr24"))
+        {
+            return benchPxr24 ();
+        }
+        else if (!strcmp (argv[a], "--rle"))
+        {
+            return benchRle ();
+        }
         else if (!strcmp (argv[a], "--core"))
         {
             coreOnly = true;
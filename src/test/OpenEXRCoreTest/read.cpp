@@ -15,6 +15,7 @@
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 static void
 err_cb (exr_const_context_t f, int code, const char* msg)
@@ -192,6 +193,10 @@ testReadMeta (const std::string& tempdir)
     EXRCORE_TEST (dlev == 45.f);
     EXRCORE_TEST_RVAL_FAIL (
         EXR_ERR_NOT_OPEN_WRITE, exr_set_dwa_compression_level (f, 0, 42.f));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_NOT_OPEN_WRITE,
+        exr_add_dwa_channel_rule (
+            f, 0, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
 
     exr_finish (&f);
 }
@@ -614,6 +619,667 @@ testReadUnpack (const std::string& tempdir)
         EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
     }
 
+    {
+        // mixed half / float channels converted to an interleaved,
+        // padded float layout must match the planar decode, including
+        // when a channel is skipped
+        struct pix
+        {
+            float g, z, pad;
+        };
+        exr_decode_pipeline_t decoder;
+        std::vector<float>    gref (24 * 12), zref (24 * 12);
+        std::vector<pix>      all (24 * 12), zonly (24 * 12);
+
+        EXRCORE_TEST_RVAL (exr_decoding_initialize (f, 0, &cinfo, &decoder));
+        for (int c = 0; c < 2; ++c)
+        {
+            decoder.channels[c].decode_to_ptr =
+                (uint8_t*) (c == 0 ? gref.data () : zref.data ());
+            decoder.channels[c].user_pixel_stride      = 4;
+            decoder.channels[c].user_line_stride       = 4 * 12;
+            decoder.channels[c].user_bytes_per_element = 4;
+            decoder.channels[c].user_data_type         = EXR_PIXEL_FLOAT;
+        }
+        EXRCORE_TEST_RVAL (
+            exr_decoding_choose_default_routines (f, 0, &decoder));
+        EXRCORE_TEST_RVAL (exr_decoding_run (f, 0, &decoder));
+        EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            pix* out = (pass == 0) ? all.data () : zonly.data ();
+
+            EXRCORE_TEST_RVAL (
+                exr_decoding_initialize (f, 0, &cinfo, &decoder));
+            decoder.channels[0].decode_to_ptr =
+                (pass == 0) ? (uint8_t*) &(out->g) : NULL;
+            decoder.channels[1].decode_to_ptr = (uint8_t*) &(out->z);
+            for (int c = 0; c < 2; ++c)
+            {
+                decoder.channels[c].user_pixel_stride = sizeof (pix);
+                decoder.channels[c].user_line_stride  = sizeof (pix) * 12;
+                decoder.channels[c].user_bytes_per_element = 4;
+                decoder.channels[c].user_data_type = EXR_PIXEL_FLOAT;
+            }
+            EXRCORE_TEST_RVAL (
+                exr_decoding_choose_default_routines (f, 0, &decoder));
+            EXRCORE_TEST_RVAL (exr_decoding_run (f, 0, &decoder));
+            EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
+        }
+
+        for (size_t i = 0; i < all.size (); ++i)
+        {
+            EXRCORE_TEST (all[i].g == gref[i]);
+            EXRCORE_TEST (all[i].z == zref[i]);
+            EXRCORE_TEST (all[i].pad == 0.f);
+            EXRCORE_TEST (zonly[i].g == 0.f);
+            EXRCORE_TEST (zonly[i].z == zref[i]);
+        }
+    }
+
+    exr_finish (&f);
+
+    {
+        // skipping the 2x2 subsampled chroma channels must not disturb
+        // the full resolution luma decoded next to them
+        const int             w = 16, h = 8;
+        std::string           sfn = tempdir + "unpack_subsampled.exr";
+        std::vector<uint16_t> chroma (w / 2 * h / 2), luma (w * h);
+        std::vector<uint16_t> restore (w * h, 0);
+        exr_encode_pipeline_t encoder;
+        exr_decode_pipeline_t decoder;
+        int                   partidx, lpc;
+
+        for (size_t i = 0; i < chroma.size (); ++i)
+            chroma[i] = (uint16_t) (0xb800 + i);
+        for (size_t i = 0; i < luma.size (); ++i)
+            luma[i] = (uint16_t) (0x3c00 + i);
+
+        EXRCORE_TEST_RVAL (exr_start_write (
+            &f, sfn.c_str (), EXR_WRITE_FILE_DIRECTLY, &cinit));
+        EXRCORE_TEST_RVAL (
+            exr_add_part (f, "scan", EXR_STORAGE_SCANLINE, &partidx));
+        EXRCORE_TEST_RVAL (exr_initialize_required_attr_simple (
+            f, partidx, w, h, EXR_COMPRESSION_ZIP));
+        EXRCORE_TEST_RVAL (exr_add_channel (
+            f, partidx, "BY", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 2, 2));
+        EXRCORE_TEST_RVAL (exr_add_channel (
+            f, partidx, "RY", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 2, 2));
+        EXRCORE_TEST_RVAL (exr_add_channel (
+            f, partidx, "Y", EXR_PIXEL_HALF, EXR_PERCEPTUALLY_LOGARITHMIC, 1, 1));
+        EXRCORE_TEST_RVAL (exr_write_header (f));
+        EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, partidx, &lpc));
+        EXRCORE_TEST (lpc >= h);
+
+        EXRCORE_TEST_RVAL (exr_write_scanline_chunk_info (f, partidx, 0, &cinfo));
+        EXRCORE_TEST_RVAL (
+            exr_encoding_initialize (f, partidx, &cinfo, &encoder));
+        for (int c = 0; c < encoder.channel_count; ++c)
+        {
+            exr_coding_channel_info_t& curch = encoder.channels[c];
+            bool                       isy   = curch.x_samples == 1;
+
+            curch.encode_from_ptr = reinterpret_cast<const uint8_t*> (
+                isy ? luma.data () : chroma.data ());
+            curch.user_pixel_stride      = sizeof (uint16_t);
+            curch.user_line_stride       = curch.width * sizeof (uint16_t);
+            curch.user_data_type         = EXR_PIXEL_HALF;
+            curch.user_bytes_per_element = sizeof (uint16_t);
+        }
+        EXRCORE_TEST_RVAL (
+            exr_encoding_choose_default_routines (f, partidx, &encoder));
+        EXRCORE_TEST_RVAL (exr_encoding_run (f, partidx, &encoder));
+        EXRCORE_TEST_RVAL (exr_encoding_destroy (f, &encoder));
+        EXRCORE_TEST_RVAL (exr_finish (&f));
+
+        EXRCORE_TEST_RVAL (exr_start_read (&f, sfn.c_str (), &cinit));
+        EXRCORE_TEST_RVAL (exr_read_scanline_chunk_info (f, 0, 0, &cinfo));
+        EXRCORE_TEST_RVAL (exr_decoding_initialize (f, 0, &cinfo, &decoder));
+        for (int c = 0; c < decoder.channel_count; ++c)
+        {
+            exr_coding_channel_info_t& curch = decoder.channels[c];
+
+            curch.decode_to_ptr =
+                curch.x_samples == 1 ? (uint8_t*) restore.data () : NULL;
+            curch.user_pixel_stride      = sizeof (uint16_t);
+            curch.user_line_stride       = w * sizeof (uint16_t);
+            curch.user_data_type         = EXR_PIXEL_HALF;
+            curch.user_bytes_per_element = sizeof (uint16_t);
+        }
+        EXRCORE_TEST_RVAL (exr_decoding_choose_default_routines (f, 0, &decoder));
+        EXRCORE_TEST_RVAL (exr_decoding_run (f, 0, &decoder));
+        EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
+        exr_finish (&f);
+        remove (sfn.c_str ());
+
+        for (size_t i = 0; i < luma.size (); ++i)
+            EXRCORE_TEST (restore[i] == luma[i]);
+    }
+}
+
+static void
+decodeScanlines (
+    exr_context_t f, bool asfloat, std::vector<uint8_t>& out, int* borrowed)
+{
+    int32_t ccount;
+    EXRCORE_TEST_RVAL (exr_get_chunk_count (f, 0, &ccount));
+
+    out.clear ();
+    *borrowed = 0;
+
+    exr_decode_pipeline_t decoder = EXR_DECODE_PIPELINE_INITIALIZER;
+    for (int32_t c = 0; c < ccount; ++c)
+    {
+        exr_chunk_info_t cinfo;
+        exr_attr_box2i_t dw;
+        int              lpc;
+        EXRCORE_TEST_RVAL (exr_get_data_window (f, 0, &dw));
+        EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, 0, &lpc));
+        EXRCORE_TEST_RVAL (
+            exr_read_scanline_chunk_info (f, 0, dw.min.y + c * lpc, &cinfo));
+
+        if (c == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_initialize (f, 0, &cinfo, &decoder));
+        }
+        else
+        {
+            EXRCORE_TEST_RVAL (exr_decoding_update (f, 0, &cinfo, &decoder));
+        }
+
+        size_t chanoff[128];
+        size_t total = out.size ();
+        EXRCORE_TEST (decoder.channel_count < 128);
+        for (int ch = 0; ch < decoder.channel_count; ++ch)
+        {
+            exr_coding_channel_info_t& decc = decoder.channels[ch];
+            if (asfloat)
+            {
+                decc.user_bytes_per_element = 4;
+                decc.user_data_type         = EXR_PIXEL_FLOAT;
+            }
+            decc.user_pixel_stride = decc.user_bytes_per_element;
+            decc.user_line_stride  = decc.width * decc.user_pixel_stride;
+            chanoff[ch]            = total;
+            total += (size_t) decc.height * (size_t) decc.user_line_stride;
+        }
+        out.resize (total);
+        for (int ch = 0; ch < decoder.channel_count; ++ch)
+            decoder.channels[ch].decode_to_ptr = out.data () + chanoff[ch];
+
+        if (c == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_choose_default_routines (f, 0, &decoder));
+        }
+
+        EXRCORE_TEST_RVAL (exr_decoding_run (f, 0, &decoder));
+
+        if (decoder.packed_buffer && decoder.packed_alloc_size == 0)
+            ++(*borrowed);
+    }
+    EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
+}
+
+static void
+decodeAllScanlines (
+    const std::string&    fn,
+    int                   flags,
+    bool                  asfloat,
+    std::vector<uint8_t>& out,
+    int*                  borrowed)
+{
+    exr_context_t             f;
+    exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    cinit.error_handler_fn          = &err_cb;
+    cinit.flags                     = flags;
+
+    EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+    decodeScanlines (f, asfloat, out, borrowed);
+    exr_finish (&f);
+}
+
+void
+testReadMemoryMapped (const std::string& tempdir)
+{
+    const char* files[] = {
+        "v1.7.test.interleaved.exr", "comp_zip.exr", "comp_piz.exr"};
+
+    for (const char* file: files)
+    {
+        std::string fn = ILM_IMF_TEST_IMAGEDIR;
+        fn += file;
+
+        for (int asfloat = 0; asfloat < 2; ++asfloat)
+        {
+            std::vector<uint8_t> readpix, mappedpix;
+            int                  readborrow, mappedborrow;
+
+            decodeAllScanlines (fn, 0, asfloat, readpix, &readborrow);
+            decodeAllScanlines (
+                fn,
+                EXR_CONTEXT_FLAG_MEMORY_MAP_READ,
+                asfloat,
+                mappedpix,
+                &mappedborrow);
+
+            EXRCORE_TEST (readborrow == 0);
+            EXRCORE_TEST (readpix.size () == mappedpix.size ());
+            EXRCORE_TEST (readpix == mappedpix);
+            if (strcmp (file, "v1.7.test.interleaved.exr") != 0 || asfloat)
+                EXRCORE_TEST (mappedborrow > 0);
+        }
+    }
+}
+
+void
+testDecodeBufferPool (const std::string& tempdir)
+{
+    exr_context_t                  f;
+    exr_context_initializer_t      cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    exr_decode_buffer_pool_stats_t stats;
+    std::vector<uint8_t>           first, second;
+    int                            borrowed;
+    std::string                    fn = ILM_IMF_TEST_IMAGEDIR;
+    fn += "comp_piz.exr";
+    cinit.error_handler_fn = &err_cb;
+
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_MISSING_CONTEXT_ARG,
+        exr_get_decode_buffer_pool_stats (NULL, &stats));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_MISSING_CONTEXT_ARG,
+        exr_set_decode_buffer_pool_limit (NULL, 0));
+
+    EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_get_decode_buffer_pool_stats (f, NULL));
+
+    EXRCORE_TEST_RVAL (exr_get_decode_buffer_pool_stats (f, &stats));
+    EXRCORE_TEST (stats.requests == 0);
+    EXRCORE_TEST (stats.cached_bytes == 0);
+    EXRCORE_TEST (stats.limit > 0);
+
+    /* the first pass fills the pool, the second should be all hits */
+    decodeScanlines (f, true, first, &borrowed);
+    EXRCORE_TEST_RVAL (exr_get_decode_buffer_pool_stats (f, &stats));
+    uint64_t firstreq = stats.requests;
+    uint64_t firsthit = stats.hits;
+    EXRCORE_TEST (firstreq > 0);
+    EXRCORE_TEST (stats.returns > 0);
+    EXRCORE_TEST (stats.cached_bytes > 0);
+    EXRCORE_TEST (stats.cached_bytes <= stats.limit);
+
+    decodeScanlines (f, true, second, &borrowed);
+    EXRCORE_TEST (first == second);
+    EXRCORE_TEST_RVAL (exr_get_decode_buffer_pool_stats (f, &stats));
+    EXRCORE_TEST (stats.requests > firstreq);
+    EXRCORE_TEST ((stats.hits - firsthit) == (stats.requests - firstreq));
+
+    /* shrinking the limit releases the pooled buffers */
+    EXRCORE_TEST_RVAL (exr_set_decode_buffer_pool_limit (f, 0));
+    EXRCORE_TEST_RVAL (exr_get_decode_buffer_pool_stats (f, &stats));
+    EXRCORE_TEST (stats.cached_bytes == 0);
+    EXRCORE_TEST (stats.limit == 0);
+    firstreq = stats.requests;
+
+    decodeScanlines (f, true, second, &borrowed);
+    EXRCORE_TEST (first == second);
+    EXRCORE_TEST_RVAL (exr_get_decode_buffer_pool_stats (f, &stats));
+    EXRCORE_TEST (stats.requests == firstreq);
+    EXRCORE_TEST (stats.cached_bytes == 0);
+
+    exr_finish (&f);
+}
+
+struct memstream
+{
+    std::vector<uint8_t> data;
+    int                  readcalls;
+    int                  batchcalls;
+    int                  batchruns;
+};
+
+static int64_t
+memstream_read (
+    exr_const_context_t         f,
+    void*                       userdata,
+    void*                       buffer,
+    uint64_t                    sz,
+    uint64_t                    offset,
+    exr_stream_error_func_ptr_t error_cb)
+{
+    memstream* ms = static_cast<memstream*> (userdata);
+    ++ms->readcalls;
+    if (offset >= ms->data.size ()) return 0;
+    if (sz > ms->data.size () - offset) sz = ms->data.size () - offset;
+    memcpy (buffer, ms->data.data () + offset, sz);
+    return (int64_t) sz;
+}
+
+static int64_t
+memstream_read_batch (
+    exr_const_context_t         f,
+    void*                       userdata,
+    const exr_read_request_t*   reqs,
+    int                         count,
+    exr_stream_error_func_ptr_t error_cb)
+{
+    memstream* ms    = static_cast<memstream*> (userdata);
+    int64_t    total = 0;
+    ++ms->batchcalls;
+    for (int i = 0; i < count; ++i)
+    {
+        EXRCORE_TEST (i == 0 || reqs[i].offset >= reqs[i - 1].offset);
+        if (i == 0 || reqs[i].offset != reqs[i - 1].offset + reqs[i - 1].size)
+            ++ms->batchruns;
+        if (reqs[i].offset + reqs[i].size > ms->data.size ()) return total;
+        memcpy (reqs[i].buffer, ms->data.data () + reqs[i].offset, reqs[i].size);
+        total += (int64_t) reqs[i].size;
+    }
+    return total;
+}
+
+static int64_t
+memstream_size (exr_const_context_t f, void* userdata)
+{
+    return (int64_t) static_cast<memstream*> (userdata)->data.size ();
+}
+
+static void
+compareBatchedRead (exr_context_t f, int part)
+{
+    int32_t ccount;
+    EXRCORE_TEST_RVAL (exr_get_chunk_count (f, part, &ccount));
+    EXRCORE_TEST (ccount > 1);
+
+    std::vector<exr_chunk_info_t> cinfos (ccount);
+    for (int32_t c = 0; c < ccount; ++c)
+    {
+        exr_storage_t store;
+        EXRCORE_TEST_RVAL (exr_get_storage (f, part, &store));
+        if (store == EXR_STORAGE_TILED)
+        {
+            int32_t tlx, tly;
+            int     levx, levy;
+            EXRCORE_TEST_RVAL (exr_get_tile_levels (f, part, &levx, &levy));
+            EXRCORE_TEST (levx == 1 && levy == 1);
+            EXRCORE_TEST_RVAL (
+                exr_get_tile_counts (f, part, 0, 0, &tlx, &tly));
+            EXRCORE_TEST_RVAL (exr_read_tile_chunk_info (
+                f, part, c % tlx, c / tlx, 0, 0, &cinfos[c]));
+        }
+        else
+        {
+            exr_attr_box2i_t dw;
+            int              lpc;
+            EXRCORE_TEST_RVAL (exr_get_data_window (f, part, &dw));
+            EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, part, &lpc));
+            EXRCORE_TEST_RVAL (exr_read_scanline_chunk_info (
+                f, part, dw.min.y + c * lpc, &cinfos[c]));
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> single (ccount), batched (ccount);
+    std::vector<void*>                ptrs (ccount);
+    for (int32_t c = 0; c < ccount; ++c)
+    {
+        single[c].resize (cinfos[c].packed_size);
+        batched[c].resize (cinfos[c].packed_size, 0xAB);
+        EXRCORE_TEST_RVAL (
+            exr_read_chunk (f, part, &cinfos[c], single[c].data ()));
+    }
+
+    /* request in reverse order to make sure they are sorted */
+    std::vector<exr_chunk_info_t> revinfos (cinfos.rbegin (), cinfos.rend ());
+    for (int32_t c = 0; c < ccount; ++c)
+        ptrs[c] = batched[ccount - c - 1].data ();
+
+    EXRCORE_TEST_RVAL (
+        exr_read_chunks (f, part, ccount, revinfos.data (), ptrs.data ()));
+    for (int32_t c = 0; c < ccount; ++c)
+        EXRCORE_TEST (single[c] == batched[c]);
+
+    EXRCORE_TEST_RVAL (exr_read_chunks (f, part, 0, NULL, NULL));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_read_chunks (f, part, ccount, cinfos.data (), NULL));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_read_chunks (f, part, -1, cinfos.data (), ptrs.data ()));
+    revinfos[0].idx = ccount;
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_read_chunks (f, part, ccount, revinfos.data (), ptrs.data ()));
+}
+
+void
+testReadChunksBatched (const std::string& tempdir)
+{
+    const char* files[] = {"comp_zip.exr", "v1.7.test.tiled.exr"};
+
+    for (const char* file: files)
+    {
+        exr_context_t             f;
+        exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+        std::string               fn    = ILM_IMF_TEST_IMAGEDIR;
+        fn += file;
+        cinit.error_handler_fn = &err_cb;
+
+        EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+        compareBatchedRead (f, 0);
+        exr_finish (&f);
+
+        cinit.flags = EXR_CONTEXT_FLAG_MEMORY_MAP_READ;
+        EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+        compareBatchedRead (f, 0);
+        exr_finish (&f);
+        cinit.flags = 0;
+
+        memstream ms;
+        FILE*     fp = fopen (fn.c_str (), "rb");
+        EXRCORE_TEST (fp != NULL);
+        fseek (fp, 0, SEEK_END);
+        ms.data.resize ((size_t) ftell (fp));
+        fseek (fp, 0, SEEK_SET);
+        EXRCORE_TEST (
+            fread (ms.data.data (), 1, ms.data.size (), fp) == ms.data.size ());
+        fclose (fp);
+
+        /* custom stream without batch support falls back to reads */
+        ms.readcalls = ms.batchcalls = ms.batchruns = 0;
+        cinit.user_data                             = &ms;
+        cinit.read_fn                               = &memstream_read;
+        cinit.size_fn                               = &memstream_size;
+        EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+        compareBatchedRead (f, 0);
+        exr_finish (&f);
+        EXRCORE_TEST (ms.batchcalls == 0);
+
+        /* and with, where the whole part should be one run */
+        ms.readcalls = ms.batchcalls = ms.batchruns = 0;
+        cinit.read_batch_fn                         = &memstream_read_batch;
+        EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+        compareBatchedRead (f, 0);
+        exr_finish (&f);
+        EXRCORE_TEST (ms.batchcalls == 1);
+        EXRCORE_TEST (ms.batchruns == 1);
+    }
+}
+
+static void
+decodeQueued (
+    const std::string& fn, int flags, int depth, std::vector<uint8_t>& out)
+{
+    exr_context_t             f;
+    exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    exr_decoding_queue_t      queue;
+    exr_decode_pipeline_t*    done;
+    exr_attr_box2i_t          dw;
+    int32_t                   ccount;
+    int                       lpc;
+    int                       expectidx = 0;
+
+    cinit.error_handler_fn = &err_cb;
+    cinit.flags            = flags;
+    EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+    EXRCORE_TEST_RVAL (exr_get_chunk_count (f, 0, &ccount));
+    EXRCORE_TEST_RVAL (exr_get_data_window (f, 0, &dw));
+    EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (f, 0, &lpc));
+    EXRCORE_TEST_RVAL (exr_decoding_queue_create (f, 0, depth, &queue));
+
+    std::vector<exr_decode_pipeline_t>  pipes (depth);
+    std::vector<exr_decode_pipeline_t*> avail;
+    std::vector<std::vector<uint8_t>>   chunkout (ccount);
+    for (int p = 0; p < depth; ++p)
+    {
+        pipes[p] = EXR_DECODE_PIPELINE_INITIALIZER;
+        avail.push_back (&pipes[p]);
+    }
+
+    for (int32_t c = 0; c <= ccount; ++c)
+    {
+        /* make room, or drain everything once all are submitted */
+        while (avail.empty () || (c == ccount && expectidx < ccount))
+        {
+            EXRCORE_TEST_RVAL (exr_decoding_queue_poll (queue, &done));
+            EXRCORE_TEST (done != NULL);
+            EXRCORE_TEST (done->chunk.idx == expectidx);
+            ++expectidx;
+            avail.push_back (done);
+        }
+        if (c == ccount) break;
+
+        exr_decode_pipeline_t* decoder = avail.back ();
+        exr_chunk_info_t       cinfo;
+        avail.pop_back ();
+
+        EXRCORE_TEST_RVAL (
+            exr_read_scanline_chunk_info (f, 0, dw.min.y + c * lpc, &cinfo));
+        bool first = (decoder->context == NULL);
+        if (first)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_initialize (f, 0, &cinfo, decoder));
+        }
+        else
+        {
+            EXRCORE_TEST_RVAL (exr_decoding_update (f, 0, &cinfo, decoder));
+        }
+
+        size_t chanoff[128];
+        size_t total = 0;
+        EXRCORE_TEST (decoder->channel_count < 128);
+        for (int ch = 0; ch < decoder->channel_count; ++ch)
+        {
+            exr_coding_channel_info_t& decc = decoder->channels[ch];
+            decc.user_bytes_per_element     = 4;
+            decc.user_data_type             = EXR_PIXEL_FLOAT;
+            decc.user_pixel_stride          = 4;
+            decc.user_line_stride           = decc.width * 4;
+            chanoff[ch]                     = total;
+            total += (size_t) decc.height * (size_t) decc.user_line_stride;
+        }
+        chunkout[c].resize (total);
+        for (int ch = 0; ch < decoder->channel_count; ++ch)
+            decoder->channels[ch].decode_to_ptr =
+                chunkout[c].data () + chanoff[ch];
+
+        if (first)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_choose_default_routines (f, 0, decoder));
+        }
+        EXRCORE_TEST_RVAL (exr_decoding_queue_submit (queue, decoder));
+    }
+
+    EXRCORE_TEST_RVAL (exr_decoding_queue_poll (queue, &done));
+    EXRCORE_TEST (done == NULL);
+    EXRCORE_TEST_RVAL (exr_decoding_queue_destroy (&queue));
+    EXRCORE_TEST (queue == NULL);
+
+    for (auto& p: pipes)
+        EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &p));
+    exr_finish (&f);
+
+    out.clear ();
+    for (auto& co: chunkout)
+        out.insert (out.end (), co.begin (), co.end ());
+}
+
+void
+testDecodingQueue (const std::string& tempdir)
+{
+    const char* files[] = {"comp_zip.exr", "comp_piz.exr"};
+
+    for (const char* file: files)
+    {
+        std::string fn = ILM_IMF_TEST_IMAGEDIR;
+        fn += file;
+
+        for (int flags: {0, (int) EXR_CONTEXT_FLAG_MEMORY_MAP_READ})
+        {
+            std::vector<uint8_t> ref, queued;
+            int                  borrowed;
+
+            decodeAllScanlines (fn, flags, true, ref, &borrowed);
+            for (int depth: {1, 3})
+            {
+                decodeQueued (fn, flags, depth, queued);
+                EXRCORE_TEST (ref == queued);
+            }
+        }
+    }
+
+    exr_context_t             f;
+    exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    exr_decoding_queue_t      queue;
+    exr_decode_pipeline_t*    done;
+    exr_chunk_info_t          cinfo;
+    exr_decode_pipeline_t     decoder = EXR_DECODE_PIPELINE_INITIALIZER;
+    std::string               fn      = ILM_IMF_TEST_IMAGEDIR;
+    fn += "comp_zip.exr";
+    cinit.error_handler_fn = &err_cb;
+
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_MISSING_CONTEXT_ARG,
+        exr_decoding_queue_create (NULL, 0, 1, &queue));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_submit (NULL, &decoder));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_poll (NULL, &done));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_destroy (NULL));
+
+    EXRCORE_TEST_RVAL (exr_start_read (&f, fn.c_str (), &cinit));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_ARGUMENT_OUT_OF_RANGE,
+        exr_decoding_queue_create (f, 1, 1, &queue));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_create (f, 0, 0, &queue));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_create (f, 0, 1, NULL));
+
+    EXRCORE_TEST_RVAL (exr_decoding_queue_create (f, 0, 1, &queue));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_poll (queue, NULL));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_submit (queue, NULL));
+    /* not initialized for this context */
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT, exr_decoding_queue_submit (queue, &decoder));
+
+    EXRCORE_TEST_RVAL (exr_read_scanline_chunk_info (f, 0, 0, &cinfo));
+    EXRCORE_TEST_RVAL (exr_decoding_initialize (f, 0, &cinfo, &decoder));
+    EXRCORE_TEST_RVAL (exr_decoding_queue_submit (queue, &decoder));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_ARGUMENT_OUT_OF_RANGE,
+        exr_decoding_queue_submit (queue, &decoder));
+    /* destroying with work pending leaves the pipeline to the caller */
+    EXRCORE_TEST_RVAL (exr_decoding_queue_destroy (&queue));
+    EXRCORE_TEST_RVAL (exr_decoding_destroy (f, &decoder));
     exr_finish (&f);
 }
 
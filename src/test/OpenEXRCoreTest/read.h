@@ -21,6 +21,10 @@ void testReadTiles (const std::string& tempdir);
 void testReadMultiPart (const std::string& tempdir);
 
 void testReadUnpack (const std::string& tempdir);
+void testReadMemoryMapped (const std::string& tempdir);
+void testReadChunksBatched (const std::string& tempdir);
+void testDecodeBufferPool (const std::string& tempdir);
+void testDecodingQueue (const std::string& tempdir);
 
 void testSamplingCalcs (const std::string& tempdir);
 
@@ -26,6 +26,9 @@
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <vector>
+
+#include <Imath/half.h>
 
 static void
 err_cb (exr_const_context_t f, exr_result_t code, const char* msg)
@@ -469,6 +472,46 @@ testWriteBaseHeader (const std::string& tempdir)
     EXRCORE_TEST_RVAL (exr_get_dwa_compression_level (outf, 0, &dlev));
     EXRCORE_TEST (dlev == 420.f);
 
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_MISSING_CONTEXT_ARG,
+        exr_add_dwa_channel_rule (
+            NULL, 0, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_ARGUMENT_OUT_OF_RANGE,
+        exr_add_dwa_channel_rule (
+            outf, 5, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, NULL, EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, "", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, "depth.Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, "Z", EXR_PIXEL_LAST_TYPE, EXR_DWA_CHANNEL_RLE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_LAST_TYPE, 0));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_INVALID_ARGUMENT,
+        exr_add_dwa_channel_rule (
+            outf, 0, "id", EXR_PIXEL_UINT, EXR_DWA_CHANNEL_LOSSY_DCT, 0));
+    EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+        outf, 0, "id", EXR_PIXEL_UINT, EXR_DWA_CHANNEL_RLE, 1));
+    EXRCORE_TEST_RVAL_FAIL (
+        EXR_ERR_MISSING_CONTEXT_ARG, exr_clear_dwa_channel_rules (NULL, 0));
+    EXRCORE_TEST_RVAL (exr_clear_dwa_channel_rules (outf, 0));
+    EXRCORE_TEST_RVAL (exr_add_dwa_channel_rule (
+        outf, 0, "Z", EXR_PIXEL_FLOAT, EXR_DWA_CHANNEL_RLE, 0));
+
     EXRCORE_TEST_RVAL (exr_finish (&outf));
     remove (outfn.c_str ());
 
@@ -1313,9 +1356,163 @@ void
 testUpdateMeta (const std::string& tempdir)
 {}
 
+static void
+writeAndCheckHalfScans (
+    const std::string& outfn, int nc, int pixstride, bool interleaved)
+{
+    // float input written to HALF channels, which takes the vector
+    // float to half packers, must match the scalar conversion bit for
+    // bit, including NaN, infinity and denormals
+    const int                 w = 97, h = 37;
+    exr_context_t             outf;
+    int                       partidx;
+    exr_context_initializer_t cinit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    cinit.error_handler_fn          = &err_cb;
+
+    const char* chans[] = {"A", "B", "G", "R"};
+    size_t      planesz = (size_t) w * (size_t) h * (size_t) pixstride;
+    std::vector<float> fsrc (
+        (interleaved ? planesz : planesz * nc) / sizeof (float));
+    std::vector<uint16_t> expect ((size_t) w * h * nc);
+
+    for (int c = 0; c < nc; ++c)
+    {
+        for (int i = 0; i < w * h; ++i)
+        {
+            float v;
+            switch (i % 7)
+            {
+                case 0: v = NAN; break;
+                case 1: v = (i & 1) ? INFINITY : -65520.f; break;
+                case 2: v = 1e-6f * (float) (i % 13); break;
+                default: v = (float) (i * (c + 1)) / 17.f - 40.f; break;
+            }
+            if (i % 97 == 5)
+            {
+                uint32_t snan = 0x7f800001 + (uint32_t) (c << 13);
+                memcpy (&v, &snan, sizeof (v));
+            }
+            size_t idx = interleaved ? ((size_t) i * pixstride +
+                                        (size_t) c * sizeof (float))
+                                     : ((size_t) c * planesz +
+                                        (size_t) i * pixstride);
+            fsrc[idx / sizeof (float)]        = v;
+            expect[(size_t) c * w * h + i] = half (v).bits ();
+        }
+    }
+
+    EXRCORE_TEST_RVAL (exr_start_write (
+        &outf, outfn.c_str (), EXR_WRITE_FILE_DIRECTLY, &cinit));
+    EXRCORE_TEST_RVAL (
+        exr_add_part (outf, "beauty", EXR_STORAGE_SCANLINE, &partidx));
+    EXRCORE_TEST_RVAL (exr_initialize_required_attr_simple (
+        outf, partidx, w, h, EXR_COMPRESSION_ZIP));
+    for (int c = 0; c < nc; ++c)
+        EXRCORE_TEST_RVAL (exr_add_channel (
+            outf,
+            partidx,
+            chans[c],
+            EXR_PIXEL_HALF,
+            EXR_PERCEPTUALLY_LOGARITHMIC,
+            1,
+            1));
+    EXRCORE_TEST_RVAL (exr_write_header (outf));
+
+    int32_t scansperchunk;
+    EXRCORE_TEST_RVAL (exr_get_scanlines_per_chunk (outf, 0, &scansperchunk));
+
+    exr_encode_pipeline_t encoder;
+    for (int y = 0; y < h; y += scansperchunk)
+    {
+        exr_chunk_info_t cinfo;
+        EXRCORE_TEST_RVAL (exr_write_scanline_chunk_info (outf, 0, y, &cinfo));
+        if (y == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_encoding_initialize (outf, 0, &cinfo, &encoder));
+        }
+        else
+        {
+            EXRCORE_TEST_RVAL (
+                exr_encoding_update (outf, 0, &cinfo, &encoder));
+        }
+
+        const uint8_t* base = reinterpret_cast<const uint8_t*> (fsrc.data ());
+        for (int c = 0; c < nc; ++c)
+        {
+            size_t off = interleaved ? (size_t) c * sizeof (float)
+                                     : (size_t) c * planesz;
+            encoder.channels[c].encode_from_ptr =
+                base + off + (size_t) y * w * pixstride;
+            encoder.channels[c].user_pixel_stride      = pixstride;
+            encoder.channels[c].user_line_stride       = w * pixstride;
+            encoder.channels[c].user_bytes_per_element = 4;
+            encoder.channels[c].user_data_type         = EXR_PIXEL_FLOAT;
+        }
+        if (y == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_encoding_choose_default_routines (outf, 0, &encoder));
+        }
+        EXRCORE_TEST_RVAL (exr_encoding_run (outf, 0, &encoder));
+    }
+    EXRCORE_TEST_RVAL (exr_encoding_destroy (outf, &encoder));
+    EXRCORE_TEST_RVAL (exr_finish (&outf));
+
+    EXRCORE_TEST_RVAL (exr_start_read (&outf, outfn.c_str (), &cinit));
+    exr_decode_pipeline_t decoder = EXR_DECODE_PIPELINE_INITIALIZER;
+    std::vector<uint16_t> got ((size_t) w * h * nc);
+    for (int y = 0; y < h; y += scansperchunk)
+    {
+        exr_chunk_info_t cinfo;
+        EXRCORE_TEST_RVAL (exr_read_scanline_chunk_info (outf, 0, y, &cinfo));
+        if (y == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_initialize (outf, 0, &cinfo, &decoder));
+        }
+        else
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_update (outf, 0, &cinfo, &decoder));
+        }
+        for (int c = 0; c < nc; ++c)
+        {
+            decoder.channels[c].decode_to_ptr = reinterpret_cast<uint8_t*> (
+                got.data () + (size_t) c * w * h + (size_t) y * w);
+            decoder.channels[c].user_pixel_stride = 2;
+            decoder.channels[c].user_line_stride  = w * 2;
+        }
+        if (y == 0)
+        {
+            EXRCORE_TEST_RVAL (
+                exr_decoding_choose_default_routines (outf, 0, &decoder));
+        }
+        EXRCORE_TEST_RVAL (exr_decoding_run (outf, 0, &decoder));
+    }
+    EXRCORE_TEST_RVAL (exr_decoding_destroy (outf, &decoder));
+    EXRCORE_TEST_RVAL (exr_finish (&outf));
+    remove (outfn.c_str ());
+
+    for (size_t i = 0; i < got.size (); ++i)
+        EXRCORE_TEST (got[i] == expect[i]);
+}
+
 void
 testWriteScans (const std::string& tempdir)
-{}
+{
+    std::string outfn = tempdir + "testwritescans.exr";
+
+    // planar
+    writeAndCheckHalfScans (outfn, 4, 4, false);
+    // planar with padding between pixels
+    writeAndCheckHalfScans (outfn, 3, 8, false);
+    // interleaved rgba and rgb
+    writeAndCheckHalfScans (outfn, 4, 16, true);
+    writeAndCheckHalfScans (outfn, 3, 12, true);
+    // interleaved with an unused trailing float
+    writeAndCheckHalfScans (outfn, 3, 16, true);
+}
 
 void
 testWriteTiles (const std::string& tempdir)
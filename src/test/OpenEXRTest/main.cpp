@@ -14,6 +14,7 @@
 #include "testBackwardCompatibility.h"
 #include "testBadTypeAttributes.h"
 #include "testChannels.h"
+#include "testChunkCache.h"
 #include "testCompositeDeepScanLine.h"
 #include "testCompression.h"
 #include "testCompressionApi.h"
@@ -58,6 +59,7 @@
 #include "testScanLineApi.h"
 #include "testSharedFrameBuffer.h"
 #include "testStandardAttributes.h"
+#include "testThreadPoolProvider.h"
 #include "testTiledCompression.h"
 #include "testTiledCopyPixels.h"
 #include "testTiledLineOrder.h"
@@ -200,6 +202,7 @@ main (int argc, char* argv[])
     TEST (testTiledCopyPixels, "basic");
     TEST (testTiledCompression, "basic");
     TEST (testTiledLineOrder, "basic");
+    TEST (testChunkCache, "basic");
     TEST (testScanLineApi, "basic");
     TEST (testExistingStreams, "core");
     TEST (testExistingStreamsUTF8, "core");
@@ -231,6 +234,7 @@ main (int argc, char* argv[])
     TEST (testRle, "core");
     TEST (testIDManifest, "core");
     TEST (testCpuId, "core");
+    TEST (testThreadPoolProvider, "core");
     TEST (testHeader, "basic");
 
     // NB: If you add a test here, make sure to enumerate it in the
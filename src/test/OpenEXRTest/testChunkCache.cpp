@@ -0,0 +1,241 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+#include "IlmThread.h"
+#include "ImfArray.h"
+#include "ImfChannelList.h"
+#include "ImfChunkCache.h"
+#include "ImfFrameBuffer.h"
+#include "ImfHeader.h"
+#include "ImfInputFile.h"
+#include "ImfOutputFile.h"
+#include "ImfThreading.h"
+#include "ImfTiledInputFile.h"
+#include "ImfTiledOutputFile.h"
+
+#include <Imath/half.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+using namespace OPENEXR_IMF_NAMESPACE;
+using namespace std;
+using namespace IMATH_NAMESPACE;
+
+namespace
+{
+
+const int W = 117;
+const int H = 97;
+
+void
+fillPixels (Array2D<half>& ph, Array2D<float>& pf, int seed)
+{
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+        {
+            ph[y][x] = half (float (sin (x * 0.25 + seed) + y % 7));
+            pf[y][x] = float (x % 13) * 0.5f + float (y + seed);
+        }
+}
+
+Header
+makeHeader ()
+{
+    Header hdr (W, H);
+    hdr.compression () = ZIP_COMPRESSION;
+    hdr.channels ().insert ("H", Channel (HALF));
+    hdr.channels ().insert ("F", Channel (FLOAT));
+    return hdr;
+}
+
+void
+insertSlices (FrameBuffer& fb, Array2D<half>& ph, Array2D<float>& pf)
+{
+    fb.insert (
+        "H",
+        Slice (
+            HALF,
+            (char*) &ph[0][0],
+            sizeof (ph[0][0]),
+            sizeof (ph[0][0]) * W));
+    fb.insert (
+        "F",
+        Slice (
+            FLOAT,
+            (char*) &pf[0][0],
+            sizeof (pf[0][0]),
+            sizeof (pf[0][0]) * W));
+}
+
+void
+writeFile (const string& fileName, bool tiled, int seed)
+{
+    Array2D<half>  ph (H, W);
+    Array2D<float> pf (H, W);
+    fillPixels (ph, pf, seed);
+
+    FrameBuffer fb;
+    insertSlices (fb, ph, pf);
+
+    remove (fileName.c_str ());
+
+    Header hdr = makeHeader ();
+    if (tiled)
+    {
+        hdr.setTileDescription (TileDescription (32, 32, ONE_LEVEL));
+        TiledOutputFile out (fileName.c_str (), hdr);
+        out.setFrameBuffer (fb);
+        out.writeTiles (0, out.numXTiles () - 1, 0, out.numYTiles () - 1);
+    }
+    else
+    {
+        OutputFile out (fileName.c_str (), hdr);
+        out.setFrameBuffer (fb);
+        out.writePixels (H);
+    }
+}
+
+//
+// Read the whole file through a fresh reader and compare against the
+// seed. Scan line files are read one line at a time so re-reading the
+// same chunk is exercised as well.
+//
+
+void
+readAndCompare (const string& fileName, bool tiled, int seed)
+{
+    Array2D<half>  ph (H, W);
+    Array2D<float> pf (H, W);
+    Array2D<half>  rh (H, W);
+    Array2D<float> rf (H, W);
+    fillPixels (ph, pf, seed);
+
+    FrameBuffer fb;
+    insertSlices (fb, rh, rf);
+
+    if (tiled)
+    {
+        TiledInputFile in (fileName.c_str ());
+        in.setFrameBuffer (fb);
+        in.readTiles (0, in.numXTiles () - 1, 0, in.numYTiles () - 1);
+    }
+    else
+    {
+        InputFile in (fileName.c_str ());
+        in.setFrameBuffer (fb);
+        for (int y = 0; y < H; ++y)
+            in.readPixels (y);
+    }
+
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+        {
+            assert (rh[y][x].bits () == ph[y][x].bits ());
+            assert (rf[y][x] == pf[y][x]);
+        }
+}
+
+void
+testCache (const string& fileName, bool tiled)
+{
+    const uint64_t nchunks = tiled ? 16 : (H + 15) / 16;
+
+    cout << (tiled ? " tiled" : " scan line") << flush;
+
+    writeFile (fileName, tiled, 0);
+
+    clearChunkCache ();
+    resetChunkCacheStats ();
+    setChunkCacheCapacity (64 * 1024 * 1024);
+
+    // first reader decompresses and fills the cache
+    readAndCompare (fileName, tiled, 0);
+    ChunkCacheStats s = chunkCacheStats ();
+    assert (s.hits == 0);
+    assert (s.misses == nchunks);
+    assert (s.insertions == nchunks);
+    assert (s.entries == nchunks);
+    assert (s.evictions == 0);
+    assert (s.bytes > 0 && s.bytes <= s.capacity);
+
+    // second reader only unpacks
+    readAndCompare (fileName, tiled, 0);
+    s = chunkCacheStats ();
+    assert (s.hits == nchunks);
+    assert (s.misses == nchunks);
+    assert (s.insertions == nchunks);
+
+    // rewriting the file must not hit stale entries
+    writeFile (fileName, tiled, 3);
+    readAndCompare (fileName, tiled, 3);
+    s = chunkCacheStats ();
+    assert (s.hits == nchunks);
+    assert (s.misses == 2 * nchunks);
+
+    // a budget of roughly two chunks forces evictions
+    size_t perChunk = s.bytes / s.entries;
+    setChunkCacheCapacity (2 * perChunk + perChunk / 2);
+    s = chunkCacheStats ();
+    assert (s.bytes <= s.capacity);
+    assert (s.evictions > 0);
+    readAndCompare (fileName, tiled, 3);
+    s = chunkCacheStats ();
+    assert (s.bytes <= s.capacity);
+    assert (s.entries < nchunks);
+
+    // disabling the cache releases everything and bypasses it
+    setChunkCacheCapacity (0);
+    resetChunkCacheStats ();
+    s = chunkCacheStats ();
+    assert (s.entries == 0 && s.bytes == 0);
+    readAndCompare (fileName, tiled, 3);
+    s = chunkCacheStats ();
+    assert (s.hits == 0 && s.misses == 0 && s.insertions == 0);
+
+    remove (fileName.c_str ());
+}
+
+} // namespace
+
+void
+testChunkCache (const std::string& tempDir)
+{
+    try
+    {
+        cout << "Testing the shared decompressed chunk cache" << endl;
+
+        int maxThreads = ILMTHREAD_NAMESPACE::supportsThreads () ? 3 : 0;
+
+        for (int n = 0; n <= maxThreads; n += 3)
+        {
+            if (ILMTHREAD_NAMESPACE::supportsThreads ())
+            {
+                setGlobalThreadCount (n);
+                cout << "\nnumber of threads: " << globalThreadCount ()
+                     << endl;
+            }
+
+            testCache (tempDir + "imf_test_chunk_cache.exr", false);
+            testCache (tempDir + "imf_test_chunk_cache.exr", true);
+            cout << endl;
+        }
+
+        clearChunkCache ();
+        resetChunkCacheStats ();
+
+        cout << "ok\n" << endl;
+    }
+    catch (const std::exception& e)
+    {
+        cerr << "ERROR -- caught exception: " << e.what () << endl;
+        assert (false);
+    }
+}
@@ -11,11 +11,13 @@
 #include "random.h"
 
 #include "Iex.h"
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <typeinfo>
 #include <vector>
@@ -24,6 +26,7 @@
 #include "ImfChannelList.h"
 #include "ImfCompositeDeepScanLine.h"
 #include "ImfCompression.h"
+#include "ImfDeepCompositing.h"
 #include "ImfDeepFrameBuffer.h"
 #include "ImfDeepScanLineInputPart.h"
 #include "ImfDeepScanLineOutputPart.h"
@@ -34,6 +37,7 @@
 #include "ImfMultiPartOutputFile.h"
 #include "ImfNamespace.h"
 #include "ImfPartType.h"
+#include "ImfStandardAttributes.h"
 #include "ImfThreading.h"
 
 namespace
@@ -53,8 +57,10 @@ using OPENEXR_IMF_NAMESPACE::MultiPartInputFile;
 
 using IMATH_NAMESPACE::Box2i;
 using OPENEXR_IMF_NAMESPACE::CompositeDeepScanLine;
+using OPENEXR_IMF_NAMESPACE::DeepCompositing;
 using OPENEXR_IMF_NAMESPACE::DeepFrameBuffer;
 using OPENEXR_IMF_NAMESPACE::DEEPSCANLINE;
+using OPENEXR_IMF_NAMESPACE::DIS_SORTED;
 using OPENEXR_IMF_NAMESPACE::DeepSlice;
 using OPENEXR_IMF_NAMESPACE::FLOAT;
 using OPENEXR_IMF_NAMESPACE::FrameBuffer;
@@ -181,6 +187,30 @@ public:
         return *this;
     }
 
+    // put the samples of each pixel in front to back order
+    void sortSamples ()
+    {
+        size_t z =
+            std::find (_channels.begin (), _channels.end (), "Z") -
+            _channels.begin ();
+        size_t zback =
+            std::find (_channels.begin (), _channels.end (), "ZBack") -
+            _channels.begin ();
+        if (zback == _channels.size ()) zback = z;
+
+        for (size_t i = 0; i < _samples.size (); i++)
+        {
+            std::stable_sort (
+                _samples[i].begin (),
+                _samples[i].end (),
+                [z, zback] (const vector<T>& a, const vector<T>& b) {
+                    if (a[z] < b[z]) return true;
+                    if (a[z] > b[z]) return false;
+                    return a[zback] < b[zback];
+                });
+        }
+    }
+
     // total number of samples - storage for one copy of everything is sizeof(T)*channels.size()*totalSamples
     size_t totalSamples () const
     {
@@ -495,7 +525,11 @@ make_pattern (data<DATA>& bob, int pattern_number)
 
 template <class T>
 void
-write_file (const char* filename, const data<T>& main, int number_of_parts)
+write_file (
+    const char*    filename,
+    const data<T>& main,
+    int            number_of_parts,
+    bool           sorted = false)
 {
     vector<Header> headers (number_of_parts);
 
@@ -528,6 +562,16 @@ write_file (const char* filename, const data<T>& main, int number_of_parts)
 
     if (number_of_parts > 1) { main.frak (sub_parts); }
 
+    if (sorted)
+    {
+        // sort the samples of each part, and say so in its header
+        for (int i = 0; i < number_of_parts; i++)
+        {
+            sub_parts[i].sortSamples ();
+            addDeepImageState (headers[i], DIS_SORTED);
+        }
+    }
+
     if (number_of_parts == 1) { main.setHeader (headers[0]); }
     else
     {
@@ -638,6 +682,81 @@ test_parts (
     remove (fn.c_str ());
 }
 
+//
+// a compositor that changes nothing, but has CompositeDeepScanLine
+// call it for every pixel instead of compositing whole rows itself
+//
+class PerPixelCompositing : public DeepCompositing
+{};
+
+//
+// the row compositing engine must give the same values, to the bit,
+// as calling DeepCompositing for each pixel
+//
+template <class T>
+void
+test_engines (
+    int                pattern_number,
+    int                number_of_parts,
+    bool               sorted,
+    const std::string& tempDir)
+{
+    std::string fn = tempDir + "imf_test_composite_deep_scanline_source.exr";
+
+    data<T> main;
+    make_pattern (main, pattern_number);
+    write_file (fn.c_str (), main, number_of_parts, sorted);
+
+    {
+        MultiPartInputFile  input (fn.c_str ());
+        vector<T>           results[2];
+        PerPixelCompositing perPixel;
+        Box2i               dw;
+
+        for (int engine = 0; engine < 2; engine++)
+        {
+            CompositeDeepScanLine          comp;
+            FrameBuffer                    testbuf;
+            vector<DeepScanLineInputPart*> parts (number_of_parts);
+
+            for (int i = 0; i < number_of_parts; i++)
+            {
+                parts[i] = new DeepScanLineInputPart (input, i);
+                comp.addSource (parts[i]);
+            }
+            if (engine == 1) comp.setCompositing (&perPixel);
+
+            dw = comp.dataWindow ();
+            main.setUpFrameBuffer (results[engine], testbuf, dw, false);
+            comp.setFrameBuffer (testbuf);
+
+            if (engine == 0)
+            {
+                // a line at a time, so lines get split between threads
+                for (int y = dw.min.y; y <= dw.max.y; y++)
+                    comp.readPixels (y, y);
+            }
+            else
+                comp.readPixels (dw.min.y, dw.max.y);
+
+            for (int i = 0; i < number_of_parts; i++)
+            {
+                delete parts[i];
+            }
+        }
+
+        assert (results[0].size () == results[1].size ());
+        assert (
+            memcmp (
+                &results[0][0],
+                &results[1][0],
+                results[0].size () * sizeof (T)) == 0);
+
+        main.checkValues (results[0], dw, false);
+    }
+    remove (fn.c_str ());
+}
+
 } // namespace
 
 void
@@ -686,6 +805,15 @@ testCompositeDeepScanLine (const std::string& tempDir)
         test_parts<half> (1, 4, true, false, tempDir);
         test_parts<half> (1, 4, false, true, tempDir);
 
+        cout << "Testing deep compositing engines agree:\n" << endl;
+
+        test_engines<float> (0, 1, false, tempDir);
+        test_engines<float> (1, 3, false, tempDir);
+        test_engines<half> (1, 4, false, tempDir);
+        test_engines<float> (0, 5, true, tempDir);
+        test_engines<float> (1, 3, true, tempDir);
+        test_engines<half> (1, 4, true, tempDir);
+
         if (passes == 2 && pass == 0)
         {
             cout << " testing with multithreading...\n";
@@ -16,7 +16,9 @@
 #include "IlmThreadPool.h"
 #include "ImfArray.h"
 #include "ImfChannelList.h"
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepFrameBuffer.h"
+#include "ImfDeepSampleCountIndex.h"
 #include "ImfDeepScanLineInputFile.h"
 #include "ImfDeepScanLineOutputFile.h"
 #include "ImfPartType.h"
@@ -538,6 +540,145 @@ readFile (
         }
 }
 
+void
+readFileSampleOffsets (
+    const std::string& filename,
+    int                channelCount,
+    bool               perLine,
+    bool               randomChannels)
+{
+    cout << " reading with sample offsets " << (perLine ? "per-line " : "")
+         << flush;
+
+    DeepScanLineInputFile file (filename.c_str (), 8);
+
+    const Box2i& dataWindow = file.header ().dataWindow ();
+
+    int width  = dataWindow.max.x - dataWindow.min.x + 1;
+    int height = dataWindow.max.y - dataWindow.min.y + 1;
+
+    Array2D<unsigned int> localSampleCount;
+    Array2D<uint64_t>     sampleOffsets;
+    localSampleCount.resizeErase (height, width);
+    sampleOffsets.resizeErase (height, width);
+
+    DeepFrameBuffer frameBuffer;
+
+    frameBuffer.insertSampleCountSlice (Slice (
+        IMF::UINT,
+        (char*) (&localSampleCount[0][0] - dataWindow.min.x -
+                 dataWindow.min.y * width),
+        sizeof (unsigned int) * 1,
+        sizeof (unsigned int) * width));
+    frameBuffer.insertSampleOffsetSlice (Slice (
+        IMF::UINT,
+        (char*) (&sampleOffsets[0][0] - dataWindow.min.x -
+                 dataWindow.min.y * width),
+        sizeof (uint64_t) * 1,
+        sizeof (uint64_t) * width));
+
+    file.setFrameBuffer (frameBuffer);
+    file.readPixelSampleCounts (dataWindow.min.y, dataWindow.max.y);
+
+    uint64_t total = frameBuffer.computeSampleOffsets (dataWindow);
+
+    // one block of samples per channel, plus a filled channel that is
+    // not in the file
+    vector<vector<char>> data (channelCount + 1);
+    vector<int>          read_channel (channelCount, 1);
+
+    for (int i = 0; i < channelCount; i++)
+    {
+        if (randomChannels) read_channel[i] = random_int (2);
+        if (!read_channel[i]) continue;
+
+        PixelType type       = IMF::UINT;
+        int       sampleSize = sizeof (unsigned int);
+        if (channelTypes[i] == 1)
+        {
+            type       = IMF::HALF;
+            sampleSize = sizeof (half);
+        }
+        if (channelTypes[i] == 2)
+        {
+            type       = IMF::FLOAT;
+            sampleSize = sizeof (float);
+        }
+
+        data[i].resize (total * sampleSize + 1);
+
+        stringstream ss;
+        ss << i;
+        frameBuffer.insert (
+            ss.str (),
+            DeepSlice (type, data[i].data (), 0, 0, sampleSize));
+    }
+
+    data[channelCount].resize (total * sizeof (float) + 1);
+    frameBuffer.insert (
+        "fill",
+        DeepSlice (
+            IMF::FLOAT,
+            data[channelCount].data (),
+            0,
+            0,
+            sizeof (float),
+            1,
+            1,
+            7.0));
+
+    file.setFrameBuffer (frameBuffer);
+
+    if (perLine)
+    {
+        for (int y = dataWindow.min.y; y <= dataWindow.max.y; ++y)
+            file.readPixels (y);
+    }
+    else
+        file.readPixels (dataWindow.min.y, dataWindow.max.y);
+
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+        {
+            assert (localSampleCount[i][j] == sampleCount[i][j]);
+
+            uint64_t     off = sampleOffsets[i][j];
+            unsigned int val = static_cast<unsigned int> (i * width + j) % 2049;
+            for (unsigned int l = 0; l < sampleCount[i][j]; l++)
+            {
+                for (int k = 0; k < channelCount; k++)
+                {
+                    if (!read_channel[k]) continue;
+
+                    if (channelTypes[k] == 0)
+                        assert (
+                            ((unsigned int*) data[k].data ())[off + l] == val);
+                    if (channelTypes[k] == 1)
+                        assert (((half*) data[k].data ())[off + l] == val);
+                    if (channelTypes[k] == 2)
+                        assert (((float*) data[k].data ())[off + l] == val);
+                }
+                assert (
+                    ((float*) data[channelCount].data ())[off + l] == 7.0f);
+            }
+        }
+
+    // writing from this layout is not supported
+    bool caught = false;
+    try
+    {
+        DeepScanLineOutputFile out (
+            (filename + ".out.exr").c_str (), file.header ());
+        out.setFrameBuffer (frameBuffer);
+    }
+    catch (...)
+    {
+        caught = true;
+    }
+    assert (caught);
+    remove ((filename + ".out.exr").c_str ());
+}
+
 void
 readWriteTest (
     const std::string& tempDir,
@@ -586,6 +727,9 @@ readWriteTest (
             displayWindow);
         readFile (filename, channelCount, eReadBulk, false);
         if (channelCount > 1) readFile (filename, channelCount, eReadBulk, true);
+        readFileSampleOffsets (filename, channelCount, i % 2 == 1, false);
+        if (channelCount > 1)
+            readFileSampleOffsets (filename, channelCount, i % 2 == 0, true);
         remove (filename.c_str ());
         cout << endl << flush;
     }
@@ -665,6 +809,432 @@ testCompressionTypeChecks ()
     assert (caught);
 }
 
+void
+testSampleCountIndex (const std::string& tempDir)
+{
+    cout << "Testing the deep sample count index" << endl;
+
+    std::string filename = tempDir + "imf_test_deep_sample_count_index.exr";
+    std::string sidecar  = filename + ".dsci";
+
+    //
+    // Samples only in scan lines 21 to 30, so that the index has
+    // blocks of sample counts both with and without samples
+    //
+
+    const Box2i dataWindow (V2i (-3, 5), V2i (20, 44));
+    const int   width  = dataWindow.max.x - dataWindow.min.x + 1;
+    const int   height = dataWindow.max.y - dataWindow.min.y + 1;
+
+    Array2D<unsigned int> counts (height, width);
+    Array2D<float*>       zPointers (height, width);
+    vector<float>         zData;
+    uint64_t              total = 0;
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int line     = y + dataWindow.min.y;
+            counts[y][x] = (line >= 21 && line <= 30) ? (x + y) % 3 : 0;
+            total += counts[y][x];
+        }
+    }
+
+    zData.resize (total);
+    for (size_t i = 0; i < zData.size (); ++i)
+        zData[i] = float (i);
+
+    float* z = zData.data ();
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            zPointers[y][x] = z;
+            z += counts[y][x];
+        }
+    }
+
+    Header hdr (
+        dataWindow,
+        dataWindow,
+        1,
+        IMATH_NAMESPACE::V2f (0, 0),
+        1,
+        INCREASING_Y,
+        ZIPS_COMPRESSION);
+    hdr.channels ().insert ("Z", Channel (IMF::FLOAT));
+    hdr.setType (DEEPSCANLINE);
+
+    remove (filename.c_str ());
+    {
+        DeepScanLineOutputFile file (filename.c_str (), hdr);
+
+        DeepFrameBuffer frameBuffer;
+        frameBuffer.insertSampleCountSlice (Slice::Make (
+            IMF::UINT, &counts[0][0], dataWindow));
+        frameBuffer.insert (
+            "Z",
+            DeepSlice (
+                IMF::FLOAT,
+                (char*) (&zPointers[0][0] - dataWindow.min.x -
+                         dataWindow.min.y * width),
+                sizeof (float*),
+                sizeof (float*) * width,
+                sizeof (float)));
+
+        file.setFrameBuffer (frameBuffer);
+        file.writePixels (height);
+    }
+
+    //
+    // Build the index, and check it after a round trip
+    // through a sidecar file
+    //
+
+    {
+        DeepSampleCountIndex built (filename.c_str ());
+        built.save (sidecar.c_str ());
+    }
+
+    DeepSampleCountIndex index;
+    index.load (sidecar.c_str ());
+
+    assert (index.dataWindow () == dataWindow);
+    assert (index.linesPerChunk () == 1);
+    assert (index.numChunks () == height);
+    assert (index.totalSampleCount () == total);
+    assert (index.sampleCount (5, 20) == 0);
+    assert (index.sampleCount (44, 21) == total);
+
+    for (int y = 0; y < height; ++y)
+    {
+        uint64_t lineTotal = 0;
+        for (int x = 0; x < width; ++x)
+            lineTotal += counts[y][x];
+
+        assert (index.chunkSampleCount (y) == lineTotal);
+    }
+
+    //
+    // Counts of a range of scan lines, served from the index only;
+    // lines outside the range are left alone
+    //
+
+    Array2D<unsigned int> localCounts (height, width);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            localCounts[y][x] = 1234;
+
+    DeepFrameBuffer frameBuffer;
+    frameBuffer.insertSampleCountSlice (
+        Slice::Make (IMF::UINT, &localCounts[0][0], dataWindow));
+
+    index.readPixelSampleCounts (frameBuffer, 15, 25);
+
+    for (int y = 0; y < height; ++y)
+    {
+        int line = y + dataWindow.min.y;
+        for (int x = 0; x < width; ++x)
+        {
+            if (line >= 15 && line <= 25)
+                assert (localCounts[y][x] == counts[y][x]);
+            else
+                assert (localCounts[y][x] == 1234);
+        }
+    }
+
+    //
+    // Two-phase read: the counts come from the index, the
+    // samples from the file
+    //
+
+    DeepScanLineInputFile file (filename.c_str (), 4);
+    file.setSampleCountIndex (
+        std::make_shared<const DeepSampleCountIndex> (index));
+    file.setFrameBuffer (frameBuffer);
+    file.readPixelSampleCounts (dataWindow.min.y, dataWindow.max.y);
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            assert (localCounts[y][x] == counts[y][x]);
+
+    vector<float>   localZ (index.totalSampleCount ());
+    Array2D<float*> localPointers (height, width);
+
+    z = localZ.data ();
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            localPointers[y][x] = z;
+            z += localCounts[y][x];
+        }
+    }
+
+    frameBuffer.insert (
+        "Z",
+        DeepSlice (
+            IMF::FLOAT,
+            (char*) (&localPointers[0][0] - dataWindow.min.x -
+                     dataWindow.min.y * width),
+            sizeof (float*),
+            sizeof (float*) * width,
+            sizeof (float)));
+    file.setFrameBuffer (frameBuffer);
+    file.readPixels (dataWindow.min.y, dataWindow.max.y);
+
+    assert (localZ == zData);
+
+    //
+    // An index of a file with a different layout is rejected,
+    // and so is a sidecar that is not an index
+    //
+
+    bool caught = false;
+    try
+    {
+        DeepSampleCountIndex other;
+        file.setSampleCountIndex (
+            std::make_shared<const DeepSampleCountIndex> (other));
+    }
+    catch (const IEX_NAMESPACE::ArgExc&)
+    {
+        caught = true;
+    }
+    assert (caught);
+
+    //
+    // So is the sidecar of an earlier version of a file
+    // with the same layout but different samples
+    //
+
+    std::string rewritten =
+        tempDir + "imf_test_deep_sample_count_index_rewritten.exr";
+
+    remove (rewritten.c_str ());
+    {
+        Array2D<unsigned int> ones (height, width);
+        Array2D<float*>       onePointers (height, width);
+        vector<float>         oneZ (size_t (width) * height, 1.0f);
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                ones[y][x]        = 1;
+                onePointers[y][x] = &oneZ[size_t (y) * width + x];
+            }
+        }
+
+        DeepScanLineOutputFile out (rewritten.c_str (), hdr);
+
+        DeepFrameBuffer outBuffer;
+        outBuffer.insertSampleCountSlice (
+            Slice::Make (IMF::UINT, &ones[0][0], dataWindow));
+        outBuffer.insert (
+            "Z",
+            DeepSlice (
+                IMF::FLOAT,
+                (char*) (&onePointers[0][0] - dataWindow.min.x -
+                         dataWindow.min.y * width),
+                sizeof (float*),
+                sizeof (float*) * width,
+                sizeof (float)));
+
+        out.setFrameBuffer (outBuffer);
+        out.writePixels (height);
+    }
+
+    caught = false;
+    try
+    {
+        DeepScanLineInputFile stale (rewritten.c_str ());
+        stale.setSampleCountIndex (
+            std::make_shared<const DeepSampleCountIndex> (index));
+    }
+    catch (const IEX_NAMESPACE::ArgExc&)
+    {
+        caught = true;
+    }
+    assert (caught);
+    remove (rewritten.c_str ());
+
+    //
+    // Uncompressed, moving samples between the pixels of a scan line
+    // leaves the chunk offsets, and so the fingerprint, unchanged.
+    // The index is accepted, but readPixels() checks the sample
+    // counts of each chunk and refuses the shifted ones
+    //
+
+    std::string original = tempDir + "imf_test_deep_sample_count_index_raw.exr";
+    std::string shifted =
+        tempDir + "imf_test_deep_sample_count_index_shifted.exr";
+
+    hdr.compression () = NO_COMPRESSION;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const std::string&    name = pass == 0 ? original : shifted;
+        Array2D<unsigned int> passCounts (height, width);
+
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                passCounts[y][x] = counts[y][(x + pass) % width];
+
+        remove (name.c_str ());
+
+        DeepScanLineOutputFile out (name.c_str (), hdr);
+
+        DeepFrameBuffer outBuffer;
+        outBuffer.insertSampleCountSlice (
+            Slice::Make (IMF::UINT, &passCounts[0][0], dataWindow));
+        outBuffer.insert (
+            "Z",
+            DeepSlice (
+                IMF::FLOAT,
+                (char*) (&zPointers[0][0] - dataWindow.min.x -
+                         dataWindow.min.y * width),
+                sizeof (float*),
+                sizeof (float*) * width,
+                sizeof (float)));
+
+        out.setFrameBuffer (outBuffer);
+        out.writePixels (height);
+    }
+
+    for (int threads = 0; threads <= 4; threads += 4)
+    {
+        DeepScanLineInputFile moved (shifted.c_str (), threads);
+        moved.setSampleCountIndex (std::make_shared<const DeepSampleCountIndex> (
+            DeepSampleCountIndex (original.c_str ())));
+        moved.setFrameBuffer (frameBuffer);
+        moved.readPixelSampleCounts (dataWindow.min.y, dataWindow.max.y);
+
+        // lines without samples are the same in both files
+        moved.readPixels (dataWindow.min.y, 20);
+
+        caught = false;
+        try
+        {
+            moved.readPixels (dataWindow.min.y, dataWindow.max.y);
+        }
+        catch (const IEX_NAMESPACE::ArgExc&)
+        {
+            caught = true;
+        }
+        assert (caught);
+    }
+    remove (original.c_str ());
+    remove (shifted.c_str ());
+
+    caught = false;
+    try
+    {
+        index.load (filename.c_str ());
+    }
+    catch (const IEX_NAMESPACE::InputExc&)
+    {
+        caught = true;
+    }
+    assert (caught);
+    assert (index.totalSampleCount () == total);
+
+    remove (filename.c_str ());
+    remove (sidecar.c_str ());
+}
+
+void
+testChunkStats (const std::string& tempDir)
+{
+    cout << "Testing the per-chunk statistics" << endl;
+
+    std::string filename = tempDir + "imf_test_deep_chunk_stats.exr";
+
+    //
+    // Only scan lines 21 to 30 hold samples, and the depth of
+    // a sample is its scan line number
+    //
+
+    const Box2i dataWindow (V2i (-3, 5), V2i (20, 68));
+    const int   width  = dataWindow.max.x - dataWindow.min.x + 1;
+    const int   height = dataWindow.max.y - dataWindow.min.y + 1;
+
+    Array2D<unsigned int> counts (height, width);
+    Array2D<float*>       zPointers (height, width);
+    vector<float>         zData;
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int line     = y + dataWindow.min.y;
+            counts[y][x] = (line >= 21 && line <= 30) ? 1 + x % 2 : 0;
+            zData.insert (zData.end (), counts[y][x], float (line));
+        }
+    }
+
+    float* z = zData.data ();
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            zPointers[y][x] = z;
+            z += counts[y][x];
+        }
+    }
+
+    Header hdr (
+        dataWindow,
+        dataWindow,
+        1,
+        IMATH_NAMESPACE::V2f (0, 0),
+        1,
+        INCREASING_Y,
+        ZIPS_COMPRESSION);
+    hdr.channels ().insert ("Z", Channel (IMF::FLOAT));
+    hdr.setType (DEEPSCANLINE);
+    addDeepChunkStats (hdr);
+
+    remove (filename.c_str ());
+    {
+        DeepScanLineOutputFile file (filename.c_str (), hdr);
+
+        DeepFrameBuffer frameBuffer;
+        frameBuffer.insertSampleCountSlice (Slice::Make (
+            IMF::UINT, &counts[0][0], dataWindow));
+        frameBuffer.insert (
+            "Z",
+            DeepSlice (
+                IMF::FLOAT,
+                (char*) (&zPointers[0][0] - dataWindow.min.x -
+                         dataWindow.min.y * width),
+                sizeof (float*),
+                sizeof (float*) * width,
+                sizeof (float)));
+
+        file.setFrameBuffer (frameBuffer);
+        file.writePixels (height);
+    }
+
+    DeepScanLineInputFile file (filename.c_str ());
+
+    assert (file.hasChunkStats ());
+    assert (file.chunkStats (5).sampleCount == 0);
+    assert (file.chunkStats (30).sampleCount == 36);
+    assert (file.chunkStats (25).minZ == 25);
+    assert (file.chunkStats (25).maxZ == 25);
+
+    vector<int> chunks = file.chunksWithSamples ();
+    assert (chunks.size () == 10 && chunks[0] == 21 && chunks[9] == 30);
+
+    chunks = file.chunksInDepthRange (29.5f, 100);
+    assert (chunks.size () == 1 && chunks[0] == 30);
+
+    assert (file.chunksInDepthRange (0, 20.5f).empty ());
+
+    remove (filename.c_str ());
+}
+
 }; // namespace
 
 namespace small
@@ -726,6 +1296,9 @@ testDeepScanLineBasic (const std::string& tempDir)
         readWriteTest (tempDir, 3, 25, dataWindow, displayWindow);
         readWriteTest (tempDir, 10, 10, dataWindow, displayWindow);
 
+        testSampleCountIndex (tempDir);
+        testChunkStats (tempDir);
+
         ThreadPool::globalThreadPool ().setNumThreads (numThreads);
 
         cout << "ok\n" << endl;
@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include "ImfDeepChunkStats.h"
 #include "ImfDeepTiledInputFile.h"
 #include "ImfDeepTiledOutputFile.h"
 
@@ -855,6 +856,159 @@ readFile (
         }
 }
 
+void
+readFileSampleOffsets (
+    int channelCount, bool perTile, const std::string& filename)
+{
+    cout << "reading with sample offsets " << (perTile ? "per-tile " : "")
+         << flush;
+
+    DeepTiledInputFile file (filename.c_str (), 4);
+
+    Array2D<unsigned int> localSampleCount;
+    Array2D<uint64_t>     sampleOffsets;
+    localSampleCount.resizeErase (height, width);
+    sampleOffsets.resizeErase (height, width);
+
+    int memOffset = dataWindow.min.x + dataWindow.min.y * width;
+
+    DeepFrameBuffer frameBuffer;
+    frameBuffer.insertSampleCountSlice (Slice (
+        IMF::UINT,
+        (char*) (&localSampleCount[0][0] - memOffset),
+        sizeof (unsigned int) * 1,
+        sizeof (unsigned int) * width));
+    frameBuffer.insertSampleOffsetSlice (Slice (
+        IMF::UINT,
+        (char*) (&sampleOffsets[0][0] - memOffset),
+        sizeof (uint64_t) * 1,
+        sizeof (uint64_t) * width));
+
+    for (int ly = 0; ly < file.numYLevels (); ly++)
+        for (int lx = 0; lx < file.numXLevels (); lx++)
+        {
+            Box2i dataWindowL = file.dataWindowForLevel (lx, ly);
+
+            // the sample counts have to be known before the offsets
+            // and the size of the sample blocks are
+            DeepFrameBuffer countBuffer;
+            countBuffer.insertSampleCountSlice (
+                frameBuffer.getSampleCountSlice ());
+            file.setFrameBuffer (countBuffer);
+            file.readPixelSampleCounts (
+                0,
+                file.numXTiles (lx) - 1,
+                0,
+                file.numYTiles (ly) - 1,
+                lx,
+                ly);
+
+            uint64_t total = frameBuffer.computeSampleOffsets (dataWindowL);
+
+            // one block of samples per channel, plus a filled channel
+            // that is not in the file
+            vector<vector<char>> data (channelCount + 1);
+            for (int k = 0; k < channelCount; k++)
+            {
+                PixelType type       = IMF::UINT;
+                int       sampleSize = sizeof (unsigned int);
+                if (channelTypes[k] == 1)
+                {
+                    type       = IMF::HALF;
+                    sampleSize = sizeof (half);
+                }
+                if (channelTypes[k] == 2)
+                {
+                    type       = IMF::FLOAT;
+                    sampleSize = sizeof (float);
+                }
+
+                data[k].resize (total * sampleSize + 1);
+
+                stringstream ss;
+                ss << k;
+                frameBuffer.insert (
+                    ss.str (),
+                    DeepSlice (type, data[k].data (), 0, 0, sampleSize));
+            }
+
+            data[channelCount].resize (total * sizeof (float) + 1);
+            frameBuffer.insert (
+                "fill",
+                DeepSlice (
+                    IMF::FLOAT,
+                    data[channelCount].data (),
+                    0,
+                    0,
+                    sizeof (float),
+                    1,
+                    1,
+                    7.0));
+
+            file.setFrameBuffer (frameBuffer);
+
+            if (perTile)
+            {
+                for (int i = 0; i < file.numYTiles (ly); i++)
+                    for (int j = 0; j < file.numXTiles (lx); j++)
+                        file.readTile (j, i, lx, ly);
+            }
+            else
+            {
+                file.readTiles (
+                    0,
+                    file.numXTiles (lx) - 1,
+                    0,
+                    file.numYTiles (ly) - 1,
+                    lx,
+                    ly);
+            }
+
+            for (int i = 0; i < file.levelHeight (ly); i++)
+                for (int j = 0; j < file.levelWidth (lx); j++)
+                {
+                    assert (
+                        localSampleCount[i][j] ==
+                        sampleCountWhole[ly][lx][i][j]);
+
+                    uint64_t     off = sampleOffsets[i][j];
+                    unsigned int val =
+                        static_cast<unsigned int> (i * width + j) % 2049;
+                    for (unsigned int l = 0; l < localSampleCount[i][j]; l++)
+                    {
+                        for (int k = 0; k < channelCount; k++)
+                        {
+                            char* d = data[k].data ();
+                            if (channelTypes[k] == 0)
+                                assert (((unsigned int*) d)[off + l] == val);
+                            if (channelTypes[k] == 1)
+                                assert (((half*) d)[off + l] == val);
+                            if (channelTypes[k] == 2)
+                                assert (((float*) d)[off + l] == val);
+                        }
+                        assert (
+                            ((float*) data[channelCount].data ())[off + l] ==
+                            7.0f);
+                    }
+                }
+        }
+
+    // writing from this layout is not supported
+    bool caught = false;
+    try
+    {
+        DeepTiledOutputFile out (
+            (filename + ".out.exr").c_str (), file.header ());
+        out.setFrameBuffer (frameBuffer);
+    }
+    catch (...)
+    {
+        caught = true;
+    }
+    assert (caught);
+    remove ((filename + ".out.exr").c_str ());
+}
+
 void
 readWriteTestWithAbsoluateCoordinates (
     int channelCount, int testTimes, const std::string& tempDir)
@@ -886,6 +1040,7 @@ readWriteTestWithAbsoluateCoordinates (
         generateRandomFile (channelCount, compression, true, false, fn);
         readFile (channelCount, true, false, false, fn);
         readFile (channelCount, true, false, true, fn);
+        readFileSampleOffsets (channelCount, i % 2 == 1, fn);
 
         remove (fn.c_str ());
         cout << endl << flush;
@@ -899,6 +1054,166 @@ readWriteTestWithAbsoluateCoordinates (
     }
 }
 
+void
+testChunkStats (const std::string& tempDir)
+{
+    cout << "Testing the per-tile statistics" << endl;
+
+    std::string filename = tempDir + "imf_test_deep_tile_stats.exr";
+
+    //
+    // A 4 by 3 grid of tiles.  Only the tiles with an even dx + dy
+    // hold samples, with depths dx * 10 + dy to dx * 10 + dy + 0.5.
+    //
+
+    const Box2i dw (V2i (-5, 3), V2i (34, 32));
+    const int   w        = dw.max.x - dw.min.x + 1;
+    const int   h        = dw.max.y - dw.min.y + 1;
+    const int   tileSize = 10;
+
+    Array2D<unsigned int> counts (h, w);
+    Array2D<float*>       zPointers (h, w);
+    Array2D<float*>       zBackPointers (h, w);
+    vector<float>         zData;
+    vector<float>         zBackData;
+
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int dx       = x / tileSize;
+            int dy       = y / tileSize;
+            counts[y][x] = ((dx + dy) % 2 == 0) ? 1 + (x + y) % 2 : 0;
+
+            for (unsigned int i = 0; i < counts[y][x]; ++i)
+            {
+                zData.push_back (float (dx * 10 + dy) + i * 0.25f);
+                zBackData.push_back (float (dx * 10 + dy) + 0.5f);
+            }
+        }
+    }
+
+    size_t offset = 0;
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            zPointers[y][x]     = zData.data () + offset;
+            zBackPointers[y][x] = zBackData.data () + offset;
+            offset += counts[y][x];
+        }
+    }
+
+    DeepFrameBuffer frameBuffer;
+    frameBuffer.insertSampleCountSlice (
+        Slice::Make (IMF::UINT, &counts[0][0], dw));
+    frameBuffer.insert (
+        "Z",
+        DeepSlice (
+            IMF::FLOAT,
+            (char*) (&zPointers[0][0] - dw.min.x - dw.min.y * w),
+            sizeof (float*),
+            sizeof (float*) * w,
+            sizeof (float)));
+    frameBuffer.insert (
+        "ZBack",
+        DeepSlice (
+            IMF::FLOAT,
+            (char*) (&zBackPointers[0][0] - dw.min.x - dw.min.y * w),
+            sizeof (float*),
+            sizeof (float*) * w,
+            sizeof (float)));
+
+    for (int withStats = 0; withStats < 2; ++withStats)
+    {
+        Header hdr (dw, dw);
+        hdr.channels ().insert ("Z", Channel (IMF::FLOAT));
+        hdr.channels ().insert ("ZBack", Channel (IMF::FLOAT));
+        hdr.setType (DEEPTILE);
+        hdr.setTileDescription (
+            TileDescription (tileSize, tileSize, ONE_LEVEL));
+        hdr.compression () = ZIPS_COMPRESSION;
+
+        if (withStats) addDeepChunkStats (hdr);
+
+        remove (filename.c_str ());
+        {
+            DeepTiledOutputFile file (filename.c_str (), hdr);
+            file.setFrameBuffer (frameBuffer);
+            file.writeTiles (
+                0, file.numXTiles () - 1, 0, file.numYTiles () - 1);
+        }
+
+        DeepTiledInputFile file (filename.c_str ());
+
+        assert (file.hasChunkStats () == bool (withStats));
+
+        vector<V2i> withSamples = file.tilesWithSamples ();
+        vector<V2i> inRange     = file.tilesInDepthRange (19.75f, 21);
+
+        if (!withStats)
+        {
+            assert (!file.tileStats (1, 1).isKnown ());
+            assert (withSamples.size () == 12);
+            assert (inRange.size () == 12);
+            continue;
+        }
+
+        for (int dy = 0; dy < file.numYTiles (); ++dy)
+        {
+            for (int dx = 0; dx < file.numXTiles (); ++dx)
+            {
+                DeepChunkStats stats = file.tileStats (dx, dy);
+                uint64_t       total = 0;
+
+                for (int y = dy * tileSize; y < (dy + 1) * tileSize; ++y)
+                    for (int x = dx * tileSize; x < (dx + 1) * tileSize; ++x)
+                        total += counts[y][x];
+
+                assert (stats.isKnown ());
+                assert (stats.sampleCount == total);
+
+                if (total)
+                {
+                    assert (stats.minZ == float (dx * 10 + dy));
+                    assert (stats.maxZ == float (dx * 10 + dy) + 0.5f);
+                }
+            }
+        }
+
+        assert (withSamples.size () == 6);
+        for (size_t i = 0; i < withSamples.size (); ++i)
+            assert ((withSamples[i].x + withSamples[i].y) % 2 == 0);
+
+        assert (withSamples[0] == V2i (0, 0));
+        assert (withSamples[1] == V2i (2, 0));
+        assert (withSamples[2] == V2i (1, 1));
+
+        //
+        // Tiles (1, 1), (2, 0) and (2, 2) have depths [11, 11.5],
+        // [20, 20.5] and [22, 22.5]; only (2, 0) overlaps.
+        //
+
+        assert (inRange.size () == 1);
+        assert (inRange[0] == V2i (2, 0));
+
+        assert (file.tilesInDepthRange (100, 200).empty ());
+
+        bool caught = false;
+        try
+        {
+            file.tileStats (4, 0);
+        }
+        catch (const IEX_NAMESPACE::ArgExc&)
+        {
+            caught = true;
+        }
+        assert (caught);
+    }
+
+    remove (filename.c_str ());
+}
+
 } // namespace
 
 void
@@ -919,6 +1234,9 @@ testDeepTiledBasic (const std::string& tempDir)
             readWriteTestWithAbsoluateCoordinates (3, 2, tempDir);
             readWriteTestWithAbsoluateCoordinates (10, 2, tempDir);
         }
+
+        testChunkStats (tempDir);
+
         ThreadPool::globalThreadPool ().setNumThreads (numThreads);
 
         cout << "ok\n" << endl;
@@ -0,0 +1,212 @@
+//
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) Contributors to the OpenEXR Project.
+//
+
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+#include "IlmThread.h"
+#include "IlmThreadPool.h"
+
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace ILMTHREAD_NAMESPACE;
+using namespace std;
+
+namespace
+{
+
+class CountTask : public Task
+{
+public:
+    CountTask (TaskGroup* g, atomic<int>& count) : Task (g), _count (count) {}
+    void execute () override { ++_count; }
+
+private:
+    atomic<int>& _count;
+};
+
+//
+// Adds children from inside a running task, which exercises the
+// worker-local path of the work-stealing provider
+//
+
+class SpawnTask : public Task
+{
+public:
+    SpawnTask (TaskGroup* g, ThreadPool& pool, atomic<int>& count, int depth)
+        : Task (g), _pool (pool), _count (count), _depth (depth)
+    {}
+    void execute () override
+    {
+        ++_count;
+        if (_depth > 0)
+        {
+            for (int i = 0; i < 4; ++i)
+                _pool.addTask (
+                    new SpawnTask (group (), _pool, _count, _depth - 1));
+        }
+    }
+
+private:
+    ThreadPool&  _pool;
+    atomic<int>& _count;
+    int          _depth;
+};
+
+//
+// Runs tasks preferring the given node; they must all run whether or
+// not the node exists
+//
+
+void
+runNodeTasks (ThreadPool& pool, int node)
+{
+    atomic<int> count (0);
+    {
+        TaskGroup g;
+        for (int i = 0; i < 1000; ++i)
+        {
+            Task* t = new CountTask (&g, count);
+            t->setPreferredNode (node);
+            assert (t->preferredNode () == node);
+            pool.addTask (t);
+        }
+    }
+    assert (count == 1000);
+}
+
+void
+runTasks (ThreadPool& pool)
+{
+    atomic<int> count (0);
+    {
+        TaskGroup g;
+        for (int i = 0; i < 10000; ++i)
+            pool.addTask (new CountTask (&g, count));
+    }
+    assert (count == 10000);
+
+    count = 0;
+    {
+        TaskGroup g;
+        pool.addTask (new SpawnTask (&g, pool, count, 5));
+    }
+    assert (count == 1 + 4 + 16 + 64 + 256 + 1024);
+}
+
+void
+testAffinity (ThreadPool& pool, int n)
+{
+    const ThreadAffinity policies[] = {
+        THREAD_AFFINITY_COMPACT,
+        THREAD_AFFINITY_SCATTER,
+        THREAD_AFFINITY_EXPLICIT,
+        THREAD_AFFINITY_NONE};
+
+    for (ThreadAffinity p: policies)
+    {
+        pool.setThreadAffinity (p, vector<int> (1, 0));
+        assert (pool.threadAffinity () == p);
+        assert (pool.numThreads () == n);
+        runTasks (pool);
+        for (int node = -1; node < ThreadPool::numNumaNodes (); ++node)
+            runNodeTasks (pool, node);
+        runNodeTasks (pool, 1000);
+
+        // the policy is kept over a change in thread count
+        pool.setNumThreads (n + 1);
+        assert (pool.threadAffinity () == p);
+        runTasks (pool);
+        pool.setNumThreads (n);
+    }
+}
+
+} // namespace
+
+void
+testThreadPoolProvider (const string&)
+{
+    if (!supportsThreads ())
+    {
+        cout << "threading not supported, skipping" << endl;
+        return;
+    }
+
+    cout << "Testing work-stealing thread pool provider" << endl;
+
+    ThreadPool pool (0);
+    for (int n = 1; n <= 8; n *= 2)
+    {
+        cout << "  " << n << " threads" << endl;
+        pool.setThreadProvider (ThreadPool::createWorkStealingProvider (n));
+        assert (pool.numThreads () == n);
+        runTasks (pool);
+
+        // resize with tasks in flight; nothing may be dropped
+        atomic<int> count (0);
+        {
+            TaskGroup g;
+            for (int i = 0; i < 2000; ++i)
+                pool.addTask (new CountTask (&g, count));
+            pool.setNumThreads (n + 1);
+            for (int i = 0; i < 2000; ++i)
+                pool.addTask (new CountTask (&g, count));
+        }
+        assert (count == 4000);
+        assert (pool.numThreads () == n + 1);
+    }
+
+    // a zero-thread provider runs tasks inline
+    pool.setThreadProvider (ThreadPool::createWorkStealingProvider (0));
+    runTasks (pool);
+
+    bool caught = false;
+    try
+    {
+        delete ThreadPool::createWorkStealingProvider (-1);
+    }
+    catch (...)
+    {
+        caught = true;
+    }
+    assert (caught);
+
+    cout << "Testing thread affinity, " << ThreadPool::numNumaNodes ()
+         << " NUMA node(s)" << endl;
+
+    assert (ThreadPool::numNumaNodes () >= 1);
+    vector<char> touched (1 << 16, 1);
+    assert (ThreadPool::numaNodeOfAddress (touched.data ()) >= -1);
+    assert (ThreadPool::numaNodeOfAddress (nullptr) == -1);
+
+    for (int n: {1, 4})
+    {
+        cout << "  " << n << " threads" << endl;
+        {
+            ThreadPool dpool (n);
+            testAffinity (dpool, n);
+        }
+        pool.setThreadProvider (ThreadPool::createWorkStealingProvider (n));
+        testAffinity (pool, n);
+    }
+
+    caught = false;
+    try
+    {
+        pool.setThreadAffinity (THREAD_AFFINITY_EXPLICIT);
+    }
+    catch (...)
+    {
+        caught = true;
+    }
+    assert (caught);
+
+    cout << "ok\n" << endl;
+}
@@ -10,12 +10,16 @@
 #include "Iex.h"
 #include "ImfDeepImage.h"
 #include "ImfDeepImageIO.h"
+#include "ImfDeepImageTidy.h"
 #include "ImfHeader.h"
+#include "ImfStandardAttributes.h"
+#include "ImfThreading.h"
 
 #include <Imath/ImathRandom.h>
 
 #include <cassert>
 #include <climits>
+#include <cmath>
 #include <cstdio>
 
 using namespace OPENEXR_IMF_NAMESPACE;
@@ -772,6 +776,287 @@ testRoundListSizeUpLimits ()
     });
 }
 
+bool
+near (float a, float b)
+{
+    return fabs (a - b) < 1e-4;
+}
+
+void
+testTidyPixels ()
+{
+    cout << "            tidy overlapping and coincident samples" << endl;
+
+    DeepImage img (Box2i (V2i (0, 0), V2i (2, 0)));
+    img.insertChannel ("Z", FLOAT);
+    img.insertChannel ("ZBack", FLOAT);
+    img.insertChannel ("A", HALF);
+    img.insertChannel ("R", FLOAT);
+    img.insertChannel ("id", UINT);
+
+    DeepImageLevel& level = img.level ();
+
+    TypedDeepImageChannel<float>& z  = level.typedChannel<float> ("Z");
+    TypedDeepImageChannel<float>& zb = level.typedChannel<float> ("ZBack");
+    TypedDeepImageChannel<half>&  a  = level.typedChannel<half> ("A");
+    TypedDeepImageChannel<float>& r  = level.typedChannel<float> ("R");
+
+    TypedDeepImageChannel<unsigned int>& id =
+        level.typedChannel<unsigned int> ("id");
+
+    level.sampleCounts ().set (0, 0, 2);
+    level.sampleCounts ().set (1, 0, 3);
+    level.sampleCounts ().set (2, 0, 2);
+
+    //
+    // Pixel (0,0): two overlapping volume samples, back one first
+    //
+
+    z (0, 0)[0]  = 2;
+    zb (0, 0)[0] = 4;
+    a (0, 0)[0]  = 0.75;
+    r (0, 0)[0]  = 0.6f;
+    id (0, 0)[0] = 7;
+
+    z (0, 0)[1]  = 1;
+    zb (0, 0)[1] = 3;
+    a (0, 0)[1]  = 0.5;
+    r (0, 0)[1]  = 0.5f;
+    id (0, 0)[1] = 3;
+
+    //
+    // Pixel (1,0): three point samples at the same depth,
+    // two of them opaque
+    //
+
+    for (int i = 0; i < 3; ++i)
+    {
+        z (1, 0)[i]  = 5;
+        zb (1, 0)[i] = 5;
+        id (1, 0)[i] = i + 1;
+    }
+
+    a (1, 0)[0] = 0.5;
+    r (1, 0)[0] = 0.9f;
+    a (1, 0)[1] = 1;
+    r (1, 0)[1] = 0.2f;
+    a (1, 0)[2] = 1;
+    r (1, 0)[2] = 0.6f;
+
+    //
+    // Pixel (2,0): already tidy
+    //
+
+    z (2, 0)[0]  = 1;
+    zb (2, 0)[0] = 2;
+    a (2, 0)[0]  = 0.25;
+    r (2, 0)[0]  = 0.125f;
+    z (2, 0)[1]  = 2;
+    zb (2, 0)[1] = 2;
+    a (2, 0)[1]  = 1;
+    r (2, 0)[1]  = 1;
+
+    Header hdr;
+    assert (!hasDeepImageState (hdr));
+
+    tidyDeepImage (hdr, img);
+    assert (deepImageState (hdr) == DIS_TIDY);
+
+    //
+    // The volume samples are split at Z = 2 and Z = 3, and the
+    // parts between 2 and 3 are merged.  The total alpha is the
+    // same as before: 1 - (1 - 0.5) * (1 - 0.75) = 0.875.
+    //
+
+    assert (level.sampleCounts () (0, 0) == 3);
+
+    assert (z (0, 0)[0] == 1 && zb (0, 0)[0] == 2);
+    assert (z (0, 0)[1] == 2 && zb (0, 0)[1] == 3);
+    assert (z (0, 0)[2] == 3 && zb (0, 0)[2] == 4);
+
+    assert (near (r (0, 0)[0], 1 - sqrt (0.5)));
+    assert (near (r (0, 0)[1], 0.560258f));
+    assert (near (r (0, 0)[2], 0.4f));
+
+    float t = 1;
+    for (int i = 0; i < 3; ++i)
+        t *= 1 - a (0, 0)[i];
+
+    assert (fabs (1 - t - 0.875f) < 1e-3);
+    assert (a (0, 0)[2] == 0.5);
+
+    assert (id (0, 0)[0] == 3);
+    assert (id (0, 0)[1] == 3);
+    assert (id (0, 0)[2] == 7);
+
+    //
+    // Only the opaque samples contribute to the merged color,
+    // and the front-most id wins
+    //
+
+    assert (level.sampleCounts () (1, 0) == 1);
+    assert (a (1, 0)[0] == 1);
+    assert (near (r (1, 0)[0], 0.4f));
+    assert (id (1, 0)[0] == 1);
+
+    assert (level.sampleCounts () (2, 0) == 2);
+    assert (a (2, 0)[0] == 0.25 && r (2, 0)[0] == 0.125f);
+    assert (a (2, 0)[1] == 1 && r (2, 0)[1] == 1);
+
+    //
+    // A level without a Z channel cannot be tidied
+    //
+
+    img.eraseChannel ("Z");
+
+    bool caught = false;
+    try
+    {
+        tidyDeepImage (img);
+    }
+    catch (const ArgExc&)
+    {
+        caught = true;
+    }
+    assert (caught);
+}
+
+void
+testTidyRandomImage ()
+{
+    cout << "            tidy random image" << endl;
+
+    //
+    // Random overlapping volume samples in two layers, tidied on
+    // several threads.  Afterwards, every pixel must be tidy and
+    // have the same total alpha as before, and tidying it again
+    // must not change it.
+    //
+
+    Rand48 random (5);
+    Box2i  dataWindow (V2i (-3, 2), V2i (40, 37));
+
+    DeepImage img (dataWindow);
+    img.insertChannel ("Z", FLOAT);
+    img.insertChannel ("ZBack", FLOAT);
+    img.insertChannel ("A", FLOAT);
+    img.insertChannel ("G", HALF);
+    img.insertChannel ("spec.A", HALF);
+    img.insertChannel ("spec.G", FLOAT);
+
+    DeepImageLevel&     level = img.level ();
+    SampleCountChannel& scc   = level.sampleCounts ();
+
+    fillSampleCounts (random, scc);
+
+    TypedDeepImageChannel<float>& z  = level.typedChannel<float> ("Z");
+    TypedDeepImageChannel<float>& zb = level.typedChannel<float> ("ZBack");
+    TypedDeepImageChannel<float>& a  = level.typedChannel<float> ("A");
+    TypedDeepImageChannel<half>&  g  = level.typedChannel<half> ("G");
+    TypedDeepImageChannel<half>&  sa = level.typedChannel<half> ("spec.A");
+    TypedDeepImageChannel<float>& sg = level.typedChannel<float> ("spec.G");
+
+    vector<float> alpha;
+    vector<float> specAlpha;
+
+    for (int y = dataWindow.min.y; y <= dataWindow.max.y; ++y)
+    {
+        for (int x = dataWindow.min.x; x <= dataWindow.max.x; ++x)
+        {
+            float t  = 1;
+            float ts = 1;
+
+            for (unsigned int i = 0; i < scc (x, y); ++i)
+            {
+                z (x, y)[i] = float (random.nexti () % 8);
+                zb (x, y)[i] =
+                    z (x, y)[i] + float (random.nexti () % 3) * 0.5f;
+                a (x, y)[i]  = float (random.nextf (0, 1));
+                g (x, y)[i]  = half (a (x, y)[i] * random.nextf (0, 1));
+                sa (x, y)[i] = half (random.nextf (0, 1));
+                sg (x, y)[i] = float (sa (x, y)[i] * random.nextf (0, 1));
+
+                t *= 1 - a (x, y)[i];
+                ts *= 1 - sa (x, y)[i];
+            }
+
+            alpha.push_back (1 - t);
+            specAlpha.push_back (1 - ts);
+        }
+    }
+
+    int threads = globalThreadCount ();
+    setGlobalThreadCount (3);
+    tidyDeepImage (img);
+
+    size_t p = 0;
+    for (int y = dataWindow.min.y; y <= dataWindow.max.y; ++y)
+    {
+        for (int x = dataWindow.min.x; x <= dataWindow.max.x; ++x, ++p)
+        {
+            float t  = 1;
+            float ts = 1;
+
+            for (unsigned int i = 0; i < scc (x, y); ++i)
+            {
+                assert (zb (x, y)[i] >= z (x, y)[i]);
+
+                if (i > 0)
+                {
+                    //
+                    // Sorted, no duplicates, and no overlaps
+                    //
+
+                    float z0  = z (x, y)[i - 1];
+                    float zb0 = zb (x, y)[i - 1];
+                    float z1  = z (x, y)[i];
+                    float zb1 = zb (x, y)[i];
+
+                    assert (z0 < z1 || (z0 == z1 && zb0 < zb1));
+                    assert (zb0 <= z1 || z0 == zb0);
+                }
+
+                assert (a (x, y)[i] >= 0 && a (x, y)[i] <= 1);
+                assert (g (x, y)[i] <= a (x, y)[i] + 1e-3);
+                assert (sg (x, y)[i] <= sa (x, y)[i] + 1e-3);
+
+                t *= 1 - a (x, y)[i];
+                ts *= 1 - sa (x, y)[i];
+            }
+
+            assert (fabs (1 - t - alpha[p]) < 1e-4);
+            assert (fabs (1 - ts - specAlpha[p]) < 1e-2);
+        }
+    }
+
+    auto snapshot = [&] () {
+        vector<float> v;
+        for (int y = dataWindow.min.y; y <= dataWindow.max.y; ++y)
+        {
+            for (int x = dataWindow.min.x; x <= dataWindow.max.x; ++x)
+            {
+                v.push_back (float (scc (x, y)));
+                for (unsigned int i = 0; i < scc (x, y); ++i)
+                {
+                    v.push_back (z (x, y)[i]);
+                    v.push_back (zb (x, y)[i]);
+                    v.push_back (a (x, y)[i]);
+                    v.push_back (g (x, y)[i]);
+                    v.push_back (sa (x, y)[i]);
+                    v.push_back (sg (x, y)[i]);
+                }
+            }
+        }
+        return v;
+    };
+
+    vector<float> tidy = snapshot ();
+    tidyDeepImage (img);
+    setGlobalThreadCount (threads);
+
+    assert (snapshot () == tidy);
+}
+
 } // namespace
 
 void
@@ -791,6 +1076,8 @@ testDeepImage (const string& tempDir)
         testCropping (tempDir + "deepCropped.exr");
         testRenameChannel ();
         testRenameChannels ();
+        testTidyPixels ();
+        testTidyRandomImage ();
 
         cout << "ok\n" << endl;
     }